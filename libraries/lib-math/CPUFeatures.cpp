@@ -0,0 +1,43 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file CPUFeatures.cpp
+
+**********************************************************************/
+
+#include "CPUFeatures.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+bool DetectAVX2()
+{
+#if !defined(AUDACITY_SSE2)
+   return false;
+#elif defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7)
+      return false;
+   __cpuid(info, 1);
+   const int osxsave = 1 << 27, avx = 1 << 28;
+   if ((info[2] & (osxsave | avx)) != (osxsave | avx) ||
+       (_xgetbv(0) & 6) != 6)
+      return false;
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#else
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2");
+#endif
+}
+}
+
+bool CPUFeatures::HaveAVX2()
+{
+   static const bool result = DetectAVX2();
+   return result;
+}
@@ -0,0 +1,38 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file CPUFeatures.h
+  @brief Compile time and run time detection of SIMD instruction sets
+
+  SSE2 is assumed whenever the compiler targets it, which is always so for
+  64 bit Intel processors.  AVX2 is detected at run time; functions using it
+  are compiled with AUDACITY_AVX2_TARGET, so the rest of the library does
+  not require it.
+
+**********************************************************************/
+
+#ifndef __AUDACITY_CPU_FEATURES__
+#define __AUDACITY_CPU_FEATURES__
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDACITY_SSE2
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define AUDACITY_AVX2_TARGET __attribute__((target("avx2")))
+#else
+// MSVC allows AVX2 intrinsics without any option
+#define AUDACITY_AVX2_TARGET
+#endif
+#endif
+
+namespace CPUFeatures {
+
+//! Whether the processor has AVX2, and the system saves its registers
+/*! Always false when AUDACITY_SSE2 is not defined */
+bool HaveAVX2();
+
+}
+
+#endif
@@ -39,12 +39,14 @@ and get deterministic behaviour.
 
 #include "Internat.h"
 #include "Prefs.h"
+#include "SampleConversion.h"
 
 // Erik de Castro Lopo's header file that
 // makes sure that we have lrint and lrintf
 // (Note: this file should be included first)
 #include "float_cast.h"
 
+#include <algorithm>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
@@ -83,11 +85,6 @@ constexpr auto CONVERT_DIV16 = float(1<<15);
 constexpr auto CONVERT_DIV24 = float(1<<23);
 
 // Dereference sample pointer and convert to float sample
-static inline float FROM_INT16(const short *ptr)
-{
-    return *ptr / CONVERT_DIV16;
-}
-
 static inline float FROM_INT24(const int *ptr)
 {
     return *ptr / CONVERT_DIV24;
@@ -179,6 +176,50 @@ static inline void DITHER( Ditherer dither, State &state,
 }
 
 
+// Dither floats without noise shaping, using the vectorized kernels.
+// The noise is generated first, with the same calls of rand() in the same
+// order as by RectangleDither and TriangleDither, so results are the same.
+static void DITHER_FLOAT( DitherType ditherType, State &state,
+   samplePtr dst, sampleFormat dstFormat, size_t dstStride,
+   const float *src, size_t srcStride, size_t len)
+{
+    auto &kernels = SampleConversion::GetKernels();
+
+    // Enough noise for one block, preceded by the previous triangle value
+    constexpr size_t blockSize = 1024;
+    float noise[blockSize + 1];
+
+    for (size_t done = 0; done < len;) {
+        const auto count = std::min(blockSize, len - done);
+        const float *add = nullptr, *sub = nullptr;
+        if (ditherType == DitherType::rectangle) {
+            for (size_t ii = 0; ii < count; ++ii)
+                noise[ii] = DITHER_NOISE();
+            sub = noise;
+        }
+        else if (ditherType == DitherType::triangle) {
+            noise[0] = state.mTriangleState;
+            for (size_t ii = 1; ii <= count; ++ii)
+                noise[ii] = DITHER_NOISE();
+            state.mTriangleState = noise[count];
+            add = noise + 1;
+            sub = noise;
+        }
+
+        if (dstFormat == int16Sample)
+            kernels.floatToInt16(src + done * srcStride, srcStride,
+                reinterpret_cast<short*>(dst) + done * dstStride, dstStride,
+                count, add, sub);
+        else if (dstFormat == int24Sample)
+            kernels.floatToInt24(src + done * srcStride, srcStride,
+                reinterpret_cast<int*>(dst) + done * dstStride, dstStride,
+                count, add, sub);
+        else { wxASSERT(false); }
+
+        done += count;
+    }
+}
+
 static inline float NoDither(State &, float sample);
 static inline float RectangleDither(State &, float sample);
 static inline float TriangleDither(State &state, float sample);
@@ -276,44 +317,50 @@ void Dither::Apply(enum DitherType ditherType,
     {
         // No need to dither, just convert samples to float.
         // No clipping should be necessary.
+        auto &kernels = SampleConversion::GetKernels();
         auto d = (float*)dest;
 
         if (sourceFormat == int16Sample)
-        {
-            auto s = (const short*)source;
-            for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-                *d = FROM_INT16(s);
-        } else
+            kernels.int16ToFloat(
+                (const short*)source, sourceStride, d, destStride, len);
+        else
         if (sourceFormat == int24Sample)
-        {
-            auto s = (const int*)source;
-            for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-                *d = FROM_INT24(s);
-        } else {
+            kernels.int24ToFloat(
+                (const int*)source, sourceStride, d, destStride, len);
+        else {
             wxASSERT(false); // source format unknown
         }
     } else
     if (destFormat == int24Sample && sourceFormat == int16Sample)
     {
         // Special case when promoting 16 bit to 24 bit
-        auto d = (int*)dest;
-        auto s = (const short*)source;
-        for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-            *d = ((int)*s) << 8;
+        SampleConversion::GetKernels().int16ToInt24(
+            (const short*)source, sourceStride, (int*)dest, destStride, len);
     } else
     {
         // We must do dithering
+        // Shaped dither, and conversion from 24 to 16 bits, stay scalar
+        const bool fromFloat = (sourceFormat == floatSample);
         switch (ditherType)
         {
         case DitherType::none:
-            DITHER(NoDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
+            if (fromFloat)
+                DITHER_FLOAT(ditherType, mState, dest, destFormat, destStride, (const float*)source, sourceStride, len);
+            else
+                DITHER(NoDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
             break;
         case DitherType::rectangle:
-            DITHER(RectangleDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
+            if (fromFloat)
+                DITHER_FLOAT(ditherType, mState, dest, destFormat, destStride, (const float*)source, sourceStride, len);
+            else
+                DITHER(RectangleDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
             break;
         case DitherType::triangle:
             Reset(); // reset dither filter for this NEW conversion
-            DITHER(TriangleDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
+            if (fromFloat)
+                DITHER_FLOAT(ditherType, mState, dest, destFormat, destStride, (const float*)source, sourceStride, len);
+            else
+                DITHER(TriangleDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
             break;
         case DitherType::shaped:
             Reset(); // reset dither filter for this NEW conversion
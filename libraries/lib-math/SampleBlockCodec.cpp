@@ -0,0 +1,418 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCodec.cpp
+
+**********************************************************************/
+
+#include "SampleBlockCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace {
+// An encoding is a header, then a stream of bits, most significant first:
+//
+// byte 0      version of the encoding
+// byte 1      Kind of the samples
+// bytes 2-5   count of samples, little endian
+//
+// Then for each frame of up to FrameSamples samples, the order of the
+// predictor in 2 bits, and then for each partition of up to
+// PartitionSamples samples, the Rice parameter in 5 bits and the residuals.
+//
+// Prediction continues across frames, from zeroes before the first sample.
+//
+// Each residual r is mapped to the unsigned u = 2r or -2r - 1.  Its quotient
+// u >> k is written in unary as ones ending with a zero, then the low k bits
+// of u; but a quotient of at least EscapeQuotient is written as that many
+// ones, then all of u in EscapeBits bits.
+
+constexpr unsigned char Version = 1;
+
+enum Kind : unsigned char {
+   Int16,
+   Int32,
+   //! Floats times 2^15
+   Float15,
+   //! Floats times 2^23
+   Float23,
+};
+
+constexpr size_t HeaderBytes = 6;
+constexpr size_t FrameSamples = 4096;
+constexpr size_t PartitionSamples = 256;
+constexpr unsigned MaxOrder = 3;
+constexpr unsigned OrderBits = 2;
+constexpr unsigned ParameterBits = 5;
+constexpr unsigned MaxParameter = (1u << ParameterBits) - 1;
+constexpr unsigned EscapeQuotient = 24;
+// Enough for the residuals of 32 bit samples
+constexpr unsigned EscapeBits = 40;
+
+float Scale(Kind kind)
+{
+   return kind == Float15 ? 32768.0f : 8388608.0f;
+}
+
+//! @return whether every float is an integer after scaling, in range
+bool IsScalable(const float *samples, size_t count, Kind kind)
+{
+   const auto scale = Scale(kind);
+   for (size_t ii = 0; ii < count; ++ii) {
+      const auto sample = samples[ii];
+      // Negative zero would be decoded as zero
+      if (sample == 0 && std::signbit(sample))
+         return false;
+      const auto scaled = sample * scale;
+      // Also false for NaN
+      if (!(scaled >= -scale && scaled < scale) ||
+          scaled != std::floor(scaled))
+         return false;
+   }
+   return true;
+}
+
+//! @return the integer of sample ii
+int64_t Get(constSamplePtr src, Kind kind, size_t ii)
+{
+   switch (kind) {
+   case Int16:
+      return reinterpret_cast<const int16_t *>(src)[ii];
+   case Int32:
+      return reinterpret_cast<const int32_t *>(src)[ii];
+   default:
+      return static_cast<int64_t>(
+         reinterpret_cast<const float *>(src)[ii] * Scale(kind));
+   }
+}
+
+//! @return false if value is out of range
+bool Put(samplePtr dest, Kind kind, size_t ii, int64_t value)
+{
+   switch (kind) {
+   case Int16:
+      if (value < std::numeric_limits<int16_t>::min() ||
+          value > std::numeric_limits<int16_t>::max())
+         return false;
+      reinterpret_cast<int16_t *>(dest)[ii] = value;
+      return true;
+   case Int32:
+      if (value < std::numeric_limits<int32_t>::min() ||
+          value > std::numeric_limits<int32_t>::max())
+         return false;
+      reinterpret_cast<int32_t *>(dest)[ii] = value;
+      return true;
+   default: {
+      const int64_t limit = Scale(kind);
+      if (value < -limit || value >= limit)
+         return false;
+      reinterpret_cast<float *>(dest)[ii] = value / Scale(kind);
+      return true;
+   }
+   }
+}
+
+//! Fixed polynomial predictors, as in FLAC
+struct History {
+   int64_t Predict(unsigned order) const
+   {
+      switch (order) {
+      case 0: return 0;
+      case 1: return h1;
+      case 2: return 2 * h1 - h2;
+      default: return 3 * h1 - 3 * h2 + h3;
+      }
+   }
+   void Push(int64_t value)
+   {
+      h3 = h2, h2 = h1, h1 = value;
+   }
+   int64_t h1{}, h2{}, h3{};
+};
+
+uint64_t ZigZag(int64_t residual)
+{
+   return residual < 0
+      ? 2 * static_cast<uint64_t>(-(residual + 1)) + 1
+      : 2 * static_cast<uint64_t>(residual);
+}
+
+int64_t UnZigZag(uint64_t value)
+{
+   return (value & 1)
+      ? -static_cast<int64_t>(value >> 1) - 1
+      : static_cast<int64_t>(value >> 1);
+}
+
+class BitWriter {
+public:
+   BitWriter(unsigned char *begin, unsigned char *end)
+      : mNext{ begin }, mEnd{ end }
+   {}
+
+   //! @pre bits <= 32
+   void Write(uint32_t value, unsigned bits)
+   {
+      mBits = (mBits << bits) | value;
+      mCount += bits;
+      while (mCount >= 8) {
+         mCount -= 8;
+         WriteByte(mBits >> mCount);
+      }
+   }
+
+   //! Write the last partial byte
+   void Finish()
+   {
+      if (mCount > 0)
+         WriteByte(mBits << (8 - mCount));
+      mCount = 0;
+   }
+
+   //! Whether the space ran out
+   bool Full() const { return mFull; }
+
+   size_t Position(const unsigned char *begin) const { return mNext - begin; }
+
+private:
+   void WriteByte(uint64_t byte)
+   {
+      if (mNext == mEnd)
+         mFull = true;
+      else
+         *mNext++ = static_cast<unsigned char>(byte);
+   }
+
+   unsigned char *mNext;
+   unsigned char *const mEnd;
+   uint64_t mBits{ 0 };
+   unsigned mCount{ 0 };
+   bool mFull{ false };
+};
+
+class BitReader {
+public:
+   BitReader(const unsigned char *begin, const unsigned char *end)
+      : mNext{ begin }, mEnd{ end }
+   {}
+
+   //! @pre bits <= 32
+   uint32_t Read(unsigned bits)
+   {
+      while (mCount < bits) {
+         if (mNext == mEnd) {
+            mFailed = true;
+            return 0;
+         }
+         mBits = (mBits << 8) | *mNext++;
+         mCount += 8;
+      }
+      mCount -= bits;
+      return (mBits >> mCount) & ((uint64_t{ 1 } << bits) - 1);
+   }
+
+   //! @return the count of ones before a zero, but no more than limit
+   unsigned ReadUnary(unsigned limit)
+   {
+      unsigned result = 0;
+      while (result < limit && Read(1))
+         ++result;
+      return result;
+   }
+
+   bool Failed() const { return mFailed; }
+
+private:
+   const unsigned char *mNext;
+   const unsigned char *const mEnd;
+   uint64_t mBits{ 0 };
+   unsigned mCount{ 0 };
+   bool mFailed{ false };
+};
+
+//! @return the Rice parameter that about minimizes the bits for values
+//! whose sum is given
+unsigned RiceParameter(uint64_t sum, size_t count)
+{
+   unsigned k = 0;
+   while (k < MaxParameter && (static_cast<uint64_t>(count) << (k + 1)) < sum)
+      ++k;
+   return k;
+}
+
+void WriteResidual(BitWriter &writer, uint64_t value, unsigned k)
+{
+   const auto quotient = value >> k;
+   if (quotient < EscapeQuotient) {
+      // Ones, then a zero
+      writer.Write(((1u << quotient) - 1) << 1, quotient + 1);
+      if (k > 0)
+         writer.Write(value & ((uint64_t{ 1 } << k) - 1), k);
+   }
+   else {
+      writer.Write((1u << EscapeQuotient) - 1, EscapeQuotient);
+      writer.Write(value >> 32, EscapeBits - 32);
+      writer.Write(value & 0xFFFFFFFFu, 32);
+   }
+}
+
+uint64_t ReadResidual(BitReader &reader, unsigned k)
+{
+   const uint64_t quotient = reader.ReadUnary(EscapeQuotient);
+   if (quotient < EscapeQuotient)
+      return (quotient << k) | (k > 0 ? reader.Read(k) : 0);
+   const uint64_t high = reader.Read(EscapeBits - 32);
+   return (high << 32) | reader.Read(32);
+}
+
+//! Encode one frame of values
+void EncodeFrame(BitWriter &writer, History &history,
+   const int64_t *values, size_t count)
+{
+   // Choose the order with the least sum of magnitudes of residuals
+   unsigned order = 0;
+   {
+      uint64_t best = std::numeric_limits<uint64_t>::max();
+      for (unsigned candidate = 0; candidate <= MaxOrder; ++candidate) {
+         auto trial = history;
+         uint64_t sum = 0;
+         for (size_t ii = 0; ii < count; ++ii) {
+            sum += ZigZag(values[ii] - trial.Predict(candidate));
+            trial.Push(values[ii]);
+         }
+         if (sum < best)
+            best = sum, order = candidate;
+      }
+   }
+   writer.Write(order, OrderBits);
+
+   uint64_t residuals[PartitionSamples];
+   for (size_t first = 0; first < count; first += PartitionSamples) {
+      const auto size = std::min(PartitionSamples, count - first);
+      uint64_t sum = 0;
+      for (size_t ii = 0; ii < size; ++ii) {
+         const auto value = values[first + ii];
+         sum += (residuals[ii] = ZigZag(value - history.Predict(order)));
+         history.Push(value);
+      }
+      const auto k = RiceParameter(sum, size);
+      writer.Write(k, ParameterBits);
+      for (size_t ii = 0; ii < size; ++ii)
+         WriteResidual(writer, residuals[ii], k);
+      if (writer.Full())
+         return;
+   }
+}
+}
+
+size_t SampleBlockCodec::Encode(constSamplePtr src, size_t count,
+   sampleFormat format, ArrayOf<char> &dest)
+{
+   const auto rawBytes = count * SAMPLE_SIZE(format);
+   if (count == 0 || count > std::numeric_limits<uint32_t>::max() ||
+       rawBytes <= HeaderBytes)
+      return 0;
+
+   Kind kind;
+   switch (format) {
+   case int16Sample:
+      kind = Int16; break;
+   case int24Sample:
+      kind = Int32; break;
+   case floatSample: {
+      const auto floats = reinterpret_cast<const float *>(src);
+      if (IsScalable(floats, count, Float15))
+         kind = Float15;
+      else if (IsScalable(floats, count, Float23))
+         kind = Float23;
+      else
+         return 0;
+      break;
+   }
+   default:
+      return 0;
+   }
+
+   // Give up as soon as the encoding is no smaller, so leave no room for
+   // the last raw byte
+   ArrayOf<char> buffer{ rawBytes };
+   const auto begin = reinterpret_cast<unsigned char *>(buffer.get());
+   begin[0] = Version;
+   begin[1] = kind;
+   for (unsigned ii = 0; ii < 4; ++ii)
+      begin[2 + ii] = (count >> (8 * ii)) & 0xFF;
+   BitWriter writer{ begin + HeaderBytes, begin + rawBytes - 1 };
+
+   History history;
+   int64_t values[FrameSamples];
+   for (size_t first = 0; first < count && !writer.Full();
+        first += FrameSamples) {
+      const auto size = std::min(FrameSamples, count - first);
+      for (size_t ii = 0; ii < size; ++ii)
+         values[ii] = Get(src, kind, first + ii);
+      EncodeFrame(writer, history, values, size);
+   }
+   writer.Finish();
+   if (writer.Full())
+      return 0;
+
+   const auto bytes = writer.Position(begin);
+   dest.reinit(bytes);
+   memcpy(dest.get(), buffer.get(), bytes);
+   return bytes;
+}
+
+bool SampleBlockCodec::Decode(int codec, const void *src, size_t srcbytes,
+   sampleFormat format, samplePtr dest, size_t bytes)
+{
+   const auto begin = static_cast<const unsigned char *>(src);
+   if (codec != FixedRice || srcbytes < HeaderBytes || begin[0] != Version)
+      return false;
+
+   const auto kind = static_cast<Kind>(begin[1]);
+   size_t count = 0;
+   for (unsigned ii = 0; ii < 4; ++ii)
+      count |= size_t{ begin[2 + ii] } << (8 * ii);
+
+   switch (kind) {
+   case Int16:
+      if (format != int16Sample) return false;
+      break;
+   case Int32:
+      if (format != int24Sample) return false;
+      break;
+   case Float15:
+   case Float23:
+      if (format != floatSample) return false;
+      break;
+   default:
+      return false;
+   }
+   if (count * SAMPLE_SIZE(format) != bytes)
+      return false;
+
+   BitReader reader{ begin + HeaderBytes, begin + srcbytes };
+   History history;
+   for (size_t first = 0; first < count; first += FrameSamples) {
+      const auto order = reader.Read(OrderBits);
+      const auto frameEnd = std::min(first + FrameSamples, count);
+      for (size_t partition = first; partition < frameEnd;
+           partition += PartitionSamples) {
+         const auto k = reader.Read(ParameterBits);
+         const auto end = std::min(partition + PartitionSamples, frameEnd);
+         for (size_t ii = partition; ii < end; ++ii) {
+            const auto value =
+               history.Predict(order) + UnZigZag(ReadResidual(reader, k));
+            if (reader.Failed() || !Put(dest, kind, ii, value))
+               return false;
+            history.Push(value);
+         }
+      }
+   }
+   return !reader.Failed();
+}
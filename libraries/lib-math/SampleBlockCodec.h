@@ -0,0 +1,54 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCodec.h
+@brief Lossless encoding of the samples of stored sample blocks
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_BLOCK_CODEC__
+#define __AUDACITY_SAMPLE_BLOCK_CODEC__
+
+#include <cstddef>
+
+#include "MemoryX.h"
+#include "SampleFormat.h"
+
+//! Encodes sample blobs with fixed polynomial prediction and Rice coded
+//! residuals, as in FLAC
+/*!
+ Integer formats are encoded as they are.  Float samples are encoded only if
+ every one is an exact multiple of 2^-15 or 2^-23 in the range of 16 or 24
+ bit integers, as after recording or importing integer audio; otherwise the
+ blob stays raw.  Decoding restores the same bits.
+
+ All functions may be called from any thread.
+ */
+namespace SampleBlockCodec {
+
+//! Values of the codec column of sampleblocks
+enum Codec : int {
+   //! The samples as they are in memory
+   Raw = 0,
+   //! The encoding of Encode()
+   FixedRice = 1,
+};
+
+//! Encode count samples of the format
+/*! @return the number of bytes in dest, or zero if the samples can't be
+ encoded in fewer bytes than they occupy; then dest is unchanged */
+MATH_API
+size_t Encode(constSamplePtr src, size_t count, sampleFormat format,
+   ArrayOf<char> &dest);
+
+//! Decode a blob stored with the codec into exactly bytes of samples of the
+//! format
+/*! @return false if the blob is not such an encoding */
+MATH_API
+bool Decode(int codec, const void *src, size_t srcbytes,
+   sampleFormat format, samplePtr dest, size_t bytes);
+
+}
+
+#endif
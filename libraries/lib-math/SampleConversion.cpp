@@ -0,0 +1,481 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file SampleConversion.cpp
+
+**********************************************************************/
+
+#include "SampleConversion.h"
+#include "CPUFeatures.h"
+
+// Erik de Castro Lopo's header file that
+// makes sure that we have lrint and lrintf
+// (Note: this file should be included first)
+#include "float_cast.h"
+
+#include <math.h>
+
+namespace SampleConversion {
+
+namespace {
+
+constexpr auto Scale16 = float(1<<15);
+constexpr auto Scale24 = float(1<<23);
+
+//////////////////////////////////////////////////////////////////////////
+// Scalar kernels, which do just what Dither.cpp does for each sample
+
+// As FROM_FLOAT in Dither.cpp
+inline float Clip(float sample)
+{
+   return sample > 1.0 ? 1.0 : sample < -1.0 ? -1.0 : sample;
+}
+
+// As IMPLEMENT_STORE in Dither.cpp, but lrintf of NaN varies by platform
+template<typename Int>
+inline Int Store(float sample, Int minBound, Int maxBound)
+{
+   if (sample != sample)
+      return 0;
+   int x = lrintf(sample);
+   if (x > maxBound)
+      return maxBound;
+   else if (x < minBound)
+      return minBound;
+   else
+      return static_cast<Int>(x);
+}
+
+template<typename Int>
+inline void ScalarFloatToInt(const float *src, size_t srcStride,
+   Int *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub,
+   float scale, Int minBound, Int maxBound)
+{
+   for (size_t ii = 0; ii < len; ++ii, src += srcStride, dst += dstStride) {
+      float sample = Clip(*src) * scale;
+      if (add)
+         sample += add[ii];
+      if (sub)
+         sample -= sub[ii];
+      *dst = Store<Int>(sample, minBound, maxBound);
+   }
+}
+
+void ScalarFloatToInt16(const float *src, size_t srcStride,
+   short *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub)
+{
+   ScalarFloatToInt<short>(src, srcStride, dst, dstStride, len, add, sub,
+      Scale16, -32768, 32767);
+}
+
+void ScalarFloatToInt24(const float *src, size_t srcStride,
+   int *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub)
+{
+   ScalarFloatToInt<int>(src, srcStride, dst, dstStride, len, add, sub,
+      Scale24, -8388608, 8388607);
+}
+
+void ScalarInt16ToFloat(const short *src, size_t srcStride,
+   float *dst, size_t dstStride, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii, src += srcStride, dst += dstStride)
+      *dst = *src / Scale16;
+}
+
+void ScalarInt24ToFloat(const int *src, size_t srcStride,
+   float *dst, size_t dstStride, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii, src += srcStride, dst += dstStride)
+      *dst = *src / Scale24;
+}
+
+void ScalarInt16ToInt24(const short *src, size_t srcStride,
+   int *dst, size_t dstStride, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii, src += srcStride, dst += dstStride)
+      *dst = ((int)*src) << 8;
+}
+
+const Kernels ScalarKernels{
+   "scalar",
+   ScalarFloatToInt16,
+   ScalarFloatToInt24,
+   ScalarInt16ToFloat,
+   ScalarInt24ToFloat,
+   ScalarInt16ToInt24,
+};
+
+#ifdef AUDACITY_SSE2
+
+//////////////////////////////////////////////////////////////////////////
+// SSE2 kernels
+//
+// Multiplying by a power of two is exact, and so is the same as the
+// division in the scalar kernels.  Conversion to integers rounds in the
+// current mode, as lrintf does.  Packing with signed saturation is the same
+// as clamping to the int16 range.
+
+inline const float *Offset(const float *p, size_t ii)
+{
+   return p ? p + ii : nullptr;
+}
+
+inline __m128 Load4(const float *src, size_t stride)
+{
+   if (stride == 1)
+      return _mm_loadu_ps(src);
+   return _mm_setr_ps(src[0], src[stride], src[2 * stride], src[3 * stride]);
+}
+
+inline void Store4(float *dst, size_t stride, __m128 values)
+{
+   if (stride == 1)
+      _mm_storeu_ps(dst, values);
+   else {
+      alignas(16) float temp[4];
+      _mm_store_ps(temp, values);
+      for (size_t ii = 0; ii < 4; ++ii)
+         dst[ii * stride] = temp[ii];
+   }
+}
+
+template<typename Int>
+inline void Store128i(Int *dst, size_t stride, __m128i values)
+{
+   if (stride == 1)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), values);
+   else {
+      enum : size_t { count = sizeof(__m128i) / sizeof(Int) };
+      alignas(16) Int temp[count];
+      _mm_store_si128(reinterpret_cast<__m128i*>(temp), values);
+      for (size_t ii = 0; ii < count; ++ii)
+         dst[ii * stride] = temp[ii];
+   }
+}
+
+//! Clip, scale, and apply noise to four samples; NaN becomes zero
+inline __m128 Prepare4(const float *src, size_t stride, __m128 scale,
+   const float *add, const float *sub)
+{
+   // Operands are ordered so that NaN passes through min and max, as in Clip
+   auto x = _mm_max_ps(_mm_set1_ps(-1.0f),
+      _mm_min_ps(_mm_set1_ps(1.0f), Load4(src, stride)));
+   x = _mm_mul_ps(x, scale);
+   if (add)
+      x = _mm_add_ps(x, _mm_loadu_ps(add));
+   if (sub)
+      x = _mm_sub_ps(x, _mm_loadu_ps(sub));
+   return _mm_and_ps(x, _mm_cmpord_ps(x, x));
+}
+
+inline __m128i Clamp4(__m128i x, __m128i minBound, __m128i maxBound)
+{
+   // SSE2 lacks _mm_min_epi32 and _mm_max_epi32
+   auto over = _mm_cmpgt_epi32(x, maxBound);
+   x = _mm_or_si128(_mm_and_si128(over, maxBound), _mm_andnot_si128(over, x));
+   auto under = _mm_cmplt_epi32(x, minBound);
+   return
+      _mm_or_si128(_mm_and_si128(under, minBound), _mm_andnot_si128(under, x));
+}
+
+void SSE2FloatToInt16(const float *src, size_t srcStride,
+   short *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub)
+{
+   const auto scale = _mm_set1_ps(Scale16);
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      auto lo = _mm_cvtps_epi32(Prepare4(src + ii * srcStride, srcStride,
+         scale, Offset(add, ii), Offset(sub, ii)));
+      auto hi = _mm_cvtps_epi32(Prepare4(src + (ii + 4) * srcStride,
+         srcStride, scale, Offset(add, ii + 4), Offset(sub, ii + 4)));
+      Store128i(dst + ii * dstStride, dstStride, _mm_packs_epi32(lo, hi));
+   }
+   ScalarFloatToInt16(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii,
+      Offset(add, ii), Offset(sub, ii));
+}
+
+void SSE2FloatToInt24(const float *src, size_t srcStride,
+   int *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub)
+{
+   const auto scale = _mm_set1_ps(Scale24);
+   const auto minBound = _mm_set1_epi32(-8388608);
+   const auto maxBound = _mm_set1_epi32(8388607);
+   size_t ii = 0;
+   for (; ii + 4 <= len; ii += 4) {
+      auto x = _mm_cvtps_epi32(Prepare4(src + ii * srcStride, srcStride,
+         scale, Offset(add, ii), Offset(sub, ii)));
+      Store128i(dst + ii * dstStride, dstStride,
+         Clamp4(x, minBound, maxBound));
+   }
+   ScalarFloatToInt24(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii,
+      Offset(add, ii), Offset(sub, ii));
+}
+
+inline __m128i LoadInt16x8(const short *src, size_t stride)
+{
+   if (stride == 1)
+      return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+   return _mm_setr_epi16(src[0], src[stride], src[2 * stride],
+      src[3 * stride], src[4 * stride], src[5 * stride], src[6 * stride],
+      src[7 * stride]);
+}
+
+inline __m128i LoadInt32x4(const int *src, size_t stride)
+{
+   if (stride == 1)
+      return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+   return _mm_setr_epi32(src[0], src[stride], src[2 * stride], src[3 * stride]);
+}
+
+void SSE2Int16ToFloat(const short *src, size_t srcStride,
+   float *dst, size_t dstStride, size_t len)
+{
+   const auto scale = _mm_set1_ps(1.0f / Scale16);
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      auto x = LoadInt16x8(src + ii * srcStride, srcStride);
+      // Sign extend
+      auto lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+      auto hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+      Store4(dst + ii * dstStride, dstStride,
+         _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+      Store4(dst + (ii + 4) * dstStride, dstStride,
+         _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+   }
+   ScalarInt16ToFloat(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii);
+}
+
+void SSE2Int24ToFloat(const int *src, size_t srcStride,
+   float *dst, size_t dstStride, size_t len)
+{
+   const auto scale = _mm_set1_ps(1.0f / Scale24);
+   size_t ii = 0;
+   for (; ii + 4 <= len; ii += 4) {
+      auto x = LoadInt32x4(src + ii * srcStride, srcStride);
+      Store4(dst + ii * dstStride, dstStride,
+         _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+   }
+   ScalarInt24ToFloat(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii);
+}
+
+void SSE2Int16ToInt24(const short *src, size_t srcStride,
+   int *dst, size_t dstStride, size_t len)
+{
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      auto x = LoadInt16x8(src + ii * srcStride, srcStride);
+      // Sign extend and shift left by 8, all at once
+      auto lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 8);
+      auto hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 8);
+      // Clear the low byte, which received copies of the high one
+      const auto mask = _mm_set1_epi32(~0xFF);
+      Store128i(dst + ii * dstStride, dstStride, _mm_and_si128(lo, mask));
+      Store128i(dst + (ii + 4) * dstStride, dstStride, _mm_and_si128(hi, mask));
+   }
+   ScalarInt16ToInt24(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii);
+}
+
+const Kernels SSE2Kernels{
+   "SSE2",
+   SSE2FloatToInt16,
+   SSE2FloatToInt24,
+   SSE2Int16ToFloat,
+   SSE2Int24ToFloat,
+   SSE2Int16ToInt24,
+};
+
+//////////////////////////////////////////////////////////////////////////
+// AVX2 kernels
+//
+// These do eight samples at a time, and leave remainders to SSE2
+
+AUDACITY_AVX2_TARGET
+inline __m256 Load8(const float *src, size_t stride)
+{
+   if (stride == 1)
+      return _mm256_loadu_ps(src);
+   return _mm256_setr_ps(src[0], src[stride], src[2 * stride],
+      src[3 * stride], src[4 * stride], src[5 * stride], src[6 * stride],
+      src[7 * stride]);
+}
+
+AUDACITY_AVX2_TARGET
+inline void Store8(float *dst, size_t stride, __m256 values)
+{
+   if (stride == 1)
+      _mm256_storeu_ps(dst, values);
+   else {
+      alignas(32) float temp[8];
+      _mm256_store_ps(temp, values);
+      for (size_t ii = 0; ii < 8; ++ii)
+         dst[ii * stride] = temp[ii];
+   }
+}
+
+AUDACITY_AVX2_TARGET
+inline void Store8(int *dst, size_t stride, __m256i values)
+{
+   if (stride == 1)
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), values);
+   else {
+      alignas(32) int temp[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(temp), values);
+      for (size_t ii = 0; ii < 8; ++ii)
+         dst[ii * stride] = temp[ii];
+   }
+}
+
+AUDACITY_AVX2_TARGET
+inline __m256 Prepare8(const float *src, size_t stride, __m256 scale,
+   const float *add, const float *sub)
+{
+   auto x = _mm256_max_ps(_mm256_set1_ps(-1.0f),
+      _mm256_min_ps(_mm256_set1_ps(1.0f), Load8(src, stride)));
+   x = _mm256_mul_ps(x, scale);
+   if (add)
+      x = _mm256_add_ps(x, _mm256_loadu_ps(add));
+   if (sub)
+      x = _mm256_sub_ps(x, _mm256_loadu_ps(sub));
+   return _mm256_and_ps(x, _mm256_cmp_ps(x, x, _CMP_ORD_Q));
+}
+
+AUDACITY_AVX2_TARGET
+void AVX2FloatToInt16(const float *src, size_t srcStride,
+   short *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub)
+{
+   const auto scale = _mm256_set1_ps(Scale16);
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      auto x = _mm256_cvtps_epi32(Prepare8(src + ii * srcStride, srcStride,
+         scale, Offset(add, ii), Offset(sub, ii)));
+      // Pack the halves, keeping the order of samples
+      Store128i(dst + ii * dstStride, dstStride, _mm_packs_epi32(
+         _mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1)));
+   }
+   SSE2FloatToInt16(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii,
+      Offset(add, ii), Offset(sub, ii));
+}
+
+AUDACITY_AVX2_TARGET
+void AVX2FloatToInt24(const float *src, size_t srcStride,
+   int *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub)
+{
+   const auto scale = _mm256_set1_ps(Scale24);
+   const auto minBound = _mm256_set1_epi32(-8388608);
+   const auto maxBound = _mm256_set1_epi32(8388607);
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      auto x = _mm256_cvtps_epi32(Prepare8(src + ii * srcStride, srcStride,
+         scale, Offset(add, ii), Offset(sub, ii)));
+      Store8(dst + ii * dstStride, dstStride,
+         _mm256_min_epi32(_mm256_max_epi32(x, minBound), maxBound));
+   }
+   SSE2FloatToInt24(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii,
+      Offset(add, ii), Offset(sub, ii));
+}
+
+AUDACITY_AVX2_TARGET
+void AVX2Int16ToFloat(const short *src, size_t srcStride,
+   float *dst, size_t dstStride, size_t len)
+{
+   const auto scale = _mm256_set1_ps(1.0f / Scale16);
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      auto x =
+         _mm256_cvtepi16_epi32(LoadInt16x8(src + ii * srcStride, srcStride));
+      Store8(dst + ii * dstStride, dstStride,
+         _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+   }
+   SSE2Int16ToFloat(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii);
+}
+
+AUDACITY_AVX2_TARGET
+void AVX2Int24ToFloat(const int *src, size_t srcStride,
+   float *dst, size_t dstStride, size_t len)
+{
+   const auto scale = _mm256_set1_ps(1.0f / Scale24);
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      __m256i x;
+      if (srcStride == 1)
+         x = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(src + ii));
+      else {
+         auto s = src + ii * srcStride;
+         x = _mm256_setr_epi32(s[0], s[srcStride], s[2 * srcStride],
+            s[3 * srcStride], s[4 * srcStride], s[5 * srcStride],
+            s[6 * srcStride], s[7 * srcStride]);
+      }
+      Store8(dst + ii * dstStride, dstStride,
+         _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+   }
+   SSE2Int24ToFloat(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii);
+}
+
+AUDACITY_AVX2_TARGET
+void AVX2Int16ToInt24(const short *src, size_t srcStride,
+   int *dst, size_t dstStride, size_t len)
+{
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      auto x =
+         _mm256_cvtepi16_epi32(LoadInt16x8(src + ii * srcStride, srcStride));
+      Store8(dst + ii * dstStride, dstStride, _mm256_slli_epi32(x, 8));
+   }
+   SSE2Int16ToInt24(src + ii * srcStride, srcStride,
+      dst + ii * dstStride, dstStride, len - ii);
+}
+
+const Kernels AVX2Kernels{
+   "AVX2",
+   AVX2FloatToInt16,
+   AVX2FloatToInt24,
+   AVX2Int16ToFloat,
+   AVX2Int24ToFloat,
+   AVX2Int16ToInt24,
+};
+
+#endif
+
+const Kernels &ChooseKernels()
+{
+#ifdef AUDACITY_SSE2
+   if (CPUFeatures::HaveAVX2())
+      return AVX2Kernels;
+   return SSE2Kernels;
+#else
+   return ScalarKernels;
+#endif
+}
+
+}
+
+const Kernels &GetKernels()
+{
+   static const Kernels &kernels = ChooseKernels();
+   return kernels;
+}
+
+const Kernels &GetScalarKernels()
+{
+   return ScalarKernels;
+}
+
+}
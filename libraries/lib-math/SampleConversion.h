@@ -0,0 +1,66 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file SampleConversion.h
+  @brief Vectorized loops converting between sample formats
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_CONVERSION__
+#define __AUDACITY_SAMPLE_CONVERSION__
+
+#include <cstddef>
+
+//! Inner loops of Dither::Apply, chosen at run time for the processor
+/*!
+ Each loop gives results identical to the scalar conversions in Dither.cpp,
+ for all inputs but NaN, which convert to zero.
+
+ Strides count samples, not bytes; a stride of 1 means contiguous.
+ */
+namespace SampleConversion {
+
+//! Clip floats to [-1, 1], scale, optionally add and subtract noise, round,
+//! and saturate
+/*!
+ @param add if not null, has len values added after scaling
+ @param sub if not null, has len values subtracted after adding
+ */
+using FloatToInt16Fn = void (*)(const float *src, size_t srcStride,
+   short *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub);
+
+//! Like FloatToInt16Fn, but for 24 bit samples in ints
+using FloatToInt24Fn = void (*)(const float *src, size_t srcStride,
+   int *dst, size_t dstStride, size_t len,
+   const float *add, const float *sub);
+
+using Int16ToFloatFn = void (*)(const short *src, size_t srcStride,
+   float *dst, size_t dstStride, size_t len);
+
+using Int24ToFloatFn = void (*)(const int *src, size_t srcStride,
+   float *dst, size_t dstStride, size_t len);
+
+using Int16ToInt24Fn = void (*)(const short *src, size_t srcStride,
+   int *dst, size_t dstStride, size_t len);
+
+struct Kernels {
+   //! For diagnostics, as "scalar", "SSE2" or "AVX2"
+   const char *name;
+   FloatToInt16Fn floatToInt16;
+   FloatToInt24Fn floatToInt24;
+   Int16ToFloatFn int16ToFloat;
+   Int24ToFloatFn int24ToFloat;
+   Int16ToInt24Fn int16ToInt24;
+};
+
+//! The best kernels supported by this processor
+MATH_API const Kernels &GetKernels();
+
+//! Portable kernels, for reference and for processors without SIMD
+MATH_API const Kernels &GetScalarKernels();
+
+}
+
+#endif
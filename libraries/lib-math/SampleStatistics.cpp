@@ -0,0 +1,156 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file SampleStatistics.cpp
+
+**********************************************************************/
+
+#include "SampleStatistics.h"
+#include "CPUFeatures.h"
+
+namespace {
+
+using Kernel = MinMaxSumSq (*)(const float *samples, size_t len);
+
+//! Continue accumulating into result
+inline void Accumulate(MinMaxSumSq &result, const float *samples, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii) {
+      const auto sample = samples[ii];
+      if (sample > result.max)
+         result.max = sample;
+      if (sample < result.min)
+         result.min = sample;
+      result.sumsq += sample * sample;
+   }
+}
+
+MinMaxSumSq Scalar(const float *samples, size_t len)
+{
+   MinMaxSumSq result;
+   Accumulate(result, samples, len);
+   return result;
+}
+
+#ifdef AUDACITY_SSE2
+
+// In _mm_min_ps and _mm_max_ps, a NaN in the first operand yields the second,
+// so samples are passed first, to skip NaN as the scalar loop does
+
+//! Combine the lanes of accumulators, then the remaining samples
+/*! Inline, so that the AVX2 kernel does not pay for transitions into
+ code with legacy SSE encodings */
+inline MinMaxSumSq Reduce(__m128 mins, __m128 maxs, __m128 sums,
+   const float *samples, size_t len)
+{
+   alignas(16) float min[4], max[4], sum[4];
+   _mm_store_ps(min, mins);
+   _mm_store_ps(max, maxs);
+   _mm_store_ps(sum, sums);
+
+   MinMaxSumSq result;
+   for (size_t ii = 0; ii < 4; ++ii) {
+      if (min[ii] < result.min)
+         result.min = min[ii];
+      if (max[ii] > result.max)
+         result.max = max[ii];
+   }
+   result.sumsq = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+
+   Accumulate(result, samples, len);
+   return result;
+}
+
+MinMaxSumSq SSE2(const float *samples, size_t len)
+{
+   // Two sets of accumulators hide the latency of the additions
+   auto min0 = _mm_set1_ps(FLT_MAX), min1 = min0;
+   auto max0 = _mm_set1_ps(-FLT_MAX), max1 = max0;
+   auto sum0 = _mm_setzero_ps(), sum1 = sum0;
+
+   size_t ii = 0;
+   for (; ii + 8 <= len; ii += 8) {
+      const auto x0 = _mm_loadu_ps(samples + ii);
+      const auto x1 = _mm_loadu_ps(samples + ii + 4);
+      min0 = _mm_min_ps(x0, min0);
+      min1 = _mm_min_ps(x1, min1);
+      max0 = _mm_max_ps(x0, max0);
+      max1 = _mm_max_ps(x1, max1);
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(x0, x0));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(x1, x1));
+   }
+
+   return Reduce(_mm_min_ps(min0, min1), _mm_max_ps(max0, max1),
+      _mm_add_ps(sum0, sum1), samples + ii, len - ii);
+}
+
+AUDACITY_AVX2_TARGET
+MinMaxSumSq AVX2(const float *samples, size_t len)
+{
+   auto min0 = _mm256_set1_ps(FLT_MAX), min1 = min0;
+   auto max0 = _mm256_set1_ps(-FLT_MAX), max1 = max0;
+   auto sum0 = _mm256_setzero_ps(), sum1 = sum0;
+
+   size_t ii = 0;
+   for (; ii + 16 <= len; ii += 16) {
+      const auto x0 = _mm256_loadu_ps(samples + ii);
+      const auto x1 = _mm256_loadu_ps(samples + ii + 8);
+      min0 = _mm256_min_ps(x0, min0);
+      min1 = _mm256_min_ps(x1, min1);
+      max0 = _mm256_max_ps(x0, max0);
+      max1 = _mm256_max_ps(x1, max1);
+      sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(x0, x0));
+      sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(x1, x1));
+   }
+
+   const auto mins = _mm256_min_ps(min0, min1);
+   const auto maxs = _mm256_max_ps(max0, max1);
+   const auto sums = _mm256_add_ps(sum0, sum1);
+   return Reduce(
+      _mm_min_ps(
+         _mm256_castps256_ps128(mins), _mm256_extractf128_ps(mins, 1)),
+      _mm_max_ps(
+         _mm256_castps256_ps128(maxs), _mm256_extractf128_ps(maxs, 1)),
+      _mm_add_ps(
+         _mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1)),
+      samples + ii, len - ii);
+}
+
+#endif
+
+struct Choice {
+   Kernel kernel;
+   const char *name;
+};
+
+const Choice &Choose()
+{
+   static const Choice choice = []() -> Choice {
+#ifdef AUDACITY_SSE2
+      if (CPUFeatures::HaveAVX2())
+         return { AVX2, "AVX2" };
+      return { SSE2, "SSE2" };
+#else
+      return { Scalar, "scalar" };
+#endif
+   }();
+   return choice;
+}
+
+}
+
+MinMaxSumSq SampleStatistics::Compute(const float *samples, size_t len)
+{
+   return Choose().kernel(samples, len);
+}
+
+MinMaxSumSq SampleStatistics::ComputeScalar(const float *samples, size_t len)
+{
+   return Scalar(samples, len);
+}
+
+const char *SampleStatistics::GetKernelName()
+{
+   return Choose().name;
+}
@@ -0,0 +1,43 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file SampleStatistics.h
+  @brief Vectorized minimum, maximum, and sum of squares of samples
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_STATISTICS__
+#define __AUDACITY_SAMPLE_STATISTICS__
+
+#include <cfloat>
+#include <cstddef>
+
+//! Statistics of a run of float samples, as needed for summaries
+struct MinMaxSumSq {
+   //! FLT_MAX if there were no samples
+   float min{ FLT_MAX };
+   //! -FLT_MAX if there were no samples
+   float max{ -FLT_MAX };
+   float sumsq{ 0 };
+};
+
+namespace SampleStatistics {
+
+//! Compute the statistics, using the best kernel for the processor
+/*!
+ NaN samples are skipped by min and max, but make the sum of squares NaN.
+ The sum of squares is accumulated in several partial sums, so it may
+ differ from a serial sum in the last bits.
+ */
+MATH_API MinMaxSumSq Compute(const float *samples, size_t len);
+
+//! Compute the statistics with a portable serial loop, for comparison
+MATH_API MinMaxSumSq ComputeScalar(const float *samples, size_t len);
+
+//! Name of the kernel that Compute uses, as "scalar", "SSE2" or "AVX2"
+MATH_API const char *GetKernelName();
+
+}
+
+#endif
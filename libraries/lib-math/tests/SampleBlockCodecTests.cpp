@@ -0,0 +1,198 @@
+/*!********************************************************************
+
+ Audacity: A Digital Audio Editor
+
+ @file SampleBlockCodecTests.cpp
+ @brief Tests that encoded sample blocks decode to the same bits
+
+ **********************************************************************/
+
+#include <catch2/catch.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "SampleBlockCodec.h"
+
+namespace {
+
+//! Encode the samples
+/*! @return the count of encoded bytes, after checking that the encoding,
+ if any, decodes to exactly the same bytes */
+template<typename T>
+size_t RoundTrip(const std::vector<T> &samples, sampleFormat format)
+{
+   ArrayOf<char> encoded;
+   const auto bytes = SampleBlockCodec::Encode(
+      reinterpret_cast<constSamplePtr>(samples.data()), samples.size(),
+      format, encoded);
+   if (bytes == 0)
+      return 0;
+
+   const auto rawBytes = samples.size() * sizeof(T);
+   REQUIRE(bytes < rawBytes);
+   std::vector<T> decoded(samples.size());
+   REQUIRE(SampleBlockCodec::Decode(SampleBlockCodec::FixedRice,
+      encoded.get(), bytes, format,
+      reinterpret_cast<samplePtr>(decoded.data()), rawBytes));
+   REQUIRE(memcmp(decoded.data(), samples.data(), rawBytes) == 0);
+   return bytes;
+}
+
+//! A sine wave with a little noise, scaled to amplitude
+std::vector<double> Signal(size_t count, double amplitude)
+{
+   std::mt19937 engine{ 1357 };
+   std::uniform_real_distribution<double> noise{ -0.01, 0.01 };
+   std::vector<double> result(count);
+   for (size_t ii = 0; ii < count; ++ii)
+      result[ii] = amplitude * (0.9 * sin(ii * 0.031) + noise(engine));
+   return result;
+}
+
+template<typename T>
+std::vector<T> Quantize(const std::vector<double> &signal, double scale = 1.0)
+{
+   std::vector<T> result;
+   for (auto value : signal)
+      result.push_back(static_cast<T>(std::round(value)) / scale);
+   return result;
+}
+
+}
+
+TEST_CASE("SampleBlockCodec/int16", "")
+{
+   const auto samples = Quantize<int16_t>(Signal(10000, 32767));
+   REQUIRE(RoundTrip(samples, int16Sample) > 0);
+
+   std::vector<int16_t> extremes(1000);
+   for (size_t ii = 0; ii < extremes.size(); ++ii)
+      extremes[ii] = ii % 3 == 0 ? std::numeric_limits<int16_t>::min()
+         : ii % 3 == 1 ? std::numeric_limits<int16_t>::max() : 0;
+   RoundTrip(extremes, int16Sample);
+}
+
+TEST_CASE("SampleBlockCodec/int24", "")
+{
+   const auto samples = Quantize<int32_t>(Signal(10000, (1 << 23) - 1));
+   REQUIRE(RoundTrip(samples, int24Sample) > 0);
+}
+
+TEST_CASE("SampleBlockCodec/floats that fit 15 or 23 bits", "")
+{
+   const auto float15 = Quantize<float>(Signal(10000, 32767), 32768.0);
+   REQUIRE(RoundTrip(float15, floatSample) > 0);
+
+   const auto float23 =
+      Quantize<float>(Signal(10000, (1 << 23) - 1), 8388608.0);
+   REQUIRE(RoundTrip(float23, floatSample) > 0);
+
+   // The ends of the range
+   std::vector<float> ends(100, 0.0f);
+   ends[10] = -1.0f;
+   ends[20] = 1.0f - 1.0f / 8388608;
+   REQUIRE(RoundTrip(ends, floatSample) > 0);
+}
+
+TEST_CASE("SampleBlockCodec/floats that do not fit stay raw", "")
+{
+   const auto base = Quantize<float>(Signal(1000, 32767), 32768.0);
+   const float specials[] = {
+      0.1f, // not a multiple of 2^-23
+      1.0f, // out of range
+      -1.5f,
+      std::numeric_limits<float>::quiet_NaN(),
+      std::numeric_limits<float>::infinity(),
+      -std::numeric_limits<float>::infinity(),
+      -0.0f, // would decode as positive zero
+      std::numeric_limits<float>::denorm_min(),
+   };
+   for (auto special : specials) {
+      INFO("special value " << special);
+      for (size_t position : { size_t(0), size_t(500), base.size() - 1 }) {
+         auto samples = base;
+         samples[position] = special;
+         ArrayOf<char> encoded;
+         REQUIRE(SampleBlockCodec::Encode(
+            reinterpret_cast<constSamplePtr>(samples.data()), samples.size(),
+            floatSample, encoded) == 0);
+         REQUIRE(!encoded);
+      }
+   }
+}
+
+TEST_CASE("SampleBlockCodec/short and odd lengths", "")
+{
+   const auto signal = Signal(4096 * 2 + 300, 30000);
+   const auto int16s = Quantize<int16_t>(signal);
+   const auto int32s = Quantize<int32_t>(signal);
+   const auto floats = Quantize<float>(signal, 32768.0);
+   for (size_t count : { 1, 2, 3, 4, 5, 7, 13, 255, 256, 257, 511,
+      4095, 4096, 4097, 4096 + 257, 4096 * 2 + 299 }) {
+      INFO("count " << count);
+      RoundTrip(std::vector<int16_t>(int16s.begin(), int16s.begin() + count),
+         int16Sample);
+      RoundTrip(std::vector<int32_t>(int32s.begin(), int32s.begin() + count),
+         int24Sample);
+      RoundTrip(std::vector<float>(floats.begin(), floats.begin() + count),
+         floatSample);
+   }
+   // Too short to save anything over the header
+   ArrayOf<char> encoded;
+   const int16_t one = 0;
+   REQUIRE(SampleBlockCodec::Encode(
+      reinterpret_cast<constSamplePtr>(&one), 1, int16Sample, encoded) == 0);
+}
+
+TEST_CASE("SampleBlockCodec/maximum residuals", "")
+{
+   // Alternating extremes give the largest residuals of every predictor
+   std::vector<int32_t> extremes(5000);
+   for (size_t ii = 0; ii < extremes.size(); ++ii)
+      extremes[ii] = (ii % 2) ? std::numeric_limits<int32_t>::max()
+         : std::numeric_limits<int32_t>::min();
+   RoundTrip(extremes, int24Sample);
+
+   // Silence with rare extreme jumps, so the encoding is smaller but must
+   // escape the residuals of the jumps
+   std::vector<int32_t> spikes(5000, 0);
+   for (size_t ii = 100; ii < spikes.size(); ii += 700) {
+      spikes[ii] = std::numeric_limits<int32_t>::max();
+      spikes[ii + 1] = std::numeric_limits<int32_t>::min();
+   }
+   REQUIRE(RoundTrip(spikes, int24Sample) > 0);
+
+   std::vector<int16_t> spikes16(5000, 0);
+   for (size_t ii = 100; ii < spikes16.size(); ii += 700) {
+      spikes16[ii] = std::numeric_limits<int16_t>::max();
+      spikes16[ii + 1] = std::numeric_limits<int16_t>::min();
+   }
+   REQUIRE(RoundTrip(spikes16, int16Sample) > 0);
+}
+
+TEST_CASE("SampleBlockCodec/rejects mismatched blobs", "")
+{
+   const auto samples = Quantize<int16_t>(Signal(2000, 20000));
+   ArrayOf<char> encoded;
+   const auto bytes = SampleBlockCodec::Encode(
+      reinterpret_cast<constSamplePtr>(samples.data()), samples.size(),
+      int16Sample, encoded);
+   REQUIRE(bytes > 0);
+
+   std::vector<int16_t> decoded(samples.size());
+   const auto dest = reinterpret_cast<samplePtr>(decoded.data());
+   const auto rawBytes = samples.size() * sizeof(int16_t);
+   REQUIRE(!SampleBlockCodec::Decode(SampleBlockCodec::Raw,
+      encoded.get(), bytes, int16Sample, dest, rawBytes));
+   REQUIRE(!SampleBlockCodec::Decode(SampleBlockCodec::FixedRice,
+      encoded.get(), bytes, floatSample, dest, rawBytes));
+   REQUIRE(!SampleBlockCodec::Decode(SampleBlockCodec::FixedRice,
+      encoded.get(), bytes, int16Sample, dest, rawBytes - 2));
+   REQUIRE(!SampleBlockCodec::Decode(SampleBlockCodec::FixedRice,
+      encoded.get(), bytes / 2, int16Sample, dest, rawBytes));
+}
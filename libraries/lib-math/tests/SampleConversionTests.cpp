@@ -0,0 +1,166 @@
+/*!********************************************************************
+
+ Audacity: A Digital Audio Editor
+
+ @file SampleConversionTests.cpp
+ @brief Tests that the vectorized conversions agree with the scalar ones
+
+ **********************************************************************/
+
+#include <catch2/catch.hpp>
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "SampleConversion.h"
+
+namespace {
+
+// Enough to cover the tails after whole vectors of 4, 8, and 16 samples
+constexpr size_t MaxLength = 40;
+// Offsets of the first sample, to defeat alignment
+constexpr size_t MaxOffset = 3;
+
+//! Floats out of range, at the limits, at halves of steps, and random
+std::vector<float> MakeFloats(size_t count, float scale)
+{
+   std::mt19937 engine{ 12345 };
+   std::uniform_real_distribution<float> distribution{ -1.5f, 1.5f };
+   const float special[] = {
+      0.0f, -0.0f, 1.0f, -1.0f, 2.0f, -2.0f, 1e10f, -1e10f,
+      std::numeric_limits<float>::infinity(),
+      -std::numeric_limits<float>::infinity(),
+      std::numeric_limits<float>::denorm_min(),
+      0.5f / scale, -0.5f / scale, 1.5f / scale, -2.5f / scale,
+      (scale - 0.5f) / scale, -(scale + 0.5f) / scale,
+   };
+   std::vector<float> result;
+   for (size_t ii = 0; ii < count; ++ii) {
+      const auto nSpecial = sizeof(special) / sizeof(*special);
+      result.push_back(ii % 3 == 0
+         ? special[(ii / 3) % nSpecial]
+         : distribution(engine));
+   }
+   return result;
+}
+
+template<typename Int>
+std::vector<Int> MakeInts(size_t count, int minBound, int maxBound)
+{
+   std::mt19937 engine{ 54321 };
+   std::uniform_int_distribution<int> distribution{ minBound, maxBound };
+   std::vector<Int> result;
+   for (size_t ii = 0; ii < count; ++ii) {
+      const auto choice = ii % 4;
+      result.push_back(static_cast<Int>(
+         choice == 0 ? minBound : choice == 1 ? maxBound
+            : distribution(engine)));
+   }
+   return result;
+}
+
+//! Run both kernels over the same inputs for every length, offset, stride,
+//! and presence of noise; compare all of each destination buffer, so that
+//! writes past the end are detected too
+template<typename Src, typename Dst, typename Fn, typename Call>
+void Compare(const std::vector<Src> &source, Fn scalar, Fn vector,
+   const Call &call)
+{
+   for (size_t stride : { 1, 2 })
+   for (size_t offset = 0; offset <= MaxOffset; ++offset)
+   for (size_t len = 0; len <= MaxLength; ++len) {
+      const auto size = offset + stride * MaxLength + 1;
+      std::vector<Dst> expected(size, Dst(77)), actual(size, Dst(77));
+      call(scalar, source.data() + offset, stride,
+         expected.data() + offset, stride, len);
+      call(vector, source.data() + offset, stride,
+         actual.data() + offset, stride, len);
+      INFO("length " << len << ", offset " << offset << ", stride " << stride);
+      REQUIRE(expected == actual);
+   }
+}
+
+template<typename Int, typename Fn>
+void CompareFromFloat(Fn scalar, Fn vector, float scale)
+{
+   const auto source = MakeFloats(MaxOffset + 2 * MaxLength + 1, scale);
+   std::mt19937 engine{ 777 };
+   std::uniform_real_distribution<float> distribution{ -1.0f, 1.0f };
+   std::vector<float> add(MaxLength), sub(MaxLength);
+   for (auto &value : add)
+      value = distribution(engine);
+   for (auto &value : sub)
+      value = distribution(engine);
+
+   // No dither, rectangle dither, and triangle dither
+   const std::pair<const float *, const float *> noises[] = {
+      { nullptr, nullptr }, { add.data(), nullptr }, { add.data(), sub.data() }
+   };
+   for (const auto &noise : noises)
+      Compare<float, Int>(source, scalar, vector,
+         [&](Fn fn, const float *src, size_t srcStride,
+            Int *dst, size_t dstStride, size_t len){
+            fn(src, srcStride, dst, dstStride, len, noise.first, noise.second);
+         });
+}
+
+template<typename Src, typename Dst, typename Fn>
+void CompareFromInt(Fn scalar, Fn vector, int minBound, int maxBound)
+{
+   const auto source =
+      MakeInts<Src>(MaxOffset + 2 * MaxLength + 1, minBound, maxBound);
+   Compare<Src, Dst>(source, scalar, vector,
+      [](Fn fn, const Src *src, size_t srcStride,
+         Dst *dst, size_t dstStride, size_t len){
+         fn(src, srcStride, dst, dstStride, len);
+      });
+}
+
+}
+
+TEST_CASE("SampleConversion/float to int16", "")
+{
+   const auto &scalar = SampleConversion::GetScalarKernels();
+   const auto &vector = SampleConversion::GetKernels();
+   INFO(vector.name);
+   CompareFromFloat<short>(
+      scalar.floatToInt16, vector.floatToInt16, float(1 << 15));
+}
+
+TEST_CASE("SampleConversion/float to int24", "")
+{
+   const auto &scalar = SampleConversion::GetScalarKernels();
+   const auto &vector = SampleConversion::GetKernels();
+   INFO(vector.name);
+   CompareFromFloat<int>(
+      scalar.floatToInt24, vector.floatToInt24, float(1 << 23));
+}
+
+TEST_CASE("SampleConversion/int to float", "")
+{
+   const auto &scalar = SampleConversion::GetScalarKernels();
+   const auto &vector = SampleConversion::GetKernels();
+   INFO(vector.name);
+   CompareFromInt<short, float>(
+      scalar.int16ToFloat, vector.int16ToFloat, -32768, 32767);
+   CompareFromInt<int, float>(
+      scalar.int24ToFloat, vector.int24ToFloat, -8388608, 8388607);
+   CompareFromInt<short, int>(
+      scalar.int16ToInt24, vector.int16ToInt24, -32768, 32767);
+}
+
+TEST_CASE("SampleConversion/NaN", "")
+{
+   const auto &kernels = SampleConversion::GetKernels();
+   std::vector<float> source(MaxLength, std::nanf(""));
+   std::vector<short> dst16(MaxLength, 77);
+   std::vector<int> dst24(MaxLength, 77);
+   kernels.floatToInt16(
+      source.data(), 1, dst16.data(), 1, MaxLength, nullptr, nullptr);
+   kernels.floatToInt24(
+      source.data(), 1, dst24.data(), 1, MaxLength, nullptr, nullptr);
+   REQUIRE(dst16 == std::vector<short>(MaxLength, 0));
+   REQUIRE(dst24 == std::vector<int>(MaxLength, 0));
+}
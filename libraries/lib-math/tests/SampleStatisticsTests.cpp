@@ -0,0 +1,70 @@
+/*!********************************************************************
+
+ Audacity: A Digital Audio Editor
+
+ @file SampleStatisticsTests.cpp
+ @brief Tests that the vectorized statistics agree with the scalar loop
+
+ **********************************************************************/
+
+#include <catch2/catch.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "SampleStatistics.h"
+
+TEST_CASE("SampleStatistics/agrees with scalar loop", "")
+{
+   INFO(SampleStatistics::GetKernelName());
+   std::mt19937 engine{ 2468 };
+   std::uniform_real_distribution<float> distribution{ -1.0f, 1.0f };
+   std::vector<float> samples(300);
+   for (auto &sample : samples)
+      sample = distribution(engine);
+
+   for (size_t offset = 0; offset <= 3; ++offset)
+   for (size_t len = 0; len <= 260; ++len) {
+      INFO("length " << len << ", offset " << offset);
+      const auto expected =
+         SampleStatistics::ComputeScalar(samples.data() + offset, len);
+      const auto actual =
+         SampleStatistics::Compute(samples.data() + offset, len);
+      REQUIRE(expected.min == actual.min);
+      REQUIRE(expected.max == actual.max);
+      // Partial sums may differ in the last bits
+      REQUIRE(actual.sumsq == Approx(expected.sumsq).epsilon(1e-5));
+   }
+}
+
+TEST_CASE("SampleStatistics/empty", "")
+{
+   const auto stats = SampleStatistics::Compute(nullptr, 0);
+   REQUIRE(stats.min == FLT_MAX);
+   REQUIRE(stats.max == -FLT_MAX);
+   REQUIRE(stats.sumsq == 0);
+}
+
+TEST_CASE("SampleStatistics/NaN", "")
+{
+   std::vector<float> samples(256, std::nanf(""));
+
+   SECTION("NaN is skipped by min and max")
+   {
+      samples[3] = 0.25f;
+      samples[200] = -0.5f;
+      const auto stats = SampleStatistics::Compute(samples.data(), 256);
+      REQUIRE(stats.min == -0.5f);
+      REQUIRE(stats.max == 0.25f);
+      REQUIRE(std::isnan(stats.sumsq));
+   }
+
+   SECTION("Only NaN is like no samples for min and max")
+   {
+      const auto stats = SampleStatistics::Compute(samples.data(), 256);
+      REQUIRE(stats.min == FLT_MAX);
+      REQUIRE(stats.max == -FLT_MAX);
+   }
+}
@@ -23,6 +23,7 @@ UndoManager
 
 #include "UndoManager.h"
 
+#include <unordered_set>
 #include <wx/hashset.h>
 
 #include "BasicUI.h"
@@ -200,6 +201,7 @@ void UndoManager::ModifyState(const TrackList &l,
    stack[current]->state.tracks = std::move(tracksCopy);
 
    stack[current]->state.selectedRegion = selectedRegion;
+   stack[current]->spaceItems.reset();
 //   SonifyEndModifyState();
 
    EnqueueMessage({ UndoRedoMessage::Modified });
@@ -352,6 +354,35 @@ void UndoManager::VisitStates(
    }
 }
 
+std::vector<unsigned long long> UndoManager::GetSpaceUsage()
+{
+   // After copies and pastes, an item may be used in more than one place in
+   // one state, and in more than one state -- even in two states, but not in
+   // another between them, as after a cut and a paste back.
+   //
+   // Count it in the newest state that uses it, because the oldest states
+   // are discarded first, and only discarding that state reclaims the space.
+   std::vector<unsigned long long> result(stack.size());
+   std::unordered_set<long long> seen;
+   for (auto ii = stack.size(); ii-- > 0;) {
+      auto &elem = *stack[ii];
+      if (!elem.spaceItems) {
+         std::vector<UndoSpaceItem> items;
+         std::unordered_set<long long> ids;
+         UndoSpaceInspector::Call(*elem.state.tracks,
+            [&](const UndoSpaceItem &item){
+               if (ids.insert(item.id).second)
+                  items.push_back(item);
+            });
+         elem.spaceItems = std::move(items);
+      }
+      for (const auto &item : *elem.spaceItems)
+         if (seen.insert(item.id).second)
+            result[ii] += item.bytes;
+   }
+   return result;
+}
+
 bool UndoManager::UnsavedChanges() const
 {
    return (saved != current);
@@ -51,8 +51,10 @@
 
 #include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 #include "ClientData.h"
+#include "GlobalVariable.h"
 #include "Observer.h"
 #include "SelectedRegion.h"
 
@@ -109,6 +111,19 @@ public:
    };
 };
 
+//! Identity and size of something that states of history may share, such as
+//! a block of samples
+struct UndoSpaceItem {
+   long long id;
+   unsigned long long bytes;
+};
+
+//! Visits the shareable things that tracks use, which may be repeated
+struct PROJECT_HISTORY_API UndoSpaceInspector : GlobalHook<UndoSpaceInspector,
+   void(const TrackList &tracks,
+      const std::function<void(const UndoSpaceItem &)> &visitor)
+>{};
+
 struct UndoState {
    using Extensions = std::vector<std::shared_ptr<UndoStateExtension>>;
 
@@ -140,6 +155,9 @@ struct UndoStackElem {
    UndoState state;
    TranslatableString description;
    TranslatableString shortDescription;
+
+   //! What the tracks use, each id once; found when first needed
+   std::optional<std::vector<UndoSpaceItem>> spaceItems;
 };
 
 using UndoStack = std::vector <std::unique_ptr<UndoStackElem>>;
@@ -215,6 +233,12 @@ class PROJECT_HISTORY_API UndoManager final
    void VisitStates(
       const Consumer &consumer, size_t begin, size_t end );
 
+   //! Bytes used by each state, oldest first, counting each shared item once,
+   //! in the newest state that uses it
+   /*! Each state is inspected with UndoSpaceInspector only the first time,
+    and again after ModifyState() */
+   std::vector<unsigned long long> GetSpaceUsage();
+
    bool UndoAvailable();
    bool RedoAvailable();
 
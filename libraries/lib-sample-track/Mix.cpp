@@ -30,8 +30,11 @@
 #include "SampleTrackCache.h"
 #include "Prefs.h"
 #include "Resample.h"
+#include "ThreadPool.h"
 #include "float_cast.h"
 
+BoolSetting MixerParallel{ L"/Performance/ParallelMixing", false };
+
 Mixer::WarpOptions::WarpOptions(const TrackList &list)
 : envelope(DefaultWarp::Call(list)), minSpeed(0.0), maxSpeed(0.0)
 {
@@ -67,7 +70,8 @@ Mixer::Mixer(const SampleTrackConstArray &inputTracks,
              double startTime, double stopTime,
              unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
              double outRate, sampleFormat outFormat,
-             bool highQuality, MixerSpec *mixerSpec, bool applyTrackGains)
+             bool highQuality, MixerSpec *mixerSpec, bool applyTrackGains,
+             bool mayParallelize)
    : mNumInputTracks { inputTracks.size() }
 
    , mApplyTrackGains{ applyTrackGains }
@@ -168,6 +172,21 @@ Mixer::Mixer(const SampleTrackConstArray &inputTracks,
 
    const auto envLen = std::max(mQueueMaxLen, mInterleavedBufferSize);
    mEnvValues.reinit(envLen);
+
+   // A time track envelope is shared by all tracks, and evaluating it is not
+   // thread-safe, so then mix serially
+   auto &pool = ThreadPool::Get();
+   mParallel = mayParallelize && MixerParallel.Read() &&
+      mNumInputTracks > 1 && !mEnvelope && pool.GetConcurrency() > 1;
+   if (mParallel) {
+      // See Bug2536 comment below, for the extra float
+      mTrackBuffers = FloatBuffers{ mNumInputTracks, mBufferSize + 1 };
+      mTrackLens.reinit(mNumInputTracks);
+      const auto nLanes = std::min(mNumInputTracks, pool.GetConcurrency());
+      mLaneEnvValues.reinit(nLanes);
+      for (size_t lane = 0; lane < nLanes; ++lane)
+         mLaneEnvValues[lane].reinit(envLen);
+   }
 }
 
 Mixer::~Mixer()
@@ -234,10 +253,11 @@ double ComputeWarpFactor(const Envelope &env, double t0, double t1)
 
 }
 
-size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
+size_t Mixer::MixVariableRates(SampleTrackCache &cache,
                                     sampleCount *pos, float *queue,
                                     int *queueStart, int *queueLen,
-                                    Resample * pResample)
+                                    Resample * pResample,
+                                    float *floatBuffer, double *envValues)
 {
    const auto track = cache.GetTrack().get();
    const double trackRate = track->GetRate();
@@ -291,7 +311,7 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
                else
                   memset(&queue[*queueLen], 0, sizeof(float) * getLen);
 
-               track->GetEnvelopeValues(mEnvValues.get(),
+               track->GetEnvelopeValues(envValues,
                                         getLen,
                                         (*pos - (getLen- 1)).as_double() / trackRate);
                *pos -= getLen;
@@ -303,7 +323,7 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
                else
                   memset(&queue[*queueLen], 0, sizeof(float) * getLen);
 
-               track->GetEnvelopeValues(mEnvValues.get(),
+               track->GetEnvelopeValues(envValues,
                                         getLen,
                                         (*pos).as_double() / trackRate);
 
@@ -311,7 +331,7 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
             }
 
             for (decltype(getLen) i = 0; i < getLen; i++) {
-               queue[(*queueLen) + i] *= mEnvValues[i];
+               queue[(*queueLen) + i] *= envValues[i];
             }
 
             if (backwards)
@@ -355,7 +375,7 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
          // in soxr_output_no_callback.
          // Now we make the bug go away by allocating a little more space in
          // the buffer than we need.
-         &mFloatBuffer[out],
+         &floatBuffer[out],
          mMaxOut - out);
 
       const auto input_used = results.first;
@@ -369,28 +389,11 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
       }
    }
 
-   for (size_t c = 0; c < mNumChannels; c++) {
-      if (mApplyTrackGains) {
-         mGains[c] = track->GetChannelGain(c);
-      }
-      else {
-         mGains[c] = 1.0;
-      }
-   }
-
-   MixBuffers(mNumChannels,
-              channelFlags,
-              mGains.get(),
-              mFloatBuffer.get(),
-              mTemp.get(),
-              out,
-              mInterleaved);
-
    return out;
 }
 
-size_t Mixer::MixSameRate(int *channelFlags, SampleTrackCache &cache,
-                               sampleCount *pos)
+size_t Mixer::MixSameRate(SampleTrackCache &cache, sampleCount *pos,
+                          float *floatBuffer, double *envValues)
 {
    const auto track = cache.GetTrack().get();
    const double t = ( *pos ).as_double() / track->GetRate();
@@ -416,29 +419,76 @@ size_t Mixer::MixSameRate(int *channelFlags, SampleTrackCache &cache,
    if (backwards) {
       auto results = cache.GetFloats(*pos - (slen - 1), slen, mMayThrow);
       if (results)
-         memcpy(mFloatBuffer.get(), results, sizeof(float) * slen);
+         memcpy(floatBuffer, results, sizeof(float) * slen);
       else
-         memset(mFloatBuffer.get(), 0, sizeof(float) * slen);
-      track->GetEnvelopeValues(mEnvValues.get(), slen, t - (slen - 1) / mRate);
+         memset(floatBuffer, 0, sizeof(float) * slen);
+      track->GetEnvelopeValues(envValues, slen, t - (slen - 1) / mRate);
       for(decltype(slen) i = 0; i < slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
-      ReverseSamples((samplePtr)mFloatBuffer.get(), floatSample, 0, slen);
+         floatBuffer[i] *= envValues[i]; // Track gain control will go here?
+      ReverseSamples((samplePtr)floatBuffer, floatSample, 0, slen);
 
       *pos -= slen;
    }
    else {
       auto results = cache.GetFloats(*pos, slen, mMayThrow);
       if (results)
-         memcpy(mFloatBuffer.get(), results, sizeof(float) * slen);
+         memcpy(floatBuffer, results, sizeof(float) * slen);
       else
-         memset(mFloatBuffer.get(), 0, sizeof(float) * slen);
-      track->GetEnvelopeValues(mEnvValues.get(), slen, t);
+         memset(floatBuffer, 0, sizeof(float) * slen);
+      track->GetEnvelopeValues(envValues, slen, t);
       for(decltype(slen) i = 0; i < slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
+         floatBuffer[i] *= envValues[i]; // Track gain control will go here?
 
       *pos += slen;
    }
 
+   return slen;
+}
+
+size_t Mixer::RenderTrack(size_t i, float *floatBuffer, double *envValues)
+{
+   const auto track = mInputTrack[i].GetTrack().get();
+   if (mbVariableRates || track->GetRate() != mRate)
+      return MixVariableRates(mInputTrack[i],
+         &mSamplePos[i], mSampleQueue[i].get(),
+         &mQueueStart[i], &mQueueLen[i], mResample[i].get(),
+         floatBuffer, envValues);
+   else
+      return MixSameRate(mInputTrack[i], &mSamplePos[i],
+         floatBuffer, envValues);
+}
+
+void Mixer::MixTrack(
+   size_t i, int *channelFlags, const float *src, size_t len)
+{
+   const auto track = mInputTrack[i].GetTrack().get();
+   for(size_t j=0; j<mNumChannels; j++)
+      channelFlags[j] = 0;
+
+   if( mMixerSpec ) {
+      //ignore left and right when downmixing is not required
+      for(size_t j = 0; j < mNumChannels; j++ )
+         channelFlags[ j ] = mMixerSpec->mMap[ i ][ j ] ? 1 : 0;
+   }
+   else {
+      switch(track->GetChannel()) {
+      case Track::MonoChannel:
+      default:
+         for(size_t j=0; j<mNumChannels; j++)
+            channelFlags[j] = 1;
+         break;
+      case Track::LeftChannel:
+         channelFlags[0] = 1;
+         break;
+      case Track::RightChannel:
+         if (mNumChannels >= 2)
+            channelFlags[1] = 1;
+         else
+            channelFlags[0] = 1;
+         break;
+      }
+   }
+
    for(size_t c=0; c<mNumChannels; c++)
       if (mApplyTrackGains)
          mGains[c] = track->GetChannelGain(c);
@@ -446,9 +496,7 @@ size_t Mixer::MixSameRate(int *channelFlags, SampleTrackCache &cache,
          mGains[c] = 1.0;
 
    MixBuffers(mNumChannels, channelFlags, mGains.get(),
-              mFloatBuffer.get(), mTemp.get(), slen, mInterleaved);
-
-   return slen;
+              src, mTemp.get(), len, mInterleaved);
 }
 
 size_t Mixer::Process(size_t maxToProcess)
@@ -463,43 +511,33 @@ size_t Mixer::Process(size_t maxToProcess)
 
    mMaxOut = maxToProcess;
 
+   if (mParallel) {
+      // Each track has its own buffer, and each concurrent call its own
+      // scratch space for envelope values
+      ThreadPool::Get().ParallelFor(mNumInputTracks,
+         [this](size_t i, size_t lane){
+            mTrackLens[i] = RenderTrack(
+               i, mTrackBuffers[i].get(), mLaneEnvValues[lane].get());
+         });
+   }
+
    Clear();
+   // Accumulate in the same order as when rendering serially, so that
+   // results are identical
    for(size_t i=0; i<mNumInputTracks; i++) {
       const auto track = mInputTrack[i].GetTrack().get();
-      for(size_t j=0; j<mNumChannels; j++)
-         channelFlags[j] = 0;
-
-      if( mMixerSpec ) {
-         //ignore left and right when downmixing is not required
-         for(size_t j = 0; j < mNumChannels; j++ )
-            channelFlags[ j ] = mMixerSpec->mMap[ i ][ j ] ? 1 : 0;
+      size_t len;
+      const float *src;
+      if (mParallel) {
+         len = mTrackLens[i];
+         src = mTrackBuffers[i].get();
       }
       else {
-         switch(track->GetChannel()) {
-         case Track::MonoChannel:
-         default:
-            for(size_t j=0; j<mNumChannels; j++)
-               channelFlags[j] = 1;
-            break;
-         case Track::LeftChannel:
-            channelFlags[0] = 1;
-            break;
-         case Track::RightChannel:
-            if (mNumChannels >= 2)
-               channelFlags[1] = 1;
-            else
-               channelFlags[0] = 1;
-            break;
-         }
+         len = RenderTrack(i, mFloatBuffer.get(), mEnvValues.get());
+         src = mFloatBuffer.get();
       }
-      if (mbVariableRates || track->GetRate() != mRate)
-         maxOut = std::max(maxOut,
-            MixVariableRates(channelFlags.get(), mInputTrack[i],
-               &mSamplePos[i], mSampleQueue[i].get(),
-               &mQueueStart[i], &mQueueLen[i], mResample[i].get()));
-      else
-         maxOut = std::max(maxOut,
-            MixSameRate(channelFlags.get(), mInputTrack[i], &mSamplePos[i]));
+      maxOut = std::max(maxOut, len);
+      MixTrack(i, channelFlags.get(), src, len);
 
       double t = mSamplePos[i].as_double() / (double)track->GetRate();
       if (mT0 > mT1)
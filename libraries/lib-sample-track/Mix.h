@@ -21,6 +21,7 @@
 #define __AUDACITY_MIX__
 
 #include "GlobalVariable.h"
+#include "Prefs.h"
 #include "SampleFormat.h"
 #include <functional>
 #include <vector>
@@ -33,6 +34,9 @@ class SampleTrack;
 using SampleTrackConstArray = std::vector < std::shared_ptr < const SampleTrack > >;
 class SampleTrackCache;
 
+//! Whether mixers of several tracks may render the tracks concurrently
+extern SAMPLE_TRACK_API BoolSetting MixerParallel;
+
 class SAMPLE_TRACK_API MixerSpec
 {
    unsigned mNumTracks, mNumChannels, mMaxNumChannels;
@@ -93,7 +97,10 @@ class SAMPLE_TRACK_API Mixer {
          unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
          double outRate, sampleFormat outFormat,
          bool highQuality = true, MixerSpec *mixerSpec = nullptr,
-         bool applytTrackGains = true);
+         bool applytTrackGains = true,
+         //! False for mixers that must not block on the shared ThreadPool,
+         //! such as those of the audio thread
+         bool mayParallelize = true);
 
    virtual ~ Mixer();
 
@@ -133,13 +140,29 @@ class SAMPLE_TRACK_API Mixer {
  private:
 
    void Clear();
-   size_t MixSameRate(int *channelFlags, SampleTrackCache &cache,
-                           sampleCount *pos);
 
-   size_t MixVariableRates(int *channelFlags, SampleTrackCache &cache,
-                                sampleCount *pos, float *queue,
-                                int *queueStart, int *queueLen,
-                                Resample * pResample);
+   //! Fetch, apply the envelope to, and resample the next samples of a track
+   /*!
+    Touches no state of the mixer shared with other tracks, so different
+    tracks may be rendered concurrently
+    @param floatBuffer receives the output, for up to mMaxOut samples
+    @param envValues scratch space for envelope values
+    @return the number of samples written
+    */
+   size_t RenderTrack(size_t iTrack, float *floatBuffer, double *envValues);
+
+   size_t MixSameRate(SampleTrackCache &cache, sampleCount *pos,
+                      float *floatBuffer, double *envValues);
+
+   size_t MixVariableRates(SampleTrackCache &cache,
+                           sampleCount *pos, float *queue,
+                           int *queueStart, int *queueLen,
+                           Resample * pResample,
+                           float *floatBuffer, double *envValues);
+
+   //! Accumulate rendered samples of a track into mTemp, with channel gains
+   void MixTrack(
+      size_t iTrack, int *channelFlags, const float *src, size_t len);
 
    void MakeResamplers();
 
@@ -182,6 +205,15 @@ class SAMPLE_TRACK_API Mixer {
    std::vector<double> mMinFactor, mMaxFactor;
 
    const bool       mMayThrow;
+
+   // Parallel rendering
+   //! Whether tracks are rendered on the ThreadPool before mixing
+   bool             mParallel{ false };
+   //! Rendered samples of each track, in parallel mode
+   FloatBuffers     mTrackBuffers;
+   ArrayOf<size_t>  mTrackLens;
+   //! Envelope values for each lane of the ThreadPool, in parallel mode
+   ArrayOf<Doubles> mLaneEnvValues;
 };
 
 #endif
@@ -87,6 +87,14 @@ public:
       // contiguous range.
       sampleCount * pNumWithinClips = nullptr) const = 0;
 
+   //! Hint that samples in a range will soon be retrieved, in increasing order
+   /*!
+    Lets the storage fetch several blocks at once.  Non-throwing.
+    The default does nothing.
+    @param start relative to absolute time zero, as for Get()
+    */
+   virtual void Preload(sampleCount start, sampleCount len) const;
+
    /** @brief Convert correctly between an (absolute) time in seconds and a number of samples.
     *
     * This method will not give the correct results if used on a relative time (difference of two
@@ -11,6 +11,11 @@ Paul Licameli split from WaveTrack.cpp
 #include "SampleTrackCache.h"
 #include "SampleTrack.h"
 
+namespace {
+//! How many blocks ahead to fetch together, when reading sequentially
+constexpr size_t PreloadBlocks = 8;
+}
+
 SampleTrackCache::~SampleTrackCache()
 {
 }
@@ -31,6 +36,7 @@ void SampleTrackCache::SetTrack(const std::shared_ptr<const SampleTrack> &pTrack
          Free();
       mPTrack = pTrack;
       mNValidBuffers = 0;
+      mPreloadedEnd = 0;
    }
 }
 
@@ -84,6 +90,10 @@ const float *SampleTrackCache::GetFloats(
       if (fillFirst) {
          const auto start0 = mPTrack->GetBlockStart(start);
          if (start0 >= 0) {
+            if (fillSecond)
+               // Probably a jump, so earlier preloading is not relevant
+               mPreloadedEnd = start0;
+            PreloadFrom(start0);
             const auto len0 = mPTrack->GetBestBlockSize(start0);
             wxASSERT(len0 <= mBufferSize);
             if (!mPTrack->GetFloats(
@@ -112,6 +122,7 @@ const float *SampleTrackCache::GetFloats(
          if (end > end0) {
             const auto start1 = mPTrack->GetBlockStart(end0);
             if (start1 == end0) {
+               PreloadFrom(start1);
                const auto len1 = mPTrack->GetBestBlockSize(start1);
                wxASSERT(len1 <= mBufferSize);
                if (!mPTrack->GetFloats(mBuffers[1].data.get(), start1, len1, fillZero, mayThrow))
@@ -214,6 +225,17 @@ const float *SampleTrackCache::GetFloats(
    }
 }
 
+void SampleTrackCache::PreloadFrom(sampleCount start)
+{
+   // Sequential reading fetches one block at a time; instead fetch several
+   // together whenever the reading reaches the end of the previous batch
+   if (start < mPreloadedEnd)
+      return;
+   const auto len = sampleCount{ PreloadBlocks * mBufferSize };
+   mPTrack->Preload(start, len);
+   mPreloadedEnd = start + len;
+}
+
 void SampleTrackCache::Free()
 {
    mBuffers[0].Free();
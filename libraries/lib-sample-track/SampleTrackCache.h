@@ -68,11 +68,15 @@ private:
       }
    };
 
+   //! When marching forward past this position, preload more of the track
+   void PreloadFrom(sampleCount start);
+
    std::shared_ptr<const SampleTrack> mPTrack;
    size_t mBufferSize;
    Buffer mBuffers[2];
    GrowableSampleBuffer mOverlapBuffer;
    int mNValidBuffers;
+   sampleCount mPreloadedEnd{ 0 };
 };
 
 #endif
@@ -845,23 +845,25 @@ void Envelope::BinarySearchForTime( int &Lo, int &Hi, double t ) const
    // Optimizations for the usual pattern of repeated calls with
    // small increases of t.
    {
-      if (mSearchGuess >= 0 && mSearchGuess < (int)mEnv.size()) {
-         if (t >= mEnv[mSearchGuess].GetT() &&
-             (1 + mSearchGuess == (int)mEnv.size() ||
-              t < mEnv[1 + mSearchGuess].GetT())) {
-            Lo = mSearchGuess;
-            Hi = 1 + mSearchGuess;
+      auto guess = mSearchGuess.load(std::memory_order_relaxed);
+      if (guess >= 0 && guess < (int)mEnv.size()) {
+         if (t >= mEnv[guess].GetT() &&
+             (1 + guess == (int)mEnv.size() ||
+              t < mEnv[1 + guess].GetT())) {
+            Lo = guess;
+            Hi = 1 + guess;
             return;
          }
       }
 
-      ++mSearchGuess;
-      if (mSearchGuess >= 0 && mSearchGuess < (int)mEnv.size()) {
-         if (t >= mEnv[mSearchGuess].GetT() &&
-             (1 + mSearchGuess == (int)mEnv.size() ||
-              t < mEnv[1 + mSearchGuess].GetT())) {
-            Lo = mSearchGuess;
-            Hi = 1 + mSearchGuess;
+      ++guess;
+      if (guess >= 0 && guess < (int)mEnv.size()) {
+         if (t >= mEnv[guess].GetT() &&
+             (1 + guess == (int)mEnv.size() ||
+              t < mEnv[1 + guess].GetT())) {
+            Lo = guess;
+            Hi = 1 + guess;
+            mSearchGuess.store(guess, std::memory_order_relaxed);
             return;
          }
       }
@@ -881,7 +883,7 @@ void Envelope::BinarySearchForTime( int &Lo, int &Hi, double t ) const
    }
    wxASSERT( Hi == ( Lo+1 ));
 
-   mSearchGuess = Lo;
+   mSearchGuess.store(Lo, std::memory_order_relaxed);
 }
 
 // relative time
@@ -903,7 +905,7 @@ void Envelope::BinarySearchForTime_LeftLimit( int &Lo, int &Hi, double t ) const
    }
    wxASSERT( Hi == ( Lo+1 ));
 
-   mSearchGuess = Lo;
+   mSearchGuess.store(Lo, std::memory_order_relaxed);
 }
 
 /// GetInterpolationStartValueAtPoint() is used to select either the
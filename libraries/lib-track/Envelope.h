@@ -13,6 +13,7 @@
 
 #include <stdlib.h>
 #include <algorithm>
+#include <atomic>
 #include <vector>
 
 #include "XMLTagHandler.h"
@@ -252,7 +253,9 @@ private:
    bool mDragPointValid { false };
    int mDragPoint { -1 };
 
-   mutable int mSearchGuess { -2 };
+   //! Hint for searches; atomic, because several threads may read the
+   //! envelope at once, as when exporting
+   mutable std::atomic<int> mSearchGuess { -2 };
 };
 
 inline void EnvPoint::SetVal( Envelope *pEnvelope, double val )
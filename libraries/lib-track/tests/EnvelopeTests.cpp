@@ -0,0 +1,52 @@
+/*!********************************************************************
+
+ Audacity: A Digital Audio Editor
+
+ @file EnvelopeTests.cpp
+ @brief Tests that envelopes may be read by several threads at once
+
+ **********************************************************************/
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "Envelope.h"
+
+TEST_CASE("Envelope/concurrent reads agree with one reader", "")
+{
+   Envelope envelope{ false, 0.0, 2.0, 1.0 };
+   envelope.SetTrackLen(10.0);
+   for (int ii = 0; ii <= 20; ++ii)
+      envelope.InsertOrReplace(ii * 0.5, (ii % 3) * 0.5);
+
+   // A prime, so that every stride below visits every time
+   const size_t len = 4001;
+   const double tstep = 10.0 / len;
+   std::vector<double> expected(len);
+   for (size_t ii = 0; ii < len; ++ii)
+      expected[ii] = envelope.GetValue(ii * tstep);
+
+   // Each thread visits the times in another order, so that the threads
+   // move the shared search hint in different directions
+   const size_t nThreads = 4;
+   std::vector<std::vector<double>> results(nThreads);
+   std::vector<std::thread> threads;
+   for (size_t jj = 0; jj < nThreads; ++jj)
+      threads.emplace_back([&, jj]{
+         auto &result = results[jj];
+         result.resize(len);
+         for (size_t kk = 0; kk < len; ++kk) {
+            const auto ii = (jj % 2)
+               ? len - 1 - kk
+               : (kk * (2 * jj + 1)) % len;
+            result[ii] = envelope.GetValue(ii * tstep);
+         }
+      });
+   for (auto &thread : threads)
+      thread.join();
+
+   for (const auto &result : results)
+      REQUIRE(result == expected);
+}
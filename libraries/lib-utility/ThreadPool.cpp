@@ -0,0 +1,190 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file ThreadPool.cpp
+
+**********************************************************************/
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+struct ThreadPool::Job {
+   Job(size_t count, const Function &fn, size_t maxLanes)
+      : count{ count }, fn{ fn }, maxLanes{ maxLanes }
+   {}
+
+   const size_t count;
+   //! Valid only while some index remains unfinished
+   const Function &fn;
+   const size_t maxLanes;
+
+   //! Next index to claim
+   std::atomic<size_t> next{ 0 };
+   //! Guarded by ThreadPool::mMutex; the caller of ParallelFor has lane 0,
+   //! unless it only polls
+   size_t lanes{ 1 };
+
+   std::mutex mutex;
+   std::condition_variable done;
+   size_t finished{ 0 };
+   std::exception_ptr exception;
+   size_t exceptionIndex{ 0 };
+};
+
+ThreadPool &ThreadPool::Get()
+{
+   static ThreadPool instance{
+      std::max(1u, std::thread::hardware_concurrency()) - 1 };
+   return instance;
+}
+
+ThreadPool::ThreadPool(size_t nWorkers)
+{
+   mThreads.reserve(nWorkers);
+   for (size_t ii = 0; ii < nWorkers; ++ii)
+      mThreads.emplace_back([this]{ Run(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mStop = true;
+   }
+   mCondition.notify_all();
+   for (auto &thread : mThreads)
+      thread.join();
+}
+
+size_t ThreadPool::GetConcurrency() const
+{
+   return mThreads.size() + 1;
+}
+
+void ThreadPool::ParallelFor(size_t count, const Function &fn)
+{
+   if (count == 0)
+      return;
+
+   const auto maxLanes = std::min(count, GetConcurrency());
+   if (maxLanes == 1) {
+      for (size_t ii = 0; ii < count; ++ii)
+         fn(ii, 0);
+      return;
+   }
+
+   const auto pJob = std::make_shared<Job>(count, fn, maxLanes);
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mJobs.push_back(pJob);
+   }
+   if (maxLanes == 2)
+      mCondition.notify_one();
+   else
+      mCondition.notify_all();
+
+   Participate(*pJob, 0);
+
+   // Don't let idle workers join a job that has no more indices
+   Withdraw(pJob);
+
+   std::unique_lock<std::mutex> lock(pJob->mutex);
+   pJob->done.wait(lock, [&]{ return pJob->finished == count; });
+   if (pJob->exception)
+      std::rethrow_exception(pJob->exception);
+}
+
+void ThreadPool::ParallelFor(size_t count, const Function &fn,
+   const Poller &poll, std::chrono::milliseconds interval)
+{
+   if (count == 0)
+      return;
+
+   if (mThreads.empty()) {
+      for (size_t ii = 0; ii < count; ++ii) {
+         fn(ii, 0);
+         poll();
+      }
+      return;
+   }
+
+   // Workers take all of the lanes, starting from 0
+   const auto pJob = std::make_shared<Job>(
+      count, fn, std::min(count, mThreads.size()));
+   pJob->lanes = 0;
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mJobs.push_back(pJob);
+   }
+   if (pJob->maxLanes == 1)
+      mCondition.notify_one();
+   else
+      mCondition.notify_all();
+
+   {
+      std::unique_lock<std::mutex> lock(pJob->mutex);
+      while (!pJob->done.wait_for(lock, interval,
+         [&]{ return pJob->finished == count; })
+      ) {
+         lock.unlock();
+         poll();
+         lock.lock();
+      }
+   }
+
+   Withdraw(pJob);
+   if (pJob->exception)
+      std::rethrow_exception(pJob->exception);
+}
+
+void ThreadPool::Withdraw(const std::shared_ptr<Job> &pJob)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   auto end = mJobs.end();
+   auto iter = std::find(mJobs.begin(), end, pJob);
+   if (iter != end)
+      mJobs.erase(iter);
+}
+
+void ThreadPool::Run()
+{
+   while (true) {
+      std::shared_ptr<Job> pJob;
+      size_t lane;
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         mCondition.wait(lock, [this]{ return mStop || !mJobs.empty(); });
+         if (mStop)
+            return;
+         pJob = mJobs.front();
+         lane = pJob->lanes++;
+         if (pJob->lanes == pJob->maxLanes)
+            mJobs.pop_front();
+      }
+      Participate(*pJob, lane);
+   }
+}
+
+void ThreadPool::Participate(Job &job, size_t lane)
+{
+   for (size_t index; (index = job.next++) < job.count;) {
+      std::exception_ptr exception;
+      try {
+         job.fn(index, lane);
+      }
+      catch (...) {
+         exception = std::current_exception();
+      }
+
+      std::lock_guard<std::mutex> guard(job.mutex);
+      if (exception && (!job.exception || index < job.exceptionIndex)) {
+         job.exception = exception;
+         job.exceptionIndex = index;
+      }
+      if (++job.finished == job.count)
+         job.done.notify_all();
+   }
+}
@@ -0,0 +1,91 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file ThreadPool.h
+  @brief A fixed set of worker threads for data-parallel loops
+
+**********************************************************************/
+#ifndef __AUDACITY_THREAD_POOL__
+#define __AUDACITY_THREAD_POOL__
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Runs the iterations of loops concurrently on long lived worker threads
+/*!
+ Threads are not created for each loop, so that per-thread resources, such as
+ cached database statements, are not multiplied.
+
+ The thread that calls ParallelFor() takes part in the work too, so that
+ nested calls make progress even when all workers are busy.
+ */
+class UTILITY_API ThreadPool final
+{
+public:
+   //! Loop body; given the iteration index and a lane number
+   /*!
+    Calls that overlap in time are given distinct lanes, which are less than
+    both the count of iterations and GetConcurrency(), so that the body can
+    index scratch storage preallocated for each lane.
+    */
+   using Function = std::function<void(size_t index, size_t lane)>;
+
+   //! Called repeatedly while waiting; must not throw
+   using Poller = std::function<void()>;
+
+   //! The pool shared by the application, sized to the hardware
+   static ThreadPool &Get();
+
+   //! @param nWorkers how many threads to start besides the caller's
+   explicit ThreadPool(size_t nWorkers);
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool &operator=(const ThreadPool&) = delete;
+   //! Joins the workers
+   ~ThreadPool();
+
+   //! Count of the workers, plus one for the calling thread
+   size_t GetConcurrency() const;
+
+   //! Call fn for each index in [0, count) and return when all calls finish
+   /*!
+    The order of the calls is unspecified.
+    If any calls throw, the others still complete, and then the exception
+    from the least index is rethrown.
+    */
+   void ParallelFor(size_t count, const Function &fn);
+
+   //! Like the other overload, but the calling thread does not take part;
+   //! instead it calls poll at intervals until all calls finish
+   /*!
+    This suits a thread that must keep a user interface responsive.
+    If there are no workers, the calls are made in the calling thread
+    instead, with poll called after each.
+    */
+   void ParallelFor(size_t count, const Function &fn,
+      const Poller &poll, std::chrono::milliseconds interval);
+
+private:
+   struct Job;
+
+   //! Remove the job from the queue, if it is still there
+   void Withdraw(const std::shared_ptr<Job> &pJob);
+   void Run();
+   static void Participate(Job &job, size_t lane);
+
+   std::vector<std::thread> mThreads;
+
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+   //! Jobs that may still accept another lane
+   std::deque<std::shared_ptr<Job>> mJobs;
+   bool mStop{ false };
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*!********************************************************************
+
+ Audacity: A Digital Audio Editor
+
+ @file ThreadPoolTests.cpp
+ @brief Tests of the iterations, lanes and exceptions of ThreadPool
+
+ **********************************************************************/
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace {
+
+//! Checks that each index is visited once, and that no lane is used by two
+//! calls at the same time
+/*! Catch assertions are not thread safe, so workers only record failures */
+struct Visits {
+   Visits(size_t count, size_t nLanes)
+      : counts(count), busy(nLanes)
+   {}
+
+   void Visit(size_t index, size_t lane)
+   {
+      if (lane >= busy.size()) {
+         badLane.store(true);
+         return;
+      }
+      if (busy[lane].exchange(true))
+         overlap.store(true);
+      ++counts[index];
+      // Give other threads a chance to overlap
+      std::this_thread::yield();
+      busy[lane].store(false);
+   }
+
+   void Check() const
+   {
+      REQUIRE(!badLane.load());
+      REQUIRE(!overlap.load());
+      for (auto &count : counts)
+         REQUIRE(count.load() == 1);
+   }
+
+   std::vector<std::atomic<int>> counts;
+   std::vector<std::atomic<bool>> busy;
+   std::atomic<bool> badLane{ false };
+   std::atomic<bool> overlap{ false };
+};
+
+}
+
+TEST_CASE("ThreadPool/visits each index once, in distinct lanes", "")
+{
+   for (size_t nWorkers : { 0, 1, 3 }) {
+      ThreadPool pool{ nWorkers };
+      REQUIRE(pool.GetConcurrency() == nWorkers + 1);
+      for (size_t count : { 0, 1, 2, 5, 1000 }) {
+         INFO("workers " << nWorkers << ", count " << count);
+         const auto nLanes = std::min(count, pool.GetConcurrency());
+         Visits visits{ count, nLanes };
+         pool.ParallelFor(count, [&](size_t index, size_t lane){
+            visits.Visit(index, lane);
+         });
+         visits.Check();
+      }
+   }
+}
+
+TEST_CASE("ThreadPool/rethrows the exception of the least index", "")
+{
+   ThreadPool pool{ 3 };
+   const size_t count = 200;
+   std::vector<std::atomic<int>> counts(count);
+   try {
+      pool.ParallelFor(count, [&](size_t index, size_t){
+         ++counts[index];
+         if (index % 50 == 7)
+            throw std::runtime_error(std::to_string(index));
+      });
+      FAIL("no exception");
+   }
+   catch (const std::runtime_error &e) {
+      REQUIRE(std::string{ e.what() } == "7");
+   }
+   // The other calls still completed
+   for (auto &n : counts)
+      REQUIRE(n.load() == 1);
+}
+
+TEST_CASE("ThreadPool/polls while the workers run", "")
+{
+   for (size_t nWorkers : { 0, 2 }) {
+      INFO("workers " << nWorkers);
+      ThreadPool pool{ nWorkers };
+      const size_t count = 20;
+      const auto caller = std::this_thread::get_id();
+      // The caller does not take a lane of its own, when there are workers
+      Visits visits{ count, std::max<size_t>(1, nWorkers) };
+      std::atomic<int> callerCalls{ 0 };
+      int polls = 0;
+      pool.ParallelFor(count, [&](size_t index, size_t lane){
+         if (std::this_thread::get_id() == caller)
+            ++callerCalls;
+         visits.Visit(index, lane);
+         std::this_thread::sleep_for(std::chrono::milliseconds{ 2 });
+      }, [&]{ ++polls; }, std::chrono::milliseconds{ 1 });
+      visits.Check();
+      REQUIRE(polls > 0);
+      if (nWorkers > 0)
+         REQUIRE(callerCalls.load() == 0);
+
+      REQUIRE_THROWS_AS(pool.ParallelFor(count, [&](size_t index, size_t){
+         if (index == 3)
+            throw std::logic_error("");
+      }, []{}, std::chrono::milliseconds{ 1 }), std::logic_error);
+   }
+}
+
+TEST_CASE("ThreadPool/nested loops complete", "")
+{
+   ThreadPool pool{ 2 };
+   const size_t outer = 8, inner = 50;
+   std::vector<std::atomic<int>> counts(outer * inner);
+   pool.ParallelFor(outer, [&](size_t ii, size_t){
+      pool.ParallelFor(inner, [&](size_t jj, size_t){
+         ++counts[ii * inner + jj];
+      });
+   });
+   for (auto &n : counts)
+      REQUIRE(n.load() == 1);
+}
@@ -76,6 +76,7 @@ It handles initialization and termination by subclassing wxApp.
 #include "AColor.h"
 #include "AudacityFileConfig.h"
 #include "AudioIO.h"
+#include "BatchCommands.h"
 #include "Benchmark.h"
 #include "Clipboard.h"
 #include "CrashReport.h" // for HAS_CRASH_REPORT
@@ -1165,6 +1166,45 @@ void AudacityApp::OnInit0()
    wxFileSystem::AddHandler(safenew wxZipFSHandler);
 }
 
+// Apply the macro to each file named on the command line, in the order given,
+// and continue after failures.  Returns the exit code for the process.
+static int ApplyMacroToFiles(AudacityProject &project,
+   const wxString &macroName, const wxCmdLineParser &parser)
+{
+   if (MacroCommands::GetNames().Index(macroName) == wxNOT_FOUND)
+   {
+      wxPrintf(_("Macro not found: %s\n"), macroName);
+      return 1;
+   }
+
+   // The window is needed by commands, but need not be seen
+   GetProjectFrame(project).Hide();
+
+   // This insures that we start with an empty and temporary project
+   auto &projectFileManager = ProjectFileManager::Get(project);
+   projectFileManager.CloseProject();
+   projectFileManager.OpenProject();
+
+   MacroCommandsCatalog catalog{ &project };
+   MacroCommands macroCommands{ project };
+   macroCommands.ReadMacro(macroName);
+
+   int result = 0;
+   for (size_t i = 0, cnt = parser.GetParamCount(); i < cnt; i++)
+   {
+      const auto fileName = parser.GetParam(i);
+      if (macroCommands.ApplyMacroToFile(catalog, fileName) ==
+          MacroCommands::FileResult::Success)
+         wxPrintf("%s\n", fileName);
+      else
+      {
+         wxPrintf(_("Failed: %s\n"), fileName);
+         result = 1;
+      }
+   }
+   return result;
+}
+
 // The `main program' equivalent, creating the windows and returning the
 // main frame
 bool AudacityApp::OnInit()
@@ -1297,6 +1337,9 @@ bool AudacityApp::InitPart2()
    wxString journalFileName;
    const bool playingJournal = parser->Found("j", &journalFileName);
 
+   wxString macroName;
+   const bool applyingMacro = parser->Found(wxT("m"), &macroName);
+
 #if defined(__WXMSW__) && !defined(__WXUNIVERSAL__) && !defined(__CYGWIN__)
    if (!playingJournal)
       this->AssociateFileTypes();
@@ -1407,7 +1450,7 @@ bool AudacityApp::InitPart2()
 
    //Search for the new plugins
    std::vector<wxString> failedPlugins;
-   if(!playingJournal)
+   if(!playingJournal && !applyingMacro)
    {
       auto newPlugins = PluginManager::Get().CheckPluginUpdates();
       if(!newPlugins.empty())
@@ -1435,7 +1478,8 @@ bool AudacityApp::InitPart2()
       project = ProjectManager::New();
    }
 
-   if (!playingJournal && ProjectSettings::Get(*project).GetShowSplashScreen())
+   if (!playingJournal && !applyingMacro &&
+       ProjectSettings::Get(*project).GetShowSplashScreen())
    {
       // This may do a check-for-updates at every start up.
       // Mainly this is to tell users of ALPHAS who don't know that they have an ALPHA.
@@ -1468,7 +1512,7 @@ bool AudacityApp::InitPart2()
       //
       bool didRecoverAnything = false;
       // This call may reassign project (passed by reference)
-      if (!playingJournal)
+      if (!playingJournal && !applyingMacro)
       {
          if (!ShowAutoRecoveryDialogIfNeeded(project, &didRecoverAnything))
          {
@@ -1487,6 +1531,13 @@ bool AudacityApp::InitPart2()
             QuitAudacity(true);
          }
 
+         if (applyingMacro)
+         {
+            mMacroExitCode = ApplyMacroToFiles(*project, macroName, *parser);
+            QuitAudacity(true);
+            return;
+         }
+
          for (size_t i = 0, cnt = parser->GetParamCount(); i < cnt; i++)
          {
             // PRL: Catch any exceptions, don't try this file again, continue to
@@ -1570,6 +1621,9 @@ int AudacityApp::OnRun()
    if (result == 0)
       // If not otherwise abnormal, report any journal sync failure
       result = Journal::GetExitCode();
+   if (result == 0)
+      // Report any failure to apply a macro from the command line
+      result = mMacroExitCode;
    return result;
 }
 
@@ -2147,6 +2201,11 @@ std::unique_ptr<wxCmdLineParser> AudacityApp::ParseCommandLine()
 
    parser->AddOption(wxT("j"), wxT("journal"), journalOptionDescription);
 
+   /*i18n-hint: This applies a macro to each of the files named on the
+    *           command line, then quits */
+   parser->AddOption(wxT("m"), wxT("macro"),
+                     _("apply a macro to each file, then quit"));
+
    /*i18n-hint: This displays a list of available options */
    parser->AddSwitch(wxT("h"), wxT("help"), _("this help message"),
                      wxCMD_LINE_OPTION_HELP);
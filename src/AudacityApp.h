@@ -106,6 +106,9 @@ class AudacityApp final : public wxApp {
 
    wxTimer mTimer;
 
+   //! Exit code after applying a macro to files named on the command line
+   int mMacroExitCode{ 0 };
+
    void InitCommandHandler();
 
    bool InitTempDir();
@@ -66,6 +66,9 @@ time warp info and AudioIOListener and whether the playback is looped.
 
 #include "AudioIOExt.h"
 #include "AudioIOListener.h"
+#include "PlaybackPrefetcher.h"
+#include "SampleBlockCache.h"
+#include "SampleBlockWriter.h"
 
 #include "float_cast.h"
 #include "DeviceManager.h"
@@ -95,8 +98,10 @@ time warp info and AudioIOListener and whether the playback is looped.
 #include <wx/frame.h>
 #include <wx/wxcrtvararg.h>
 #include <wx/log.h>
+#include <wx/sstream.h>
 #include <wx/textctrl.h>
 #include <wx/timer.h>
+#include <wx/txtstrm.h>
 #include <wx/intl.h>
 #include <wx/debug.h>
 
@@ -308,6 +313,8 @@ AudioIO::AudioIO()
    SetMixerOutputVol(AudioIOPlaybackVolume.Read());
 
    mLastPlaybackTimeMillis = 0;
+
+   mpPrefetcher = std::make_unique<PlaybackPrefetcher>();
 }
 
 void AudioIO::StartThread()
@@ -942,6 +949,18 @@ int AudioIO::StartStream(const TransportTracks &tracks,
    mPlaybackSchedule.mTimeQueue.Prime(mPlaybackSchedule.GetTrackTime());
    // else recording only without overdub
 
+   if (!mPlaybackTracks.empty())
+      mpPrefetcher->Start(
+         { mPlaybackTracks.begin(), mPlaybackTracks.end() },
+         mPlaybackSchedule.GetTrackTime(),
+         mPlaybackSchedule.ReversedTime());
+
+   // Let a worker thread insert the recorded blocks into the database, so
+   // that a briefly stalled disk does not hold up the audio thread
+   if (!mCaptureTracks.empty())
+      if (auto pOwningProject = mOwningProject.lock())
+         SampleBlockWriter::Get(*pOwningProject).Start();
+
    // We signal the audio thread to call TrackBufferExchange, to prime the RingBuffers
    // so that they will have data in them when the stream starts.  Having the
    // audio thread call TrackBufferExchange here makes the code more predictable, since
@@ -1036,6 +1055,50 @@ void AudioIO::DelayActions(bool recording)
    mDelayingActions = recording;
 }
 
+wxString AudioIO::GetPrefetchInfo(const AudacityProject &project) const
+{
+   wxStringOutputStream o;
+   wxTextOutputStream s(o, wxEOL_UNIX);
+
+   const auto prefetch = mpPrefetcher->GetStatistics();
+   s << wxT("==============================\n");
+   s << XO("Playback read-ahead setting: %.1f seconds\n")
+      .Format( AudioIOPrefetchSeconds.Read() );
+   s << XO("Read-ahead requests in last playback: %llu\n")
+      .Format( prefetch.requests );
+   s << XO("Read-ahead stalls in last playback: %llu\n")
+      .Format( prefetch.stalls );
+   s << XO("Greatest read-ahead depth: %.1f seconds\n")
+      .Format( prefetch.maxDepth );
+
+   const auto cache = SampleBlockCache::Get( project ).GetStatistics();
+   s << wxT("==============================\n");
+   s << XO("Sample block cache: %llu hits, %llu misses, %llu evictions\n")
+      .Format( cache.hits, cache.misses, cache.evictions );
+   s << XO("Sample block cache: %llu blocks, %llu of %llu bytes\n")
+      .Format( (unsigned long long)cache.entries,
+         (unsigned long long)cache.bytes,
+         (unsigned long long)cache.capacity );
+
+   const auto writer = SampleBlockWriter::Get( project ).GetStatistics();
+   s << wxT("==============================\n");
+   s << XO("Write queue setting: %d MB\n")
+      .Format( SampleBlockWriteQueueSize.Read() );
+   s << XO("Blocks written in last recording: %llu in %llu transactions\n")
+      .Format( writer.written, writer.transactions );
+   s << XO("Blocks discarded before writing: %llu\n")
+      .Format( writer.cancelled );
+   s << XO("Write queue stalls: %llu\n")
+      .Format( writer.stalls );
+   s << XO("Greatest write queue depth: %llu blocks, %llu bytes\n")
+      .Format( (unsigned long long)writer.maxDepth,
+         (unsigned long long)writer.maxBytes );
+   s << XO("Write queue now: %llu blocks\n")
+      .Format( (unsigned long long)writer.depth );
+
+   return o.GetString();
+}
+
 bool AudioIO::DelayingActions() const
 {
    return mDelayingActions || (mPortStreamV19 && mNumCaptureChannels > 0);
@@ -1194,7 +1257,9 @@ bool AudioIO::AllocateBuffers(
                   mRate, floatSample,
                   false, // low quality dithering and resampling
                   nullptr,
-                  false // don't apply track gains
+                  false, // don't apply track gains
+                  // Don't block the audio thread on the shared thread pool
+                  false
                );
             }
 
@@ -1262,6 +1327,11 @@ bool AudioIO::AllocateBuffers(
 
 void AudioIO::StartStreamCleanup(bool bOnlyBuffers)
 {
+   mpPrefetcher->Stop();
+   if (auto pOwningProject = mOwningProject.lock())
+      GuardedCall( [&] {
+         SampleBlockWriter::Get(*pOwningProject).Stop();
+      } );
    mpTransportState.reset();
 
    mPlaybackBuffers.reset();
@@ -1429,6 +1499,13 @@ void AudioIO::StopStream()
    //
    if (mPlaybackTracks.size() > 0)
    {
+      if (mpPrefetcher->IsActive()) {
+         const auto stats = mpPrefetcher->GetStatistics();
+         wxLogMessage(
+            "Playback prefetch: %llu requests, %llu stalls, max depth %.1f s",
+            stats.requests, stats.stalls, stats.maxDepth);
+      }
+      mpPrefetcher->Stop();
       mPlaybackBuffers.reset();
       mScratchBuffers.clear();
       mScratchPointers.clear();
@@ -1476,6 +1553,22 @@ void AudioIO::StopStream()
             } );
          }
 
+         // Insert any blocks still queued, before the undo history
+         // refers to them
+         if (auto pOwningProject = mOwningProject.lock())
+            GuardedCall( [&] {
+               auto &writer = SampleBlockWriter::Get(*pOwningProject);
+               if (writer.IsActive()) {
+                  const auto stats = writer.GetStatistics();
+                  wxLogMessage(
+                     "Sample block writer: %llu blocks in %llu transactions, "
+                     "%llu cancelled, %llu stalls, max depth %llu blocks",
+                     stats.written, stats.transactions, stats.cancelled,
+                     stats.stalls, (unsigned long long)stats.maxDepth);
+               }
+               writer.Stop();
+            } );
+
          
          if (!mLostCaptureIntervals.empty())
          {
@@ -1887,6 +1980,9 @@ void AudioIO::FillPlayBuffers()
    */
    for (size_t i = 0; i < std::max(size_t{1}, mPlaybackTracks.size()); ++i)
       mPlaybackBuffers[i]->Flush();
+
+   // Let the prefetcher keep ahead of what the mixers will need next
+   mpPrefetcher->Advance(mPlaybackSchedule.mTimeQueue.GetLastTime());
 }
 
 void AudioIO::TransformPlayBuffers(
@@ -35,6 +35,7 @@ class AudioIOBase;
 class AudioIO;
 class RingBuffer;
 class Mixer;
+class PlaybackPrefetcher;
 class RealtimeEffectState;
 class Resample;
 
@@ -560,6 +561,10 @@ public:
     recording (when argument is true) or not necessarily so (false) */
    void DelayActions(bool recording);
 
+   //! Describe read-ahead of the last playback, write-behind of the last
+   //! recording, and the sample block cache of a project, for diagnostics
+   wxString GetPrefetchInfo(const AudacityProject &project) const;
+
 private:
 
    bool DelayingActions() const;
@@ -635,6 +640,9 @@ private:
    PostRecordingAction mPostRecordingAction;
 
    bool mDelayingActions{ false };
+
+   //! Reads ahead of the mixers so they seldom wait for the database
+   std::unique_ptr<PlaybackPrefetcher> mpPrefetcher;
 };
 
 #endif
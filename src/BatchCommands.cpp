@@ -27,9 +27,12 @@ processing.  See also MacrosWindow and ApplyMacroDialog.
 #include <wx/textfile.h>
 #include <wx/time.h>
 
+#include "Clipboard.h"
 #include "Project.h"
 #include "ProjectAudioManager.h"
+#include "ProjectFileManager.h"
 #include "ProjectHistory.h"
+#include "ProjectManager.h"
 #include "ProjectSettings.h"
 #include "ProjectWindow.h"
 #include "commands/CommandManager.h"
@@ -645,6 +648,29 @@ bool MacroCommands::ApplyCommandInBatchMode(
    return ApplyCommand( friendlyCommand, command, params, pContext );
 }
 
+auto MacroCommands::ApplyMacroToFile(
+   const MacroCommandsCatalog &catalog, const FilePath & file) -> FileResult
+{
+   auto &project = mProject;
+   auto result = GuardedCall< FileResult >([&] {
+      if (!ProjectFileManager::Get(project).Import(file))
+         return FileResult::ImportFailed;
+      ProjectWindow::Get(project).ZoomAfterImport(nullptr);
+      SelectUtilities::DoSelectAll(project);
+      return ApplyMacro(catalog)
+         ? FileResult::Success : FileResult::MacroFailed;
+   }, MakeSimpleGuard( FileResult::MacroFailed ) );
+
+   // Ensure project is completely reset
+   ProjectManager::Get(project).ResetProjectToEmpty();
+   // Bug2567:
+   // Must also destroy the clipboard, to be sure sample blocks are
+   // all freed and their ids can be reused safely in the next pass
+   Clipboard::Get().Clear();
+
+   return result;
+}
+
 static int MacroReentryCount = 0;
 // ApplyMacro returns true on success, false otherwise.
 // Any error reporting to the user in setting up the macro
@@ -63,6 +63,18 @@ class MacroCommands final {
  public:
    bool ApplyMacro( const MacroCommandsCatalog &catalog,
       const wxString & filename = {});
+   enum class FileResult {
+      Success,
+      //! The file was not imported, and the macro was not applied
+      ImportFailed,
+      MacroFailed,
+   };
+   //! Import the file into the empty project, select all, apply the macro,
+   //! then reset the project to empty and clear the clipboard
+   /*! Exceptions are caught and reported.
+    @return whether importing and then the macro succeeded */
+   FileResult ApplyMacroToFile( const MacroCommandsCatalog &catalog,
+      const FilePath & file );
    bool ApplyCommand( const TranslatableString &friendlyCommand,
       const CommandID & command, const wxString & params,
       CommandContext const * pContext=NULL );
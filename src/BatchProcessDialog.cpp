@@ -45,9 +45,6 @@
 #include "Project.h"
 #include "ProjectFileManager.h"
 #include "ProjectHistory.h"
-#include "ProjectManager.h"
-#include "ProjectWindow.h"
-#include "SelectUtilities.h"
 #include "Track.h"
 #include "commands/CommandManager.h"
 #include "effects/Effect.h"
@@ -467,27 +464,15 @@ void ApplyMacroDialog::OnApplyToFiles(wxCommandEvent & WXUNUSED(event))
          fileList->SetItemImage(i, 1, 1);
          fileList->EnsureVisible(i);
 
-         auto success = GuardedCall< bool >([&] {
-            ProjectFileManager::Get(*project).Import(files[i]);
-            ProjectWindow::Get(*project).ZoomAfterImport(nullptr);
-            SelectUtilities::DoSelectAll(*project);
-            if (!mMacroCommands.ApplyMacro(mCatalog))
-               return false;
-
-            if (!activityWin.IsShown() || mAbort)
-               return false;
-
-            return true;
-         });
-
-         // Ensure project is completely reset
-         ProjectManager::Get(*project).ResetProjectToEmpty();
-         // Bug2567:
-         // Must also destroy the clipboard, to be sure sample blocks are
-         // all freed and their ids can be reused safely in the next pass
-         globalClipboard.Clear();
+         const auto result =
+            mMacroCommands.ApplyMacroToFile(mCatalog, files[i]);
+         if (result == MacroCommands::FileResult::ImportFailed)
+            // Go on to the other files
+            wxLogMessage(wxT("Failed to import %s"), files[i]);
+         else if (result != MacroCommands::FileResult::Success)
+            break;
 
-         if (!success)
+         if (!activityWin.IsShown() || mAbort)
             break;
       }
    }
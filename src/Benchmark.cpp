@@ -18,6 +18,8 @@ of sample block storage.
 
 #include "Benchmark.h"
 
+#include <cmath>
+
 #include <wx/app.h>
 #include <wx/log.h>
 #include <wx/textctrl.h>
@@ -41,6 +43,7 @@ of sample block storage.
 #include "Sequence.h"
 #include "Prefs.h"
 #include "ProjectRate.h"
+#include "SampleStatistics.h"
 #include "ViewInfo.h"
 
 #include "FileNames.h"
@@ -568,6 +571,50 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
    Printf( XO("At 44100 Hz, %d bytes per sample, the estimated number of\n simultaneous tracks that could be played at once: %.1f\n" )
       .Format( SAMPLE_SIZE(SampleFormat), (nChunks*chunkSize/44100.0)/(elapsed/1000.0) ) );
 
+   {
+      // Time the min, max, and sum of squares of each 256 samples, as for the
+      // summaries of sample blocks, with the portable loop and with the
+      // kernel chosen for this processor
+      Printf( XO("Computing summaries, with %s kernel...\n")
+         .Format( SampleStatistics::GetKernelName() ) );
+      wxTheApp->Yield();
+      FlushPrint();
+
+      constexpr size_t bufferSize = 65536;
+      Floats buffer{ bufferSize };
+      const auto total = nChunks * chunkSize;
+      wxStopWatch scalarTimer, kernelTimer;
+      scalarTimer.Pause();
+      kernelTimer.Pause();
+      float scalarSum = 0, kernelSum = 0;
+      for (uint64_t start = 0; start < total; start += bufferSize) {
+         const auto len = std::min<uint64_t>(bufferSize, total - start);
+         t->GetFloats(buffer.get(), start, len);
+
+         scalarTimer.Resume();
+         for (uint64_t b = 0; b < len; b += 256)
+            scalarSum += SampleStatistics::ComputeScalar(
+               buffer.get() + b, std::min<uint64_t>(256, len - b)).sumsq;
+         scalarTimer.Pause();
+
+         kernelTimer.Resume();
+         for (uint64_t b = 0; b < len; b += 256)
+            kernelSum += SampleStatistics::Compute(
+               buffer.get() + b, std::min<uint64_t>(256, len - b)).sumsq;
+         kernelTimer.Pause();
+      }
+
+      Printf( XO("Time to summarize all data: %ld ms scalar, %ld ms %s\n")
+         .Format( scalarTimer.Time(), kernelTimer.Time(),
+            SampleStatistics::GetKernelName() ) );
+      // Partial sums are added in different orders, so allow for rounding
+      if (std::fabs(scalarSum - kernelSum) > 1e-3 * std::fabs(scalarSum)) {
+         Printf( XO("Sums of squares differ: %f, %f\n")
+            .Format( scalarSum, kernelSum ) );
+         goto fail;
+      }
+   }
+
    goto success;
 
  fail:
@@ -13,12 +13,19 @@ Paul Licameli -- split from ProjectFileIO.cpp
 
 #include "sqlite3.h"
 
+#include <algorithm>
+#include <utility>
+
+#include <wx/sstream.h>
 #include <wx/string.h>
+#include <wx/thread.h>
+#include <wx/txtstrm.h>
 
 #include "AudacityLogger.h"
 #include "BasicUI.h"
 #include "FileNames.h"
 #include "Internat.h"
+#include "Prefs.h"
 #include "Project.h"
 #include "FileException.h"
 #include "wxFileNameWrapper.h"
@@ -29,8 +36,11 @@ Paul Licameli -- split from ProjectFileIO.cpp
 #define xstr(a) str(a)
 #define str(a) #a
 
+// Like the page size, the vacuum mode of a database can change only before
+// it is in WAL mode
 static const char* PageSizeConfig =
    "PRAGMA <schema>.page_size = " xstr(AUDACITY_PROJECT_PAGE_SIZE) ";"
+   "PRAGMA <schema>.auto_vacuum = INCREMENTAL;"
    "VACUUM;";
 
 // Configuration to provide "safe" connections
@@ -41,6 +51,10 @@ static const char* SafeConfig =
    "PRAGMA <schema>.journal_mode = WAL;"
    "PRAGMA <schema>.wal_autocheckpoint = 0;";
 
+// Configuration of the read-only connections of the pool
+static const char *ReadConfig =
+   "PRAGMA <schema>.busy_timeout = 5000;";
+
 // Configuration to provide "Fast" connections
 static const char *FastConfig =
    "PRAGMA <schema>.busy_timeout = 5000;"
@@ -48,6 +62,17 @@ static const char *FastConfig =
    "PRAGMA <schema>.synchronous = OFF;"
    "PRAGMA <schema>.journal_mode = OFF;";
 
+IntSetting DBReadConnections{ L"/Performance/ReadConnections", 4 };
+
+IntSetting DBMmapSizeMB{ L"/Performance/MmapSizeMB", 256 };
+
+struct DBConnection::ReadStatement::Reader
+{
+   sqlite3 *db{};
+   std::map<StatementID, sqlite3_stmt *> statements;
+   bool busy{ false };
+};
+
 DBConnection::DBConnection(
    const std::weak_ptr<AudacityProject> &pProject,
    const std::shared_ptr<DBConnectionErrors> &pErrors,
@@ -144,6 +169,11 @@ int DBConnection::Open(const FilePath fileName)
    wxASSERT(mDB == nullptr);
    int rc;
 
+   // Read in the main thread, for use in workers
+   mMaxReaders = std::max(0, DBReadConnections.Read());
+   mMmapBytes = std::max(0, DBMmapSizeMB.Read()) * 1024LL * 1024LL;
+   mReadersFailed = false;
+
    // Initialize checkpoint controls
    mCheckpointStop = false;
    mCheckpointPending = false;
@@ -202,6 +232,8 @@ int DBConnection::OpenStepByStep(const FilePath fileName)
       return rc;
    }
 
+   ConfigMmap(mDB);
+
    rc = sqlite3_open(name, &mCheckpointDB);
    if (rc != SQLITE_OK)
    {
@@ -285,6 +317,8 @@ bool DBConnection::Close()
       mCheckpointThread.join();
    }
 
+   CloseReaders();
+
    // We're done with the prepared statements
    {
       std::lock_guard<std::mutex> guard(mStatementMutex);
@@ -338,6 +372,311 @@ bool DBConnection::Close()
    return true;
 }
 
+sqlite3 *DBConnection::OpenAuxiliary()
+{
+   if (!mDB)
+      return nullptr;
+
+   const char *name = sqlite3_db_filename(mDB, nullptr);
+
+   sqlite3 *db = nullptr;
+   int rc = sqlite3_open(name, &db);
+   if (rc == SQLITE_OK)
+      rc = ModeConfig(db, "main", SafeConfig);
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "DBConnection::OpenAuxiliary");
+
+      wxLogMessage("Failed to open auxiliary connection to %s: %d, %s\n",
+         name,
+         rc,
+         sqlite3_errstr(rc));
+      sqlite3_close(db);
+      return nullptr;
+   }
+
+   ConfigMmap(db);
+
+   // The WAL grows with commits from either connection
+   sqlite3_wal_hook(db, CheckpointHook, this);
+   return db;
+}
+
+sqlite3 *DBConnection::OpenReader()
+{
+   const char *name = sqlite3_db_filename(mDB, nullptr);
+
+   // Each connection is used by one thread at a time
+   sqlite3 *db = nullptr;
+   int rc = sqlite3_open_v2(name, &db,
+      SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+   if (rc == SQLITE_OK)
+      rc = ModeConfig(db, "main", ReadConfig);
+   if (rc != SQLITE_OK)
+   {
+      wxLogMessage("Failed to open read connection to %s: %d, %s\n",
+         name,
+         rc,
+         sqlite3_errstr(rc));
+      sqlite3_close(db);
+      return nullptr;
+   }
+   ConfigMmap(db);
+   return db;
+}
+
+int DBConnection::ConfigMmap(sqlite3 *db)
+{
+   // Mapping spares the copying of pages into the page cache, which matters
+   // most for the big blobs of samples.  Failure only leaves reads slower.
+   if (mMmapBytes <= 0)
+      return SQLITE_OK;
+
+   char sql[64];
+   sqlite3_snprintf(sizeof(sql), sql,
+      "PRAGMA main.mmap_size = %lld;", mMmapBytes);
+   int rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+      wxLogMessage("Failed to set mmap_size on %s: %d, %s\n",
+         sqlite3_db_filename(db, nullptr),
+         rc,
+         sqlite3_errstr(rc));
+   return rc;
+}
+
+void DBConnection::CloseReaders()
+{
+   std::lock_guard<std::mutex> guard(mReadersMutex);
+   for (auto &pReader : mReaders)
+   {
+      // Readers are used only by worker threads that are stopped, or
+      // excluded by ExcludeBackgroundReads(), before the connection closes
+      wxASSERT(!pReader->busy);
+      for (auto &pair : pReader->statements)
+         sqlite3_finalize(pair.second);
+      sqlite3_close(pReader->db);
+   }
+   mReaders.clear();
+}
+
+auto DBConnection::PrepareRead(enum StatementID id, const char *sql)
+   -> ReadStatement
+{
+   // The main thread reads with the primary connection, which sees its own
+   // uncommitted changes
+   if (wxIsMainThread())
+      return {};
+
+   const auto pReader = AcquireReader();
+   if (!pReader)
+      return {};
+
+   // This thread now uses the connection exclusively
+   auto &stmt = pReader->statements[id];
+   if (!stmt &&
+       sqlite3_prepare_v3(pReader->db, sql, -1, SQLITE_PREPARE_PERSISTENT,
+          &stmt, nullptr) != SQLITE_OK)
+   {
+      wxLogDebug(wxT("DBConnection::PrepareRead - SQLITE error %s"),
+         sqlite3_errmsg(pReader->db));
+      stmt = nullptr;
+      ReleaseReader(*pReader);
+      return {};
+   }
+
+   ++mReadLeases;
+   return { *this, *pReader, stmt };
+}
+
+auto DBConnection::AcquireReader() -> ReadStatement::Reader *
+{
+   std::lock_guard<std::mutex> guard(mReadersMutex);
+   if (!mDB || mMaxReaders == 0)
+      return nullptr;
+   for (auto &pOther : mReaders)
+      if (!pOther->busy)
+      {
+         pOther->busy = true;
+         return pOther.get();
+      }
+   if (mReadersFailed || mReaders.size() >= mMaxReaders)
+   {
+      ++mReadsExhausted;
+      return nullptr;
+   }
+   auto db = OpenReader();
+   if (!db)
+   {
+      // Don't try again for this file
+      mReadersFailed = true;
+      return nullptr;
+   }
+   mReaders.push_back(std::make_unique<ReadStatement::Reader>());
+   auto pReader = mReaders.back().get();
+   pReader->db = db;
+   pReader->busy = true;
+   return pReader;
+}
+
+void DBConnection::ReleaseReader(ReadStatement::Reader &reader)
+{
+   std::lock_guard<std::mutex> guard(mReadersMutex);
+   reader.busy = false;
+}
+
+namespace {
+// Read part of a blob with one connection
+int64_t ReadBlobPart(sqlite3 *db, const char *table, const char *column,
+   int64_t rowID, size_t offset, void *dest, size_t bytes)
+{
+   // The handle is closed at once, so that it does not hold a read
+   // transaction, which would keep checkpoints from finishing
+   sqlite3_blob *blob = nullptr;
+   if (sqlite3_blob_open(db, "main", table, column, rowID, 0, &blob)
+       != SQLITE_OK)
+   {
+      sqlite3_blob_close(blob);
+      return -1;
+   }
+
+   const size_t blobBytes = sqlite3_blob_bytes(blob);
+   offset = std::min(offset, blobBytes);
+   bytes = std::min(bytes, blobBytes - offset);
+   int rc = bytes == 0 ? SQLITE_OK
+      : sqlite3_blob_read(blob, dest, static_cast<int>(bytes),
+         static_cast<int>(offset));
+   sqlite3_blob_close(blob);
+
+   return rc == SQLITE_OK ? static_cast<int64_t>(bytes) : -1;
+}
+}
+
+int64_t DBConnection::ReadBlob(const char *table, const char *column,
+   int64_t rowID, size_t offset, void *dest, size_t bytes)
+{
+   // The main thread reads with the primary connection, which sees its own
+   // uncommitted changes
+   if (!wxIsMainThread())
+   {
+      if (const auto pReader = AcquireReader())
+      {
+         ++mReadLeases;
+         const auto result = ReadBlobPart(
+            pReader->db, table, column, rowID, offset, dest, bytes);
+         ReleaseReader(*pReader);
+         if (result >= 0)
+            return result;
+
+         // Perhaps the row was inserted in a transaction not yet committed
+         CountReadFallback();
+      }
+   }
+
+   return ReadBlobPart(mDB, table, column, rowID, offset, dest, bytes);
+}
+
+void DBConnection::CountReadFallback()
+{
+   ++mReadFallbacks;
+}
+
+auto DBConnection::GetReadPoolStatistics() const -> ReadPoolStatistics
+{
+   std::lock_guard<std::mutex> guard(mReadersMutex);
+   return { mReadLeases.load(), mReadsExhausted.load(),
+      mReadFallbacks.load(), mReaders.size() };
+}
+
+wxString DBConnection::GetReadPoolInfo() const
+{
+   wxStringOutputStream o;
+   wxTextOutputStream s(o, wxEOL_UNIX);
+
+   const auto reads = GetReadPoolStatistics();
+   s << wxT("==============================\n");
+   s << XO("Read connections setting: %d\n")
+      .Format( DBReadConnections.Read() );
+   s << XO(
+"Pooled reads: %llu, pool exhausted: %llu, rows read from main connection: %llu, connections: %llu\n")
+      .Format( reads.leases, reads.exhausted, reads.fallbacks,
+         (unsigned long long)reads.connections );
+
+   return o.GetString();
+}
+
+DBConnection::ReadStatement::ReadStatement(
+   DBConnection &connection, Reader &reader, sqlite3_stmt *stmt)
+   : mpConnection{ &connection }
+   , mpReader{ &reader }
+   , mStmt{ stmt }
+{
+}
+
+DBConnection::ReadStatement::ReadStatement(ReadStatement &&other) noexcept
+   : mpConnection{ other.mpConnection }
+   , mpReader{ other.mpReader }
+   , mStmt{ other.mStmt }
+{
+   other.mpConnection = nullptr;
+   other.mpReader = nullptr;
+   other.mStmt = nullptr;
+}
+
+auto DBConnection::ReadStatement::operator=(ReadStatement &&other) noexcept
+   -> ReadStatement &
+{
+   if (this != &other)
+   {
+      Release();
+      std::swap(mpConnection, other.mpConnection);
+      std::swap(mpReader, other.mpReader);
+      std::swap(mStmt, other.mStmt);
+   }
+   return *this;
+}
+
+DBConnection::ReadStatement::~ReadStatement()
+{
+   Release();
+}
+
+void DBConnection::ReadStatement::Release()
+{
+   if (!mpReader)
+      return;
+   if (mStmt)
+   {
+      sqlite3_clear_bindings(mStmt);
+      sqlite3_reset(mStmt);
+   }
+   {
+      std::lock_guard<std::mutex> guard(mpConnection->mReadersMutex);
+      mpReader->busy = false;
+   }
+   mpConnection = nullptr;
+   mpReader = nullptr;
+   mStmt = nullptr;
+}
+
+namespace {
+std::shared_mutex &BackgroundReadsMutex()
+{
+   static std::shared_mutex mutex;
+   return mutex;
+}
+}
+
+std::shared_lock<std::shared_mutex> DBConnection::LockForBackgroundReads()
+{
+   return std::shared_lock<std::shared_mutex>{ BackgroundReadsMutex() };
+}
+
+std::unique_lock<std::shared_mutex> DBConnection::ExcludeBackgroundReads()
+{
+   return std::unique_lock<std::shared_mutex>{ BackgroundReadsMutex() };
+}
+
 [[noreturn]] void DBConnection::ThrowException( bool write ) const
 {
    // Sqlite3 documentation says returned character string
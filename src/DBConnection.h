@@ -18,7 +18,9 @@ Paul Licameli -- split from ProjectFileIO.h
 #include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
+#include <vector>
 
 #include "ClientData.h"
 #include "Identifier.h"
@@ -27,6 +29,15 @@ struct sqlite3;
 struct sqlite3_stmt;
 class wxString;
 class AudacityProject;
+class IntSetting;
+
+//! Greatest count of read-only connections that worker threads of one
+//! project may use; zero disables them
+extern AUDACITY_DLL_API IntSetting DBReadConnections;
+
+//! Megabytes of a project file that each connection may memory-map for
+//! reading; zero disables mapping
+extern AUDACITY_DLL_API IntSetting DBMmapSizeMB;
 
 struct DBConnectionErrors
 {
@@ -64,6 +75,20 @@ public:
    bool Assign(sqlite3 *handle);
    sqlite3 *Detach();
 
+   //! Open another connection to the same database, in safe mode, for the
+   //! use of one worker thread; its commits also schedule checkpoints
+   /*! @return null for failure; the caller must sqlite3_close() the result
+    before this connection closes */
+   sqlite3 *OpenAuxiliary();
+
+   //! Hold while reading sample blocks in a worker thread that is not
+   //! otherwise stopped before connections change, as for drawing
+   static std::shared_lock<std::shared_mutex> LockForBackgroundReads();
+
+   //! Hold in the main thread while opening, closing or exchanging the
+   //! connection of a project; this waits for background reads to finish
+   static std::unique_lock<std::shared_mutex> ExcludeBackgroundReads();
+
    sqlite3 *DB();
 
    int GetLastRC() const ;
@@ -75,13 +100,92 @@ public:
       GetSummary256,
       GetSummary64k,
       LoadSampleBlock,
+      LoadEncodedSampleBlock,
       InsertSampleBlock,
+      InsertEncodedSampleBlock,
       DeleteSampleBlock,
       GetSampleBlockSize,
-      GetAllSampleBlocksSize
+      GetAllSampleBlocksSize,
+      GetSamplesBatch,
+      LoadSpectrumTile,
+      InsertSpectrumTile,
+      InsertSpectrumTileBlock,
+      GetSpectrumTilesSize,
+      GetOldestSpectrumTile,
+      DeleteSpectrumTile,
+      FindSampleBlockHash,
+      InsertSampleBlockHash
    };
    sqlite3_stmt *Prepare(enum StatementID id, const char *sql);
 
+   //! A statement prepared on a connection of the read pool, which the
+   //! holder uses exclusively until destruction
+   class ReadStatement
+   {
+   public:
+      ReadStatement() = default;
+      ReadStatement(ReadStatement &&other) noexcept;
+      ReadStatement &operator=(ReadStatement &&other) noexcept;
+      //! Resets the statement and returns the connection to the pool
+      ~ReadStatement();
+
+      sqlite3_stmt *get() const { return mStmt; }
+      explicit operator bool() const { return mStmt != nullptr; }
+
+   private:
+      friend DBConnection;
+      struct Reader;
+      ReadStatement(DBConnection &connection, Reader &reader,
+         sqlite3_stmt *stmt);
+      void Release();
+
+      DBConnection *mpConnection{};
+      Reader *mpReader{};
+      sqlite3_stmt *mStmt{};
+   };
+
+   //! Prepare a statement on a read-only connection of a pool, so that
+   //! worker threads read concurrently, and not only with the primary
+   //! connection's mutex
+   /*!
+    Pooled connections see only committed rows.  A reader that does not find
+    a row should try again with Prepare(), which sees rows inserted in an
+    uncommitted transaction, and then call CountReadFallback().
+
+    @return an empty object, meaning use Prepare() instead, in the main
+    thread, or if the pool is disabled or failed, or all of its connections
+    are in use
+    */
+   ReadStatement PrepareRead(enum StatementID id, const char *sql);
+
+   void CountReadFallback();
+
+   //! Read bytes of a blob from an offset, without reading the rest of it
+   /*!
+    In worker threads, uses a connection of the read pool if one is free and
+    finds the row, else the primary connection.
+
+    @return the count of bytes read, fewer if the blob is shorter, or
+    negative if the blob could not be read
+    */
+   int64_t ReadBlob(const char *table, const char *column, int64_t rowID,
+      size_t offset, void *dest, size_t bytes);
+
+   struct ReadPoolStatistics {
+      //! Statements given by PrepareRead()
+      unsigned long long leases{ 0 };
+      //! Calls of PrepareRead() in worker threads that found every
+      //! connection in use
+      unsigned long long exhausted{ 0 };
+      //! Rows then read with the primary connection
+      unsigned long long fallbacks{ 0 };
+      //! Connections now in the pool
+      size_t connections{ 0 };
+   };
+   ReadPoolStatistics GetReadPoolStatistics() const;
+   //! Statistics of the read pool formatted for Audio Device Info
+   wxString GetReadPoolInfo() const;
+
    void SetBypass( bool bypass );
    bool ShouldBypass();
 
@@ -120,6 +224,24 @@ private:
    using StatementIndex = std::pair<enum StatementID, std::thread::id>;
    std::map<StatementIndex, sqlite3_stmt *> mStatements;
 
+   sqlite3 *OpenReader();
+   void CloseReaders();
+   //! @return a connection of the pool, now busy, or null
+   ReadStatement::Reader *AcquireReader();
+   void ReleaseReader(ReadStatement::Reader &reader);
+
+   int ConfigMmap(sqlite3 *db);
+
+   //! Guards the pool, but not the statements of a connection in use
+   mutable std::mutex mReadersMutex;
+   std::vector<std::unique_ptr<ReadStatement::Reader>> mReaders;
+   size_t mMaxReaders{ 0 };
+   long long mMmapBytes{ 0 };
+   bool mReadersFailed{ false };
+   std::atomic<unsigned long long> mReadLeases{ 0 };
+   std::atomic<unsigned long long> mReadsExhausted{ 0 };
+   std::atomic<unsigned long long> mReadFallbacks{ 0 };
+
    std::shared_ptr<DBConnectionErrors> mpErrors;
    CheckpointFailureCallback mCallback;
 
@@ -56,56 +56,25 @@ struct SpaceUsageCalculator {
    using Type = unsigned long long;
    using SpaceArray = std::vector<Type> ;
 
-   Type CalculateUsage(const TrackList &tracks, SampleBlockIDSet &seen)
-   {
-      Type result = 0;
-      //TIMER_START( "CalculateSpaceUsage", space_calc );
-      InspectBlocks(
-         tracks,
-         BlockSpaceUsageAccumulator( result ),
-         &seen
-      );
-      return result;
-   }
-
    SpaceArray space;
    Type clipboardSpaceUsage;
 
    void Calculate( UndoManager &manager )
    {
-      SampleBlockIDSet seen;
+      // Each block counts in the newest state that uses it; the manager
+      // remembers which blocks the states use, so this inspects only states
+      // not seen before
+      space = manager.GetSpaceUsage();
 
-      // After copies and pastes, a block file may be used in more than
-      // one place in one undo history state, and it may be used in more than
-      // one undo history state.  It might even be used in two states, but not
-      // in another state that is between them -- as when you have state A,
-      // then make a cut to get state B, but then paste it back into state C.
-
-      // So be sure to count each block file once only, in the last undo item that
-      // contains it.
-
-      // Why the last and not the first? Because the user of the History dialog
-      // may DELETE undo states, oldest first.  To reclaim disk space you must
-      // DELETE all states containing the block file.  So the block file's
-      // contribution to space usage should be counted only in that latest
-      // state.
-
-      manager.VisitStates(
-         [this, &seen]( const UndoStackElem &elem ){
-            // Scan all tracks at current level
-            auto &tracks = *elem.state.tracks;
-            space.push_back(CalculateUsage(tracks, seen));
-         },
-         true // newest state first
-      );
-
-      // Count the usage of the clipboard separately, using another set.  Do not
+      // Count the usage of the clipboard separately.  Do not
       // multiple-count any block occurring multiple times within the clipboard.
-      seen.clear();
-      clipboardSpaceUsage = CalculateUsage(
-         Clipboard::Get().GetTracks(), seen);
-
-      //TIMER_STOP( space_calc );
+      SampleBlockIDSet seen;
+      clipboardSpaceUsage = 0;
+      InspectBlocks(
+         Clipboard::Get().GetTracks(),
+         BlockSpaceUsageAccumulator( clipboardSpaceUsage ),
+         &seen
+      );
    }
 };
 }
@@ -290,7 +259,7 @@ void HistoryDialog::DoUpdate()
    calculator.Calculate( *mManager );
 
    // point to size for oldest state
-   auto iter = calculator.space.rbegin();
+   auto iter = calculator.space.begin();
 
    mList->DeleteAllItems();
 
@@ -0,0 +1,149 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file PlaybackPrefetcher.cpp
+
+**********************************************************************/
+
+#include "PlaybackPrefetcher.h"
+
+#include <algorithm>
+
+#include "SampleTrack.h"
+
+DoubleSetting AudioIOPrefetchSeconds{ L"/AudioIO/PrefetchSeconds", 10.0 };
+
+PlaybackPrefetcher::PlaybackPrefetcher() = default;
+
+PlaybackPrefetcher::~PlaybackPrefetcher()
+{
+   Stop();
+}
+
+void PlaybackPrefetcher::Start(Tracks tracks, double time, bool reversed)
+{
+   Stop();
+
+   mRequests.store(0, std::memory_order_relaxed);
+   mStalls.store(0, std::memory_order_relaxed);
+   mMaxDepth.store(0, std::memory_order_relaxed);
+   mTime.store(time, std::memory_order_relaxed);
+   mPrefetched.store(time, std::memory_order_relaxed);
+
+   mDepth = std::max(0.0, AudioIOPrefetchSeconds.Read());
+   if (mDepth <= 0 || tracks.empty())
+      return;
+
+   mTracks = std::move(tracks);
+   mReversed.store(reversed, std::memory_order_relaxed);
+   mStop = false;
+   // Begin preloading at once, before the Audio thread primes the buffers
+   mPending = true;
+   mThread = std::thread([this]{ Run(); });
+}
+
+void PlaybackPrefetcher::Stop()
+{
+   if (!mThread.joinable())
+      return;
+
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mStop = true;
+   }
+   mCondition.notify_one();
+   mThread.join();
+
+   // Don't keep the tracks alive longer than the stream
+   mTracks.clear();
+}
+
+bool PlaybackPrefetcher::IsActive() const
+{
+   return mThread.joinable();
+}
+
+void PlaybackPrefetcher::Advance(double time)
+{
+   if (!IsActive())
+      return;
+
+   mTime.store(time, std::memory_order_relaxed);
+
+   // Did mixing get ahead of preloading?
+   const auto prefetched = mPrefetched.load(std::memory_order_relaxed);
+   if (mRequests.load(std::memory_order_relaxed) > 0 &&
+       (mReversed.load(std::memory_order_relaxed)
+          ? time < prefetched : time > prefetched))
+      ++mStalls;
+
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mPending = true;
+   }
+   mCondition.notify_one();
+}
+
+auto PlaybackPrefetcher::GetStatistics() const -> Statistics
+{
+   Statistics result;
+   const auto sign = mReversed.load(std::memory_order_relaxed) ? -1.0 : 1.0;
+   result.depth = std::max(0.0, sign * (
+      mPrefetched.load(std::memory_order_relaxed) -
+      mTime.load(std::memory_order_relaxed)));
+   result.maxDepth = mMaxDepth.load(std::memory_order_relaxed);
+   result.requests = mRequests.load(std::memory_order_relaxed);
+   result.stalls = mStalls.load(std::memory_order_relaxed);
+   return result;
+}
+
+void PlaybackPrefetcher::Run()
+{
+   while (true) {
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         mCondition.wait(lock, [this]{ return mStop || mPending; });
+         if (mStop)
+            break;
+         mPending = false;
+      }
+      Prefetch(mTime.load(std::memory_order_relaxed));
+   }
+}
+
+void PlaybackPrefetcher::Prefetch(double time)
+{
+   const auto sign = mReversed.load(std::memory_order_relaxed) ? -1.0 : 1.0;
+   auto prefetched = mPrefetched.load(std::memory_order_relaxed);
+   auto ahead = sign * (prefetched - time);
+
+   if (ahead < 0 || ahead > 2 * mDepth) {
+      // Fell behind, or play jumped, as when looping play restarts or
+      // the user seeks; start again from the play head
+      prefetched = time;
+      ahead = 0;
+   }
+   else if (ahead >= mDepth / 2)
+      // Still comfortably ahead; avoid many small requests
+      return;
+
+   const auto target = time + sign * mDepth;
+   const auto t0 = std::min(prefetched, target);
+   const auto t1 = std::max(prefetched, target);
+   for (const auto &pTrack : mTracks) {
+      const auto s0 = pTrack->TimeToLongSamples(t0);
+      const auto s1 = pTrack->TimeToLongSamples(t1);
+      if (s1 > s0)
+         pTrack->Preload(s0, s1 - s0);
+   }
+
+   mPrefetched.store(target, std::memory_order_relaxed);
+   ++mRequests;
+
+   // Only this thread writes mMaxDepth
+   const auto depth =
+      sign * (target - mTime.load(std::memory_order_relaxed));
+   if (depth > mMaxDepth.load(std::memory_order_relaxed))
+      mMaxDepth.store(depth, std::memory_order_relaxed);
+}
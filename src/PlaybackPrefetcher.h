@@ -0,0 +1,98 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file PlaybackPrefetcher.h
+@brief Reads track contents ahead of the play head in a worker thread
+
+**********************************************************************/
+
+#ifndef __AUDACITY_PLAYBACK_PREFETCHER__
+#define __AUDACITY_PLAYBACK_PREFETCHER__
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Prefs.h"
+
+class SampleTrack;
+
+//! How many seconds of track time to read ahead of playback; zero disables
+extern AUDACITY_DLL_API DoubleSetting AudioIOPrefetchSeconds;
+
+//! Warms the sample block cache ahead of the mixers of AudioIO
+/*!
+ The Audio thread reports the track time up to which it has produced
+ samples, as it fills the playback ring buffers.  A worker thread then
+ preloads the next few seconds of each playback track, so that the mixers
+ rarely wait for the database.
+
+ A "stall" is counted when the Audio thread reports a time not yet covered
+ by preloading, meaning that mixing probably read from disk.
+ */
+class AUDACITY_DLL_API PlaybackPrefetcher final
+{
+public:
+   using Tracks = std::vector<std::shared_ptr<const SampleTrack>>;
+
+   struct Statistics {
+      //! Seconds of track time preloaded ahead of the last reported time
+      double depth{ 0 };
+      //! Greatest value of depth seen
+      double maxDepth{ 0 };
+      unsigned long long requests{ 0 };
+      unsigned long long stalls{ 0 };
+   };
+
+   PlaybackPrefetcher();
+   PlaybackPrefetcher( const PlaybackPrefetcher & ) PROHIBITED;
+   PlaybackPrefetcher &operator=( const PlaybackPrefetcher & ) PROHIBITED;
+   //! Stops the worker thread
+   ~PlaybackPrefetcher();
+
+   //! Called by the main thread when a stream starts; no-op if disabled
+   /*! Resets statistics */
+   void Start(Tracks tracks, double time, bool reversed);
+
+   //! Called by the main thread when a stream stops
+   void Stop();
+
+   //! Called by the Audio thread after it produces samples up to time
+   void Advance(double time);
+
+   bool IsActive() const;
+
+   Statistics GetStatistics() const;
+
+private:
+   void Run();
+   //! Preload from mPrefetched towards time + mDepth, if the horizon is near
+   void Prefetch(double time);
+
+   Tracks mTracks;
+   double mDepth{ 0 };
+   //! Read by all threads, including GetStatistics() at any time
+   std::atomic<bool> mReversed{ false };
+
+   std::thread mThread;
+   mutable std::mutex mMutex;
+   std::condition_variable mCondition;
+   bool mStop{ false };
+   bool mPending{ false };
+
+   //! Last time reported by the Audio thread
+   std::atomic<double> mTime{ 0 };
+   //! Track time up to which (or, when reversed, down to which) preloading
+   //! was requested
+   std::atomic<double> mPrefetched{ 0 };
+
+   std::atomic<double> mMaxDepth{ 0 };
+   std::atomic<unsigned long long> mRequests{ 0 };
+   std::atomic<unsigned long long> mStalls{ 0 };
+};
+
+#endif
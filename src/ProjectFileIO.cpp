@@ -10,6 +10,7 @@ Paul Licameli split from AudacityProject.cpp
 
 #include "ProjectFileIO.h"
 
+#include <algorithm>
 #include <atomic>
 #include <sqlite3.h>
 #include <optional>
@@ -29,6 +30,8 @@ Paul Licameli split from AudacityProject.cpp
 #include "ProjectSerializer.h"
 #include "ProjectWindows.h"
 #include "SampleBlock.h"
+#include "SampleBlockIndex.h"
+#include "SpectrumTileStore.h"
 #include "TempDirectory.h"
 #include "TransactionScope.h"
 #include "WaveTrack.h"
@@ -94,6 +97,10 @@ static const int ProjectFileID = PACK('A', 'U', 'D', 'Y');
 // A search for "SQL sampleblocks" will find all SQL related 
 // to sampleblocks.
 
+// Pages released by each step of compaction in place, bounding the time
+// spent in each statement
+static const int64_t CompactionStepPages = 256;
+
 static const char *ProjectFileSchema =
    // These are persistent and not connection based
    //
@@ -102,6 +109,12 @@ static const char *ProjectFileSchema =
    "PRAGMA <schema>.application_id = %d;"
    "PRAGMA <schema>.user_version = %u;"
    ""
+   // The main database was already set so by DBConnection; this is for
+   // copies.  It takes effect only before the first table is created, so
+   // that files made earlier release free pages only when compaction copies
+   // them
+   "PRAGMA <schema>.auto_vacuum = INCREMENTAL;"
+   ""
    // project is a binary representation of an XML file.
    // it's in binary for speed.
    // One instance only.  id is always 1.
@@ -167,6 +180,72 @@ static const char *ProjectFileSchema =
    "  samples              BLOB"
    ");";
 
+// ALTER SQL sampleblocks
+// Only in files that store encoded samples, which older versions can't read.
+// codec is a SampleBlockCodec::Codec, describing samples.  rawbytes is the
+// size of the samples when decoded, and null when codec is raw.
+static const char *EncodedSamplesSchema =
+   "ALTER TABLE <schema>.sampleblocks"
+   "  ADD COLUMN codec INTEGER NOT NULL DEFAULT 0;"
+   "ALTER TABLE <schema>.sampleblocks"
+   "  ADD COLUMN rawbytes INTEGER;";
+
+BoolSetting ProjectFileCompressSamples{
+   L"/Performance/CompressSampleBlocks", false };
+
+// CREATE SQL autosavedoc, autosavetracks
+// Only in files autosaved in parts, which older versions can't recover.
+// One row of autosavedoc, with id 1.  The document is dict and head, then the
+// doc of each row of autosavetracks listed in tracks, then tail.  tracks is
+// an array of ids, as little endian 64 bit integers; one row may be listed
+// more than once, for identical tracks.  Rows are inserted only for tracks
+// that changed, and generation increases with each write.
+static const char *AutoSavePartsSchema =
+   "CREATE TABLE IF NOT EXISTS main.autosavedoc"
+   "("
+   "  id                   INTEGER PRIMARY KEY,"
+   "  generation           INTEGER,"
+   "  dict                 BLOB,"
+   "  head                 BLOB,"
+   "  tracks               BLOB,"
+   "  tail                 BLOB"
+   ");"
+   ""
+   "CREATE TABLE IF NOT EXISTS main.autosavetracks"
+   "("
+   "  id                   INTEGER PRIMARY KEY,"
+   "  doc                  BLOB"
+   ");";
+
+BoolSetting ProjectFileIncrementalAutoSave{
+   L"/Performance/IncrementalAutoSave", false };
+
+// Files storing encoded samples need the version that can decode them
+static ProjectFormatExtensionsRegistry::Extension encodedSamplesExtension(
+   [](const AudacityProject &project) -> ProjectFormatVersion
+   {
+      auto &pConnection = ConnectionPtr::Get(project).mpConnection;
+      if (pConnection &&
+          ProjectFileIO::StoresEncodedSamples(pConnection->DB()))
+         return { 3, 2, 0, 0 };
+
+      return BaseProjectFormatVersion;
+   }
+);
+
+// Files autosaved in parts need the version that can compose the document
+static ProjectFormatExtensionsRegistry::Extension autoSavePartsExtension(
+   [](const AudacityProject &project) -> ProjectFormatVersion
+   {
+      auto &pConnection = ConnectionPtr::Get(project).mpConnection;
+      if (pConnection &&
+          ProjectFileIO::HasAutoSaveParts(pConnection->DB()))
+         return { 3, 2, 0, 0 };
+
+      return BaseProjectFormatVersion;
+   }
+);
+
 // This singleton handles initialization/shutdown of the SQLite library.
 // It is needed because our local SQLite is built with SQLITE_OMIT_AUTOINIT
 // defined.
@@ -344,11 +423,24 @@ private:
 class BufferedProjectBlobStream : public BufferedStreamReader
 {
 public:
-   static constexpr std::array<const char*, 2> Columns = { "dict", "doc" };
+   //! A column of one row, read in sequence with the others
+   struct Blob
+   {
+      const char* table;
+      const char* column;
+      int64_t rowID;
+   };
 
    BufferedProjectBlobStream(
       sqlite3* db, const char* schema, const char* table,
       int64_t rowID)
+       : BufferedProjectBlobStream(
+            db, schema, { { table, "dict", rowID }, { table, "doc", rowID } })
+   {
+   }
+
+   BufferedProjectBlobStream(
+      sqlite3* db, const char* schema, std::vector<Blob> blobs)
        // Despite we use 64k pages in SQLite - it is impossible to guarantee
        // that read is satisfied from a single page.
        // Reading 64k proved to be slower, (64k - 8) gives no measurable difference
@@ -357,22 +449,22 @@ public:
        : BufferedStreamReader(32 * 1024) 
        , mDB(db)
        , mSchema(schema)
-       , mTable(table)
-       , mRowID(rowID)
+       , mBlobs(std::move(blobs))
    {
    }
 
 private:
    bool OpenBlob(size_t index)
    {
-      if (index >= Columns.size())
+      if (index >= mBlobs.size())
       {
          mBlobStream.reset();
          return false;
       }
 
+      const auto& blob = mBlobs[index];
       mBlobStream = SQLiteBlobStream::Open(
-         mDB, mSchema, mTable, Columns[index], mRowID, true);
+         mDB, mSchema, blob.table, blob.column, blob.rowID, true);
 
       return mBlobStream.has_value();
    }
@@ -382,13 +474,12 @@ private:
 
    sqlite3* mDB;
    const char* mSchema;
-   const char* mTable;
-   const int64_t mRowID;
+   const std::vector<Blob> mBlobs;
 
 protected:
    bool HasMoreData() const override
    {
-      return mBlobStream.has_value() || mNextBlobIndex < Columns.size();
+      return mBlobStream.has_value() || mNextBlobIndex < mBlobs.size();
    }
 
    size_t ReadData(void* buffer, size_t maxBytes) override
@@ -408,7 +499,7 @@ protected:
          // Reading has failed, close the stream and do not allow opening
          // the next one
          mBlobStream = {};
-         mNextBlobIndex = Columns.size();
+         mNextBlobIndex = mBlobs.size();
 
          return 0;
       }
@@ -421,8 +512,6 @@ protected:
    }
 };
 
-constexpr std::array<const char*, 2> BufferedProjectBlobStream::Columns;
-
 bool ProjectFileIO::InitializeSQL()
 {
    static SQLiteIniter sqliteIniter;
@@ -598,6 +687,7 @@ bool ProjectFileIO::OpenConnection(FilePath fileName /* = {}  */)
    }
 
    // Pass weak_ptr to project into DBConnection constructor
+   auto lock = DBConnection::ExcludeBackgroundReads();
    curConn = std::make_unique<DBConnection>(
       mProject.shared_from_this(), mpErrors, [this]{ OnCheckpointFailure(); } );
    auto rc = curConn->Open(fileName);
@@ -612,6 +702,7 @@ bool ProjectFileIO::OpenConnection(FilePath fileName /* = {}  */)
       curConn.reset();
       return false;
    }
+   lock.unlock();
 
    if (!CheckVersion())
    {
@@ -633,11 +724,14 @@ bool ProjectFileIO::CloseConnection()
    if (!curConn)
       return false;
 
+   auto lock = DBConnection::ExcludeBackgroundReads();
+
    if (!curConn->Close())
    {
       return false;
    }
    curConn.reset();
+   mAutoSaveParts = {};
 
    SetFileName({});
 
@@ -651,6 +745,7 @@ void ProjectFileIO::SaveConnection()
    // Should do nothing in proper usage, but be sure not to leak a connection:
    DiscardConnection();
 
+   auto lock = DBConnection::ExcludeBackgroundReads();
    mPrevConn = std::move(CurrConn());
    mPrevFileName = mFileName;
    mPrevTemporary = mTemporary;
@@ -695,6 +790,7 @@ void ProjectFileIO::DiscardConnection()
 // Close any current connection and switch back to using the saved
 void ProjectFileIO::RestoreConnection()
 {
+   auto lock = DBConnection::ExcludeBackgroundReads();
    auto &curConn = CurrConn();
    if (curConn)
    {
@@ -708,6 +804,7 @@ void ProjectFileIO::RestoreConnection()
    }
 
    curConn = std::move(mPrevConn);
+   mAutoSaveParts = {};
    SetFileName(mPrevFileName);
    mTemporary = mPrevTemporary;
 
@@ -716,10 +813,12 @@ void ProjectFileIO::RestoreConnection()
 
 void ProjectFileIO::UseConnection(Connection &&conn, const FilePath &filePath)
 {
+   auto lock = DBConnection::ExcludeBackgroundReads();
    auto &curConn = CurrConn();
    wxASSERT(!curConn);
 
    curConn = std::move(conn);
+   mAutoSaveParts = {};
    SetFileName(filePath);
 }
 
@@ -836,7 +935,7 @@ bool ProjectFileIO::CheckVersion()
    // must be a new project file.
    if (wxStrtol<char **>(result, nullptr, 10) == 0)
    {
-      return InstallSchema(db);
+      return InstallSchema(db, "main", ProjectFileCompressSamples.Read());
    }
 
    // Check for our application ID
@@ -874,12 +973,15 @@ bool ProjectFileIO::CheckVersion()
    return true;
 }
 
-bool ProjectFileIO::InstallSchema(sqlite3 *db, const char *schema /* = "main" */)
+bool ProjectFileIO::InstallSchema(sqlite3 *db, const char *schema /* = "main" */,
+   bool encodeSamples /* = false */)
 {
    int rc;
 
    wxString sql;
    sql.Printf(ProjectFileSchema, ProjectFileID, BaseProjectFormatVersion.GetPacked());
+   if (encodeSamples)
+      sql += EncodedSamplesSchema;
    sql.Replace("<schema>", schema);
 
    rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
@@ -1102,8 +1204,9 @@ bool ProjectFileIO::CopyTo(const FilePath &destpath,
       return false;
    }
 
-   // Install our schema into the new database
-   if (!InstallSchema(db, "outbound"))
+   // Install our schema into the new database, storing samples as the
+   // source does, so that rows copy unchanged
+   if (!InstallSchema(db, "outbound", StoresEncodedSamples(db)))
    {
       // Message already set
       return false;
@@ -1209,6 +1312,10 @@ bool ProjectFileIO::CopyTo(const FilePath &destpath,
          }
       }
 
+      // Spectrogram tiles and hashes of the copied blocks are still good
+      SpectrumTileStore::CopyTiles(db, "outbound");
+      SampleBlockIndex::CopyIndex(db, "outbound");
+
       // Write the doc.
       //
       // If we're compacting a temporary project (user initiated from the File
@@ -1507,6 +1614,14 @@ void ProjectFileIO::Compact(
       }
    }
 
+   // Files that vacuum incrementally can delete unused blocks and release
+   // their pages in place, without copying all of the other blocks
+   if (CanVacuumIncrementally())
+   {
+      mWasCompacted = CompactInPlace(tracks);
+      return;
+   }
+
    wxString origName = mFileName;
    wxString backName = origName + "_compact_back";
    wxString tempName = origName + "_compact_temp";
@@ -1606,6 +1721,154 @@ void ProjectFileIO::Compact(
    return;
 }
 
+bool ProjectFileIO::CompactInPlace(
+   const std::vector<const TrackList *> &tracks)
+{
+   auto db = DB();
+
+   // Keep the same blocks, and write the same doc, that CopyTo() would
+   SampleBlockIDSet blockids;
+   for (auto trackList : tracks)
+      if (trackList)
+         InspectBlocks( *trackList, {}, &blockids );
+
+   ProjectSerializer doc;
+   WriteXMLHeader(doc);
+   WriteXML(doc, false, tracks.empty() ? nullptr : tracks[0]);
+
+   {
+      // Delete the blocks and replace the doc as one change
+      if (sqlite3_exec(db, "SAVEPOINT compact;", nullptr, nullptr, nullptr)
+         != SQLITE_OK)
+      {
+         SetDBError(
+            XO("Failed to update the project file.\nThe following command failed:\n\n%s")
+               .Format("SAVEPOINT compact;")
+         );
+         return false;
+      }
+
+      bool success = false;
+      auto cleanup = finally([&]
+      {
+         if (!success)
+         {
+            sqlite3_exec(db, "ROLLBACK TO compact;", nullptr, nullptr, nullptr);
+            sqlite3_exec(db, "RELEASE compact;", nullptr, nullptr, nullptr);
+         }
+      });
+
+      // Only prune sample blocks if we have a tracklist
+      if (!tracks.empty() && !DeleteBlocks(blockids, true))
+         return false;
+
+      if (!WriteDoc(IsTemporary() ? "autosave" : "project", doc))
+         return false;
+
+      if (!IsTemporary() && !AutoSaveDelete(db))
+         return false;
+
+      if (sqlite3_exec(db, "RELEASE compact;", nullptr, nullptr, nullptr)
+         != SQLITE_OK)
+      {
+         SetDBError(
+            XO("Failed to update the project file.\nThe following command failed:\n\n%s")
+               .Format("RELEASE compact;")
+         );
+         return false;
+      }
+      success = true;
+   }
+
+   // Release the free pages in bounded steps
+   const auto total = GetFreeUsage();
+   int64_t released = 0;
+   if (total > 0)
+   {
+      /* i18n-hint: This title appears on a dialog that indicates the progress
+         in doing something.*/
+      ProgressDialog progress(
+         XO("Progress"), XO("Compacting project"), pdlgHideStopButton);
+      while (released < total)
+      {
+         const auto bytes = IncrementalVacuum(CompactionStepPages);
+         if (bytes <= 0)
+            break;
+         released += bytes;
+         progress.Update(
+            static_cast<wxLongLong_t>(released),
+            static_cast<wxLongLong_t>(total));
+      }
+   }
+   wxLogMessage(wxT("Compaction released %lld bytes"),
+      static_cast<long long>(released));
+
+   // Shrink the file now, not at the next checkpoint
+   sqlite3_wal_checkpoint_v2(
+      db, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+
+   return true;
+}
+
+bool ProjectFileIO::CanVacuumIncrementally()
+{
+   // 2 is INCREMENTAL
+   int64_t mode = 0;
+   return GetValue("PRAGMA auto_vacuum;", mode, true) && mode == 2;
+}
+
+bool ProjectFileIO::StoresEncodedSamples(
+   sqlite3 *db, const char *schema /* = "main" */)
+{
+   const auto sql = wxString::Format(
+      "SELECT 1 FROM pragma_table_info('sampleblocks', '%s')"
+      "  WHERE name = 'codec';", schema);
+
+   sqlite3_stmt *stmt = nullptr;
+   if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+      return false;
+   const auto result = (sqlite3_step(stmt) == SQLITE_ROW);
+   sqlite3_finalize(stmt);
+   return result;
+}
+
+int64_t ProjectFileIO::IncrementalVacuum(int64_t maxPages)
+{
+   auto db = DB();
+
+   // Don't make the release part of another change that might roll back
+   if (!sqlite3_get_autocommit(db))
+      return 0;
+
+   const auto before = GetFreeUsage();
+   if (before <= 0)
+      return before;
+
+   const auto sql = wxString::Format(
+      "PRAGMA incremental_vacuum(%lld);",
+      static_cast<long long>(std::max<int64_t>(1, maxPages)));
+   const auto rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      wxLogDebug(wxT("ProjectFileIO::IncrementalVacuum - SQLITE error %s"),
+         sqlite3_errmsg(db));
+      return -1;
+   }
+
+   const auto after = GetFreeUsage();
+   return after < 0 ? -1 : before - after;
+}
+
+int64_t ProjectFileIO::GetFreeUsage()
+{
+   int64_t pages = 0;
+   int64_t pageSize = 0;
+   if (!GetValue("PRAGMA freelist_count;", pages, true) ||
+       !GetValue("PRAGMA page_size;", pageSize, true))
+      return -1;
+   return pages * pageSize;
+}
+
 bool ProjectFileIO::WasCompacted()
 {
    return mWasCompacted;
@@ -1618,6 +1881,8 @@ bool ProjectFileIO::HadUnused()
 
 void ProjectFileIO::UpdatePrefs()
 {
+   mIncrementalAutoSave = ProjectFileIncrementalAutoSave.Read();
+
    SetProjectTitle();
 }
 
@@ -1808,7 +2073,8 @@ void ProjectFileIO::WriteXMLHeader(XMLWriter &xmlFile) const
 
 void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
                              bool recording /* = false */,
-                             const TrackList *tracks /* = nullptr */)
+                             const TrackList *tracks /* = nullptr */,
+                             const std::function<void()> &markPart /* = {} */)
 // may throw
 {
    auto &proj = mProject;
@@ -1841,9 +2107,13 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
          // when pushing.  Don't auto-save it.
          return;
       }
+      if (markPart)
+         markPart();
       useTrack->WriteXML(xmlFile);
    });
 
+   if (markPart)
+      markPart();
    xmlFile.EndTag(wxT("project"));
 
    //TIMER_STOP( xml_writer_timer );
@@ -1853,9 +2123,29 @@ bool ProjectFileIO::AutoSave(bool recording)
 {
    ProjectSerializer autosave;
    WriteXMLHeader(autosave);
-   WriteXML(autosave, recording);
 
-   if (WriteDoc("autosave", autosave))
+   bool success = false;
+   if (mIncrementalAutoSave)
+   {
+      // Remember where each track begins, and where the last one ends
+      std::vector<size_t> marks;
+      WriteXML(autosave, recording, nullptr,
+         [&]{ marks.push_back(autosave.GetData().GetSize()); });
+
+      success = WriteAutoSaveParts(autosave, marks);
+   }
+   else
+   {
+      WriteXML(autosave, recording);
+
+      // Parts written before the preference changed would be loaded instead
+      TransactionScope transaction(mProject, "AutoSave");
+      success = DeleteAutoSaveParts(DB()) &&
+         WriteDoc("autosave", autosave) &&
+         transaction.Commit();
+   }
+
+   if (success)
    {
       mModified = true;
       return true;
@@ -1885,6 +2175,13 @@ bool ProjectFileIO::AutoSaveDelete(sqlite3 *db /* = nullptr */)
       return false;
    }
 
+   if (HasAutoSaveParts(db))
+   {
+      // The file may no longer need a newer version
+      if (!DeleteAutoSaveParts(db) || !WriteRequiredVersion(db, "main"))
+         return false;
+   }
+
    mModified = false;
 
    return true;
@@ -2041,7 +2338,8 @@ bool ProjectFileIO::WriteDoc(const char *table,
       ProjectFormatExtensionsRegistry::Get().GetRequiredVersion(mProject);
 
    const wxString setVersionSql =
-      wxString::Format("PRAGMA user_version = %u", requiredVersion.GetPacked());
+      wxString::Format("PRAGMA %s.user_version = %u",
+         schema, requiredVersion.GetPacked());
 
    if (!Query(setVersionSql.c_str(), [](auto...) { return 0; }))
    {
@@ -2055,6 +2353,325 @@ bool ProjectFileIO::WriteDoc(const char *table,
    return transaction.Commit();
 }
 
+bool ProjectFileIO::WriteAutoSaveParts(
+   const ProjectSerializer &autosave, const std::vector<size_t> &marks)
+{
+   wxASSERT(!marks.empty());
+
+   auto db = DB();
+
+   TransactionScope transaction(mProject, "UpdateProject");
+
+   const auto reportError = [this](auto sql) {
+      SetDBError(
+         XO("Failed to update the project file.\nThe following command failed:\n\n%s")
+            .Format(sql));
+   };
+
+   sqlite3_stmt *stmt = nullptr;
+   auto cleanup = finally([&]
+   {
+      if (stmt)
+      {
+         sqlite3_finalize(stmt);
+      }
+   });
+
+   // Prepare the statement, or report the failure
+   const auto prepare = [&](const char *sql)
+   {
+      if (stmt)
+         sqlite3_finalize(stmt);
+      stmt = nullptr;
+
+      int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+      if (rc != SQLITE_OK)
+      {
+         ADD_EXCEPTION_CONTEXT("sqlite3.query", sql);
+         ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+         ADD_EXCEPTION_CONTEXT(
+            "sqlite3.context", "ProjectFileIO::WriteAutoSaveParts::prepare");
+
+         SetDBError(
+            XO("Unable to prepare project file command:\n\n%s").Format(sql)
+         );
+         return false;
+      }
+      return true;
+   };
+
+   // Step the statement, or report the failure
+   const auto step = [&](const char *sql)
+   {
+      int rc = sqlite3_step(stmt);
+      if (rc != SQLITE_DONE)
+      {
+         ADD_EXCEPTION_CONTEXT("sqlite3.query", sql);
+         ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+         ADD_EXCEPTION_CONTEXT(
+            "sqlite3.context", "ProjectFileIO::WriteAutoSaveParts::step");
+
+         reportError(sql);
+         return false;
+      }
+      sqlite3_reset(stmt);
+      return true;
+   };
+
+   int rc = sqlite3_exec(db, AutoSavePartsSchema, nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT(
+         "sqlite3.context", "ProjectFileIO::WriteAutoSaveParts::schema");
+
+      reportError(AutoSavePartsSchema);
+      return false;
+   }
+
+   // Rows that the last write inserted may be reused only if that write was
+   // to this database, and was not rolled back since
+   auto &parts = mAutoSaveParts;
+   int64_t generation = 0;
+   GetValue("SELECT generation FROM main.autosavedoc WHERE id = 1;",
+      generation, true);
+   if (parts.db != db || parts.generation != generation)
+   {
+      parts = {};
+
+      const char *const deleteSql = "DELETE FROM main.autosavetracks;";
+      if (!prepare(deleteSql) || !step(deleteSql))
+         return false;
+   }
+   ++generation;
+
+   const auto data = static_cast<const char *>(autosave.GetData().GetData());
+   const auto size = autosave.GetData().GetSize();
+
+   // Find or insert the rows for the tracks
+   decltype(parts.rows) rows;
+   std::vector<int64_t> ids;
+   const char *const insertSql =
+      "INSERT INTO main.autosavetracks(doc) VALUES(?1);";
+   if (!prepare(insertSql))
+      return false;
+   for (size_t ii = 0; ii + 1 < marks.size(); ++ii)
+   {
+      std::string doc{ data + marks[ii], data + marks[ii + 1] };
+
+      // Identical to another track of this document?
+      if (auto iter = rows.find(doc); iter != rows.end())
+      {
+         ids.push_back(iter->second);
+         continue;
+      }
+
+      // Unchanged since the last write?
+      if (auto node = parts.rows.extract(doc))
+      {
+         ids.push_back(node.mapped());
+         rows.insert(std::move(node));
+         continue;
+      }
+
+      if (sqlite3_bind_blob64(stmt, 1, doc.data(), doc.size(), SQLITE_STATIC))
+      {
+         ADD_EXCEPTION_CONTEXT("sqlite3.query", insertSql);
+         ADD_EXCEPTION_CONTEXT(
+            "sqlite3.context", "ProjectFileIO::WriteAutoSaveParts::bind");
+
+         SetDBError(XO("Unable to bind to blob"));
+         return false;
+      }
+      if (!step(insertSql))
+         return false;
+      const auto id = sqlite3_last_insert_rowid(db);
+      ids.push_back(id);
+      rows.emplace(std::move(doc), id);
+   }
+
+   // Delete the rows of tracks that changed or went away
+   if (!parts.rows.empty())
+   {
+      const char *const deleteSql =
+         "DELETE FROM main.autosavetracks WHERE id = ?1;";
+      if (!prepare(deleteSql))
+         return false;
+      for (const auto &pair : parts.rows)
+      {
+         sqlite3_bind_int64(stmt, 1, pair.second);
+         if (!step(deleteSql))
+            return false;
+      }
+   }
+
+   // Write the rest of the document, which is small
+   const auto dict =
+      static_cast<const char *>(autosave.GetDict().GetData());
+   const auto dictSize = autosave.GetDict().GetSize();
+   const char *const docSql =
+      "INSERT INTO main.autosavedoc(id, generation, dict, head, tracks, tail)"
+      "       VALUES(1, ?1, ?2, ?3, ?4, ?5)"
+      "       ON CONFLICT(id) DO UPDATE SET generation = ?1, dict = ?2,"
+      "          head = ?3, tracks = ?4, tail = ?5;";
+   if (!prepare(docSql))
+      return false;
+   if (
+      sqlite3_bind_int64(stmt, 1, generation) ||
+      sqlite3_bind_blob64(stmt, 2, dict, dictSize, SQLITE_STATIC) ||
+      sqlite3_bind_blob64(stmt, 3, data, marks.front(), SQLITE_STATIC) ||
+      sqlite3_bind_blob64(stmt, 4, ids.data(),
+         ids.size() * sizeof(int64_t), SQLITE_STATIC) ||
+      sqlite3_bind_blob64(stmt, 5, data + marks.back(),
+         size - marks.back(), SQLITE_STATIC))
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.query", docSql);
+      ADD_EXCEPTION_CONTEXT(
+         "sqlite3.context", "ProjectFileIO::WriteAutoSaveParts::bind");
+
+      SetDBError(XO("Unable to bind to blob"));
+      return false;
+   }
+   if (!step(docSql))
+      return false;
+
+   // Finalize the statement before committing the transaction
+   sqlite3_finalize(stmt);
+   stmt = nullptr;
+
+   // The document in parts replaces any written whole
+   rc = sqlite3_exec(db, "DELETE FROM main.autosave;", nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT(
+         "sqlite3.context", "ProjectFileIO::WriteAutoSaveParts::delete");
+
+      reportError("DELETE FROM main.autosave;");
+      return false;
+   }
+
+   if (!WriteRequiredVersion(db, "main") || !transaction.Commit())
+   {
+      parts = {};
+      return false;
+   }
+
+   parts.db = db;
+   parts.generation = generation;
+   parts.rows = std::move(rows);
+
+   return true;
+}
+
+bool ProjectFileIO::DeleteAutoSaveParts(sqlite3 *db)
+{
+   mAutoSaveParts = {};
+
+   if (!HasAutoSaveParts(db))
+      return true;
+
+   int rc = sqlite3_exec(db,
+      "DELETE FROM main.autosavedoc;"
+      "DELETE FROM main.autosavetracks;",
+      nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT(
+         "sqlite3.context", "ProjectFileIO::DeleteAutoSaveParts");
+
+      SetDBError(
+         XO("Failed to remove the autosave information from the project file.")
+      );
+      return false;
+   }
+
+   return true;
+}
+
+bool ProjectFileIO::HasAutoSaveParts(sqlite3 *db)
+{
+   // Look in the schema first, to avoid logging an error for a missing table
+   bool result = false;
+   sqlite3_stmt *stmt = nullptr;
+   if (sqlite3_prepare_v2(db,
+      "SELECT 1 FROM main.sqlite_master"
+      "  WHERE type = 'table' AND name = 'autosavedoc';",
+      -1, &stmt, nullptr) == SQLITE_OK)
+      result = (sqlite3_step(stmt) == SQLITE_ROW);
+   sqlite3_finalize(stmt);
+   if (!result)
+      return false;
+
+   stmt = nullptr;
+   result = false;
+   if (sqlite3_prepare_v2(db,
+      "SELECT 1 FROM main.autosavedoc WHERE id = 1;",
+      -1, &stmt, nullptr) == SQLITE_OK)
+      result = (sqlite3_step(stmt) == SQLITE_ROW);
+   sqlite3_finalize(stmt);
+   return result;
+}
+
+bool ProjectFileIO::WriteRequiredVersion(sqlite3 *db, const char *schema)
+{
+   const auto requiredVersion =
+      ProjectFormatExtensionsRegistry::Get().GetRequiredVersion(mProject);
+
+   char sql[256];
+   sqlite3_snprintf(sizeof(sql), sql,
+      "PRAGMA %s.user_version = %u", schema, requiredVersion.GetPacked());
+
+   int rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.query", sql);
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT(
+         "sqlite3.context", "ProjectFileIO::WriteRequiredVersion");
+
+      SetDBError(
+         XO("Failed to update the project file.\nThe following command failed:\n\n%s")
+            .Format(sql));
+      return false;
+   }
+
+   return true;
+}
+
+// Get the blobs of the autosave document written in parts, in order
+static bool GetAutoSaveParts(sqlite3 *db,
+   std::vector<BufferedProjectBlobStream::Blob> &blobs)
+{
+   sqlite3_stmt *stmt = nullptr;
+   auto cleanup = finally([&]{ sqlite3_finalize(stmt); });
+
+   if (sqlite3_prepare_v2(db,
+      "SELECT ROWID, tracks FROM main.autosavedoc WHERE id = 1;",
+      -1, &stmt, nullptr) != SQLITE_OK ||
+      sqlite3_step(stmt) != SQLITE_ROW)
+      return false;
+
+   const int64_t rowID = sqlite3_column_int64(stmt, 0);
+   const auto tracks =
+      static_cast<const char *>(sqlite3_column_blob(stmt, 1));
+   const size_t count = sqlite3_column_bytes(stmt, 1) / sizeof(int64_t);
+
+   blobs.clear();
+   blobs.push_back({ "autosavedoc", "dict", rowID });
+   blobs.push_back({ "autosavedoc", "head", rowID });
+   for (size_t ii = 0; ii < count; ++ii)
+   {
+      int64_t id;
+      memcpy(&id, tracks + ii * sizeof(id), sizeof(id));
+      blobs.push_back({ "autosavetracks", "doc", id });
+   }
+   blobs.push_back({ "autosavedoc", "tail", rowID });
+
+   return true;
+}
+
 bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
 {
    auto now = std::chrono::high_resolution_clock::now();
@@ -2079,9 +2696,17 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
 
    int64_t rowId = -1;
 
-   bool useAutosave =
+   // An autosave document written in parts replaces any written whole
+   std::vector<BufferedProjectBlobStream::Blob> parts;
+   const bool useParts =
       !ignoreAutosave &&
-      GetValue("SELECT ROWID FROM main.autosave WHERE id = 1;", rowId, true);
+      HasAutoSaveParts(DB()) &&
+      GetAutoSaveParts(DB(), parts);
+
+   bool useAutosave =
+      useParts ||
+      (!ignoreAutosave &&
+      GetValue("SELECT ROWID FROM main.autosave WHERE id = 1;", rowId, true));
 
    int64_t rowsCount = 0;
    // If we didn't have an autosave doc, load the project doc instead
@@ -2105,10 +2730,14 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
    else
    {
       // Load 'er up
-      BufferedProjectBlobStream stream(
-         DB(), "main", useAutosave ? "autosave" : "project", rowId);
+      std::optional<BufferedProjectBlobStream> stream;
+      if (useParts)
+         stream.emplace(DB(), "main", std::move(parts));
+      else
+         stream.emplace(
+            DB(), "main", useAutosave ? "autosave" : "project", rowId);
 
-      success = ProjectSerializer::Decode(stream, this);
+      success = ProjectSerializer::Decode(*stream, this);
 
       if (!success)
       {
@@ -12,7 +12,10 @@ Paul Licameli split from AudacityProject.h
 #define __AUDACITY_PROJECT_FILE_IO__
 
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <wx/event.h>
 
@@ -44,6 +47,14 @@ using Connection = std::unique_ptr<DBConnection>;
 
 using BlockIDs = std::unordered_set<SampleBlockID>;
 
+//! Whether new project files store sample blocks encoded, so that they are
+//! smaller, but can't be opened by versions before 3.2
+extern AUDACITY_DLL_API BoolSetting ProjectFileCompressSamples;
+
+//! Whether autosave rewrites only the tracks that changed, so that it is
+//! faster for big projects, but versions before 3.2 can't recover the file
+extern AUDACITY_DLL_API BoolSetting ProjectFileIncrementalAutoSave;
+
 // An event processed by the project in the main thread after a checkpoint
 // failure was detected in a worker thread
 wxDECLARE_EXPORTED_EVENT( AUDACITY_DLL_API,
@@ -183,6 +194,25 @@ public:
    // The last compact check did actually compact the project file if true
    bool WasCompacted();
 
+   // Whether the file can release free pages in place, by
+   // IncrementalVacuum(), rather than only when compaction copies it
+   bool CanVacuumIncrementally();
+
+   // Release up to maxPages free pages from the file, unless a transaction
+   // is in progress; return the bytes released, or negative for failure
+   int64_t IncrementalVacuum(int64_t maxPages);
+
+   // Return the bytes in free pages of the file, or negative for failure
+   int64_t GetFreeUsage();
+
+   // Whether the sampleblocks table of the schema has the columns for
+   // encoded samples; fixed when the table is made
+   static bool StoresEncodedSamples(sqlite3 *db, const char *schema = "main");
+
+   // Whether the file has an autosave document written in parts by
+   // AutoSave() with incremental autosave enabled
+   static bool HasAutoSaveParts(sqlite3 *db);
+
    // The last compact check found unused blocks in the project file
    bool HadUnused();
 
@@ -207,8 +237,11 @@ private:
    void OnCheckpointFailure();
 
    void WriteXMLHeader(XMLWriter &xmlFile) const;
+   // markPart, if not empty, is called before each track is written, and
+   // before the end of the document
    void WriteXML(XMLWriter &xmlFile, bool recording = false,
-      const TrackList *tracks = nullptr) /* not override */;
+      const TrackList *tracks = nullptr,
+      const std::function<void()> &markPart = {}) /* not override */;
 
    // XMLTagHandler callback methods
    bool HandleXMLTag(const std::string_view& tag, const AttributesList &attrs) override;
@@ -245,11 +278,23 @@ private:
    bool GetValue(const char *sql, int64_t &value, bool silent = false);
 
    bool CheckVersion();
-   bool InstallSchema(sqlite3 *db, const char *schema = "main");
+   bool InstallSchema(
+      sqlite3 *db, const char *schema = "main", bool encodeSamples = false);
 
    // Write project or autosave XML (binary) documents
    bool WriteDoc(const char *table, const ProjectSerializer &autosave, const char *schema = "main");
 
+   // Write the autosave document in parts, divided at the given offsets of
+   // the data, rewriting only the tracks that changed since the last time
+   bool WriteAutoSaveParts(
+      const ProjectSerializer &autosave, const std::vector<size_t> &marks);
+
+   // Delete any autosave document written in parts
+   bool DeleteAutoSaveParts(sqlite3 *db);
+
+   // Set the user_version of the schema to what the project requires
+   bool WriteRequiredVersion(sqlite3 *db, const char *schema);
+
    // Application defined function to verify blockid exists is in set of blockids
    static void InSet(sqlite3_context *context, int argc, sqlite3_value **argv);
 
@@ -276,6 +321,9 @@ private:
 
    bool ShouldCompact(const std::vector<const TrackList *> &tracks);
 
+   // Delete unused blocks, then release free pages with IncrementalVacuum()
+   bool CompactInPlace(const std::vector<const TrackList *> &tracks);
+
    // Gets values from SQLite B-tree structures
    static unsigned int get2(const unsigned char *ptr);
    static unsigned int get4(const unsigned char *ptr);
@@ -307,6 +355,18 @@ private:
    // Project had unused blocks during last Compact()
    bool mHadUnused;
 
+   // Cached preference
+   bool mIncrementalAutoSave;
+
+   // What the last write of autosave parts stored, so that unchanged
+   // tracks need not be written again
+   struct AutoSaveParts {
+      sqlite3 *db{};
+      int64_t generation{};
+      // Encoded track subtrees, and their rows in autosavetracks
+      std::unordered_map<std::string, int64_t> rows;
+   } mAutoSaveParts;
+
    Connection mPrevConn;
    FilePath mPrevFileName;
    bool mPrevTemporary;
@@ -16,13 +16,16 @@ Paul Licameli split from AudacityProject.cpp
 #include <wx/evtloop.h>
 #endif
 
+#include <wx/app.h>
 #include <wx/frame.h>
 #include <wx/log.h>
+#include "AudacityException.h"
 #include "BasicUI.h"
 #include "CodeConversions.h"
 #include "Legacy.h"
 #include "PlatformCompatibility.h"
 #include "Project.h"
+#include "ProjectAudioIO.h"
 #include "ProjectFileIO.h"
 #include "ProjectFSCK.h"
 #include "ProjectHistory.h"
@@ -32,11 +35,13 @@ Paul Licameli split from AudacityProject.cpp
 #include "ProjectSettings.h"
 #include "ProjectStatus.h"
 #include "ProjectWindow.h"
+#include "SampleBlockWriter.h"
 #include "SelectFile.h"
 #include "SelectUtilities.h"
 #include "SelectionState.h"
 #include "Tags.h"
 #include "TempDirectory.h"
+#include "ThreadPool.h"
 #include "TrackPanelAx.h"
 #include "TrackPanel.h"
 #include "UndoManager.h"
@@ -46,9 +51,11 @@ Paul Licameli split from AudacityProject.cpp
 #include "export/Export.h"
 #include "import/Import.h"
 #include "import/ImportMIDI.h"
+#include "import/ImportPlugin.h"
 #include "toolbars/SelectionBar.h"
 #include "widgets/AudacityMessageBox.h"
 #include "widgets/FileHistory.h"
+#include "widgets/ProgressDialog.h"
 #include "widgets/UnwritableLocationErrorDialog.h"
 #include "widgets/Warning.h"
 #include "widgets/wxPanelWrapper.h"
@@ -56,6 +63,9 @@ Paul Licameli split from AudacityProject.cpp
 
 #include "HelpText.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <optional>
 
 static const AudacityProject::AttachedObjects::RegisteredFactory sFileManagerKey{
@@ -1331,6 +1341,149 @@ bool ProjectFileManager::Import(
    return true;
 }
 
+BoolSetting ImportConcurrently{ L"/Performance/ImportConcurrently", false };
+
+bool ProjectFileManager::Import(
+   const FilePaths &fileNames, bool addToHistory /* = true */)
+{
+   if (ImportConcurrently.Read() && fileNames.size() > 1)
+      return DoImportConcurrently(fileNames, addToHistory);
+
+   bool result = true;
+   for (const auto &fileName : fileNames)
+      result = Import(fileName, addToHistory) && result;
+   return result;
+}
+
+bool ProjectFileManager::DoImportConcurrently(
+   const FilePaths &fileNames, bool addToHistory)
+{
+   using namespace BasicUI;
+   auto &project = mProject;
+   auto &trackFactory = WaveTrackFactory::Get( project );
+
+   struct File {
+      std::unique_ptr<ImportFileHandle> pHandle;
+      std::shared_ptr<Tags> pTags;
+      TrackHolders tracks;
+      //! Fraction of the file done, written by the worker thread
+      std::atomic<double> done{ 0.0 };
+      ProgressResult result{ ProgressResult::Cancelled };
+   };
+
+   // What the importers are told by the reports of their progress
+   std::atomic<ProgressResult> state{ ProgressResult::Success };
+   std::vector<File> files(fileNames.size());
+   std::vector<File*> tasks;
+
+   {
+      auto cleanup = valueRestorer( project.mbBusyImporting, true );
+
+      // Open the files and read preferences in this thread
+      for (size_t ii = 0; ii < files.size(); ++ii) {
+         auto &file = files[ii];
+         file.pHandle = Importer::Get().OpenForTask(project, fileNames[ii]);
+         if (!file.pHandle)
+            continue;
+         // Receives only the tags of this file, to be merged later
+         file.pTags = std::make_shared<Tags>();
+         file.pTags->Clear();
+         file.pHandle->SetProgressReport(
+            [&file, &state](double current, double total){
+               file.done.store(total > 0 ? std::min(1.0, current / total) : 0,
+                  std::memory_order_relaxed);
+               return state.load(std::memory_order_relaxed);
+            });
+         tasks.push_back(&file);
+      }
+
+      if (!tasks.empty()) {
+         // Insert the new sample blocks in transactions of many rows
+         auto &writer = SampleBlockWriter::Get( project );
+         const bool started = !writer.IsActive() && writer.Start();
+         auto stop = finally( [&]{
+            // Rows that fail to be inserted remain queued, and are inserted
+            // later with the usual error reporting
+            if (started)
+               GuardedCall( [&]{ writer.Stop(); } );
+         } );
+
+         ProgressDialog progress{ XO("Import"),
+            XP("Importing %d file", "Importing %d files", 0)(
+               static_cast<int>(tasks.size()) ) };
+
+         ThreadPool::Get().ParallelFor(tasks.size(),
+            [&](size_t index, size_t){
+               auto &file = *tasks[index];
+               // Don't begin more files after the user stopped or cancelled
+               if (state.load(std::memory_order_relaxed) !=
+                   ProgressResult::Success)
+                  return;
+               try {
+                  file.result = file.pHandle->Import(
+                     &trackFactory, file.tracks, file.pTags.get());
+               }
+               catch (...) {
+                  // Stop the other files; ParallelFor rethrows
+                  state.store(ProgressResult::Cancelled);
+                  throw;
+               }
+               file.done.store(1.0, std::memory_order_relaxed);
+            },
+            [&]{
+               double done = 0;
+               for (auto pFile : tasks)
+                  done += pFile->done.load(std::memory_order_relaxed);
+               const auto result =
+                  progress.Update(done, static_cast<double>(tasks.size()));
+               if (result != ProgressResult::Success)
+                  state.store(result);
+            },
+            std::chrono::milliseconds{ 50 });
+      }
+   }
+
+   // Add the tracks in the order of the files, as if imported one at a time
+   bool result = true;
+   for (size_t ii = 0; ii < files.size(); ++ii) {
+      auto &file = files[ii];
+      const auto &fileName = fileNames[ii];
+      // Close the file
+      file.pHandle.reset();
+
+      auto &tracks = file.tracks;
+      tracks.erase( std::remove_if( tracks.begin(), tracks.end(),
+         std::mem_fn( &WaveTrackArray::empty ) ), tracks.end() );
+
+      const bool imported = !tracks.empty() &&
+         (file.result == ProgressResult::Success ||
+          file.result == ProgressResult::Stopped);
+      if (!imported) {
+         const bool retry = file.pTags
+            // Let Import() try the other plugins, and report errors
+            ? (file.result == ProgressResult::Failed ||
+               file.result == ProgressResult::Success)
+            // Import the files not opened for a task, unless the user
+            // stopped or cancelled
+            : state.load() == ProgressResult::Success;
+         result = retry && Import(fileName, addToHistory) && result;
+         continue;
+      }
+
+      auto newTags = Tags::Get( project ).Duplicate();
+      newTags->Merge( *file.pTags );
+      Tags::Set( project, newTags );
+
+      if (addToHistory)
+         FileHistory::Global().Append(fileName);
+
+      // PRL: Undo history is incremented inside this:
+      AddImportedTracks(fileName, std::move(tracks));
+   }
+
+   return result;
+}
+
 #include "Clipboard.h"
 #include "ShuttleGui.h"
 #include "widgets/HelpSystem.h"
@@ -1462,3 +1615,79 @@ void ProjectFileManager::Compact()
          XO("Compact") );
    }
 }
+
+BoolSetting ProjectFileIdleVacuum{ L"/Performance/IdleVacuum", true };
+
+namespace {
+//! Releases free pages of the project file a few at a time, while the
+//! project is idle
+class IdleVacuumWorker final
+   : public ClientData::Base
+{
+public:
+   explicit IdleVacuumWorker( AudacityProject &project );
+   ~IdleVacuumWorker();
+
+   void OnIdle(wxIdleEvent &evt);
+
+private:
+   //! Pages released by each step, bounding the time taken from the UI
+   static constexpr int64_t StepPages = 32;
+   //! Pause between checks, when there was nothing to release
+   static constexpr std::chrono::seconds Interval{ 1 };
+
+   AudacityProject &mProject;
+   std::chrono::steady_clock::time_point mNextCheck{};
+   //! Bytes released since the last report
+   int64_t mReleased{ 0 };
+};
+
+static const AudacityProject::AttachedObjects::RegisteredFactory
+sIdleVacuumWorkerKey{
+   []( AudacityProject &project ){
+      return std::make_shared< IdleVacuumWorker >( project );
+   }
+};
+
+IdleVacuumWorker::IdleVacuumWorker( AudacityProject &project )
+   : mProject{ project }
+{
+   wxTheApp->Bind(wxEVT_IDLE, &IdleVacuumWorker::OnIdle, this);
+}
+
+IdleVacuumWorker::~IdleVacuumWorker()
+{
+   wxTheApp->Unbind(wxEVT_IDLE, &IdleVacuumWorker::OnIdle, this);
+}
+
+void IdleVacuumWorker::OnIdle(wxIdleEvent &evt)
+{
+   evt.Skip();
+
+   const auto now = std::chrono::steady_clock::now();
+   if (now < mNextCheck)
+      return;
+   mNextCheck = now + Interval;
+
+   // Don't open a connection, and don't compete with recording for the disk
+   auto &projectFileIO = ProjectFileIO::Get( mProject );
+   if (!ProjectFileIdleVacuum.Read() ||
+       !projectFileIO.HasConnection() ||
+       ProjectAudioIO::Get( mProject ).IsAudioActive() ||
+       !projectFileIO.CanVacuumIncrementally())
+      return;
+
+   const auto bytes = projectFileIO.IncrementalVacuum(StepPages);
+   if (bytes > 0) {
+      mReleased += bytes;
+      // Continue at the next idle time
+      mNextCheck = now;
+   }
+   else if (mReleased > 0) {
+      ProjectStatus::Get( mProject ).Set(
+         XO("Released %s of unused space in the project file")
+            .Format( Internat::FormatSize( mReleased ) ) );
+      mReleased = 0;
+   }
+}
+}
@@ -21,6 +21,7 @@ Paul Licameli split from AudacityProject.h
 class wxString;
 class wxFileName;
 class AudacityProject;
+class BoolSetting;
 class Track;
 class TrackList;
 class WaveTrack;
@@ -29,6 +30,12 @@ class XMLTagHandler;
 using WaveTrackArray = std::vector < std::shared_ptr < WaveTrack > >;
 using TrackHolders = std::vector< WaveTrackArray >;
 
+//! Whether free pages of the project file are released while it is idle
+extern AUDACITY_DLL_API BoolSetting ProjectFileIdleVacuum;
+
+//! Whether several files imported together are decoded concurrently
+extern AUDACITY_DLL_API BoolSetting ImportConcurrently;
+
 class AUDACITY_DLL_API ProjectFileManager final
    : public ClientData::Base
 {
@@ -98,6 +105,12 @@ public:
    bool Import(const FilePath &fileName,
                bool addToHistory = true);
 
+   //! Import the files in order, as by the other overload, but decode them
+   //! concurrently if ImportConcurrently is on
+   /*! @return whether all were imported */
+   bool Import(const FilePaths &fileNames,
+               bool addToHistory = true);
+
    void Compact();
 
    void AddImportedTracks(const FilePath &fileName,
@@ -107,6 +120,8 @@ public:
    void SetMenuClose(bool value) { mMenuClose = value; }
 
 private:
+   bool DoImportConcurrently(const FilePaths &fileNames, bool addToHistory);
+
    /*!
     @param fileName a path assumed to exist and contain an .aup3 project
     @param addtohistory whether to add the file to the MRU list
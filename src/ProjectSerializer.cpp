@@ -542,15 +542,16 @@ bool ProjectSerializer::Decode(BufferedStreamReader& in, XMLTagHandler* handler)
    mIds.clear();
 
    struct Error{}; // exception type for short-range try/catch
+   // Names are looked up for every tag and attribute, so index a vector
+   // rather than hash
    auto Lookup = [&mIds]( UShort id ) -> std::string_view
    {
-      auto iter = mIds.find( id );
-      if (iter == mIds.end())
+      if (id >= mIds.size() || mIds[id].empty())
       {
          throw Error{};
       }
 
-      return iter->second;
+      return mIds[id];
    };
 
    int64_t stringsCount = 0;
@@ -558,18 +559,26 @@ bool ProjectSerializer::Decode(BufferedStreamReader& in, XMLTagHandler* handler)
 
    auto ReadString = [&mCharSize, &in, &bytes, &stringsCount, &stringsLength](int len) -> std::string
    {
-      bytes.reserve( len );
-      auto data = bytes.data();
-      in.Read( data, len );
+      if (len < 0)
+         throw Error{};
 
       stringsCount++;
       stringsLength += len;
-      
-      switch (mCharSize)
+
+      if (mCharSize == 1)
       {
-         case 1:
-            return std::string(bytes.data(), len);
+         // No conversion, so read into the result without another copy
+         std::string result(len, '\0');
+         in.Read( result.data(), len );
+         return result;
+      }
 
+      if (bytes.size() < size_t(len))
+         bytes.resize( len );
+      in.Read( bytes.data(), len );
+
+      switch (mCharSize)
+      {
          case 2:
             return FastStringConvert<char16_t>(bytes.data(), len);
 
@@ -610,6 +619,8 @@ bool ProjectSerializer::Decode(BufferedStreamReader& in, XMLTagHandler* handler)
             {
                id = ReadUShort( in );
                auto len = ReadUShort( in );
+               if (id >= mIds.size())
+                  mIds.resize(id + 1);
                mIds[id] = ReadString(len);
             }
             break;
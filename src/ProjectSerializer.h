@@ -18,6 +18,7 @@
 
 #include <unordered_set>
 #include <unordered_map>
+#include <vector>
 
 #include "Identifier.h"
 
@@ -30,7 +31,8 @@ class BufferedStreamReader;
 ///
 
 using NameMap = std::unordered_map<wxString, unsigned short>;
-using IdMap = std::unordered_map<unsigned short, std::string>;
+// Names indexed by id; empty for ids not yet defined
+using IdMap = std::vector<std::string>;
 
 // This class's overrides do NOT throw AudacityException.
 class AUDACITY_DLL_API ProjectSerializer final : public XMLWriter
@@ -63,6 +63,12 @@ AUDACITY_DLL_API const wxWindow &GetProjectPanel(
    return *ptr;
 }
 
+wxWindow *FindProjectPanel( AudacityProject *project ) {
+   if (!project)
+      return nullptr;
+   return ProjectWindows::Get(*project).mPanel;
+}
+
 AUDACITY_DLL_API void SetProjectPanel(
    AudacityProject &project, wxWindow &panel )
 {
@@ -43,6 +43,10 @@ AUDACITY_DLL_API wxWindow &GetProjectPanel( AudacityProject &project );
 AUDACITY_DLL_API const wxWindow &GetProjectPanel(
    const AudacityProject &project );
 
+///\brief Get a pointer to the panel associated with a project, or null if
+/// the given pointer is null, or the panel was not yet set or was destroyed.
+AUDACITY_DLL_API wxWindow *FindProjectPanel( AudacityProject *project );
+
 AUDACITY_DLL_API void SetProjectPanel(
    AudacityProject &project, wxWindow &panel );
 AUDACITY_DLL_API void SetProjectFrame(
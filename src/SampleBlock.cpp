@@ -23,6 +23,10 @@ SampleBlockFactoryPtr SampleBlockFactory::New( AudacityProject &project )
 
 SampleBlockFactory::~SampleBlockFactory() = default;
 
+void SampleBlockFactory::Preload(const SampleBlockPtrs &)
+{
+}
+
 SampleBlockPtr SampleBlockFactory::Create(constSamplePtr src,
    size_t numsamples,
    sampleFormat srcformat)
@@ -15,6 +15,7 @@ SampleBlock.h
 #include <functional>
 #include <memory>
 #include <unordered_set>
+#include <vector>
 
 #include "XMLTagHandler.h"
 
@@ -138,6 +139,17 @@ public:
    /*! @return ids of all sample blocks created by this factory and still extant */
    virtual SampleBlockIDs GetActiveBlockIDs() = 0;
 
+   using SampleBlockPtrs = std::vector<SampleBlockPtr>;
+   //! Hint that the contents of several blocks will soon be read in sequence
+   /*!
+    Implementations may fetch them all in fewer operations on the storage than
+    separate calls to SampleBlock::GetSamples() would need.  Non-throwing:
+    failures are ignored, and reported later when the blocks are read.
+    The default does nothing.
+    @param blocks must have been created by this factory
+    */
+   virtual void Preload(const SampleBlockPtrs &blocks);
+
 protected:
    // The override should throw more informative exceptions on error than the
    // default InconsistencyException thrown by Create
@@ -0,0 +1,166 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCache.cpp
+
+**********************************************************************/
+
+#include "SampleBlockCache.h"
+
+#include <algorithm>
+
+#include "Project.h"
+
+IntSetting SampleBlockCacheSize{ L"/Performance/SampleBlockCacheMB", 64 };
+
+namespace {
+size_t CapacityFromPrefs()
+{
+   return std::max(0, SampleBlockCacheSize.Read()) * size_t(1024 * 1024);
+}
+}
+
+static const AudacityProject::AttachedObjects::RegisteredFactory
+sSampleBlockCacheKey{
+   []( AudacityProject & ){
+      return std::make_shared< SampleBlockCache >( CapacityFromPrefs() );
+   }
+};
+
+SampleBlockCache &SampleBlockCache::Get( AudacityProject &project )
+{
+   return project.AttachedObjects::Get< SampleBlockCache >(
+      sSampleBlockCacheKey );
+}
+
+const SampleBlockCache &SampleBlockCache::Get( const AudacityProject &project )
+{
+   return Get( const_cast< AudacityProject & >( project ) );
+}
+
+SampleBlockCache::SampleBlockCache(size_t capacity)
+   : mCapacity{ capacity }
+{
+}
+
+SampleBlockCache::~SampleBlockCache() = default;
+
+bool SampleBlockCache::IsEnabled() const
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return mCapacity > 0;
+}
+
+auto SampleBlockCache::Find(SampleBlockID id) -> Blob
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   auto iter = mIndex.find(id);
+   if (iter == mIndex.end()) {
+      ++mMisses;
+      return {};
+   }
+   ++mHits;
+   // Move to the front without invalidating iterators
+   mList.splice(mList.begin(), mList, iter->second);
+   return iter->second->second;
+}
+
+bool SampleBlockCache::Contains(SampleBlockID id) const
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return mIndex.count(id) > 0;
+}
+
+void SampleBlockCache::Insert(SampleBlockID id, Blob blob)
+{
+   if (!blob)
+      return;
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   const auto size = blob->size();
+   if (size > mCapacity)
+      return;
+
+   auto iter = mIndex.find(id);
+   if (iter != mIndex.end()) {
+      // Another thread may have loaded the same block concurrently
+      auto &entry = *iter->second;
+      mBytes -= entry.second->size();
+      entry.second = std::move(blob);
+      mList.splice(mList.begin(), mList, iter->second);
+   }
+   else {
+      mList.emplace_front(id, std::move(blob));
+      mIndex.emplace(id, mList.begin());
+   }
+   mBytes += size;
+   Trim();
+}
+
+void SampleBlockCache::Invalidate(SampleBlockID id)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   auto iter = mIndex.find(id);
+   if (iter == mIndex.end())
+      return;
+   mBytes -= iter->second->second->size();
+   mList.erase(iter->second);
+   mIndex.erase(iter);
+}
+
+void SampleBlockCache::Clear()
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   mList.clear();
+   mIndex.clear();
+   mBytes = 0;
+}
+
+void SampleBlockCache::SetCapacity(size_t capacity)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   mCapacity = capacity;
+   Trim();
+}
+
+size_t SampleBlockCache::GetCapacity() const
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return mCapacity;
+}
+
+auto SampleBlockCache::GetStatistics() const -> Statistics
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   Statistics result;
+   result.hits = mHits;
+   result.misses = mMisses;
+   result.evictions = mEvictions;
+   result.entries = mIndex.size();
+   result.bytes = mBytes;
+   result.capacity = mCapacity;
+   return result;
+}
+
+void SampleBlockCache::ResetStatistics()
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   mHits = mMisses = mEvictions = 0;
+}
+
+void SampleBlockCache::UpdatePrefs()
+{
+   SetCapacity(CapacityFromPrefs());
+}
+
+void SampleBlockCache::Trim()
+{
+   while (mBytes > mCapacity && !mList.empty()) {
+      auto &entry = mList.back();
+      mBytes -= entry.second->size();
+      mIndex.erase(entry.first);
+      mList.pop_back();
+      ++mEvictions;
+   }
+}
@@ -0,0 +1,115 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCache.h
+@brief Bounded, thread-safe LRU cache of sample block contents
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_BLOCK_CACHE__
+#define __AUDACITY_SAMPLE_BLOCK_CACHE__
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ClientData.h"
+#include "Prefs.h"
+#include "SampleBlock.h" // for SampleBlockID
+
+class AudacityProject;
+
+//! Capacity of the per-project cache, in megabytes; zero disables it
+extern AUDACITY_DLL_API IntSetting SampleBlockCacheSize;
+
+//! Holds recently read sample blobs of one project, keyed by block id
+/*!
+ Blobs are stored as they are in the database, but decoded, in the sample
+ format of the block, so that hits cost no more than a copy and format
+ conversion.
+
+ Entries must be invalidated when their blocks are deleted, because the
+ database may reuse the row id of a deleted block.
+
+ All member functions may be called from any thread.
+ */
+class AUDACITY_DLL_API SampleBlockCache final
+   : public ClientData::Base
+   , public std::enable_shared_from_this<SampleBlockCache>
+   , public PrefsListener
+{
+public:
+   using Blob = std::shared_ptr<const std::vector<char>>;
+
+   struct Statistics {
+      unsigned long long hits{ 0 };
+      unsigned long long misses{ 0 };
+      unsigned long long evictions{ 0 };
+      size_t entries{ 0 };
+      size_t bytes{ 0 };
+      size_t capacity{ 0 };
+   };
+
+   static SampleBlockCache &Get( AudacityProject &project );
+   static const SampleBlockCache &Get( const AudacityProject &project );
+
+   //! @param capacity in bytes
+   explicit SampleBlockCache(size_t capacity);
+   SampleBlockCache( const SampleBlockCache & ) PROHIBITED;
+   SampleBlockCache &operator=( const SampleBlockCache & ) PROHIBITED;
+   ~SampleBlockCache() override;
+
+   //! Whether the capacity is nonzero
+   bool IsEnabled() const;
+
+   //! Find the blob for a block, counting a hit or a miss
+   /*! @return null for a miss */
+   Blob Find(SampleBlockID id);
+
+   //! Test for presence without counting or changing recency
+   bool Contains(SampleBlockID id) const;
+
+   //! Store a blob, becoming the most recently used; may evict others
+   /*! Blobs larger than the whole capacity are not stored */
+   void Insert(SampleBlockID id, Blob blob);
+
+   //! Forget the blob for a block, if present
+   void Invalidate(SampleBlockID id);
+
+   void Clear();
+
+   //! @param capacity in bytes
+   void SetCapacity(size_t capacity);
+   //! @return capacity in bytes
+   size_t GetCapacity() const;
+
+   Statistics GetStatistics() const;
+   void ResetStatistics();
+
+private:
+   void UpdatePrefs() override;
+
+   //! Evict least recently used entries until within capacity
+   /*! @pre mMutex is locked */
+   void Trim();
+
+   mutable std::mutex mMutex;
+
+   using Entry = std::pair<SampleBlockID, Blob>;
+   //! Front is most recently used
+   using LRUList = std::list<Entry>;
+   LRUList mList;
+   std::unordered_map<SampleBlockID, LRUList::iterator> mIndex;
+
+   size_t mBytes{ 0 };
+   size_t mCapacity;
+
+   unsigned long long mHits{ 0 };
+   unsigned long long mMisses{ 0 };
+   unsigned long long mEvictions{ 0 };
+};
+
+#endif
@@ -0,0 +1,215 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockIndex.cpp
+
+**********************************************************************/
+
+#include "SampleBlockIndex.h"
+
+#include <cstring>
+#include <sqlite3.h>
+#include <wx/log.h>
+#include <wx/string.h>
+
+#include "DBConnection.h"
+#include "Project.h"
+
+BoolSetting SampleBlockDeduplication{
+   L"/Performance/DeduplicateSampleBlocks", false };
+
+namespace {
+// Triggers on sampleblocks must name tables of the same schema without
+// qualification.
+const char *const Schema =
+   "CREATE TABLE IF NOT EXISTS <schema>.sampleblockhashes"
+   "("
+   "  blockid              INTEGER PRIMARY KEY,"
+   "  hash                 INTEGER NOT NULL"
+   ");"
+   ""
+   "CREATE INDEX IF NOT EXISTS <schema>.sampleblockhashes_hash"
+   "  ON sampleblockhashes (hash);"
+   ""
+   "CREATE TRIGGER IF NOT EXISTS <schema>.sampleblockhashes_blockdeleted"
+   "  AFTER DELETE ON sampleblocks"
+   "  BEGIN"
+   "    DELETE FROM sampleblockhashes WHERE blockid = OLD.blockid;"
+   "  END;";
+
+const char *const CopySQL =
+   "INSERT INTO <schema>.sampleblockhashes"
+   "  SELECT * FROM main.sampleblockhashes"
+   "  WHERE blockid IN (SELECT blockid FROM <schema>.sampleblocks);";
+
+const char *const FindSQL =
+   "SELECT blockid FROM sampleblockhashes WHERE hash = ?1;";
+
+const char *const InsertSQL =
+   "INSERT OR REPLACE INTO sampleblockhashes (blockid, hash)"
+   "  VALUES (?1, ?2);";
+
+//! Finalizer of MurmurHash3
+uint64_t Mix(uint64_t value)
+{
+   value ^= value >> 33;
+   value *= 0xff51afd7ed558ccdULL;
+   value ^= value >> 33;
+   value *= 0xc4ceb9fe1a85ec53ULL;
+   value ^= value >> 33;
+   return value;
+}
+}
+
+static const AudacityProject::AttachedObjects::RegisteredFactory
+sSampleBlockIndexKey{
+   []( AudacityProject &project ){
+      return std::make_shared< SampleBlockIndex >(
+         ConnectionPtr::Get( project ).shared_from_this() );
+   }
+};
+
+SampleBlockIndex &SampleBlockIndex::Get( AudacityProject &project )
+{
+   return project.AttachedObjects::Get< SampleBlockIndex >(
+      sSampleBlockIndexKey );
+}
+
+const SampleBlockIndex &SampleBlockIndex::Get( const AudacityProject &project )
+{
+   return Get( const_cast< AudacityProject & >( project ) );
+}
+
+uint64_t SampleBlockIndex::Hash(
+   constSamplePtr src, size_t numsamples, sampleFormat format)
+{
+   const auto bytes = numsamples * SAMPLE_SIZE(format);
+   auto hash = Mix(bytes ^ (static_cast<uint64_t>(format) << 32));
+
+   size_t ii = 0;
+   for (; ii + sizeof(uint64_t) <= bytes; ii += sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, src + ii, sizeof word);
+      hash = (hash ^ Mix(word)) * 0x9e3779b97f4a7c15ULL;
+   }
+   if (ii < bytes) {
+      uint64_t word = 0;
+      memcpy(&word, src + ii, bytes - ii);
+      hash = (hash ^ Mix(word)) * 0x9e3779b97f4a7c15ULL;
+   }
+   return Mix(hash);
+}
+
+SampleBlockIndex::SampleBlockIndex(
+   const std::shared_ptr<ConnectionPtr> &ppConnection)
+   : mppConnection{ ppConnection }
+   , mEnabled{ SampleBlockDeduplication.Read() }
+{
+}
+
+SampleBlockIndex::~SampleBlockIndex() = default;
+
+bool SampleBlockIndex::IsEnabled() const
+{
+   return mEnabled.load(std::memory_order_relaxed);
+}
+
+void SampleBlockIndex::UpdatePrefs()
+{
+   mEnabled.store(SampleBlockDeduplication.Read());
+}
+
+DBConnection *SampleBlockIndex::Conn()
+{
+   const auto pConn = mppConnection->mpConnection.get();
+   if (!pConn)
+      return nullptr;
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   const auto db = pConn->DB();
+   if (db != mDB) {
+      wxString sql{ Schema };
+      sql.Replace("<schema>", "main");
+      if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+         wxLogDebug(wxT("SampleBlockIndex::Conn - SQLITE error %s"),
+            sqlite3_errmsg(db));
+         mDB = nullptr;
+         return nullptr;
+      }
+      mDB = db;
+   }
+   return pConn;
+}
+
+std::vector<SampleBlockID> SampleBlockIndex::Find(uint64_t hash)
+{
+   const auto pConn = Conn();
+   if (!pConn)
+      return {};
+
+   std::vector<SampleBlockID> result;
+   try {
+      // Prepare and cache statement...automatically finalized at DB close
+      const auto stmt = pConn->Prepare(DBConnection::FindSampleBlockHash, FindSQL);
+      if (sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(hash)) ==
+          SQLITE_OK) {
+         while (sqlite3_step(stmt) == SQLITE_ROW)
+            result.push_back(sqlite3_column_int64(stmt, 0));
+      }
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   }
+   catch (...) {
+      // Perhaps the tables were lost with a rolled back transaction
+      std::lock_guard<std::mutex> guard(mMutex);
+      mDB = nullptr;
+   }
+   return result;
+}
+
+void SampleBlockIndex::Add(uint64_t hash, SampleBlockID id)
+{
+   const auto pConn = Conn();
+   if (!pConn)
+      return;
+
+   try {
+      // Prepare and cache statement...automatically finalized at DB close
+      const auto stmt =
+         pConn->Prepare(DBConnection::InsertSampleBlockHash, InsertSQL);
+      if (sqlite3_bind_int64(stmt, 1, id) ||
+          sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(hash)) ||
+          sqlite3_step(stmt) != SQLITE_DONE)
+         wxLogDebug(wxT("SampleBlockIndex::Add - SQLITE error %s"),
+            sqlite3_errmsg(pConn->DB()));
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   }
+   catch (...) {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mDB = nullptr;
+   }
+}
+
+void SampleBlockIndex::CopyIndex(sqlite3 *db, const char *schema)
+{
+   // Nothing to copy, unless the index was used with this project file
+   sqlite3_stmt *stmt = nullptr;
+   if (sqlite3_prepare_v2(db,
+      "SELECT 1 FROM main.sqlite_master"
+      "  WHERE type = 'table' AND name = 'sampleblockhashes';",
+      -1, &stmt, nullptr) != SQLITE_OK)
+      return;
+   const auto exists = (sqlite3_step(stmt) == SQLITE_ROW);
+   sqlite3_finalize(stmt);
+   if (!exists)
+      return;
+
+   wxString sql{ Schema };
+   sql += CopySQL;
+   sql.Replace("<schema>", schema);
+   if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+      wxLogDebug(wxT("SampleBlockIndex::CopyIndex - SQLITE error %s"),
+         sqlite3_errmsg(db));
+}
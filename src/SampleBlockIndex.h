@@ -0,0 +1,91 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockIndex.h
+@brief Finds the sample blocks of a project file by their contents
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_BLOCK_INDEX__
+#define __AUDACITY_SAMPLE_BLOCK_INDEX__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ClientData.h"
+#include "Prefs.h"
+#include "SampleBlock.h" // for SampleBlockID
+#include "SampleFormat.h"
+
+class AudacityProject;
+class ConnectionPtr;
+class DBConnection;
+struct sqlite3;
+
+//! Whether new sample blocks share existing blocks with the same samples
+extern AUDACITY_DLL_API BoolSetting SampleBlockDeduplication;
+
+//! Maps hashes of the samples of blocks to their ids, so that a block with
+//! the same samples as another can share its row
+/*!
+ A table of the project file maps ids of sampleblocks to the hashes.  A
+ trigger deletes the row for a block when the block is deleted.  Hashes may
+ collide, so callers must compare the samples too.
+
+ The tables are created only when the index is first used with a project
+ file.  Older versions ignore them, and lose them in compaction.
+
+ All member functions may be called from any thread.  Failures are not
+ reported, because blocks are then only not shared.
+ */
+class AUDACITY_DLL_API SampleBlockIndex final
+   : public ClientData::Base
+   , public std::enable_shared_from_this<SampleBlockIndex>
+   , public PrefsListener
+{
+public:
+   static SampleBlockIndex &Get( AudacityProject &project );
+   static const SampleBlockIndex &Get( const AudacityProject &project );
+
+   static uint64_t Hash(
+      constSamplePtr src, size_t numsamples, sampleFormat format);
+
+   explicit SampleBlockIndex(
+      const std::shared_ptr<ConnectionPtr> &ppConnection);
+   SampleBlockIndex( const SampleBlockIndex & ) PROHIBITED;
+   SampleBlockIndex &operator=( const SampleBlockIndex & ) PROHIBITED;
+   ~SampleBlockIndex() override;
+
+   //! Whether deduplication is enabled in preferences
+   bool IsEnabled() const;
+
+   //! @return ids of blocks whose samples may have the hash
+   std::vector<SampleBlockID> Find(uint64_t hash);
+
+   void Add(uint64_t hash, SampleBlockID id);
+
+   //! Copy the entries for the blocks that were copied to another schema
+   /*! This is for a database attached to the project's connection, which
+    is being filled with sampleblocks, as for compaction */
+   static void CopyIndex(sqlite3 *db, const char *schema);
+
+private:
+   void UpdatePrefs() override;
+
+   //! @return the connection, if the tables exist or could be created
+   DBConnection *Conn();
+
+   const std::shared_ptr<ConnectionPtr> mppConnection;
+
+   std::atomic<bool> mEnabled;
+
+   std::mutex mMutex;
+   //! Database for which the tables exist, or null
+   sqlite3 *mDB{ nullptr };
+};
+
+#endif
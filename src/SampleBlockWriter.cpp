@@ -0,0 +1,504 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockWriter.cpp
+
+**********************************************************************/
+
+#include "SampleBlockWriter.h"
+
+#include <algorithm>
+#include <sqlite3.h>
+#include <wx/log.h>
+
+#include "AudacityException.h"
+#include "DBConnection.h"
+#include "Project.h"
+#include "SentryHelper.h"
+
+IntSetting SampleBlockWriteQueueSize{ L"/Performance/WriteQueueMB", 64 };
+
+namespace {
+// The id is null in synchronous insertions, so that the database assigns it
+const char *const RawInsertSQL =
+   "INSERT INTO sampleblocks (blockid, sampleformat, summin, summax, sumrms,"
+   "                          summary256, summary64k, samples)"
+   "                         VALUES(?1,?2,?3,?4,?5,?6,?7,?8);";
+
+// Only project files that store encoded samples have the last two columns
+const char *const EncodedInsertSQL =
+   "INSERT INTO sampleblocks (blockid, sampleformat, summin, summax, sumrms,"
+   "                          summary256, summary64k, samples,"
+   "                          codec, rawbytes)"
+   "                         VALUES(?1,?2,?3,?4,?5,?6,?7,?8,?9,?10);";
+
+//! Most rows inserted in one transaction
+/*! Rows accumulate while a transaction commits, so that the batches grow
+ just when the disk is slow */
+constexpr size_t MaxBatch = 256;
+
+size_t RowBytes(const SampleBlockWriter::Row &row)
+{
+   return row.sampleBytes + row.summary256Bytes + row.summary64kBytes;
+}
+}
+
+static const AudacityProject::AttachedObjects::RegisteredFactory
+sSampleBlockWriterKey{
+   []( AudacityProject &project ){
+      return std::make_shared< SampleBlockWriter >(
+         ConnectionPtr::Get( project ).shared_from_this() );
+   }
+};
+
+SampleBlockWriter &SampleBlockWriter::Get( AudacityProject &project )
+{
+   return project.AttachedObjects::Get< SampleBlockWriter >(
+      sSampleBlockWriterKey );
+}
+
+const SampleBlockWriter &SampleBlockWriter::Get(
+   const AudacityProject &project )
+{
+   return Get( const_cast< AudacityProject & >( project ) );
+}
+
+SampleBlockWriter::SampleBlockWriter(
+   const std::shared_ptr<ConnectionPtr> &ppConnection)
+   : mppConnection{ ppConnection }
+{
+}
+
+SampleBlockWriter::~SampleBlockWriter()
+{
+   // If Stop() was not called, the worker finishes the queue now
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mStopping = true;
+   }
+   mCondition.notify_all();
+   if (mThread.joinable())
+      mThread.join();
+   if (mDB)
+      sqlite3_close(mDB);
+
+   // If the worker or Stop() failed, try once more to insert the rest of
+   // the recording, and report failure rather than lose it silently
+   GuardedCall( [this]{ FlushFailed(); } );
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   if (!mEntries.empty())
+      wxLogMessage(wxT("%lu queued sample blocks were not saved"),
+         static_cast<unsigned long>(mEntries.size()));
+}
+
+bool SampleBlockWriter::Start()
+{
+   if (IsActive())
+      return true;
+
+   const auto capacity =
+      std::max(0, SampleBlockWriteQueueSize.Read()) * size_t(1024 * 1024);
+   if (capacity == 0)
+      return false;
+
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      // Rows left by an earlier failure must be inserted synchronously
+      // before any others
+      if (!mEntries.empty())
+         return false;
+   }
+
+   auto &pConnection = mppConnection->mpConnection;
+   if (!pConnection)
+      return false;
+   auto db = pConnection->OpenAuxiliary();
+   if (!db)
+      return false;
+
+   // Continue the sequence of ids that AUTOINCREMENT would assign, so that
+   // the queued rows can be referenced before they are inserted.
+   // This sees only committed rows, but no transaction of the main connection
+   // is open when recording begins.
+   SampleBlockID lastID = -1;
+   sqlite3_stmt *stmt = nullptr;
+   int rc = sqlite3_prepare_v2(db,
+      "SELECT max("
+      "  ifnull((SELECT seq FROM sqlite_sequence"
+      "           WHERE name = 'sampleblocks'), 0),"
+      "  ifnull((SELECT max(blockid) FROM sampleblocks), 0));",
+      -1, &stmt, nullptr);
+   if (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW)
+      lastID = sqlite3_column_int64(stmt, 0);
+   sqlite3_finalize(stmt);
+
+   if (lastID < 0)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SampleBlockWriter::Start");
+
+      wxLogMessage("Failed to find the last sample block id: %d, %s\n",
+         rc,
+         sqlite3_errmsg(db));
+      sqlite3_close(db);
+      return false;
+   }
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   mDB = db;
+   mCapacity = capacity;
+   mNextID = lastID + 1;
+   mActive = true;
+   mStopping = false;
+   mFailed = false;
+   mStatistics = {};
+   mThread = std::thread([this]{ WriterThread(); });
+   return true;
+}
+
+void SampleBlockWriter::Stop()
+{
+   if (IsActive())
+   {
+      {
+         std::lock_guard<std::mutex> guard(mMutex);
+         mStopping = true;
+      }
+      mCondition.notify_all();
+
+      // The worker finishes the queue unless it fails
+      mThread.join();
+      sqlite3_close(mDB);
+      mDB = nullptr;
+
+      std::lock_guard<std::mutex> guard(mMutex);
+      mActive = false;
+      mStopping = false;
+      mFailed = false;
+   }
+
+   FlushFailed();
+}
+
+bool SampleBlockWriter::IsActive() const
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return mActive;
+}
+
+SampleBlockID SampleBlockWriter::Write(Row &&row)
+{
+   {
+      std::unique_lock<std::mutex> lock(mMutex);
+      if (mActive && !mFailed)
+      {
+         const auto bytes = RowBytes(row);
+
+         // Apply back-pressure, but always admit one row
+         if (mBytes + bytes > mCapacity && !mEntries.empty())
+         {
+            ++mStatistics.stalls;
+            mCondition.wait(lock, [&]{
+               return mFailed || mEntries.empty() ||
+                  mBytes + bytes <= mCapacity;
+            });
+         }
+
+         if (!mFailed)
+         {
+            const auto id = mNextID++;
+            mEntries.emplace(id, Entry{ std::move(row) });
+            mBytes += bytes;
+            mStatistics.maxDepth =
+               std::max(mStatistics.maxDepth, mEntries.size());
+            mStatistics.maxBytes = std::max(mStatistics.maxBytes, mBytes);
+            mCondition.notify_all();
+            return id;
+         }
+      }
+   }
+
+   // Not queuing, or the worker failed
+   FlushFailed();
+   return InsertNow(0, row);
+}
+
+bool SampleBlockWriter::Visit(SampleBlockID id, const Visitor &visitor) const
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   auto iter = mEntries.find(id);
+   if (iter == mEntries.end())
+      return false;
+   visitor(iter->second.row);
+   return true;
+}
+
+bool SampleBlockWriter::Cancel(SampleBlockID id)
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   auto iter = mEntries.find(id);
+   if (iter == mEntries.end())
+      return false;
+
+   if (iter->second.busy)
+   {
+      mCondition.wait(lock, [&]{
+         iter = mEntries.find(id);
+         return iter == mEntries.end() || !iter->second.busy;
+      });
+      if (iter == mEntries.end())
+         // It was inserted
+         return false;
+   }
+
+   Erase(iter);
+   ++mStatistics.cancelled;
+   mCondition.notify_all();
+   return true;
+}
+
+auto SampleBlockWriter::GetStatistics() const -> Statistics
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   auto result = mStatistics;
+   result.depth = mEntries.size();
+   result.bytes = mBytes;
+   return result;
+}
+
+DBConnection &SampleBlockWriter::Conn() const
+{
+   auto &pConnection = mppConnection->mpConnection;
+   if (!pConnection) {
+      throw SimpleMessageBoxException
+      {
+         ExceptionType::Internal,
+         XO("Connection to project file is null"),
+         XO("Warning"),
+         "Error:_Disk_full_or_not_writable"
+      };
+   }
+   return *pConnection;
+}
+
+int SampleBlockWriter::Insert(
+   sqlite3_stmt *stmt, SampleBlockID id, const Row &row)
+{
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   if ((id > 0
+          ? sqlite3_bind_int64(stmt, 1, id)
+          : sqlite3_bind_null(stmt, 1)) ||
+       sqlite3_bind_int(stmt, 2, row.format) ||
+       sqlite3_bind_double(stmt, 3, row.sumMin) ||
+       sqlite3_bind_double(stmt, 4, row.sumMax) ||
+       sqlite3_bind_double(stmt, 5, row.sumRms) ||
+       sqlite3_bind_blob(stmt, 6,
+          row.summary256.get(), row.summary256Bytes, SQLITE_STATIC) ||
+       sqlite3_bind_blob(stmt, 7,
+          row.summary64k.get(), row.summary64kBytes, SQLITE_STATIC) ||
+       sqlite3_bind_blob(stmt, 8,
+          row.samples.get(), row.sampleBytes, SQLITE_STATIC) ||
+       (row.codec != 0 &&
+          (sqlite3_bind_int(stmt, 9, row.codec) ||
+           sqlite3_bind_int64(stmt, 10, row.rawBytes))))
+   {
+      ADD_EXCEPTION_CONTEXT(
+         "sqlite3.rc", std::to_string(sqlite3_errcode(sqlite3_db_handle(stmt))));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SampleBlockWriter::Insert::bind");
+
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   // Execute the statement
+   const auto rc = sqlite3_step(stmt);
+
+   // Clear statement bindings and rewind statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+
+   return rc;
+}
+
+const char *SampleBlockWriter::InsertSQL(const Row &row)
+{
+   return row.codec != 0 ? EncodedInsertSQL : RawInsertSQL;
+}
+
+SampleBlockID SampleBlockWriter::InsertNow(SampleBlockID id, const Row &row)
+{
+   auto &conn = Conn();
+   auto db = conn.DB();
+
+   // Prepare and cache statement...automatically finalized at DB close
+   sqlite3_stmt *stmt = conn.Prepare(row.codec != 0
+         ? DBConnection::InsertEncodedSampleBlock
+         : DBConnection::InsertSampleBlock,
+      InsertSQL(row));
+
+   // Other threads may insert with this connection too, as when effects
+   // process tracks concurrently, so hold its mutex until the row id is read
+   const auto mutex = sqlite3_db_mutex(db);
+   sqlite3_mutex_enter(mutex);
+   auto leave = finally([&]{ sqlite3_mutex_leave(mutex); });
+
+   const auto rc = Insert(stmt, id, row);
+   if (rc != SQLITE_DONE)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SampleBlockWriter::InsertNow::step");
+
+      wxLogDebug(wxT("SampleBlockWriter::InsertNow - SQLITE error %s"), sqlite3_errmsg(db));
+
+      // Just showing the user a simple message, not the library error too
+      // which isn't internationalized
+      conn.ThrowException( true );
+   }
+
+   return id > 0 ? id : sqlite3_last_insert_rowid(db);
+}
+
+void SampleBlockWriter::FlushFailed()
+{
+   std::lock_guard<std::mutex> flushGuard(mFlushMutex);
+   std::unique_lock<std::mutex> lock(mMutex);
+   while (!mEntries.empty())
+   {
+      // Insert in order of id, leaving each entry readable until inserted
+      const auto iter = mEntries.begin();
+      iter->second.busy = true;
+
+      bool inserted = false;
+      auto cleanup = finally([&]{
+         lock.lock();
+         if (inserted)
+            Erase(iter);
+         else
+            iter->second.busy = false;
+         mCondition.notify_all();
+      });
+
+      lock.unlock();
+      InsertNow(iter->first, iter->second.row);
+      inserted = true;
+   }
+}
+
+void SampleBlockWriter::WriterThread()
+{
+   Statements statements;
+   auto &stmt = statements.raw;
+   const auto rc = sqlite3_prepare_v3(
+      mDB, RawInsertSQL, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SampleBlockWriter::WriterThread::prepare");
+
+      wxLogMessage("Failed to prepare the sample block insertion: %s\n",
+         sqlite3_errmsg(mDB));
+   }
+
+   std::unique_lock<std::mutex> lock(mMutex);
+   if (!stmt)
+   {
+      // Writes will be synchronous
+      mFailed = true;
+      mCondition.notify_all();
+      return;
+   }
+
+   while (true)
+   {
+      mCondition.wait(lock, [this]{ return mStopping || !mEntries.empty(); });
+      if (mEntries.empty())
+         // Stopping, and the queue is finished
+         break;
+
+      // Take all of the oldest rows, up to a limit
+      Batch batch;
+      for (auto iter = mEntries.begin(), end = mEntries.end();
+           iter != end && batch.size() < MaxBatch; ++iter)
+      {
+         iter->second.busy = true;
+         batch.push_back(&*iter);
+      }
+
+      lock.unlock();
+      const bool success = WriteBatch(statements, batch);
+      lock.lock();
+
+      for (auto pEntry : batch)
+      {
+         if (success)
+            Erase(mEntries.find(pEntry->first));
+         else
+            pEntry->second.busy = false;
+      }
+      if (success)
+      {
+         mStatistics.written += batch.size();
+         ++mStatistics.transactions;
+      }
+      else
+         mFailed = true;
+
+      // Wake writers waiting for space, or cancellations waiting for rows
+      mCondition.notify_all();
+
+      if (!success)
+         break;
+   }
+
+   lock.unlock();
+   sqlite3_finalize(statements.raw);
+   sqlite3_finalize(statements.encoded);
+}
+
+bool SampleBlockWriter::WriteBatch(Statements &statements, const Batch &batch)
+{
+   int rc = sqlite3_exec(mDB, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+   for (auto iter = batch.begin(), end = batch.end();
+        rc == SQLITE_OK && iter != end; ++iter)
+   {
+      const auto &[id, entry] = **iter;
+      auto &stmt = entry.row.codec != 0 ? statements.encoded : statements.raw;
+      if (!stmt) {
+         rc = sqlite3_prepare_v3(mDB, InsertSQL(entry.row), -1,
+            SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+         if (rc != SQLITE_OK)
+            break;
+      }
+      rc = Insert(stmt, id, entry.row);
+      if (rc == SQLITE_DONE)
+         rc = SQLITE_OK;
+   }
+   if (rc == SQLITE_OK)
+      rc = sqlite3_exec(mDB, "COMMIT;", nullptr, nullptr, nullptr);
+
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SampleBlockWriter::WriteBatch");
+
+      wxLogMessage("Failed to insert queued sample blocks in %s\n"
+                   "\tError: %s\n",
+                   sqlite3_db_filename(mDB, nullptr),
+                   sqlite3_errmsg(mDB));
+
+      // The rows remain queued, to be inserted synchronously
+      sqlite3_exec(mDB, "ROLLBACK;", nullptr, nullptr, nullptr);
+      return false;
+   }
+
+   return true;
+}
+
+void SampleBlockWriter::Erase(Entries::iterator iter)
+{
+   mBytes -= RowBytes(iter->second.row);
+   mEntries.erase(iter);
+}
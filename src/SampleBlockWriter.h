@@ -0,0 +1,203 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockWriter.h
+@brief Inserts sample blocks into the project database, optionally from a
+worker thread that groups them into transactions
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_BLOCK_WRITER__
+#define __AUDACITY_SAMPLE_BLOCK_WRITER__
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ClientData.h"
+#include "MemoryX.h"
+#include "Prefs.h"
+#include "SampleBlock.h" // for SampleBlockID
+#include "SampleFormat.h"
+
+class AudacityProject;
+class ConnectionPtr;
+class DBConnection;
+struct sqlite3;
+struct sqlite3_stmt;
+
+//! Capacity of the write-behind queue, in megabytes; zero disables it
+extern AUDACITY_DLL_API IntSetting SampleBlockWriteQueueSize;
+
+//! Inserts rows of the sampleblocks table for one project
+/*!
+ Normally each row is inserted synchronously, as it is written.
+
+ Between Start() and Stop(), as while recording, rows are instead queued and
+ inserted by a worker thread, with its own database connection, in
+ transactions of several rows.  Ids of queued rows are assigned in advance,
+ and the rows can be read back from memory until they are inserted.  Writing
+ blocks while the queue holds more than its capacity, so that a briefly
+ stalled disk slows the producer rather than exhausting memory.
+
+ If the worker fails, the rows it did not insert remain queued, and are
+ inserted synchronously before the next row, or by Stop(), reporting errors
+ in the usual way.
+
+ Write(), Visit() and Cancel() may be called from any thread.  Start() and
+ Stop() are called from the main thread, while no other thread is writing.
+ */
+class AUDACITY_DLL_API SampleBlockWriter final
+   : public ClientData::Base
+   , public std::enable_shared_from_this<SampleBlockWriter>
+{
+public:
+   //! Contents of one row, except the id
+   struct Row {
+      sampleFormat format{ floatSample };
+      double sumMin{ 0 };
+      double sumMax{ 0 };
+      double sumRms{ 0 };
+      ArrayOf<char> summary256;
+      size_t summary256Bytes{ 0 };
+      ArrayOf<char> summary64k;
+      size_t summary64kBytes{ 0 };
+      //! Encoded as codec says
+      ArrayOf<char> samples;
+      size_t sampleBytes{ 0 };
+      //! A value of SampleBlockCodec::Codec; not raw only if the project
+      //! file stores encoded samples
+      int codec{ 0 };
+      //! Bytes of the samples before encoding
+      size_t rawBytes{ 0 };
+   };
+
+   struct Statistics {
+      //! Rows now queued
+      size_t depth{ 0 };
+      //! Bytes of sample and summary data now queued
+      size_t bytes{ 0 };
+      size_t maxDepth{ 0 };
+      size_t maxBytes{ 0 };
+      //! Rows inserted by the worker thread
+      unsigned long long written{ 0 };
+      //! Transactions committed by the worker thread
+      unsigned long long transactions{ 0 };
+      //! Queued rows deleted before they were inserted
+      unsigned long long cancelled{ 0 };
+      //! Times that Write() waited for the queue to shrink
+      unsigned long long stalls{ 0 };
+   };
+
+   using Visitor = std::function<void(const Row &)>;
+
+   static SampleBlockWriter &Get( AudacityProject &project );
+   static const SampleBlockWriter &Get( const AudacityProject &project );
+
+   explicit SampleBlockWriter(
+      const std::shared_ptr<ConnectionPtr> &ppConnection);
+   SampleBlockWriter( const SampleBlockWriter & ) PROHIBITED;
+   SampleBlockWriter &operator=( const SampleBlockWriter & ) PROHIBITED;
+   ~SampleBlockWriter() override;
+
+   //! Begin queuing rows for the worker thread, and reset statistics
+   /*! @return false, and rows remain synchronous, if the queue is disabled
+    in preferences or the worker's connection could not be opened */
+   bool Start();
+
+   //! Insert all queued rows and end the worker thread
+   /*! This may throw database errors, leaving rows not yet inserted in the
+    queue.  Callers of Start() must call this; the destructor inserts rows
+    left queued only as a last resort, when errors can't be reported in the
+    usual way. */
+   void Stop();
+
+   //! Whether rows are queued rather than inserted synchronously
+   bool IsActive() const;
+
+   //! Insert a row, or queue it
+   /*! This may throw database errors from synchronous insertion
+    @return the id of the row */
+   SampleBlockID Write(Row &&row);
+
+   //! If the row for id is still queued, pass it to visitor, which must not
+   //! call back into this object
+   /*! @return whether the row was found */
+   bool Visit(SampleBlockID id, const Visitor &visitor) const;
+
+   //! Prevent the insertion of the row for id, if it is still queued
+   /*! If the row is being inserted now, wait for that to finish
+    @return whether the row was found and removed, so that there is nothing
+    to delete from the database */
+   bool Cancel(SampleBlockID id);
+
+   Statistics GetStatistics() const;
+
+private:
+   struct Entry {
+      Row row;
+      //! Being inserted now; not to be erased by any other thread
+      bool busy{ false };
+   };
+   //! Ordered by id, which is also the order of writing
+   using Entries = std::map<SampleBlockID, Entry>;
+
+   DBConnection &Conn() const;
+
+   //! Bind the parameters of a prepared insertion and step it
+   /*! @param stmt must be prepared with InsertSQL(row)
+    @param id if zero, the database assigns the id
+    @return the result of sqlite3_step() */
+   static int Insert(sqlite3_stmt *stmt, SampleBlockID id, const Row &row);
+   //! @return the statement inserting the row, which names the codec
+   //! columns only if it is encoded
+   static const char *InsertSQL(const Row &row);
+
+   //! Insert with the project's connection, throwing on failure
+   /*! @return the id of the row */
+   SampleBlockID InsertNow(SampleBlockID id, const Row &row);
+
+   //! Synchronously insert rows that the worker failed to insert
+   void FlushFailed();
+
+   using Batch = std::vector<Entries::value_type *>;
+   void WriterThread();
+   //! Insertions prepared with the worker's connection
+   struct Statements {
+      sqlite3_stmt *raw{};
+      //! Prepared when first needed, because only some project files have
+      //! the columns
+      sqlite3_stmt *encoded{};
+   };
+   //! Insert entries in one transaction with the worker's connection
+   bool WriteBatch(Statements &statements, const Batch &batch);
+
+   //! @pre mMutex is locked
+   void Erase(Entries::iterator iter);
+
+   const std::shared_ptr<ConnectionPtr> mppConnection;
+
+   mutable std::mutex mMutex;
+   std::condition_variable mCondition;
+   Entries mEntries;
+   size_t mBytes{ 0 };
+   size_t mCapacity{ 0 };
+   SampleBlockID mNextID{ 0 };
+   bool mActive{ false };
+   bool mStopping{ false };
+   bool mFailed{ false };
+   Statistics mStatistics;
+
+   //! Serializes FlushFailed()
+   std::mutex mFlushMutex;
+
+   std::thread mThread;
+   sqlite3 *mDB{ nullptr };
+};
+
+#endif
@@ -1074,9 +1074,38 @@ bool Sequence::Get(samplePtr buffer, sampleFormat format,
    }
    int b = FindBlock(start);
 
+   // Long reads may span many blocks; fetch them together
+   if (len > 0) {
+      const auto b1 = FindBlock(start + len - 1) + 1;
+      // One block gains nothing from batching
+      if (b1 > size_t(b) + 1)
+         PreloadBlocks(b, b1);
+   }
+
    return Get(b, buffer, format, start, len, mayThrow);
 }
 
+void Sequence::Preload(sampleCount start, sampleCount len) const
+{
+   const auto end = std::min(start + len, mNumSamples);
+   start = std::max(start, sampleCount{ 0 });
+   if (start >= end)
+      return;
+   PreloadBlocks(FindBlock(start), FindBlock(end - 1) + 1);
+}
+
+void Sequence::PreloadBlocks(size_t b0, size_t b1) const
+{
+   if (b1 <= b0)
+      return;
+
+   SampleBlockFactory::SampleBlockPtrs blocks;
+   blocks.reserve(b1 - b0);
+   for (auto b = b0; b < b1; ++b)
+      blocks.push_back(mBlock[b].sb);
+   mpFactory->Preload(blocks);
+}
+
 bool Sequence::Get(int b, samplePtr buffer, sampleFormat format,
    sampleCount start, size_t len, bool mayThrow) const
 {
@@ -1286,7 +1315,9 @@ SeqBlock::SampleBlockPtr Sequence::DoAppend(
    SeqBlock *pLastBlock;
    decltype(pLastBlock->sb->GetSampleCount()) length;
    size_t bufferSize = mMaxSamples;
-   SampleBuffer buffer2(bufferSize, mSampleFormat);
+   // Allocated only if samples must be copied, not for whole new blocks of
+   // the sequence's format
+   GrowableSampleBuffer buffer2;
    bool replaceLast = false;
    if (coalesce &&
        numBlocks > 0 &&
@@ -1296,6 +1327,7 @@ SeqBlock::SampleBlockPtr Sequence::DoAppend(
       const SeqBlock &lastBlock = *pLastBlock;
       const auto addLen = std::min(mMaxSamples - length, len);
 
+      buffer2.Resize(bufferSize, mSampleFormat);
       Read(buffer2.ptr(), mSampleFormat, lastBlock, 0, length, true);
 
       CopySamples(buffer,
@@ -1332,6 +1364,7 @@ SeqBlock::SampleBlockPtr Sequence::DoAppend(
          result = pBlock;
       }
       else {
+         buffer2.Resize(bufferSize, mSampleFormat);
          CopySamples(buffer, format, buffer2.ptr(), mSampleFormat, addedLen);
          pBlock = factory.Create(buffer2.ptr(), addedLen, mSampleFormat);
       }
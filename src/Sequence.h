@@ -93,6 +93,11 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    bool Get(samplePtr buffer, sampleFormat format,
             sampleCount start, size_t len, bool mayThrow) const;
 
+   //! Hint that samples in the range will soon be read, so that the blocks
+   //! may be fetched together
+   /*! Non-throwing.  The range is clipped to the sequence. */
+   void Preload(sampleCount start, sampleCount len) const;
+
    // Note that len is not size_t, because nullptr may be passed for buffer, in
    // which case, silence is inserted, possibly a large amount.
    void SetSamples(constSamplePtr buffer, sampleFormat format,
@@ -118,7 +123,7 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    void SetSilence(sampleCount s0, sampleCount len);
    void InsertSilence(sampleCount s0, sampleCount len);
 
-   const SampleBlockFactoryPtr &GetFactory() { return mpFactory; }
+   const SampleBlockFactoryPtr &GetFactory() const { return mpFactory; }
 
    //
    // XMLTagHandler callback methods for loading and saving
@@ -224,6 +229,9 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
                         constSamplePtr buffer,
                         size_t len);
 
+   //! Preload blocks with indices in [b0, b1)
+   void PreloadBlocks(size_t b0, size_t b1) const;
+
    bool Get(int b,
             samplePtr buffer,
             sampleFormat format,
@@ -0,0 +1,344 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SpectrumTileStore.cpp
+
+**********************************************************************/
+
+#include "SpectrumTileStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sqlite3.h>
+#include <wx/log.h>
+#include <wx/string.h>
+
+#include "DBConnection.h"
+#include "Project.h"
+
+IntSetting SpectrumTileStoreSize{ L"/Performance/SpectrumTileStoreMB", 256 };
+
+namespace {
+// The blocks of each tile are listed in a second table, so that a trigger
+// can find the tiles of a deleted block; another trigger then deletes the
+// list of the tile.
+//
+// Triggers on sampleblocks must name tables of the same schema without
+// qualification.
+const char *const Schema =
+   "CREATE TABLE IF NOT EXISTS <schema>.spectrumtiles"
+   "("
+   "  tileid               INTEGER PRIMARY KEY AUTOINCREMENT,"
+   "  key                  TEXT UNIQUE NOT NULL,"
+   "  columns              BLOB"
+   ");"
+   ""
+   "CREATE TABLE IF NOT EXISTS <schema>.spectrumtileblocks"
+   "("
+   "  tileid               INTEGER,"
+   "  blockid              INTEGER,"
+   "  PRIMARY KEY (tileid, blockid)"
+   ") WITHOUT ROWID;"
+   ""
+   "CREATE INDEX IF NOT EXISTS <schema>.spectrumtileblocks_blockid"
+   "  ON spectrumtileblocks (blockid);"
+   ""
+   "CREATE TRIGGER IF NOT EXISTS <schema>.spectrumtiles_blockdeleted"
+   "  AFTER DELETE ON sampleblocks"
+   "  BEGIN"
+   "    DELETE FROM spectrumtiles WHERE tileid IN"
+   "      (SELECT tileid FROM spectrumtileblocks WHERE blockid = OLD.blockid);"
+   "  END;"
+   ""
+   "CREATE TRIGGER IF NOT EXISTS <schema>.spectrumtiles_deleted"
+   "  AFTER DELETE ON spectrumtiles"
+   "  BEGIN"
+   "    DELETE FROM spectrumtileblocks WHERE tileid = OLD.tileid;"
+   "  END;";
+
+// Tiles and their lists, where every block was copied to the other schema
+const char *const CopySQL =
+   "INSERT INTO <schema>.spectrumtiles"
+   "  SELECT * FROM main.spectrumtiles AS tiles"
+   "  WHERE NOT EXISTS (SELECT 1 FROM main.spectrumtileblocks AS blocks"
+   "    WHERE blocks.tileid = tiles.tileid AND blocks.blockid NOT IN"
+   "      (SELECT blockid FROM <schema>.sampleblocks));"
+   ""
+   "INSERT INTO <schema>.spectrumtileblocks"
+   "  SELECT * FROM main.spectrumtileblocks"
+   "  WHERE tileid IN (SELECT tileid FROM <schema>.spectrumtiles);";
+
+const char *const LoadSQL =
+   "SELECT columns FROM spectrumtiles WHERE key = ?1;";
+
+// Workers computing the same tile may race to insert it
+const char *const InsertSQL =
+   "INSERT OR IGNORE INTO spectrumtiles (key, columns) VALUES (?1, ?2);";
+
+const char *const InsertBlockSQL =
+   "INSERT OR IGNORE INTO spectrumtileblocks (tileid, blockid)"
+   "  VALUES (?1, ?2);";
+
+const char *const SizeSQL =
+   "SELECT COALESCE(SUM(length(columns)), 0) FROM spectrumtiles;";
+
+const char *const OldestSQL =
+   "SELECT tileid, length(columns) FROM spectrumtiles"
+   "  ORDER BY tileid LIMIT 1;";
+
+const char *const DeleteSQL =
+   "DELETE FROM spectrumtiles WHERE tileid = ?1;";
+
+//! Step the statement once, then clear its bindings and rewind it
+int StepOnce(sqlite3_stmt *stmt)
+{
+   const auto rc = sqlite3_step(stmt);
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+   return rc;
+}
+}
+
+static const AudacityProject::AttachedObjects::RegisteredFactory
+sSpectrumTileStoreKey{
+   []( AudacityProject &project ){
+      return std::make_shared< SpectrumTileStore >(
+         ConnectionPtr::Get( project ).shared_from_this() );
+   }
+};
+
+SpectrumTileStore &SpectrumTileStore::Get( AudacityProject &project )
+{
+   return project.AttachedObjects::Get< SpectrumTileStore >(
+      sSpectrumTileStoreKey );
+}
+
+const SpectrumTileStore &SpectrumTileStore::Get(
+   const AudacityProject &project )
+{
+   return Get( const_cast< AudacityProject & >( project ) );
+}
+
+SpectrumTileStore::SpectrumTileStore(
+   const std::shared_ptr<ConnectionPtr> &ppConnection)
+   : mppConnection{ ppConnection }
+{
+}
+
+SpectrumTileStore::~SpectrumTileStore() = default;
+
+DBConnection *SpectrumTileStore::Conn() const
+{
+   return mppConnection->mpConnection.get();
+}
+
+bool SpectrumTileStore::IsEnabled()
+{
+   const auto capacity =
+      std::max(0, SpectrumTileStoreSize.Read()) * 1024LL * 1024;
+   mCapacity.store(capacity, std::memory_order_relaxed);
+   if (capacity == 0)
+      return false;
+
+   const auto pConn = Conn();
+   if (!pConn)
+      return false;
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   const auto db = pConn->DB();
+   if (db != mDB) {
+      wxString sql{ Schema };
+      sql.Replace("<schema>", "main");
+      if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+         wxLogDebug(wxT("SpectrumTileStore::IsEnabled - SQLITE error %s"),
+            sqlite3_errmsg(db));
+         mDB = nullptr;
+         return false;
+      }
+      mDB = db;
+      mBytes = -1;
+   }
+   return true;
+}
+
+bool SpectrumTileStore::Load(const Key &key, float *columns, size_t count)
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   const auto pConn = Conn();
+   if (!pConn || pConn->DB() != mDB)
+      return false;
+   lock.unlock();
+
+   try {
+      // Prepare and cache statement...automatically finalized at DB close
+      const auto stmt = pConn->Prepare(DBConnection::LoadSpectrumTile, LoadSQL);
+      if (sqlite3_bind_text(stmt, 1,
+         key.description.c_str(), -1, SQLITE_STATIC)) {
+         sqlite3_clear_bindings(stmt);
+         return false;
+      }
+
+      bool found = false;
+      if (sqlite3_step(stmt) == SQLITE_ROW) {
+         const auto bytes = count * sizeof(float);
+         if (sqlite3_column_bytes(stmt, 0) == static_cast<int>(bytes)) {
+            memcpy(columns, sqlite3_column_blob(stmt, 0), bytes);
+            found = true;
+         }
+      }
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+      return found;
+   }
+   catch (...) {
+      // Perhaps the tables were lost with a rolled back transaction
+      lock.lock();
+      mDB = nullptr;
+      return false;
+   }
+}
+
+void SpectrumTileStore::Save(
+   const Key &key, const float *columns, size_t count)
+{
+   const long long bytes = count * sizeof(float);
+   const auto capacity = mCapacity.load(std::memory_order_relaxed);
+   if (bytes > capacity)
+      return;
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   const auto pConn = Conn();
+   if (!pConn || pConn->DB() != mDB)
+      return;
+
+   // Prepare before entering the mutex of the connection, which Prepare()
+   // enters while holding another mutex
+   Statements statements;
+   try {
+      auto &conn = *pConn;
+      statements = {
+         conn.Prepare(DBConnection::GetSpectrumTilesSize, SizeSQL),
+         conn.Prepare(DBConnection::GetOldestSpectrumTile, OldestSQL),
+         conn.Prepare(DBConnection::DeleteSpectrumTile, DeleteSQL),
+         conn.Prepare(DBConnection::InsertSpectrumTile, InsertSQL),
+         conn.Prepare(DBConnection::InsertSpectrumTileBlock, InsertBlockSQL),
+      };
+   }
+   catch (...) {
+      // Perhaps the tables were lost with a rolled back transaction
+      mDB = nullptr;
+      return;
+   }
+
+   // The main thread may use the connection too, perhaps in a transaction,
+   // so hold its mutex until the tile is stored, and make the tile with its
+   // list of blocks one change, inside any transaction or not
+   const auto db = mDB;
+   const auto mutex = sqlite3_db_mutex(db);
+   sqlite3_mutex_enter(mutex);
+   auto leave = finally([&]{ sqlite3_mutex_leave(mutex); });
+
+   if (sqlite3_exec(db, "SAVEPOINT spectrumtile;",
+      nullptr, nullptr, nullptr) != SQLITE_OK)
+      return;
+
+   if (MakeRoom(statements, bytes, capacity) &&
+       DoSave(db, statements, key, columns, bytes))
+      sqlite3_exec(db, "RELEASE spectrumtile;", nullptr, nullptr, nullptr);
+   else {
+      sqlite3_exec(db, "ROLLBACK TO spectrumtile; RELEASE spectrumtile;",
+         nullptr, nullptr, nullptr);
+      // Count again next time
+      mBytes = -1;
+   }
+}
+
+bool SpectrumTileStore::MakeRoom(
+   const Statements &statements, long long bytes, long long capacity)
+{
+   if (mBytes < 0) {
+      const auto stmt = statements.size;
+      if (sqlite3_step(stmt) != SQLITE_ROW) {
+         sqlite3_reset(stmt);
+         return false;
+      }
+      mBytes = sqlite3_column_int64(stmt, 0);
+      sqlite3_reset(stmt);
+   }
+
+   const auto oldest = statements.oldest;
+   while (mBytes + bytes > capacity) {
+      const auto rc = sqlite3_step(oldest);
+      if (rc == SQLITE_DONE) {
+         // The count was high, because the trigger deleted tiles
+         sqlite3_reset(oldest);
+         mBytes = 0;
+         break;
+      }
+      if (rc != SQLITE_ROW) {
+         sqlite3_reset(oldest);
+         return false;
+      }
+      const auto tileID = sqlite3_column_int64(oldest, 0);
+      const auto tileBytes = sqlite3_column_int64(oldest, 1);
+      sqlite3_reset(oldest);
+
+      if (sqlite3_bind_int64(statements.deletion, 1, tileID) ||
+          StepOnce(statements.deletion) != SQLITE_DONE)
+         return false;
+      mBytes = std::max(0LL, mBytes - tileBytes);
+   }
+   return true;
+}
+
+bool SpectrumTileStore::DoSave(sqlite3 *db, const Statements &statements,
+   const Key &key, const float *columns, long long bytes)
+{
+   const auto stmt = statements.insert;
+   if (sqlite3_bind_text(stmt, 1,
+         key.description.c_str(), -1, SQLITE_STATIC) ||
+       sqlite3_bind_blob(stmt, 2, columns, bytes, SQLITE_STATIC) ||
+       StepOnce(stmt) != SQLITE_DONE)
+      return false;
+
+   if (sqlite3_changes(db) == 0)
+      // Another thread stored the same tile
+      return true;
+   const auto tileID = sqlite3_last_insert_rowid(db);
+   mBytes += bytes;
+
+   const auto insertBlock = statements.insertBlock;
+   for (const auto blockID : key.blockIDs) {
+      // Silent blocks have no rows to be deleted
+      if (blockID <= 0)
+         continue;
+      if (sqlite3_bind_int64(insertBlock, 1, tileID) ||
+          sqlite3_bind_int64(insertBlock, 2, blockID) ||
+          StepOnce(insertBlock) != SQLITE_DONE)
+         return false;
+   }
+   return true;
+}
+
+void SpectrumTileStore::CopyTiles(sqlite3 *db, const char *schema)
+{
+   // Nothing to copy, unless the store was used with this project file
+   sqlite3_stmt *stmt = nullptr;
+   if (sqlite3_prepare_v2(db,
+      "SELECT 1 FROM main.sqlite_master"
+      "  WHERE type = 'table' AND name = 'spectrumtiles';",
+      -1, &stmt, nullptr) != SQLITE_OK)
+      return;
+   const auto exists = (sqlite3_step(stmt) == SQLITE_ROW);
+   sqlite3_finalize(stmt);
+   if (!exists)
+      return;
+
+   wxString sql{ Schema };
+   sql += CopySQL;
+   sql.Replace("<schema>", schema);
+   if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+      wxLogDebug(wxT("SpectrumTileStore::CopyTiles - SQLITE error %s"),
+         sqlite3_errmsg(db));
+}
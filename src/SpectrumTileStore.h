@@ -0,0 +1,123 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SpectrumTileStore.h
+@brief Keeps computed spectrogram columns in the project file
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SPECTRUM_TILE_STORE__
+#define __AUDACITY_SPECTRUM_TILE_STORE__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ClientData.h"
+#include "MemoryX.h"
+#include "Prefs.h"
+#include "SampleBlock.h" // for SampleBlockID
+
+class AudacityProject;
+class ConnectionPtr;
+class DBConnection;
+struct sqlite3;
+struct sqlite3_stmt;
+
+//! Capacity of the store in each project file, in megabytes; zero disables it
+extern AUDACITY_DLL_API IntSetting SpectrumTileStoreSize;
+
+//! Keeps tiles of spectrogram columns in tables of the project file, so that
+//! reopening the project does not compute them again
+/*!
+ A tile is found by a key that describes everything its contents depend on,
+ including the ids of the sample blocks read to compute it.  Rows of
+ sampleblocks are never updated, so a tile stored with an equal key is good.
+
+ A trigger deletes the tiles that depend on a block when the block is deleted.
+ The oldest tiles are deleted when the store would exceed its capacity.
+
+ The tables are created only when the store is first used with a project
+ file.
+
+ IsEnabled() is called in the main thread.  Load() and Save() may be called
+ in any thread; except in the main thread, the caller must hold
+ DBConnection::LockForBackgroundReads().  Failures are not reported, because
+ tiles can always be computed again.
+ */
+class AUDACITY_DLL_API SpectrumTileStore final
+   : public ClientData::Base
+   , public std::enable_shared_from_this< SpectrumTileStore >
+{
+public:
+   struct Key {
+      //! Settings, resolution and position of the tile, and the ids and
+      //! positions of its blocks
+      std::string description;
+      //! Blocks read to compute the tile, including silent blocks
+      std::vector<SampleBlockID> blockIDs;
+   };
+
+   static SpectrumTileStore &Get( AudacityProject &project );
+   static const SpectrumTileStore &Get( const AudacityProject &project );
+
+   explicit SpectrumTileStore(
+      const std::shared_ptr<ConnectionPtr> &ppConnection);
+   SpectrumTileStore( const SpectrumTileStore & ) PROHIBITED;
+   SpectrumTileStore &operator=( const SpectrumTileStore & ) PROHIBITED;
+   ~SpectrumTileStore() override;
+
+   //! Whether the capacity in preferences is not zero, and the tables exist
+   //! or could be created in the current project file
+   /*! This also rereads the capacity for Save() */
+   bool IsEnabled();
+
+   //! @return whether a tile of exactly count floats was found and copied
+   bool Load(const Key &key, float *columns, size_t count);
+
+   //! Store the tile, first deleting the oldest tiles as needed
+   void Save(const Key &key, const float *columns, size_t count);
+
+   //! Copy the tiles whose blocks were all copied to another schema
+   /*! This is for a database attached to the project's connection, which
+    is being filled with sampleblocks, as for compaction.  Failures leave the
+    other schema without some tiles, and are not reported. */
+   static void CopyTiles(sqlite3 *db, const char *schema);
+
+private:
+   //! @return null if there is no connection
+   DBConnection *Conn() const;
+
+   struct Statements {
+      sqlite3_stmt *size{};
+      sqlite3_stmt *oldest{};
+      sqlite3_stmt *deletion{};
+      sqlite3_stmt *insert{};
+      sqlite3_stmt *insertBlock{};
+   };
+
+   //! @pre mMutex and the connection's mutex are held
+   /*! @return whether enough tiles were deleted */
+   bool MakeRoom(
+      const Statements &statements, long long bytes, long long capacity);
+
+   //! @pre mMutex and the connection's mutex are held
+   bool DoSave(sqlite3 *db, const Statements &statements,
+      const Key &key, const float *columns, long long bytes);
+
+   const std::shared_ptr<ConnectionPtr> mppConnection;
+
+   //! In bytes
+   std::atomic<long long> mCapacity{ 0 };
+
+   std::mutex mMutex;
+   //! Database for which the tables exist, or null
+   sqlite3 *mDB{ nullptr };
+   //! Bytes of tiles stored in mDB, or negative if not yet counted
+   long long mBytes{ -1 };
+};
+
+#endif
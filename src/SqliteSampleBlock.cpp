@@ -8,16 +8,26 @@ Paul Licameli -- split from SampleBlock.cpp and SampleBlock.h
 
 **********************************************************************/
 
+#include <algorithm>
+#include <atomic>
 #include <float.h>
+#include <functional>
+#include <mutex>
 #include <sqlite3.h>
+#include <unordered_map>
 
 #include "BasicUI.h"
 #include "DBConnection.h"
 #include "ProjectFileIO.h"
 #include "SampleFormat.h"
+#include "SampleStatistics.h"
 #include "XMLTagHandler.h"
 
 #include "SampleBlock.h" // to inherit
+#include "SampleBlockCache.h"
+#include "SampleBlockCodec.h"
+#include "SampleBlockIndex.h"
+#include "SampleBlockWriter.h"
 #include "UndoManager.h"
 #include "WaveTrack.h"
 
@@ -80,7 +90,33 @@ private:
                    const char *sql);
    size_t GetBlob(void *dest,
                   sampleFormat destformat,
-                  sqlite3_stmt *stmt,
+                  DBConnection::StatementID id,
+                  const char *sql,
+                  sampleFormat srcformat,
+                  size_t srcoffset,
+                  size_t srcbytes);
+   //! Fetch the whole sample blob from the database, after a miss in the
+   //! factory's cache, then remember it in the cache
+   /*! @return null if the cache is disabled */
+   SampleBlockCache::Blob CacheSamples();
+   //! Fetch the whole sample blob from the database, decoded
+   SampleBlockCache::Blob ReadSamples();
+   //! Copy the samples of the block as stored, decoding them if need be
+   SampleBlockCache::Blob MakeBlob(const void *src, size_t srcbytes) const;
+   //! Select one blob of the row and pass its bytes to the visitor
+   /*! Uses a connection of the read pool in worker threads, else the primary
+    connection.  Throws if the row can't be read. */
+   void VisitBlob(DBConnection::StatementID id, const char *sql,
+      const std::function<void(const void *src, size_t bytes)> &visitor);
+   //! In a worker thread, select one blob of the row with a connection of
+   //! the read pool, and pass its bytes to the visitor
+   /*! @return false if not visited; then use the primary connection */
+   bool ReadPooled(DBConnection::StatementID id, const char *sql,
+      const std::function<void(const void *src, size_t bytes)> &visitor);
+   static size_t CopyFromBlob(void *dest,
+                  sampleFormat destformat,
+                  constSamplePtr src,
+                  size_t blobbytes,
                   sampleFormat srcformat,
                   size_t srcoffset,
                   size_t srcbytes);
@@ -89,6 +125,11 @@ private:
       fields = 3, /* min, max, rms */
       bytesPerFrame = fields * sizeof(float),
    };
+
+   //! Reads of no more than 1 / PartialReadRatio of a block read only
+   //! that part
+   static constexpr size_t PartialReadRatio = 4;
+
    Sizes SetSizes( size_t numsamples, sampleFormat srcformat );
    void CalcSummary(Sizes sizes);
 
@@ -110,9 +151,12 @@ private:
    SampleBlockID mBlockID{ 0 };
 
    ArrayOf<char> mSamples;
+   //! Before any encoding
    size_t mSampleBytes;
    size_t mSampleCount;
    sampleFormat mSampleFormat;
+   //! How the samples are stored
+   int mCodec{ SampleBlockCodec::Raw };
 
    ArrayOf<char> mSummary256;
    ArrayOf<char> mSummary64k;
@@ -120,6 +164,10 @@ private:
    double mSumMax;
    double mSumRms;
 
+   //! Disk usage of the stored row, which never changes, or zero if not yet
+   //! measured
+   mutable std::atomic<size_t> mSpaceUsage{ 0 };
+
 #if defined(WORDS_BIGENDIAN)
 #error All sample block data is little endian...big endian not yet supported
 #endif
@@ -130,6 +178,8 @@ private:
 // used length values
 static std::map< SampleBlockID, std::shared_ptr<SqliteSampleBlock> >
    sSilentBlocks;
+//! Guards sSilentBlocks, because effects may create blocks in worker threads
+static std::mutex sSilentBlocksMutex;
 
 ///\brief Implementation of @ref SampleBlockFactory using Sqlite database
 class SqliteSampleBlockFactory final
@@ -155,6 +205,20 @@ public:
       sampleFormat srcformat,
       const AttributesList &attrs) override;
 
+   void Preload(const SampleBlockPtrs &blocks) override;
+
+   //! Whether the project file has the columns for encoded samples, so
+   //! that blocks should be encoded when committed
+   bool StoresEncodedSamples();
+
+   //! @return a block of this factory with exactly the given samples, or null
+   std::shared_ptr<SqliteSampleBlock> FindShared(uint64_t hash,
+      constSamplePtr src, size_t numsamples, sampleFormat srcformat);
+
+   //! Installed as the SampleBlock::DeletionCallback, so that row ids of
+   //! deleted blocks, which the database may reuse, are not found in caches
+   static void InvalidateCachedBlock(const SampleBlock &block);
+
 private:
    void OnBeginPurge(size_t begin, size_t end);
    void OnEndPurge();
@@ -165,6 +229,9 @@ private:
    Observer::Subscription mUndoSubscription;
    std::optional<SampleBlock::DeletionCallback::Scope> mScope;
    const std::shared_ptr<ConnectionPtr> mppConnection;
+   const std::shared_ptr<SampleBlockCache> mpCache;
+   const std::shared_ptr<SampleBlockWriter> mpWriter;
+   const std::shared_ptr<SampleBlockIndex> mpIndex;
 
    // Track all blocks that this factory has created, but don't control
    // their lifetimes (so use weak_ptr)
@@ -173,11 +240,22 @@ private:
    using AllBlocksMap =
       std::map< SampleBlockID, std::weak_ptr< SqliteSampleBlock > >;
    AllBlocksMap mAllBlocks;
+   //! Guards mAllBlocks, because effects may create blocks in worker threads
+   std::mutex mAllBlocksMutex;
+
+   //! Guards the next two, which remember the result of
+   //! StoresEncodedSamples() for one database
+   std::mutex mEncodingMutex;
+   sqlite3 *mEncodingDB{ nullptr };
+   bool mEncoding{ false };
 };
 
 SqliteSampleBlockFactory::SqliteSampleBlockFactory( AudacityProject &project )
    : mProject{ project }
    , mppConnection{ ConnectionPtr::Get(project).shared_from_this() }
+   , mpCache{ SampleBlockCache::Get(project).shared_from_this() }
+   , mpWriter{ SampleBlockWriter::Get(project).shared_from_this() }
+   , mpIndex{ SampleBlockIndex::Get(project).shared_from_this() }
 {
    mUndoSubscription = UndoManager::Get(project)
       .Subscribe([this](UndoRedoMessage message){
@@ -194,19 +272,76 @@ SqliteSampleBlockFactory::SqliteSampleBlockFactory( AudacityProject &project )
 
 SqliteSampleBlockFactory::~SqliteSampleBlockFactory() = default;
 
+bool SqliteSampleBlockFactory::StoresEncodedSamples()
+{
+   auto &pConnection = mppConnection->mpConnection;
+   if (!pConnection)
+      return false;
+
+   // Copies of the file keep its columns, so the answer changes only when
+   // a new project file is opened
+   const auto db = pConnection->DB();
+   std::lock_guard<std::mutex> guard{ mEncodingMutex };
+   if (db != mEncodingDB) {
+      mEncoding = ProjectFileIO::StoresEncodedSamples(db);
+      mEncodingDB = db;
+   }
+   return mEncoding;
+}
+
 SampleBlockPtr SqliteSampleBlockFactory::DoCreate(
    constSamplePtr src, size_t numsamples, sampleFormat srcformat )
 {
+   // Share a block with the same samples, as after importing a file again;
+   // but not while recording, when the writer inserts the rows later
+   std::optional<uint64_t> hash;
+   auto &index = *mpIndex;
+   if (index.IsEnabled() && !mpWriter->IsActive()) {
+      hash = SampleBlockIndex::Hash(src, numsamples, srcformat);
+      if (auto pShared = FindShared(*hash, src, numsamples, srcformat))
+         return pShared;
+   }
+
    auto sb = std::make_shared<SqliteSampleBlock>(shared_from_this());
    sb->SetSamples(src, numsamples, srcformat);
    // block id has now been assigned
+   if (hash)
+      index.Add(*hash, sb->GetBlockID());
+   std::lock_guard<std::mutex> guard{ mAllBlocksMutex };
    mAllBlocks[ sb->GetBlockID() ] = sb;
    return sb;
 }
 
+std::shared_ptr<SqliteSampleBlock> SqliteSampleBlockFactory::FindShared(
+   uint64_t hash,
+   constSamplePtr src, size_t numsamples, sampleFormat srcformat)
+{
+   for (const auto id : mpIndex->Find(hash)) {
+      std::shared_ptr<SqliteSampleBlock> pBlock;
+      {
+         std::lock_guard<std::mutex> guard{ mAllBlocksMutex };
+         if (auto iter = mAllBlocks.find(id); iter != mAllBlocks.end())
+            pBlock = iter->second.lock();
+      }
+      // Rows without blocks are orphans, to be deleted
+      if (!pBlock || pBlock->GetSampleFormat() != srcformat ||
+          pBlock->GetSampleCount() != numsamples)
+         continue;
+
+      // Hashes may collide
+      SampleBuffer buffer(numsamples, srcformat);
+      if (pBlock->GetSamples(buffer.ptr(), srcformat, 0, numsamples, false)
+             == numsamples &&
+          memcmp(buffer.ptr(), src, numsamples * SAMPLE_SIZE(srcformat)) == 0)
+         return pBlock;
+   }
+   return {};
+}
+
 auto SqliteSampleBlockFactory::GetActiveBlockIDs() -> SampleBlockIDs
 {
    SampleBlockIDs result;
+   std::lock_guard<std::mutex> guard{ mAllBlocksMutex };
    for (auto end = mAllBlocks.end(), it = mAllBlocks.begin(); it != end;) {
       if (it->second.expired())
          // Tighten up the map
@@ -223,6 +358,7 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateSilent(
    size_t numsamples, sampleFormat )
 {
    auto id = -static_cast< SampleBlockID >(numsamples);
+   std::lock_guard<std::mutex> guard{ sSilentBlocksMutex };
    auto &result = sSilentBlocks[ id ];
    if ( !result ) {
       result = std::make_shared<SqliteSampleBlock>(nullptr);
@@ -259,6 +395,7 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromXML(
          }
          else {
             // First see if this block id was previously loaded
+            std::lock_guard<std::mutex> guard{ mAllBlocksMutex };
             auto &wb = mAllBlocks[ nValue ];
             auto pb = wb.lock();
             if (pb)
@@ -289,6 +426,101 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromXML(
    return sb;
 }
 
+void SqliteSampleBlockFactory::Preload(const SampleBlockPtrs &blocks)
+{
+   // Without a cache there is nowhere to keep the results
+   auto &cache = *mpCache;
+   if (!cache.IsEnabled())
+      return;
+
+   // Don't read so much ahead that the first blocks are evicted again
+   // before they are used
+   const auto budget = cache.GetCapacity() / 2;
+   size_t total = 0;
+
+   std::vector<SampleBlockID> ids;
+   // To decode the rows
+   std::unordered_map<SampleBlockID, const SqliteSampleBlock *> blocksByID;
+   for (const auto &pBlock : blocks) {
+      auto pSqliteBlock = dynamic_cast<const SqliteSampleBlock *>(pBlock.get());
+      // Blocks not yet loaded have unknown codecs
+      if (!pSqliteBlock || pSqliteBlock->IsSilent() ||
+          !pSqliteBlock->mValid ||
+          cache.Contains(pSqliteBlock->mBlockID))
+         continue;
+      total += pSqliteBlock->mSampleBytes;
+      if (total > budget)
+         break;
+      ids.push_back(pSqliteBlock->mBlockID);
+      blocksByID[pSqliteBlock->mBlockID] = pSqliteBlock;
+   }
+
+   // Blocks may be shared, as after copy and paste
+   std::sort(ids.begin(), ids.end());
+   ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+   if (ids.empty())
+      return;
+
+   enum { batchSize = 16 };
+   static const std::string sql = []{
+      std::string result =
+         "SELECT blockid, samples FROM sampleblocks WHERE blockid IN (?1";
+      for (int ii = 2; ii <= batchSize; ++ii)
+         result += ",?" + std::to_string(ii);
+      return result + ");";
+   }();
+
+   auto &pConnection = mppConnection->mpConnection;
+   if (!pConnection)
+      return;
+
+   try {
+      // Prefer a connection of the read pool, as in a worker thread;
+      // rows it does not find are read singly later
+      auto reader =
+         pConnection->PrepareRead(DBConnection::GetSamplesBatch, sql.c_str());
+      // Prepare and cache statement...automatically finalized at DB close
+      sqlite3_stmt *stmt = reader ? reader.get() :
+         pConnection->Prepare(DBConnection::GetSamplesBatch, sql.c_str());
+
+      for (size_t first = 0; first < ids.size(); first += batchSize) {
+         // Bind statement parameters
+         // Unused parameters match no row, because stored blocks have
+         // positive ids
+         for (int ii = 0; ii < batchSize; ++ii) {
+            const auto index = first + ii;
+            if (sqlite3_bind_int64(stmt, ii + 1,
+                  index < ids.size() ? ids[index] : 0))
+               wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+         }
+
+         // Execute the statement, retrieving one row per block
+         int rc;
+         while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            const SampleBlockID id = sqlite3_column_int64(stmt, 0);
+            auto src = sqlite3_column_blob(stmt, 1);
+            size_t blobbytes = (size_t) sqlite3_column_bytes(stmt, 1);
+            cache.Insert(id, blocksByID.at(id)->MakeBlob(src, blobbytes));
+         }
+
+         // Clear statement bindings and rewind statement
+         sqlite3_clear_bindings(stmt);
+         sqlite3_reset(stmt);
+
+         if (rc != SQLITE_DONE) {
+            // Leave the error to be reported when blocks are read singly
+            wxLogDebug(
+               wxT("SqliteSampleBlockFactory::Preload - SQLITE error %s"),
+               sqlite3_errmsg(sqlite3_db_handle(stmt)));
+            break;
+         }
+      }
+   }
+   catch ( const AudacityException & ) {
+   }
+}
+
 SqliteSampleBlock::SqliteSampleBlock(
    const std::shared_ptr<SqliteSampleBlockFactory> &pFactory)
 :  mpFactory(pFactory)
@@ -379,13 +611,84 @@ size_t SqliteSampleBlock::DoGetSamples(samplePtr dest,
       return numsamples;
    }
 
-   // Prepare and cache statement...automatically finalized at DB close
-   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::GetSamples,
-      "SELECT samples FROM sampleblocks WHERE blockid = ?1;");
+   const auto copyBlob = [&](const SampleBlockCache::Blob &blob){
+      return CopyFromBlob(dest,
+                  destformat,
+                  (constSamplePtr) blob->data(),
+                  blob->size(),
+                  mSampleFormat,
+                  sampleoffset * SAMPLE_SIZE(mSampleFormat),
+                  numsamples * SAMPLE_SIZE(mSampleFormat)) / SAMPLE_SIZE(mSampleFormat);
+   };
+
+   // The row may still be queued for insertion
+   size_t copied = 0;
+   if (mpFactory->mpWriter->Visit(mBlockID,
+      [&](const SampleBlockWriter::Row &row){
+         if (row.codec != SampleBlockCodec::Raw) {
+            copied = copyBlob(MakeBlob(row.samples.get(), row.sampleBytes));
+            return;
+         }
+         copied = CopyFromBlob(dest,
+                  destformat,
+                  row.samples.get(),
+                  row.sampleBytes,
+                  mSampleFormat,
+                  sampleoffset * SAMPLE_SIZE(mSampleFormat),
+                  numsamples * SAMPLE_SIZE(mSampleFormat)) / SAMPLE_SIZE(mSampleFormat);
+      }))
+      return copied;
+
+   auto &cache = *mpFactory->mpCache;
+   if (cache.IsEnabled())
+      if (auto blob = cache.Find(mBlockID))
+         return copyBlob(blob);
+
+   if (!mValid)
+   {
+      Load(mBlockID);
+   }
+
+   // Read only the wanted part of a raw blob, if it is small, as for
+   // scrubbing or drawing zoomed in; leave the cache to whole reads.
+   // Encoded samples are decoded whole
+   const auto srcbytes = numsamples * SAMPLE_SIZE(mSampleFormat);
+   if (mCodec == SampleBlockCodec::Raw &&
+       srcbytes * PartialReadRatio <= mSampleBytes)
+   {
+      const auto srcoffset = sampleoffset * SAMPLE_SIZE(mSampleFormat);
+      if (destformat == mSampleFormat)
+      {
+         const auto bytes = Conn()->ReadBlob("sampleblocks", "samples",
+            mBlockID, srcoffset, dest, srcbytes);
+         if (bytes >= 0)
+         {
+            memset(dest + bytes, 0, srcbytes - static_cast<size_t>(bytes));
+            return numsamples;
+         }
+      }
+      else
+      {
+         ArrayOf<char> buffer{ srcbytes };
+         const auto bytes = Conn()->ReadBlob("sampleblocks", "samples",
+            mBlockID, srcoffset, buffer.get(), srcbytes);
+         if (bytes >= 0)
+            return CopyFromBlob(dest, destformat, buffer.get(), bytes,
+               mSampleFormat, 0, srcbytes) / SAMPLE_SIZE(mSampleFormat);
+      }
+   }
+
+   // The cache was consulted above, so that this miss is counted once
+   if (auto blob = CacheSamples())
+      return copyBlob(blob);
+
+   if (mCodec != SampleBlockCodec::Raw)
+      return copyBlob(ReadSamples());
 
    return GetBlob(dest,
                   destformat,
-                  stmt,
+                  DBConnection::GetSamples,
+                  "SELECT samples FROM sampleblocks WHERE blockid = ?1;",
                   mSampleFormat,
                   sampleoffset * SAMPLE_SIZE(mSampleFormat),
                   numsamples * SAMPLE_SIZE(mSampleFormat)) / SAMPLE_SIZE(mSampleFormat);
@@ -408,6 +711,14 @@ bool SqliteSampleBlock::GetSummary256(float *dest,
                                       size_t frameoffset,
                                       size_t numframes)
 {
+   if (!IsSilent() && mpFactory->mpWriter->Visit(mBlockID,
+      [&](const SampleBlockWriter::Row &row){
+         CopyFromBlob(dest, floatSample,
+            row.summary256.get(), row.summary256Bytes, floatSample,
+            frameoffset * bytesPerFrame, numframes * bytesPerFrame);
+      }))
+      return true;
+
    return GetSummary(dest, frameoffset, numframes, DBConnection::GetSummary256,
       "SELECT summary256 FROM sampleblocks WHERE blockid = ?1;");
 }
@@ -416,6 +727,14 @@ bool SqliteSampleBlock::GetSummary64k(float *dest,
                                       size_t frameoffset,
                                       size_t numframes)
 {
+   if (!IsSilent() && mpFactory->mpWriter->Visit(mBlockID,
+      [&](const SampleBlockWriter::Row &row){
+         CopyFromBlob(dest, floatSample,
+            row.summary64k.get(), row.summary64kBytes, floatSample,
+            frameoffset * bytesPerFrame, numframes * bytesPerFrame);
+      }))
+      return true;
+
    return GetSummary(dest, frameoffset, numframes, DBConnection::GetSummary64k,
       "SELECT summary64k FROM sampleblocks WHERE blockid = ?1;");
 }
@@ -431,13 +750,12 @@ bool SqliteSampleBlock::GetSummary(float *dest,
    if (!silent) {
       // Not a silent block
       try {
-         // Prepare and cache statement...automatically finalized at DB close
-         auto stmt = Conn()->Prepare(id, sql);
          // Note GetBlob returns a size_t, not a bool
          // REVIEW: An error in GetBlob() will throw an exception.
          GetBlob(dest,
                      floatSample,
-                     stmt,
+                     id,
+                     sql,
                      floatSample,
                      frameoffset * fields * SAMPLE_SIZE(floatSample),
                      numframes * fields * SAMPLE_SIZE(floatSample));
@@ -494,22 +812,10 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
       float *samples = (float *) blockData.ptr();
 
       size_t copied = DoGetSamples((samplePtr) samples, floatSample, start, len);
-      for (size_t i = 0; i < copied; ++i, ++samples)
-      {
-         float sample = *samples;
-
-         if (sample > max)
-         {
-            max = sample;
-         }
-
-         if (sample < min)
-         {
-            min = sample;
-         }
-
-         sumsq += (sample * sample);
-      }
+      const auto stats = SampleStatistics::Compute(samples, copied);
+      min = stats.min;
+      max = stats.max;
+      sumsq = stats.sumsq;
    }
 
    return { min, max, (float) sqrt(sumsq / len) };
@@ -527,19 +833,31 @@ size_t SqliteSampleBlock::GetSpaceUsage() const
 {
    if (IsSilent())
       return 0;
-   else
-      return ProjectFileIO::GetDiskUsage(*Conn(), mBlockID);
+
+   // Estimate for a row not yet inserted, ignoring page overhead
+   size_t pending = 0;
+   if (mpFactory->mpWriter->Visit(mBlockID,
+      [&](const SampleBlockWriter::Row &row){
+         pending =
+            row.sampleBytes + row.summary256Bytes + row.summary64kBytes;
+      }))
+      return pending;
+
+   if (const auto usage = mSpaceUsage.load(std::memory_order_relaxed))
+      return usage;
+   const auto usage = ProjectFileIO::GetDiskUsage(*Conn(), mBlockID);
+   mSpaceUsage.store(usage, std::memory_order_relaxed);
+   return usage;
 }
 
 size_t SqliteSampleBlock::GetBlob(void *dest,
                                   sampleFormat destformat,
-                                  sqlite3_stmt *stmt,
+                                  DBConnection::StatementID id,
+                                  const char *sql,
                                   sampleFormat srcformat,
                                   size_t srcoffset,
                                   size_t srcbytes)
 {
-   auto db = DB();
-
    wxASSERT(!IsSilent());
 
    if (!mValid)
@@ -547,8 +865,32 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
       Load(mBlockID);
    }
 
-   int rc;
-   size_t minbytes = 0;
+   VisitBlob(id, sql, [&](const void *src, size_t blobbytes){
+      CopyFromBlob(dest, destformat, static_cast<constSamplePtr>(src),
+         blobbytes, srcformat, srcoffset, srcbytes);
+   });
+
+   return srcbytes;
+}
+
+void SqliteSampleBlock::VisitBlob(DBConnection::StatementID id,
+   const char *sql,
+   const std::function<void(const void *src, size_t bytes)> &visitor)
+{
+   if (ReadPooled(id, sql, visitor))
+      return;
+
+   auto db = DB();
+
+   // Prepare and cache statement...automatically finalized at DB close
+   sqlite3_stmt *stmt = Conn()->Prepare(id, sql);
+
+   // Clear statement bindings and rewind statement, even if the visitor
+   // throws
+   auto cleanup = finally([&]{
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   });
 
    // Bind statement parameters
    // Might return SQLITE_MISUSE which means it's our mistake that we violated
@@ -557,23 +899,19 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
    {
       ADD_EXCEPTION_CONTEXT(
          "sqlite3.rc", std::to_string(sqlite3_errcode(Conn()->DB())));
-      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::GetBlob::bind");
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::VisitBlob::bind");
 
       wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
    }
 
    // Execute the statement
-   rc = sqlite3_step(stmt);
+   int rc = sqlite3_step(stmt);
    if (rc != SQLITE_ROW)
    {
       ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
-      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::GetBlob::step");
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::VisitBlob::step");
 
-      wxLogDebug(wxT("SqliteSampleBlock::GetBlob - SQLITE error %s"), sqlite3_errmsg(db));
-
-      // Clear statement bindings and rewind statement
-      sqlite3_clear_bindings(stmt);
-      sqlite3_reset(stmt);
+      wxLogDebug(wxT("SqliteSampleBlock::VisitBlob - SQLITE error %s"), sqlite3_errmsg(db));
 
       // Just showing the user a simple message, not the library error too
       // which isn't internationalized
@@ -588,8 +926,19 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
    }
 
    // Retrieve returned data
-   samplePtr src = (samplePtr) sqlite3_column_blob(stmt, 0);
-   size_t blobbytes = (size_t) sqlite3_column_bytes(stmt, 0);
+   visitor(sqlite3_column_blob(stmt, 0),
+      static_cast<size_t>(sqlite3_column_bytes(stmt, 0)));
+}
+
+size_t SqliteSampleBlock::CopyFromBlob(void *dest,
+                                       sampleFormat destformat,
+                                       constSamplePtr src,
+                                       size_t blobbytes,
+                                       sampleFormat srcformat,
+                                       size_t srcoffset,
+                                       size_t srcbytes)
+{
+   size_t minbytes = 0;
 
    srcoffset = std::min(srcoffset, blobbytes);
    minbytes = std::min(srcbytes, blobbytes - srcoffset);
@@ -648,13 +997,80 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
       memset(dest, 0, srcbytes - minbytes);
    }
 
-   // Clear statement bindings and rewind statement
-   sqlite3_clear_bindings(stmt);
-   sqlite3_reset(stmt);
-
    return srcbytes;
 }
 
+SampleBlockCache::Blob SqliteSampleBlock::CacheSamples()
+{
+   auto &cache = *mpFactory->mpCache;
+   if (!cache.IsEnabled())
+      return {};
+
+   auto blob = ReadSamples();
+   cache.Insert(mBlockID, blob);
+   return blob;
+}
+
+SampleBlockCache::Blob SqliteSampleBlock::ReadSamples()
+{
+   wxASSERT(!IsSilent());
+
+   if (!mValid)
+   {
+      Load(mBlockID);
+   }
+
+   SampleBlockCache::Blob blob;
+   VisitBlob(DBConnection::GetSamples,
+      "SELECT samples FROM sampleblocks WHERE blockid = ?1;",
+      [&](const void *src, size_t blobbytes){
+         blob = MakeBlob(src, blobbytes);
+      });
+   return blob;
+}
+
+SampleBlockCache::Blob SqliteSampleBlock::MakeBlob(
+   const void *src, size_t srcbytes) const
+{
+   auto bytes = static_cast<const char *>(src);
+   if (mCodec == SampleBlockCodec::Raw)
+      return std::make_shared<const std::vector<char>>(
+         bytes, bytes + srcbytes);
+
+   auto result = std::make_shared<std::vector<char>>(mSampleBytes);
+   if (!SampleBlockCodec::Decode(mCodec, src, srcbytes,
+      mSampleFormat, result->data(), mSampleBytes))
+   {
+      // Read as silence, as when a raw blob is short
+      wxLogMessage("Sample block %lld could not be decoded", mBlockID);
+      std::fill(result->begin(), result->end(), 0);
+   }
+   return result;
+}
+
+bool SqliteSampleBlock::ReadPooled(DBConnection::StatementID id,
+   const char *sql,
+   const std::function<void(const void *src, size_t bytes)> &visitor)
+{
+   auto pConnection = Conn();
+   auto reader = pConnection->PrepareRead(id, sql);
+   if (!reader)
+      return false;
+
+   const auto stmt = reader.get();
+   if (sqlite3_bind_int64(stmt, 1, mBlockID) == SQLITE_OK &&
+       sqlite3_step(stmt) == SQLITE_ROW)
+   {
+      visitor(sqlite3_column_blob(stmt, 0),
+         static_cast<size_t>(sqlite3_column_bytes(stmt, 0)));
+      return true;
+   }
+
+   // Perhaps the row was inserted in a transaction not yet committed
+   pConnection->CountReadFallback();
+   return false;
+}
+
 void SqliteSampleBlock::Load(SampleBlockID sbid)
 {
    auto db = DB();
@@ -670,10 +1086,16 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
    mSumMin = 0.0;
 
    // Prepare and cache statement...automatically finalized at DB close
-   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::LoadSampleBlock,
-      "SELECT sampleformat, summin, summax, sumrms,"
-      "       length(samples)"
-      "  FROM sampleblocks WHERE blockid = ?1;");
+   const bool encoded = mpFactory->StoresEncodedSamples();
+   sqlite3_stmt *stmt = encoded
+      ? Conn()->Prepare(DBConnection::LoadEncodedSampleBlock,
+         "SELECT sampleformat, summin, summax, sumrms,"
+         "       length(samples), codec, rawbytes"
+         "  FROM sampleblocks WHERE blockid = ?1;")
+      : Conn()->Prepare(DBConnection::LoadSampleBlock,
+         "SELECT sampleformat, summin, summax, sumrms,"
+         "       length(samples)"
+         "  FROM sampleblocks WHERE blockid = ?1;");
 
    // Bind statement parameters
    // Might return SQLITE_MISUSE which means it's our mistake that we violated
@@ -714,6 +1136,9 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
    mSumMax = sqlite3_column_double(stmt, 2);
    mSumRms = sqlite3_column_double(stmt, 3);
    mSampleBytes = sqlite3_column_int(stmt, 4);
+   mCodec = encoded ? sqlite3_column_int(stmt, 5) : SampleBlockCodec::Raw;
+   if (mCodec != SampleBlockCodec::Raw)
+      mSampleBytes = sqlite3_column_int64(stmt, 6);
    mSampleCount = mSampleBytes / SAMPLE_SIZE(mSampleFormat);
 
    // Clear statement bindings and rewind statement
@@ -725,67 +1150,36 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
 
 void SqliteSampleBlock::Commit(Sizes sizes)
 {
-   const auto mSummary256Bytes = sizes.first;
-   const auto mSummary64kBytes = sizes.second;
-
-   auto db = DB();
-   int rc;
-
-   // Prepare and cache statement...automatically finalized at DB close
-   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::InsertSampleBlock,
-      "INSERT INTO sampleblocks (sampleformat, summin, summax, sumrms,"
-      "                          summary256, summary64k, samples)"
-      "                         VALUES(?1,?2,?3,?4,?5,?6,?7);");
-
-   // Bind statement parameters
-   // Might return SQLITE_MISUSE which means it's our mistake that we violated
-   // preconditions; should return SQL_OK which is 0
-   if (sqlite3_bind_int(stmt, 1, mSampleFormat) ||
-       sqlite3_bind_double(stmt, 2, mSumMin) ||
-       sqlite3_bind_double(stmt, 3, mSumMax) ||
-       sqlite3_bind_double(stmt, 4, mSumRms) ||
-       sqlite3_bind_blob(stmt, 5, mSummary256.get(), mSummary256Bytes, SQLITE_STATIC) ||
-       sqlite3_bind_blob(stmt, 6, mSummary64k.get(), mSummary64kBytes, SQLITE_STATIC) ||
-       sqlite3_bind_blob(stmt, 7, mSamples.get(), mSampleBytes, SQLITE_STATIC))
-   {
-
-      ADD_EXCEPTION_CONTEXT(
-         "sqlite3.rc", std::to_string(sqlite3_errcode(Conn()->DB())));
-      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::Commit::bind");
-
-
-      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
-   }
- 
-   // Execute the statement
-   rc = sqlite3_step(stmt);
-   if (rc != SQLITE_DONE)
-   {
-      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
-      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::Commit::step");
-
-      wxLogDebug(wxT("SqliteSampleBlock::Commit - SQLITE error %s"), sqlite3_errmsg(db));
-
-      // Clear statement bindings and rewind statement
-      sqlite3_clear_bindings(stmt);
-      sqlite3_reset(stmt);
-
-      // Just showing the user a simple message, not the library error too
-      // which isn't internationalized
-      Conn()->ThrowException( true );
+   // The writer takes the local arrays
+   SampleBlockWriter::Row row;
+   row.format = mSampleFormat;
+   row.sumMin = mSumMin;
+   row.sumMax = mSumMax;
+   row.sumRms = mSumRms;
+   row.summary256 = std::move(mSummary256);
+   row.summary256Bytes = sizes.first;
+   row.summary64k = std::move(mSummary64k);
+   row.summary64kBytes = sizes.second;
+   row.samples = std::move(mSamples);
+   row.sampleBytes = mSampleBytes;
+
+   // Encode in the calling thread, which may be one of several processing
+   // tracks; samples that don't shrink are stored raw
+   if (mpFactory->StoresEncodedSamples()) {
+      ArrayOf<char> encoded;
+      if (const auto bytes = SampleBlockCodec::Encode(
+            row.samples.get(), mSampleCount, mSampleFormat, encoded)) {
+         row.samples = std::move(encoded);
+         row.sampleBytes = bytes;
+         row.codec = SampleBlockCodec::FixedRice;
+         row.rawBytes = mSampleBytes;
+      }
    }
+   mCodec = row.codec;
 
-   // Retrieve returned data
-   mBlockID = sqlite3_last_insert_rowid(db);
-
-   // Reset local arrays
-   mSamples.reset();
-   mSummary256.reset();
-   mSummary64k.reset();
-
-   // Clear statement bindings and rewind statement
-   sqlite3_clear_bindings(stmt);
-   sqlite3_reset(stmt);
+   // Inserted now, or else queued while recording; either way the id is
+   // known at once
+   mBlockID = mpFactory->mpWriter->Write(std::move(row));
 
    mValid = true;
 }
@@ -797,6 +1191,10 @@ void SqliteSampleBlock::Delete()
 
    wxASSERT(!IsSilent());
 
+   // A row still queued need never be inserted
+   if (mpFactory->mpWriter->Cancel(mBlockID))
+      return;
+
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::DeleteSampleBlock,
       "DELETE FROM sampleblocks WHERE blockid = ?1;");
@@ -896,10 +1294,6 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
 
    for (int i = 0; i < sumLen; ++i)
    {
-      min = samples[i * 256];
-      max = samples[i * 256];
-      sumsq = min * min;
-
       int jcount = 256;
       if (jcount > mSampleCount - i * 256)
       {
@@ -907,27 +1301,21 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
          fraction = 1.0 - (jcount / 256.0);
       }
 
-      for (int j = 1; j < jcount; ++j)
-      {
-         float f1 = samples[i * 256 + j];
-         sumsq += f1 * f1;
+      const auto stats = SampleStatistics::Compute(samples + i * 256, jcount);
+      totalSquares += stats.sumsq;
 
-         if (f1 < min)
-         {
-            min = f1;
-         }
-         else if (f1 > max)
-         {
-            max = f1;
-         }
+      if (stats.min > stats.max) {
+         // Every sample was NaN; don't let the frame look empty to the 64k
+         // summaries and the block's minimum and maximum
+         summary256[i * fields] = 0.0f;
+         summary256[i * fields + 1] = 0.0f;
+      }
+      else {
+         summary256[i * fields] = stats.min;
+         summary256[i * fields + 1] = stats.max;
       }
-
-      totalSquares += sumsq;
-
-      summary256[i * fields] = min;
-      summary256[i * fields + 1] = max;
       // The rms is correct, but this may be for less than 256 samples in last loop.
-      summary256[i * fields + 2] = (float) sqrt(sumsq / jcount);
+      summary256[i * fields + 2] = (float) sqrt(stats.sumsq / jcount);
    }
 
    for (int i = sumLen, frames256 = mSummary256Bytes / bytesPerFrame;
@@ -1052,7 +1440,9 @@ void SqliteSampleBlockFactory::OnBeginPurge(size_t begin, size_t end)
    };
    mScope.emplace( [ pDialog, nDeleted = 0,
       nToDelete = EstimateRemovedBlocks(mProject, begin, end)
-   ] (const SampleBlock &) mutable {
+   ] (const SampleBlock &block) mutable {
+      // This replaces the usual callback for the duration of the purge
+      InvalidateCachedBlock(block);
       pDialog->Poll(++nDeleted, nToDelete);
    } );
 }
@@ -1062,6 +1452,17 @@ void SqliteSampleBlockFactory::OnEndPurge()
    mScope.reset();
 }
 
+void SqliteSampleBlockFactory::InvalidateCachedBlock(const SampleBlock &block)
+{
+   auto pBlock = dynamic_cast<const SqliteSampleBlock *>(&block);
+   if (pBlock && pBlock->mpFactory && !pBlock->IsSilent())
+      pBlock->mpFactory->mpCache->Invalidate(pBlock->mBlockID);
+}
+
+static SampleBlock::DeletionCallback::Scope sInvalidationScope{
+   SqliteSampleBlockFactory::InvalidateCachedBlock
+};
+
 // Inject our database implementation at startup
 static SampleBlockFactory::Factory::Scope scope{ []( AudacityProject &project )
 {
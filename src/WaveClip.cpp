@@ -127,6 +127,11 @@ bool WaveClip::GetSamples(samplePtr buffer, sampleFormat format,
    return mSequence->Get(buffer, format, start + TimeToSamples(mTrimLeft), len, mayThrow);
 }
 
+void WaveClip::PreloadSamples(sampleCount start, sampleCount len) const
+{
+   mSequence->Preload(start + TimeToSamples(mTrimLeft), len);
+}
+
 /*! @excsafety{Strong} */
 void WaveClip::SetSamples(constSamplePtr buffer, sampleFormat format,
                    sampleCount start, size_t len)
@@ -212,7 +217,7 @@ void WaveClip::UpdateEnvelopeTrackLen()
 
 /*! @excsafety{Strong} */
 std::shared_ptr<SampleBlock> WaveClip::AppendNewBlock(
-   samplePtr buffer, sampleFormat format, size_t len)
+   constSamplePtr buffer, sampleFormat format, size_t len)
 {
    return mSequence->AppendNewBlock( buffer, format, len );
 }
@@ -199,6 +199,8 @@ public:
 
    bool GetSamples(samplePtr buffer, sampleFormat format,
                    sampleCount start, size_t len, bool mayThrow = true) const;
+   //! Hint that samples will soon be read; start is relative to play start
+   void PreloadSamples(sampleCount start, sampleCount len) const;
    void SetSamples(constSamplePtr buffer, sampleFormat format,
                    sampleCount start, size_t len);
 
@@ -232,7 +234,7 @@ public:
 
    //! For use in importing pre-version-3 projects to preserve sharing of blocks
    std::shared_ptr<SampleBlock> AppendNewBlock(
-      samplePtr buffer, sampleFormat format, size_t len);
+      constSamplePtr buffer, sampleFormat format, size_t len);
 
    //! For use in importing pre-version-3 projects to preserve sharing of blocks
    void AppendSharedBlock(const std::shared_ptr<SampleBlock> &pBlock);
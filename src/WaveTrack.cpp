@@ -1769,6 +1769,19 @@ bool WaveTrack::Append(constSamplePtr buffer, sampleFormat format,
    return RightmostOrNewClip()->Append(buffer, format, len, stride);
 }
 
+/*! @excsafety{Partial}
+ -- Samples pending from Append() may be flushed, though the block is not
+ appended */
+void WaveTrack::AppendBlock(
+   constSamplePtr buffer, sampleFormat format, size_t len)
+{
+   const auto pClip = RightmostOrNewClip();
+   pClip->Flush();
+   pClip->AppendNewBlock(buffer, format, len);
+   pClip->UpdateEnvelopeTrackLen();
+   pClip->MarkChanged();
+}
+
 sampleCount WaveTrack::GetBlockStart(sampleCount s) const
 {
    for (const auto &clip : mClips)
@@ -2191,6 +2204,23 @@ bool WaveTrack::Get(samplePtr buffer, sampleFormat format,
    return result;
 }
 
+void WaveTrack::Preload(sampleCount start, sampleCount len) const
+{
+   // Iterate the clips.  They are not necessarily sorted by time.
+   for (const auto &clip: mClips)
+   {
+      auto clipStart = clip->GetPlayStartSample();
+      auto clipEnd = clip->GetPlayEndSample();
+
+      if (clipEnd > start && clipStart < start + len)
+      {
+         const auto t0 = std::max(start, clipStart);
+         const auto t1 = std::min(start + len, clipEnd);
+         clip->PreloadSamples(t0 - clipStart, t1 - t0);
+      }
+   }
+}
+
 /*! @excsafety{Weak} */
 void WaveTrack::Set(constSamplePtr buffer, sampleFormat format,
                     sampleCount start, size_t len)
@@ -2785,6 +2815,19 @@ void InspectBlocks(const TrackList &tracks, BlockInspector inspector,
       const_cast<TrackList &>(tracks), std::move( inspector ), pIDs );
 }
 
+#include "UndoManager.h"
+// Sample blocks are what states of undo history share
+static UndoSpaceInspector::Scope sUndoSpaceInspectorScope{
+   [](const TrackList &tracks,
+      const std::function<void(const UndoSpaceItem &)> &visitor)
+   {
+      SampleBlockIDSet seen;
+      InspectBlocks(tracks, [&](const SampleBlock &block){
+         visitor({ block.GetBlockID(), block.GetSpaceUsage() });
+      }, &seen);
+   }
+};
+
 #include "Project.h"
 #include "SampleBlock.h"
 static auto TrackFactoryFactory = []( AudacityProject &project ) {
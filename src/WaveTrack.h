@@ -249,6 +249,15 @@ private:
                size_t len, unsigned int stride=1) override;
    void Flush() override;
 
+   //! Append samples as new blocks of the rightmost clip, without copying
+   //! them into its append buffer
+   /*!
+    For importers that fill buffers of GetIdealBlockSize() samples; shorter
+    buffers make short blocks.  Samples pending from Append() are flushed
+    first.
+    */
+   void AppendBlock(constSamplePtr buffer, sampleFormat format, size_t len);
+
    ///
    /// MM: Now that each wave track can contain multiple clips, we don't
    /// have a continuous space of samples anymore, but we simulate it,
@@ -268,6 +277,7 @@ private:
       // filled according to fillFormat; but these were not necessarily one
       // contiguous range.
       sampleCount * pNumWithinClips = nullptr) const override;
+   void Preload(sampleCount start, sampleCount len) const override;
    void Set(constSamplePtr buffer, sampleFormat format,
                    sampleCount start, size_t len);
 
@@ -0,0 +1,114 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file AudioGraphBufferPool.cpp
+
+**********************************************************************/
+
+#include "AudioGraphBufferPool.h"
+
+#include <wx/sstream.h>
+#include <wx/txtstrm.h>
+
+#include "Internat.h"
+
+namespace {
+//! @return index of the smallest class holding count floats, which may be
+//! out of range
+unsigned ClassIndex(size_t count, unsigned minClassBits)
+{
+   unsigned index = 0;
+   while ((size_t{ 1 } << (minClassBits + index)) < count)
+      ++index;
+   return index;
+}
+}
+
+AudioGraph::BufferPool &AudioGraph::BufferPool::Get()
+{
+   static BufferPool pool;
+   return pool;
+}
+
+AudioGraph::BufferPool::BufferPool() = default;
+
+AudioGraph::BufferPool::~BufferPool()
+{
+   for (auto &slots : mSlots)
+      for (auto &slot : slots)
+         delete[] slot.exchange(nullptr);
+}
+
+void AudioGraph::BufferPool::Deleter::operator ()(float *p) const
+{
+   if (p)
+      BufferPool::Get().Release(p, capacity);
+}
+
+auto AudioGraph::BufferPool::Acquire(size_t count) -> Array
+{
+   const auto index = ClassIndex(count, MinClassBits);
+   if (index >= NumClasses) {
+      // Too large to keep
+      ++mMisses;
+      return { new float[count], Deleter{ count } };
+   }
+
+   const auto capacity = size_t{ 1 } << (MinClassBits + index);
+   for (auto &slot : mSlots[index]) {
+      // Load first, so that empty slots are not written
+      if (slot.load(std::memory_order_relaxed)) {
+         if (auto p = slot.exchange(nullptr, std::memory_order_acquire)) {
+            mBytes -= capacity * sizeof(float);
+            ++mHits;
+            return { p, Deleter{ capacity } };
+         }
+      }
+   }
+
+   ++mMisses;
+   return { new float[capacity], Deleter{ capacity } };
+}
+
+void AudioGraph::BufferPool::Release(float *p, size_t capacity)
+{
+   // Arrays of pooled classes have exactly the capacity of the class
+   const auto index = ClassIndex(capacity, MinClassBits);
+   if (index < NumClasses) {
+      const auto bytes = capacity * sizeof(float);
+      if (mBytes.fetch_add(bytes) + bytes <= MaxBytes) {
+         for (auto &slot : mSlots[index]) {
+            float *expected = nullptr;
+            if (slot.compare_exchange_strong(expected, p,
+               std::memory_order_release, std::memory_order_relaxed))
+               return;
+         }
+      }
+      // The pool or the class is full
+      mBytes -= bytes;
+   }
+
+   ++mDiscards;
+   delete[] p;
+}
+
+auto AudioGraph::BufferPool::GetStatistics() const -> Statistics
+{
+   return { mHits.load(), mMisses.load(), mDiscards.load(), mBytes.load() };
+}
+
+wxString AudioGraph::BufferPool::GetInfo() const
+{
+   wxStringOutputStream o;
+   wxTextOutputStream s(o, wxEOL_UNIX);
+
+   const auto pool = GetStatistics();
+   s << wxT("==============================\n");
+   s << XO("Effect buffer pool: %llu hits, %llu misses, %llu discards\n")
+      .Format( pool.hits, pool.misses, pool.discards );
+   s << XO("Effect buffer pool: %llu bytes kept\n")
+      .Format( (unsigned long long)pool.bytes );
+
+   return o.GetString();
+}
@@ -0,0 +1,85 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file AudioGraphBufferPool.h
+  @brief Recycles the sample arrays of AudioGraph::Buffers
+
+**********************************************************************/
+
+#ifndef __AUDACITY_AUDIO_GRAPH_BUFFER_POOL__
+#define __AUDACITY_AUDIO_GRAPH_BUFFER_POOL__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <wx/string.h>
+
+namespace AudioGraph {
+
+//! Keeps float arrays released by Buffers, for reuse by later effects
+/*!
+ Arrays are allocated in size classes of powers of two.  Each class has a
+ fixed number of slots, each an atomic pointer, so that acquisition and
+ release are lock-free and may happen in any threads.  The total size of
+ arrays kept is bounded; others are freed.
+ */
+class AUDACITY_DLL_API BufferPool final {
+public:
+   //! Returns the array to the pool
+   struct Deleter {
+      void operator ()(float *p) const;
+      //! Number of floats allocated
+      size_t capacity{ 0 };
+   };
+   using Array = std::unique_ptr<float[], Deleter>;
+
+   struct Statistics {
+      //! Acquisitions satisfied from the pool
+      unsigned long long hits{ 0 };
+      //! Acquisitions that allocated
+      unsigned long long misses{ 0 };
+      //! Releases freed because the pool was full or the array too large
+      unsigned long long discards{ 0 };
+      //! Bytes in arrays now kept for reuse
+      size_t bytes{ 0 };
+   };
+
+   static BufferPool &Get();
+
+   BufferPool();
+   BufferPool(const BufferPool &) = delete;
+   BufferPool &operator =(const BufferPool &) = delete;
+   ~BufferPool();
+
+   //! @return an array, with unspecified contents, of at least count floats
+   /*! @post `result.get_deleter().capacity >= count` */
+   Array Acquire(size_t count);
+
+   Statistics GetStatistics() const;
+
+   //! Statistics formatted for Audio Device Info
+   wxString GetInfo() const;
+
+private:
+   void Release(float *p, size_t capacity);
+
+   enum : unsigned {
+      //! log2 of the capacity of the smallest class
+      MinClassBits = 10,
+      NumClasses = 16,
+      SlotsPerClass = 8,
+   };
+   //! Bound on bytes kept
+   static constexpr size_t MaxBytes = 64 * 1024 * 1024;
+
+   std::atomic<float*> mSlots[NumClasses][SlotsPerClass]{};
+   std::atomic<size_t> mBytes{ 0 };
+   std::atomic<unsigned long long> mHits{ 0 };
+   std::atomic<unsigned long long> mMisses{ 0 };
+   std::atomic<unsigned long long> mDiscards{ 0 };
+};
+
+}
+
+#endif
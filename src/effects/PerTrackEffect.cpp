@@ -20,11 +20,20 @@
 
 #include "PerTrackEffect.h"
 
+#include "StatefulPerTrackEffect.h"
+#include "ThreadPool.h"
 #include "TimeWarper.h"
 #include "../SyncLock.h"
 #include "ViewInfo.h"
 #include "../WaveTrack.h"
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+
+BoolSetting PerTrackEffectParallel{ L"/Performance/ParallelEffects", false };
+
 AudioGraph::Source::~Source() = default;
 
 AudioGraph::Sink::~Sink() = default;
@@ -95,11 +104,23 @@ void AudioGraph::Buffers::Reinit(
 {
    assert(blockSize > 0);
    assert(nBlocks > 0);
+   const auto bufferSize = blockSize * nBlocks;
+   const auto oldChannels = mBuffers.size();
    mBuffers.resize(nChannels);
    mPositions.resize(nChannels);
-   const auto bufferSize = blockSize * nBlocks;
-   for (auto &buffer : mBuffers)
-      buffer.resize(bufferSize);
+   auto &pool = BufferPool::Get();
+   for (size_t ii = 0; ii < nChannels; ++ii) {
+      auto &buffer = mBuffers[ii];
+      // Size of data to preserve
+      const auto oldSize = ii < oldChannels ? mBufferSize : 0;
+      if (!buffer || buffer.get_deleter().capacity < bufferSize) {
+         auto newBuffer = pool.Acquire(bufferSize);
+         std::copy(buffer.get(), buffer.get() + oldSize, newBuffer.get());
+         buffer = std::move(newBuffer);
+      }
+      if (oldSize < bufferSize)
+         std::fill(buffer.get() + oldSize, buffer.get() + bufferSize, 0);
+   }
    mBufferSize = bufferSize;
    mBlockSize = blockSize;
    Rewind();
@@ -122,8 +143,8 @@ void AudioGraph::Buffers::Discard(size_t drop, size_t keep)
    auto iterP = mPositions.begin();
    auto iterB = mBuffers.begin();
    auto position = *iterP;
-   auto data = iterB->data();
-   auto end = data + iterB->size();
+   auto data = iterB->get();
+   auto end = data + mBufferSize;
 
    // Defend against excessive input values
    end = std::max(data, std::min(end, position + drop + keep));
@@ -165,8 +186,8 @@ void AudioGraph::Buffers::Advance(size_t count)
    auto iterP = mPositions.begin();
    auto iterB = mBuffers.begin();
    auto &position = *iterP;
-   auto data = iterB->data();
-   auto end = data + iterB->size();
+   auto data = iterB->get();
+   auto end = data + mBufferSize;
    // invariant assumed, and preserved
    assert(data <= position && position <= end);
    count = std::min<size_t>(end - position, count);
@@ -177,13 +198,13 @@ void AudioGraph::Buffers::Advance(size_t count)
    for (const auto endB = mBuffers.end(); ++iterB != endB;) {
       auto &position = *++iterP;
       // invariant assumed, and preserved
-      assert(iterB->data() <= position);
-      assert(position <= iterB->data() + iterB->size());
+      assert(iterB->get() <= position);
+      assert(position <= iterB->get() + mBufferSize);
    
       position += count;
 
-      assert(iterB->data() <= position);
-      assert(position <= iterB->data() + iterB->size());
+      assert(iterB->get() <= position);
+      assert(position <= iterB->get() + mBufferSize);
    }
 #else
    // Version that assumes the precondition,
@@ -199,7 +220,7 @@ void AudioGraph::Buffers::Rewind()
 {
    auto iterP = mPositions.begin();
    for (auto &buffer : mBuffers)
-      *iterP++ = buffer.data();
+      *iterP++ = buffer.get();
    assert(IsRewound());
 }
 
@@ -217,22 +238,21 @@ size_t AudioGraph::Buffers::Rotate()
 constSamplePtr AudioGraph::Buffers::GetReadPosition(unsigned iChannel) const
 {
    iChannel = std::min(iChannel, Channels() - 1);
-   auto buffer = mBuffers[iChannel].data();
+   auto buffer = mBuffers[iChannel].get();
    return reinterpret_cast<constSamplePtr>(buffer);
 }
 
 float &AudioGraph::Buffers::GetWritePosition(unsigned iChannel)
 {
    assert(iChannel < Channels());
-   return mBuffers[iChannel].data()[ Position() ];
+   return mBuffers[iChannel].get()[ Position() ];
 }
 
 void AudioGraph::Buffers::ClearBuffer(unsigned iChannel, size_t n)
 {
    if (iChannel < mPositions.size()) {
       auto p = mPositions[iChannel];
-      auto &buffer = mBuffers[iChannel];
-      auto end = buffer.data() + buffer.size();
+      auto end = mBuffers[iChannel].get() + mBufferSize;
       p = std::min(end, p);
       n = std::min<size_t>(end - p, n);
       std::fill(p, p + n, 0);
@@ -479,18 +499,18 @@ std::optional<size_t> EffectStage::FetchProcessAndAdvance(
 }
 
 bool EffectStage::Process(
-   const Buffers &data, size_t curBlockSize, size_t outBufferOffset) const
+   const Buffers &data, size_t curBlockSize, size_t outBufferOffset)
 {
    size_t processed{};
    try {
       auto outPositions = data.Positions();
-      std::vector<float *> advancedPositions;
       if (outBufferOffset > 0) {
          auto channels = data.Channels();
-         advancedPositions.reserve(channels);
+         // Capacity is reused for later blocks
+         mAdvancedPositions.clear();
          for (size_t ii = 0; ii < channels; ++ii)
-            advancedPositions.push_back(outPositions[ii] + outBufferOffset);
-         outPositions = advancedPositions.data();
+            mAdvancedPositions.push_back(outPositions[ii] + outBufferOffset);
+         outPositions = mAdvancedPositions.data();
       }
       processed = mInstance.ProcessBlock(mSettings,
          mInBuffers.Positions(), outPositions, curBlockSize);
@@ -618,13 +638,10 @@ bool PerTrackEffect::ProcessPass(Instance &instance, EffectSettings &settings)
    const auto duration = settings.extra.GetDuration();
    bool bGoodResult = true;
    bool isGenerator = GetType() == EffectTypeGenerate;
-   bool isProcessor = GetType() == EffectTypeProcess;
 
-   Buffers inBuffers{ 1 }, outBuffers{ 1 };
-   ChannelName map[3];
-   size_t prevBufferSize = 0;
+   Lane lane;
+   std::vector<Group> groups;
    int count = 0;
-   bool clear = false;
 
    // It's possible that the number of channels the effect expects changed based on
    // the parameters (the Audacity Reverb effect does when the stereo width is 0).
@@ -633,6 +650,12 @@ bool PerTrackEffect::ProcessPass(Instance &instance, EffectSettings &settings)
    if (numAudioOut < 1)
       return false;
 
+   // Groups are processed as they are visited, unless the effect can process
+   // them concurrently, which is decided after all are visited
+   const bool collect = PerTrackEffectParallel.Read() &&
+      CanProcessConcurrently(instance, 2);
+   const auto t1 = ViewInfo::Get(*FindProject()).selectedRegion.t1();
+
    const bool multichannel = numAudioIn > 1;
    auto range = multichannel
       ? mOutputTracks->Leaders()
@@ -644,10 +667,10 @@ bool PerTrackEffect::ProcessPass(Instance &instance, EffectSettings &settings)
          if (!left.GetSelected())
             return fallthrough();
 
-         sampleCount len = 0;
-         sampleCount start = 0;
-         unsigned numChannels = 0;
-         WaveTrack *pRight{};
+         Group group;
+         group.pLeft = pLeft;
+         auto &map = group.map;
+         auto &numChannels = group.numChannels;
 
          // Iterate either over one track which could be any channel,
          // or if multichannel, then over all channels of left,
@@ -667,17 +690,16 @@ bool PerTrackEffect::ProcessPass(Instance &instance, EffectSettings &settings)
             assert(numAudioIn > 1); // multichannel is true
             if (numChannels == 2) {
                // TODO: more-than-two-channels
-               pRight = channel;
-               clear = false;
+               group.pRight = channel;
                // Ignore other channels
                break;
             }
          }
 
          if (!isGenerator) {
-            GetBounds(left, pRight, &start, &len);
-            mSampleCnt = len;
-            if (len > 0 && numAudioIn < 1) {
+            GetBounds(left, group.pRight, &group.start, &group.len);
+            mSampleCnt = group.len;
+            if (group.len > 0 && numAudioIn < 1) {
                bGoodResult = false;
                return;
             }
@@ -685,122 +707,25 @@ bool PerTrackEffect::ProcessPass(Instance &instance, EffectSettings &settings)
          else
             mSampleCnt = left.TimeToLongSamples(duration);
 
-         const auto sampleRate = left.GetRate();
-
-         // Get the block size the client wants to use
-         auto max = left.GetMaxBlockSize() * 2;
-         const auto blockSize = instance.SetBlockSize(max);
-         if (blockSize == 0) {
-            bGoodResult = false;
+         if (collect) {
+            groups.push_back(group);
             return;
          }
 
-         // Calculate the buffer size to be at least the max rounded up to the clients
-         // selected block size.
-         const auto bufferSize =
-            ((max + (blockSize - 1)) / blockSize) * blockSize;
-         if (bufferSize == 0) {
-            bGoodResult = false;
-            return;
-         }
-
-         // Always create the number of input buffers the client expects even
-         // if we don't have
-         // the same number of channels.
-         // (These resizes may do nothing after the first track)
-
-         if (len > 0)
-            assert(numAudioIn > 0); // checked above
-         inBuffers.Reinit(numAudioIn, blockSize,
-            std::max<size_t>(1, bufferSize / blockSize));
-         if (len > 0)
-            // post of Reinit later satisfies pre of Source::Acquire()
-            assert(inBuffers.Channels() > 0);
-
-         if (prevBufferSize != bufferSize) {
-            // Buffer size has changed
-            // We won't be using more than the first 2 buffers,
-            // so clear the rest (if any)
-            for (size_t i = 2; i < numAudioIn; i++)
-               inBuffers.ClearBuffer(i, bufferSize);
-         }
-         prevBufferSize = bufferSize;
-
-         // Always create the number of output buffers the client expects
-         // even if we don't have the same number of channels.
-         // (These resizes may do nothing after the first track)
-         // Output buffers get an extra blockSize worth to give extra room if
-         // the plugin adds latency -- PRL:  actually not important to do
-         assert(numAudioOut > 0); // checked above
-         outBuffers.Reinit(numAudioOut, blockSize,
-            (bufferSize / blockSize) + 1);
-         // post of Reinit satisfies pre of ProcessTrack
-         assert(outBuffers.Channels() > 0);
-
-         // (Re)Set the input buffer positions
-         inBuffers.Rewind();
-
-         // Clear unused input buffers
-         if (!pRight && !clear && numAudioIn > 1) {
-            inBuffers.ClearBuffer(1, bufferSize);
-            clear = true;
-         }
-
-         const auto genLength = [this, &settings, &left, isGenerator](
-         ) -> std::optional<sampleCount> {
-            double genDur = 0;
-            if (isGenerator) {
-               const auto duration = settings.extra.GetDuration();
-               if (IsPreviewing()) {
-                  gPrefs->Read(wxT("/AudioIO/EffectsPreviewLen"), &genDur, 6.0);
-                  genDur = std::min(duration, CalcPreviewInputLength(settings, genDur));
-               }
-               else
-                  genDur = duration;
-               // round to nearest sample
-               return sampleCount{ (left.GetRate() * genDur) + 0.5 };
-            }
+         const auto progress = [this, numChannels, count](double fraction){
+            if (numChannels > 1)
+               return !TrackGroupProgress(count, fraction);
             else
-               return {};
-         }();
-
-         const auto pollUser = [this, numChannels, count, start,
-            length = (genLength ? *genLength : len).as_double()
-         ](sampleCount inPos){
-            if (numChannels > 1) {
-               if (TrackGroupProgress(
-                  count, (inPos - start).as_double() / length)
-               )
-                  return false;
-            }
-            else {
-               if (TrackProgress(count, (inPos - start).as_double() / length))
-                  return false;
-            }
-            return true;
+               return !TrackProgress(count, fraction);
          };
 
-         // Assured above
-         assert(len == 0 || inBuffers.Channels() > 0);
-         SampleTrackSource source{ left, pRight, start, len, pollUser };
-         // Assert source is safe to Acquire inBuffers
-         assert(source.AcceptsBuffers(inBuffers));
-         assert(source.AcceptsBlockSize(inBuffers.BlockSize()));
-
-         WaveTrackSink sink{ left, pRight, start, isGenerator, isProcessor };
-         assert(sink.AcceptsBuffers(outBuffers));
-
          // Go process the track(s)
          try {
-            bGoodResult = ProcessTrack(instance, settings, source, sink,
-               genLength, sampleRate, map,
-               inBuffers, outBuffers);
+            bGoodResult = ProcessGroup(instance, settings, lane, group,
+               progress, t1);
          } catch(const std::exception&) {
             bGoodResult = false;
          }
-         if (bGoodResult)
-            sink.Flush(outBuffers,
-               mT0, ViewInfo::Get(*FindProject()).selectedRegion.t1());
          if (!bGoodResult)
             return;
          ++count;
@@ -811,12 +736,278 @@ bool PerTrackEffect::ProcessPass(Instance &instance, EffectSettings &settings)
       }
    );
 
+   if (bGoodResult && collect) {
+      if (CanProcessConcurrently(instance, groups.size()))
+         bGoodResult = ProcessConcurrently(instance, settings, groups, t1);
+      else
+         for (const auto &group : groups) {
+            const auto progress = [this, &group, count](double fraction){
+               if (group.numChannels > 1)
+                  return !TrackGroupProgress(count, fraction);
+               else
+                  return !TrackProgress(count, fraction);
+            };
+            try {
+               bGoodResult = ProcessGroup(instance, settings, lane, group,
+                  progress, t1);
+            } catch(const std::exception&) {
+               bGoodResult = false;
+            }
+            if (!bGoodResult)
+               break;
+            ++count;
+         }
+   }
+
    if (bGoodResult && GetType() == EffectTypeGenerate)
       mT1 = mT0 + duration;
 
    return bGoodResult;
 }
 
+bool PerTrackEffect::ProcessGroup(Instance &instance, EffectSettings &settings,
+   Lane &lane, const Group &group, const Progress &progress, double t1) const
+{
+   bool isGenerator = GetType() == EffectTypeGenerate;
+   bool isProcessor = GetType() == EffectTypeProcess;
+   const auto numAudioIn = GetAudioInCount();
+   const auto numAudioOut = GetAudioOutCount();
+   auto &left = *group.pLeft;
+   const auto pRight = group.pRight;
+   const auto start = group.start;
+   const auto len = group.len;
+   auto &inBuffers = lane.inBuffers;
+   auto &outBuffers = lane.outBuffers;
+
+   // The right channel overwrites the second input buffer
+   if (pRight)
+      lane.clear = false;
+
+   const auto sampleRate = left.GetRate();
+
+   // Get the block size the client wants to use
+   auto max = left.GetMaxBlockSize() * 2;
+   const auto blockSize = instance.SetBlockSize(max);
+   if (blockSize == 0)
+      return false;
+
+   // Calculate the buffer size to be at least the max rounded up to the clients
+   // selected block size.
+   const auto bufferSize =
+      ((max + (blockSize - 1)) / blockSize) * blockSize;
+   if (bufferSize == 0)
+      return false;
+
+   // Always create the number of input buffers the client expects even
+   // if we don't have
+   // the same number of channels.
+   // (These resizes may do nothing after the first track)
+
+   if (len > 0)
+      assert(numAudioIn > 0); // checked by the caller
+   inBuffers.Reinit(numAudioIn, blockSize,
+      std::max<size_t>(1, bufferSize / blockSize));
+   if (len > 0)
+      // post of Reinit later satisfies pre of Source::Acquire()
+      assert(inBuffers.Channels() > 0);
+
+   if (lane.prevBufferSize != bufferSize) {
+      // Buffer size has changed
+      // We won't be using more than the first 2 buffers,
+      // so clear the rest (if any)
+      for (size_t i = 2; i < numAudioIn; i++)
+         inBuffers.ClearBuffer(i, bufferSize);
+   }
+   lane.prevBufferSize = bufferSize;
+
+   // Always create the number of output buffers the client expects
+   // even if we don't have the same number of channels.
+   // (These resizes may do nothing after the first track)
+   // Output buffers get an extra blockSize worth to give extra room if
+   // the plugin adds latency -- PRL:  actually not important to do
+   assert(numAudioOut > 0); // checked by the caller
+   outBuffers.Reinit(numAudioOut, blockSize,
+      (bufferSize / blockSize) + 1);
+   // post of Reinit satisfies pre of ProcessTrack
+   assert(outBuffers.Channels() > 0);
+
+   // (Re)Set the input buffer positions
+   inBuffers.Rewind();
+
+   // Clear unused input buffers
+   if (!pRight && !lane.clear && numAudioIn > 1) {
+      inBuffers.ClearBuffer(1, bufferSize);
+      lane.clear = true;
+   }
+
+   const auto genLength = [this, &settings, &left, isGenerator](
+   ) -> std::optional<sampleCount> {
+      double genDur = 0;
+      if (isGenerator) {
+         const auto duration = settings.extra.GetDuration();
+         if (IsPreviewing()) {
+            gPrefs->Read(wxT("/AudioIO/EffectsPreviewLen"), &genDur, 6.0);
+            genDur = std::min(duration, CalcPreviewInputLength(settings, genDur));
+         }
+         else
+            genDur = duration;
+         // round to nearest sample
+         return sampleCount{ (left.GetRate() * genDur) + 0.5 };
+      }
+      else
+         return {};
+   }();
+
+   const auto pollUser = [&progress, start,
+      length = (genLength ? *genLength : len).as_double()
+   ](sampleCount inPos){
+      return progress((inPos - start).as_double() / length);
+   };
+
+   // Assured above
+   assert(len == 0 || inBuffers.Channels() > 0);
+   SampleTrackSource source{ left, pRight, start, len, pollUser };
+   // Assert source is safe to Acquire inBuffers
+   assert(source.AcceptsBuffers(inBuffers));
+   assert(source.AcceptsBlockSize(inBuffers.BlockSize()));
+
+   WaveTrackSink sink{ left, pRight, start, isGenerator, isProcessor };
+   assert(sink.AcceptsBuffers(outBuffers));
+
+   if (!ProcessTrack(instance, settings, source, sink,
+      genLength, sampleRate, group.map,
+      inBuffers, outBuffers))
+      return false;
+   sink.Flush(outBuffers, mT0, t1);
+   return true;
+}
+
+bool PerTrackEffect::CanProcessConcurrently(
+   const Instance &instance, size_t nGroups) const
+{
+   // Only effects whose instances keep no state in the effect object, and
+   // that are known not to share other state among instances, qualify;
+   // generators are excluded, because they paste into the tracks
+   return nGroups > 1 &&
+      ThreadPool::Get().GetConcurrency() > 1 &&
+      GetType() == EffectTypeProcess &&
+      GetFamily().Internal() == wxT("Audacity") &&
+      !dynamic_cast<const StatefulPerTrackEffect::Instance*>(&instance);
+}
+
+bool PerTrackEffect::ProcessConcurrently(Instance &instance,
+   EffectSettings &settings, const std::vector<Group> &groups, double t1)
+{
+   const auto nGroups = groups.size();
+
+   // Make one more instance for each worker after the first
+   auto &pool = ThreadPool::Get();
+   const auto nLanes = std::min(nGroups, pool.GetConcurrency() - 1);
+   std::vector<std::shared_ptr<EffectInstance>> instances;
+   std::vector<Instance*> laneInstances{ &instance };
+   for (size_t ii = 1; ii < nLanes; ++ii) {
+      auto pInstance = MakeInstance();
+      auto pMyInstance = dynamic_cast<Instance*>(pInstance.get());
+      if (!pMyInstance || !pInstance->Init())
+         break;
+      instances.push_back(std::move(pInstance));
+      laneInstances.push_back(pMyInstance);
+   }
+   const auto nInstances = laneInstances.size();
+   // The first lane uses the given settings, and others copies
+   std::vector<EffectSettings> copies(nInstances - 1, settings);
+   const auto settingsOf = [&](size_t lane) -> EffectSettings & {
+      return lane == 0 ? settings : copies[lane - 1];
+   };
+   std::vector<Lane> lanes(nInstances);
+
+   // Workers process copies of the tracks, which share the sample blocks;
+   // only this thread commits the results to the tracks, in track order
+   std::vector<Group> work{ groups };
+   std::vector<std::shared_ptr<WaveTrack>> workTracks;
+   const auto duplicate = [&](WaveTrack *pTrack) -> WaveTrack * {
+      if (!pTrack)
+         return nullptr;
+      auto pCopy = std::static_pointer_cast<WaveTrack>(pTrack->Duplicate());
+      workTracks.push_back(pCopy);
+      return pCopy.get();
+   };
+   for (auto &group : work) {
+      group.pLeft = duplicate(group.pLeft);
+      group.pRight = duplicate(group.pRight);
+   }
+
+   // Fractions done, written by workers and read by the main thread
+   std::vector<std::atomic<double>> fractions(nGroups);
+   for (auto &fraction : fractions)
+      fraction.store(0, std::memory_order_relaxed);
+   std::vector<char> results(nGroups, false);
+   std::atomic<bool> cancelled{ false };
+
+   // Lanes beyond the instances made wait for others to finish
+   std::vector<std::mutex> mutexes(nInstances);
+
+   const auto fn = [&](size_t index, size_t lane){
+      if (cancelled.load(std::memory_order_relaxed))
+         return;
+      lane %= nInstances;
+      std::lock_guard<std::mutex> guard{ mutexes[lane] };
+      auto &fraction = fractions[index];
+      const auto progress = [&](double value){
+         fraction.store(value, std::memory_order_relaxed);
+         return !cancelled.load(std::memory_order_relaxed);
+      };
+      bool result = false;
+      try {
+         result = ProcessGroup(*laneInstances[lane], settingsOf(lane),
+            lanes[lane], work[index], progress, t1);
+      } catch(const std::exception&) {
+         result = false;
+      } catch(...) {
+         // Stop the other groups; ParallelFor rethrows
+         cancelled.store(true, std::memory_order_relaxed);
+         throw;
+      }
+      if (result)
+         fraction.store(1.0, std::memory_order_relaxed);
+      else
+         cancelled.store(true, std::memory_order_relaxed);
+      results[index] = result;
+   };
+
+   const auto poll = [&]{
+      double sum = 0;
+      for (auto &fraction : fractions)
+         sum += fraction.load(std::memory_order_relaxed);
+      if (TotalProgress(sum / nGroups))
+         cancelled.store(true, std::memory_order_relaxed);
+   };
+
+   std::exception_ptr pException;
+   try {
+      pool.ParallelFor(nGroups, fn, poll, std::chrono::milliseconds{ 50 });
+   }
+   catch (...) {
+      pException = std::current_exception();
+   }
+
+   // Commit the results up to the first group that failed, so that what is
+   // kept does not depend on the scheduling of the workers
+   const auto commit = [](WaveTrack *pTrack, WaveTrack *pResult){
+      if (pTrack)
+         std::swap(pTrack->GetClips(), pResult->GetClips());
+   };
+   size_t nCommitted = 0;
+   for (; nCommitted < nGroups && results[nCommitted]; ++nCommitted) {
+      commit(groups[nCommitted].pLeft, work[nCommitted].pLeft);
+      commit(groups[nCommitted].pRight, work[nCommitted].pRight);
+   }
+
+   if (pException)
+      std::rethrow_exception(pException);
+   return nCommitted == nGroups;
+}
+
 AudioGraph::Task::Task(Source &source, Buffers &buffers, Sink &sink)
    : mSource{ source }, mBuffers{ buffers }, mSink{ sink }
 {
@@ -15,13 +15,20 @@
 #define __AUDACITY_PER_TRACK_EFFECT__
 
 #include "Effect.h" // to inherit
+#include "AudioGraphBufferPool.h"
 #include "MemoryX.h"
+#include "Prefs.h"
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include "SampleFormat.h"
 
 class SampleTrack;
+class WaveTrack;
+
+//! Whether stateless built-in effects may process several tracks at once
+extern AUDACITY_DLL_API BoolSetting PerTrackEffectParallel;
 
 namespace AudioGraph {
 class Buffers;
@@ -232,6 +239,49 @@ private:
    bool ProcessPass(Instance &instance, EffectSettings &settings);
    //! Type of function returning false if user cancels progress
    using Poller = std::function<bool(sampleCount blockSize)>;
+   //! Type of function taking the fraction done of one group, and returning
+   //! false if user cancels progress
+   using Progress = std::function<bool(double fraction)>;
+
+   //! Buffers and related state, reused from one group to the next by one
+   //! thread
+   struct Lane {
+      Buffers inBuffers{ 1 }, outBuffers{ 1 };
+      size_t prevBufferSize{ 0 };
+      bool clear{ false };
+   };
+
+   //! A mono track, or the channels of a track processed together
+   struct Group {
+      WaveTrack *pLeft{};
+      WaveTrack *pRight{};
+      sampleCount start{ 0 };
+      sampleCount len{ 0 };
+      unsigned numChannels{ 0 };
+      ChannelName map[3]{ ChannelNameEOL, ChannelNameEOL, ChannelNameEOL };
+   };
+
+   //! Process one group through the instance and write the results
+   /*!
+    This does not change any member of the effect, so it may be called for
+    different groups at once, each with its own instance, settings and lane
+    @param t1 end of the selection, where generated audio is pasted
+    */
+   bool ProcessGroup(Instance &instance, EffectSettings &settings,
+      Lane &lane, const Group &group, const Progress &progress,
+      double t1) const;
+
+   //! Whether ProcessPass may give groups to worker threads
+   bool CanProcessConcurrently(const Instance &instance, size_t nGroups) const;
+
+   //! Process groups in worker threads, each with another instance
+   /*!
+    The main thread only reports progress.  Failure or cancellation of any
+    group stops the others.  Then the main thread commits the results of
+    the groups in track order, up to the first that did not succeed.
+    */
+   bool ProcessConcurrently(Instance &instance, EffectSettings &settings,
+      const std::vector<Group> &groups, double t1);
    /*!
     Previous contents of inBuffers and outBuffers are ignored
 
@@ -254,9 +304,12 @@ private:
  @invariant `BufferSize() % BlockSize() == 0`
 
  @invariant `mBuffers.size() == mPositions.size()`
- @invariant all `mBuffers[i].size()` are equal to `BufferSize()`
- @invariant all `(mPositions[i] - mBuffers[i].data())` are equal and in
+ @invariant all `mBuffers[i]` hold at least `BufferSize()` values
+ @invariant all `(mPositions[i] - mBuffers[i].get())` are equal and in
     range [`0`, `BufferSize()`]
+
+ Arrays come from BufferPool, and return to it at destruction, so that
+ repeated effect applications do not allocate anew.
  */
 class AudioGraph::Buffers {
 public:
@@ -283,6 +336,8 @@ public:
     @post `Channels() == nChannels`
     @post `BlockSize() == blockSize`
     @post `BufferSize() == blockSize * nBlocks`
+    @post contents of buffers are preserved up to the lesser of the old and
+    new `BufferSize()`, and zero after that, as if by `std::vector::resize`
     */
    void Reinit(unsigned nChannels, size_t blockSize, size_t nBlocks);
    //! Get array of positions in the buffers
@@ -333,7 +388,7 @@ public:
    //! starting from its position
    void ClearBuffer(unsigned iChannel, size_t n);
 private:
-   std::vector<std::vector<float>> mBuffers;
+   std::vector<BufferPool::Array> mBuffers;
    std::vector<float *> mPositions;
    size_t mBufferSize{ 0 };
    size_t mBlockSize{ 0 };
@@ -380,7 +435,7 @@ private:
     @return success
     */
    bool Process(
-      const Buffers &data, size_t curBlockSize, size_t outBufferOffset) const;
+      const Buffers &data, size_t curBlockSize, size_t outBufferOffset);
 
    std::optional<size_t> FetchProcessAndAdvance(
       Buffers &data, size_t bound, bool doZeros, size_t outBufferOffset = 0);
@@ -395,6 +450,9 @@ private:
    const double mSampleRate;
    const bool mIsProcessor;
 
+   //! Output positions offset for Process()
+   std::vector<float *> mAdvancedPositions;
+
    sampleCount mDelay{};
    sampleCount mDelayRemaining;
    size_t mLastProduced{};
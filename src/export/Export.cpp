@@ -43,6 +43,7 @@
 #include <wx/stattext.h>
 #include <wx/string.h>
 #include <wx/textctrl.h>
+#include <wx/thread.h>
 #include <wx/timer.h>
 #include <wx/dcmemory.h>
 #include <wx/window.h>
@@ -53,6 +54,7 @@
 
 #include "AllThemeResources.h"
 #include "BasicUI.h"
+#include "ExportPipeline.h"
 #include "Mix.h"
 #include "Prefs.h"
 #include "../prefs/ImportExportPrefs.h"
@@ -74,6 +76,12 @@
 #include "widgets/ProgressDialog.h"
 #include "wxFileNameWrapper.h"
 
+//----------------------------------------------------------------------------
+// ExportTask
+//----------------------------------------------------------------------------
+
+ExportTask::~ExportTask() = default;
+
 //----------------------------------------------------------------------------
 // ExportPlugin
 //----------------------------------------------------------------------------
@@ -206,6 +214,20 @@ bool ExportPlugin::DisplayOptions(wxWindow * WXUNUSED(parent), int WXUNUSED(form
    return false;
 }
 
+bool ExportPlugin::CanExportInTask(int WXUNUSED(subformat))
+{
+   return false;
+}
+
+std::unique_ptr<ExportTask> ExportPlugin::PrepareExportTask(
+   AudacityProject *, unsigned, const wxFileNameWrapper &, bool,
+   double, double, MixerSpec *, const Tags *, int WXUNUSED(subformat),
+   ProgressResult &failure)
+{
+   failure = ProgressResult::Failed;
+   return nullptr;
+}
+
 void ExportPlugin::OptionsCreate(ShuttleGui &S, int WXUNUSED(format))
 {
    S.StartHorizontalLay(wxCENTER);
@@ -220,7 +242,7 @@ void ExportPlugin::OptionsCreate(ShuttleGui &S, int WXUNUSED(format))
 }
 
 //Create a mixer by computing the time warp factor
-std::unique_ptr<Mixer> ExportPlugin::CreateMixer(const TrackList &tracks,
+std::unique_ptr<ExportPipeline> ExportPlugin::CreateMixer(const TrackList &tracks,
          bool selectionOnly,
          double startTime, double stopTime,
          unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
@@ -238,14 +260,16 @@ std::unique_ptr<Mixer> ExportPlugin::CreateMixer(const TrackList &tracks,
       inputTracks.push_back(
          pTrack->SharedPointer< const SampleTrack >() );
    // MB: the stop time should not be warped, this was a bug.
-   return std::make_unique<Mixer>(inputTracks,
+   return std::make_unique<ExportPipeline>(
+      std::make_unique<Mixer>(inputTracks,
                   // Throw, to stop exporting, if read fails:
                   true,
                   Mixer::WarpOptions{tracks},
                   startTime, stopTime,
                   numOutChannels, outBufferSize, outInterleaved,
                   outRate, outFormat,
-                  true, mixerSpec);
+                  true, mixerSpec),
+      numOutChannels, outBufferSize, outInterleaved, outFormat);
 }
 
 void ExportPlugin::InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
@@ -1522,6 +1546,14 @@ void ShowExportErrorDialog(wxString ErrorCode,
    const TranslatableString& caption,
    bool allowReporting)
 {
+   if (!wxThread::IsMain()) {
+      // An ExportTask is running on a worker thread
+      BasicUI::CallAfter([=]{
+         ShowExportErrorDialog(ErrorCode, message, caption, allowReporting);
+      });
+      return;
+   }
+
    using namespace BasicUI;
    ShowErrorDialog( {},
       caption,
@@ -1532,6 +1564,11 @@ void ShowExportErrorDialog(wxString ErrorCode,
 
 void ShowDiskFullExportErrorDialog(const wxFileNameWrapper &fileName)
 {
+   if (!wxThread::IsMain()) {
+      BasicUI::CallAfter([=]{ ShowDiskFullExportErrorDialog(fileName); });
+      return;
+   }
+
    BasicUI::ShowErrorDialog( {},
       XO("Warning"),
       FileException::WriteFailureMessage(fileName),
@@ -12,6 +12,7 @@
 #define __AUDACITY_EXPORT__
 
 #include <functional>
+#include <memory>
 #include <vector>
 #include <wx/filename.h> // member variable
 #include "Identifier.h"
@@ -34,7 +35,7 @@ class TrackList;
 class MixerSpec;
 class ProgressDialog;
 class ShuttleGui;
-class Mixer;
+class ExportPipeline;
 using WaveTrackConstArray = std::vector < std::shared_ptr < const WaveTrack > >;
 namespace BasicUI{ enum class ProgressResult : unsigned; }
 class wxFileNameWrapper;
@@ -58,6 +59,33 @@ class AUDACITY_DLL_API FormatInfo
       bool mCanMetaData;
 };
 
+//----------------------------------------------------------------------------
+// ExportTask
+//----------------------------------------------------------------------------
+
+//! The rest of an export, after ExportPlugin::PrepareExportTask() did the
+//! part that must be done on the main thread
+class AUDACITY_DLL_API ExportTask /* not final */
+{
+public:
+   using ProgressResult = BasicUI::ProgressResult;
+   //! Given the time exported so far and the total time to export; a result
+   //! other than Success ends the export with that result
+   using ProgressReport =
+      std::function< ProgressResult(double current, double total) >;
+
+   virtual ~ExportTask();
+
+   //! Mix and encode the audio, and finish the file
+   /*!
+    May run on any thread, concurrently with other tasks.  It must not read
+    preferences or show dialogs, except through ShowExportErrorDialog() or
+    ShowDiskFullExportErrorDialog().
+    @return as for ExportPlugin::Export()
+    */
+   virtual ProgressResult Run(const ProgressReport &report) = 0;
+};
+
 //----------------------------------------------------------------------------
 // ExportPlugin
 //----------------------------------------------------------------------------
@@ -134,8 +162,36 @@ public:
                        const Tags *metadata = NULL,
                        int subformat = 0) = 0;
 
+   //! Whether PrepareExportTask() is implemented for the sub-format
+   /*! Default returns false */
+   virtual bool CanExportInTask(int subformat);
+
+   /** \brief Begin an export that can finish on another thread
+    *
+    * Does the part of Export() that reads preferences, may show dialogs, and
+    * opens the file.  The project's tracks must not change until the task
+    * is destroyed.  Default returns null.
+    * @param metadata If not null, must outlive the task
+    * @param[out] failure Set to ProgressResult::Failed or
+    * ProgressResult::Cancelled, after alerting the user, when null is returned
+    * Other parameters are as for Export()
+    */
+   virtual std::unique_ptr<ExportTask> PrepareExportTask(
+      AudacityProject *project,
+      unsigned channels,
+      const wxFileNameWrapper &fName,
+      bool selectedOnly,
+      double t0,
+      double t1,
+      MixerSpec *mixerSpec,
+      const Tags *metadata,
+      int subformat,
+      ProgressResult &failure);
+
 protected:
-   std::unique_ptr<Mixer> CreateMixer(const TrackList &tracks,
+   //! Mix in a worker thread, if ExportPipelined is on
+   /*! The result may be used as a Mixer by one other thread */
+   std::unique_ptr<ExportPipeline> CreateMixer(const TrackList &tracks,
          bool selectionOnly,
          double startTime, double stopTime,
          unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
@@ -330,6 +386,8 @@ AUDACITY_DLL_API TranslatableString AudacityExportMessageStr();
 /// We have many Export errors that are essentially anonymous
 /// and are distinguished only by an error code number.
 /// Rather than repeat the code, we have it just once.
+/// May be called from other threads, and then shows the dialog later on the
+/// main thread; so may ShowDiskFullExportErrorDialog()
 AUDACITY_DLL_API void ShowExportErrorDialog(wxString ErrorCode,
    TranslatableString message = AudacityExportMessageStr(),
    const TranslatableString& caption = AudacityExportCaptionStr(),
@@ -29,6 +29,7 @@
 
 #include "FileNames.h"
 #include "Export.h"
+#include "ExportPipeline.h"
 
 #include "Mix.h"
 #include "Prefs.h"
@@ -45,6 +45,7 @@ function.
 #include "wxFileNameWrapper.h"
 
 #include "Export.h"
+#include "ExportPipeline.h"
 
 #include "ExportFFmpegDialogs.h"
 #include "SelectFile.h"
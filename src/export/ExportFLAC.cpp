@@ -19,6 +19,7 @@ Joshua Haberman
 #ifdef USE_LIBFLAC
 
 #include "Export.h"
+#include "ExportPipeline.h"
 
 #include <wx/ffile.h>
 #include <wx/log.h>
@@ -219,7 +220,19 @@ public:
                const Tags *metadata = NULL,
                int subformat = 0) override;
 
+   bool CanExportInTask(int subformat) override;
+   std::unique_ptr<ExportTask> PrepareExportTask(
+      AudacityProject *project, unsigned channels,
+      const wxFileNameWrapper &fName, bool selectedOnly, double t0, double t1,
+      MixerSpec *mixerSpec, const Tags *metadata, int subformat,
+      ProgressResult &failure) override;
+
 private:
+   class Task;
+   std::unique_ptr<Task> Prepare(AudacityProject *project, unsigned channels,
+      const wxFileNameWrapper &fName, bool selectedOnly, double t0, double t1,
+      MixerSpec *mixerSpec, const Tags *metadata, int subformat,
+      ProgressResult &failure);
 
    bool GetMetadata(AudacityProject *project, const Tags *tags);
 
@@ -240,6 +253,55 @@ ExportFLAC::ExportFLAC()
    SetDescription(XO("FLAC Files"),0);
 }
 
+//! Mixes and encodes the samples of an export prepared by ExportFLAC
+class ExportFLAC::Task final : public ExportTask
+{
+public:
+   Task(const wxFileNameWrapper &fName, double t0, double t1)
+      : mFName{ fName }, mT0{ t0 }, mT1{ t1 }
+   {}
+   ~Task() override;
+
+   ProgressResult Run(const ProgressReport &report) override;
+
+   const wxFileNameWrapper mFName;
+   const double mT0, mT1;
+   unsigned mNumChannels{};
+   sampleFormat mFormat{ int16Sample };
+
+#ifndef LEGACY_FLAC
+   wxFFile mFile;     // will be closed when the task is destroyed
+#endif
+   FLAC::Encoder::File mEncoder;
+   //! Whether the encoder was initialized and not yet finished
+   bool mStarted{ false };
+   std::unique_ptr<ExportPipeline> mMixer;
+};
+
+ExportFLAC::Task::~Task()
+{
+   if (mStarted) {
+#ifndef LEGACY_FLAC
+      mFile.Detach(); // libflac closes the file
+#endif
+      mEncoder.finish();
+   }
+}
+
+bool ExportFLAC::CanExportInTask(int WXUNUSED(subformat))
+{
+   return true;
+}
+
+std::unique_ptr<ExportTask> ExportFLAC::PrepareExportTask(
+   AudacityProject *project, unsigned channels, const wxFileNameWrapper &fName,
+   bool selectedOnly, double t0, double t1, MixerSpec *mixerSpec,
+   const Tags *metadata, int subformat, ProgressResult &failure)
+{
+   return Prepare(project, channels, fName, selectedOnly, t0, t1,
+      mixerSpec, metadata, subformat, failure);
+}
+
 ProgressResult ExportFLAC::Export(AudacityProject *project,
                         std::unique_ptr<ProgressDialog> &pDialog,
                         unsigned numChannels,
@@ -249,20 +311,44 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
                         double t1,
                         MixerSpec *mixerSpec,
                         const Tags *metadata,
-                        int WXUNUSED(subformat))
+                        int subformat)
+{
+   auto failure = ProgressResult::Cancelled;
+   auto pTask = Prepare(project, numChannels, fName, selectionOnly, t0, t1,
+      mixerSpec, metadata, subformat, failure);
+   if (!pTask)
+      return failure;
+
+   InitProgress( pDialog, fName,
+      selectionOnly
+         ? XO("Exporting the selected audio as FLAC")
+         : XO("Exporting the audio as FLAC") );
+   auto &progress = *pDialog;
+
+   return pTask->Run([&](double current, double total){
+      return progress.Update(current, total);
+   });
+}
+
+auto ExportFLAC::Prepare(AudacityProject *project,
+   unsigned numChannels, const wxFileNameWrapper &fName, bool selectionOnly,
+   double t0, double t1, MixerSpec *mixerSpec, const Tags *metadata,
+   int WXUNUSED(subformat), ProgressResult &failure) -> std::unique_ptr<Task>
 {
    double    rate    = ProjectRate::Get(*project).GetRate();
    const auto &tracks = TrackList::Get( *project );
 
    wxLogNull logNo;            // temporarily disable wxWidgets error messages
-   auto updateResult = ProgressResult::Success;
+   failure = ProgressResult::Cancelled;
 
    long levelPref;
    FLACLevel.Read().ToLong( &levelPref );
 
    auto bitDepthPref = FLACBitDepth.Read();
 
-   FLAC::Encoder::File encoder;
+   auto pTask = std::make_unique<Task>(fName, t0, t1);
+   pTask->mNumChannels = numChannels;
+   auto &encoder = pTask->mEncoder;
 
    bool success = true;
    success = success &&
@@ -276,7 +362,7 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
    if (success && !GetMetadata(project, metadata)) {
       // TODO: more precise message
       ShowExportErrorDialog("FLAC:283");
-      return ProgressResult::Cancelled;
+      return nullptr;
    }
 
    if (success && mMetadata) {
@@ -298,6 +384,7 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
       format = int16Sample;
       success = success && encoder.set_bits_per_sample(16);
    }
+   pTask->mFormat = format;
 
 
    // Duplicate the flac command line compression levels
@@ -329,17 +416,17 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
    if (!success) {
       // TODO: more precise message
       ShowExportErrorDialog("FLAC:336");
-      return ProgressResult::Cancelled;
+      return nullptr;
    }
 
 #ifdef LEGACY_FLAC
    encoder.init();
 #else
-   wxFFile f;     // will be closed when it goes out of scope
+   auto &f = pTask->mFile;
    const auto path = fName.GetFullPath();
    if (!f.Open(path, wxT("w+b"))) {
       AudacityMessageBox( XO("FLAC export couldn't open %s").Format( path ) );
-      return ProgressResult::Cancelled;
+      return nullptr;
    }
 
    // Even though there is an init() method that takes a filename, use the one that
@@ -350,43 +437,37 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
       AudacityMessageBox(
          XO("FLAC encoder failed to initialize\nStatus: %d")
             .Format( status ) );
-      return ProgressResult::Cancelled;
+      return nullptr;
    }
 #endif
+   pTask->mStarted = true;
 
    mMetadata.reset();
 
-   auto cleanup2 = finally( [&] {
-      if (!(updateResult == ProgressResult::Success ||
-            updateResult == ProgressResult::Stopped)) {
-#ifndef LEGACY_FLAC
-         f.Detach(); // libflac closes the file
-#endif
-         encoder.finish();
-      }
-   } );
+   pTask->mMixer = CreateMixer(tracks, selectionOnly,
+                               t0, t1,
+                               numChannels, SAMPLES_PER_RUN, false,
+                               rate, format, mixerSpec);
 
-   auto mixer = CreateMixer(tracks, selectionOnly,
-                            t0, t1,
-                            numChannels, SAMPLES_PER_RUN, false,
-                            rate, format, mixerSpec);
+   return pTask;
+}
 
-   ArraysOf<FLAC__int32> tmpsmplbuf{ numChannels, SAMPLES_PER_RUN, true };
+ProgressResult ExportFLAC::Task::Run(const ProgressReport &report)
+{
+   const auto numChannels = mNumChannels;
+   const auto format = mFormat;
+   auto updateResult = ProgressResult::Success;
 
-   InitProgress( pDialog, fName,
-      selectionOnly
-         ? XO("Exporting the selected audio as FLAC")
-         : XO("Exporting the audio as FLAC") );
-   auto &progress = *pDialog;
+   ArraysOf<FLAC__int32> tmpsmplbuf{ numChannels, SAMPLES_PER_RUN, true };
 
    while (updateResult == ProgressResult::Success) {
-      auto samplesThisRun = mixer->Process(SAMPLES_PER_RUN);
+      auto samplesThisRun = mMixer->Process(SAMPLES_PER_RUN);
       if (samplesThisRun == 0) { //stop encoding
          break;
       }
       else {
          for (size_t i = 0; i < numChannels; i++) {
-            auto mixed = mixer->GetBuffer(i);
+            auto mixed = mMixer->GetBuffer(i);
             if (format == int24Sample) {
                for (decltype(samplesThisRun) j = 0; j < samplesThisRun; j++) {
                   tmpsmplbuf[i][j] = ((const int *)mixed)[j];
@@ -398,27 +479,28 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
                }
             }
          }
-         if (! encoder.process(
+         if (! mEncoder.process(
                reinterpret_cast<FLAC__int32**>( tmpsmplbuf.get() ),
                samplesThisRun) ) {
             // TODO: more precise message
-            ShowDiskFullExportErrorDialog(fName);
+            ShowDiskFullExportErrorDialog(mFName);
             updateResult = ProgressResult::Cancelled;
             break;
          }
          if (updateResult == ProgressResult::Success)
             updateResult =
-               progress.Update(mixer->MixGetCurrentTime() - t0, t1 - t0);
+               report(mMixer->MixGetCurrentTime() - mT0, mT1 - mT0);
       }
    }
 
    if (updateResult == ProgressResult::Success ||
        updateResult == ProgressResult::Stopped) {
+      // The destructor must not finish again
+      mStarted = false;
 #ifndef LEGACY_FLAC
-      f.Detach(); // libflac closes the file
+      mFile.Detach(); // libflac closes the file
 #endif
-      if (!encoder.finish())
-         // Do not reassign updateResult, see cleanup2
+      if (!mEncoder.finish())
          return ProgressResult::Failed;
 #ifdef LEGACY_FLAC
       if (!f.Flush() || !f.Close())
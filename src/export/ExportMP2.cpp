@@ -47,6 +47,7 @@
 #include <wx/stream.h>
 
 #include "Export.h"
+#include "ExportPipeline.h"
 #include "FileIO.h"
 #include "Mix.h"
 #include "Prefs.h"
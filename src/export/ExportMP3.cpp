@@ -97,6 +97,7 @@
 #include "Project.h"
 
 #include "Export.h"
+#include "ExportPipeline.h"
 
 #include <lame/lame.h>
 
@@ -18,6 +18,14 @@
 
 #include "ExportMultiple.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 #include <wx/defs.h>
 #include <wx/button.h>
 #include <wx/checkbox.h>
@@ -44,6 +52,7 @@
 #include "ProjectSettings.h"
 #include "ProjectWindow.h"
 #include "ProjectWindows.h"
+#include "ThreadPool.h"
 #include "Prefs.h"
 #include "../SelectionState.h"
 #include "../ShuttleGui.h"
@@ -77,6 +86,9 @@ namespace {
     */
 }
 
+BoolSetting ExportMultipleConcurrently{
+   L"/Performance/ExportMultipleConcurrently", false };
+
 /* define our dynamic array of export settings */
 
 enum {
@@ -868,6 +880,26 @@ ProgressResult ExportMultipleDialog::ExportMultipleByLabel(bool byName,
       l++;  // next label, count up one
    }
 
+   if (ExportMultipleConcurrently.Read() &&
+       mPlugins[mPluginIndex]->CanExportInTask(mSubFormatIndex)) {
+      std::vector<const ExportKit*> kits;
+      std::vector<wxFileName> names;
+      for (const auto &kit : exportSettings)
+         // Bug 1440 fix.
+         if (!kit.destfile.GetName().empty()) {
+            kits.push_back(&kit);
+            names.push_back(kit.destfile);
+         }
+      return DoExportConcurrently(names,
+         [&](size_t index, const wxFileNameWrapper &fName,
+            ProgressResult &failure){
+            const auto &kit = *kits[index];
+            return mPlugins[mPluginIndex]->PrepareExportTask(mProject,
+               channels, fName, false, kit.t0, kit.t1, nullptr,
+               &kit.filetags, mSubFormatIndex, failure);
+         });
+   }
+
    auto ok = ProgressResult::Success;   // did it work?
    int count = 0; // count the number of successful runs
    ExportKit activeSetting;  // pointer to the settings in use for this export
@@ -1012,6 +1044,35 @@ ProgressResult ExportMultipleDialog::ExportMultipleByTrack(bool byName,
    }
    // end of user-interactive data gathering loop, start of export processing
    // loop
+   if (ExportMultipleConcurrently.Read() &&
+       mPlugins[mPluginIndex]->CanExportInTask(mSubFormatIndex)) {
+      std::vector<const ExportKit*> kits;
+      std::vector<WaveTrack*> leaders;
+      std::vector<wxFileName> names;
+      size_t ii = 0;
+      for (auto tr : mTracks->Leaders<WaveTrack>() -
+         (anySolo ? &WaveTrack::GetNotSolo : &WaveTrack::GetMute)) {
+         const auto &kit = exportSettings[ii++];
+         if (!kit.destfile.GetName().empty()) {
+            kits.push_back(&kit);
+            leaders.push_back(tr);
+            names.push_back(kit.destfile);
+         }
+      }
+      return DoExportConcurrently(names,
+         [&](size_t index, const wxFileNameWrapper &fName,
+            ProgressResult &failure){
+            const auto &kit = *kits[index];
+            // The task mixes the tracks that are selected while it is made
+            SelectionStateChanger changer2{ mSelectionState, *mTracks };
+            for (auto channel : TrackList::Channels(leaders[index]))
+               channel->SetSelected(true);
+            return mPlugins[mPluginIndex]->PrepareExportTask(mProject,
+               kit.channels, fName, true, kit.t0, kit.t1, nullptr,
+               &kit.filetags, mSubFormatIndex, failure);
+         });
+   }
+
    int count = 0; // count the number of successful runs
    ExportKit activeSetting;  // pointer to the settings in use for this export
    std::unique_ptr<ProgressDialog> pDialog;
@@ -1067,8 +1128,6 @@ ProgressResult ExportMultipleDialog::DoExport(std::unique_ptr<ProgressDialog> &p
                               double t1,
                               const Tags &tags)
 {
-   wxFileName name;
-
    wxLogDebug(wxT("Doing multiple Export: File name \"%s\""), (inName.GetFullName()));
    wxLogDebug(wxT("Channels: %i, Start: %lf, End: %lf "), channels, t0, t1);
    if (selectedOnly)
@@ -1077,6 +1136,35 @@ ProgressResult ExportMultipleDialog::DoExport(std::unique_ptr<ProgressDialog> &p
       wxLogDebug(wxT("Whole Project"));
 
    wxFileName backup;
+   const wxString fullPath{ StartFile(inName, backup) };
+   ProgressResult success = ProgressResult::Cancelled;
+
+   auto cleanup = finally( [&] {
+      FinishFile(fullPath, backup, success);
+   } );
+
+   // Call the format export routine
+   success = mPlugins[mPluginIndex]->Export(mProject,
+                                            pDialog,
+                                                channels,
+                                                fullPath,
+                                                selectedOnly,
+                                                t0,
+                                                t1,
+                                                NULL,
+                                                &tags,
+                                                mSubFormatIndex);
+
+   Refresh();
+   Update();
+
+   return success;
+}
+
+wxString ExportMultipleDialog::StartFile(
+   const wxFileName &inName, wxFileName &backup)
+{
+   wxFileName name;
    if (mOverwrite->GetValue()) {
       name = inName;
       backup.Assign(name);
@@ -1098,51 +1186,218 @@ ProgressResult ExportMultipleDialog::DoExport(std::unique_ptr<ProgressDialog> &p
          name.SetName(wxString::Format(wxT("%s-%d"), base, i++));
       }
    }
+   return name.GetFullPath();
+}
 
-   ProgressResult success = ProgressResult::Cancelled;
-   const wxString fullPath{name.GetFullPath()};
+void ExportMultipleDialog::FinishFile(const wxString &fullPath,
+   const wxFileName &backup, ProgressResult result)
+{
+   bool ok =
+      result == ProgressResult::Stopped ||
+      result == ProgressResult::Success;
+   if (backup.IsOk()) {
+      if ( ok )
+         // Remove backup
+         ::wxRemoveFile(backup.GetFullPath());
+      else {
+         // Restore original
+         ::wxRemoveFile(fullPath);
+         ::wxRenameFile(backup.GetFullPath(), fullPath);
+      }
+   }
+   else {
+      if ( ! ok )
+         // Remove any new, and only partially written, file.
+         ::wxRemoveFile(fullPath);
+   }
+
+   if (ok)
+      mExported.push_back(fullPath);
+}
 
+ProgressResult ExportMultipleDialog::DoExportConcurrently(
+   const std::vector<wxFileName> &names, const TaskFactory &prepare)
+{
+   enum class Stage {
+      //! Not yet prepared by the main thread
+      Waiting,
+      //! Prepared; a worker may run the task
+      Prepared,
+      //! Not to be exported, because of failure or cancellation
+      Skipped,
+      //! The worker has run the task, and set the result
+      Done,
+   };
+   struct File {
+      // These are used only by the main thread:
+      wxString fullPath;
+      wxFileName backup;
+      std::unique_ptr<ExportTask> pTask;
+      //! Whether StartFile() was called, and then FinishFile()
+      bool started{ false };
+      bool finished{ false };
+
+      //! Fraction of the file done, written by the worker
+      std::atomic<double> done{ 0.0 };
+      //! These are guarded by the mutex
+      Stage stage{ Stage::Waiting };
+      ProgressResult result{ ProgressResult::Cancelled };
+   };
+
+   // What the tasks are told by the reports of their progress
+   std::atomic<ProgressResult> state{ ProgressResult::Success };
+   std::mutex mutex;
+   std::condition_variable prepared;
+   std::vector<File> files(names.size());
+
+   auto &pool = ThreadPool::Get();
+   // The polling overload of ParallelFor leaves the lanes to the workers;
+   // prepare no more files than can run at once
+   const auto nLanes = std::max<size_t>(1, pool.GetConcurrency() - 1);
+
+   ProgressDialog progress{ XO("Export Multiple"),
+      XO("Exporting the audio as %s")
+         .Format( mPlugins[mPluginIndex]->GetDescription(mSubFormatIndex) ) };
+
+   auto ok = ProgressResult::Success;
+   size_t nextPrepare = 0;
+   size_t nFinished = 0;
+   std::vector<File*> running;
+
+   const auto finishFile = [&](File &file, ProgressResult result){
+      // Close the file before removing or keeping it
+      file.pTask.reset();
+      FinishFile(file.fullPath, file.backup, result);
+      file.finished = true;
+      ++nFinished;
+      if (ok == ProgressResult::Success)
+         ok = result;
+   };
+
+   // Let waiting workers skip the files not yet prepared
+   const auto skipRest = [&]{
+      {
+         std::lock_guard<std::mutex> guard{ mutex };
+         for (; nextPrepare < files.size(); ++nextPrepare)
+            files[nextPrepare].stage = Stage::Skipped;
+      }
+      prepared.notify_all();
+   };
+
+   // Every file whose StartFile() ran gets FinishFile(), even after an
+   // exception; by then ParallelFor has returned, and no task runs
    auto cleanup = finally( [&] {
-      bool ok =
-         success == ProgressResult::Stopped ||
-         success == ProgressResult::Success;
-      if (backup.IsOk()) {
-         if ( ok )
-            // Remove backup
-            ::wxRemoveFile(backup.GetFullPath());
-         else {
-            // Restore original
-            ::wxRemoveFile(fullPath);
-            ::wxRenameFile(backup.GetFullPath(), fullPath);
+      state.store(ProgressResult::Cancelled);
+      for (auto &file : files)
+         if (file.started && !file.finished)
+            finishFile(file, file.stage == Stage::Done
+               ? file.result : ProgressResult::Cancelled);
+   } );
+
+   // Called on the main thread only
+   const auto service = [&]{
+      // Finish the files of the tasks that are done
+      auto end = std::remove_if(running.begin(), running.end(),
+         [&](File *pFile){
+            {
+               std::lock_guard<std::mutex> guard{ mutex };
+               if (pFile->stage != Stage::Done)
+                  return false;
+            }
+            finishFile(*pFile, pFile->result);
+            return true;
+         });
+      running.erase(end, running.end());
+
+      double done = nFinished;
+      for (auto pFile : running)
+         done += pFile->done.load(std::memory_order_relaxed);
+      const auto result = progress.Update(done, double(files.size()));
+      if (result != ProgressResult::Success)
+         state.store(result);
+
+      // Prepare more tasks, unless something went wrong or the user said to
+      // stop
+      while (running.size() < nLanes && nextPrepare < files.size() &&
+             ok == ProgressResult::Success &&
+             state.load() == ProgressResult::Success) {
+         const auto index = nextPrepare;
+         auto &file = files[index];
+         file.fullPath = StartFile(names[index], file.backup);
+         file.started = true;
+         auto failure = ProgressResult::Failed;
+         file.pTask = GuardedCall<std::unique_ptr<ExportTask>>( [&]{
+            return prepare(index, wxFileNameWrapper{ file.fullPath }, failure);
+         }, [](AudacityException *){ return nullptr; } );
+         if (!file.pTask) {
+            finishFile(file, failure);
+            break;
+         }
+         {
+            std::lock_guard<std::mutex> guard{ mutex };
+            file.stage = Stage::Prepared;
+            ++nextPrepare;
          }
+         prepared.notify_all();
+         running.push_back(&file);
       }
-      else {
-         if ( ! ok )
-            // Remove any new, and only partially written, file.
-            ::wxRemoveFile(fullPath);
+
+      if (ok != ProgressResult::Success ||
+          state.load() != ProgressResult::Success)
+         skipRest();
+   };
+
+   const auto mainThread = std::this_thread::get_id();
+   std::exception_ptr pException;
+   pool.ParallelFor(files.size(), [&](size_t index, size_t){
+      // Without workers, the calls are made in this thread
+      if (std::this_thread::get_id() == mainThread)
+         service();
+
+      auto &file = files[index];
+      {
+         std::unique_lock<std::mutex> lock{ mutex };
+         prepared.wait(lock, [&]{ return file.stage != Stage::Waiting; });
+         if (file.stage == Stage::Skipped)
+            return;
       }
-   } );
+      const auto result = GuardedCall<ProgressResult>( [&]{
+         return file.pTask->Run([&](double current, double total){
+            file.done.store(total > 0 ? current / total : 1.0,
+               std::memory_order_relaxed);
+            return state.load(std::memory_order_relaxed);
+         });
+      }, MakeSimpleGuard(ProgressResult::Failed) );
+      {
+         std::lock_guard<std::mutex> guard{ mutex };
+         file.result = result;
+         file.stage = Stage::Done;
+      }
+   }, [&]{
+      // The poller must not throw
+      try {
+         service();
+      }
+      catch (...) {
+         if (!pException)
+            pException = std::current_exception();
+         state.store(ProgressResult::Cancelled);
+         skipRest();
+      }
+   }, std::chrono::milliseconds{ 50 });
 
-   // Call the format export routine
-   success = mPlugins[mPluginIndex]->Export(mProject,
-                                            pDialog,
-                                                channels,
-                                                fullPath,
-                                                selectedOnly,
-                                                t0,
-                                                t1,
-                                                NULL,
-                                                &tags,
-                                                mSubFormatIndex);
+   if (pException)
+      std::rethrow_exception(pException);
 
-   if (success == ProgressResult::Success || success == ProgressResult::Stopped) {
-      mExported.push_back(fullPath);
-   }
+   // Finish the files done since the last poll
+   service();
+   if (ok == ProgressResult::Success)
+      ok = state.load();
 
    Refresh();
    Update();
 
-   return success;
+   return ok;
 }
 
 wxString ExportMultipleDialog::MakeFileName(const wxString &input)
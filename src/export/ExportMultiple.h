@@ -12,6 +12,7 @@
 #define __AUDACITY_EXPORT_MULTIPLE__
 
 #include "Export.h"
+#include "Prefs.h"
 #include "wxFileNameWrapper.h" // member variable
 
 class wxButton;
@@ -29,6 +30,10 @@ class SelectionState;
 class ShuttleGui;
 class Track;
 
+//! Whether Export Multiple exports several files at once, when the format
+//! allows
+extern AUDACITY_DLL_API BoolSetting ExportMultipleConcurrently;
+
 class AUDACITY_DLL_API ExportMultipleDialog final : public wxDialogWrapper
 {
 public:
@@ -80,6 +85,35 @@ private:
                  double t0,
                  double t1,
                  const Tags &tags);
+
+   //! Makes the task to export one file, given its index in the set, and the
+   //! path; see ExportPlugin::PrepareExportTask()
+   using TaskFactory = std::function< std::unique_ptr<ExportTask>(
+      size_t index, const wxFileNameWrapper &fName, ProgressResult &failure) >;
+
+   /** \brief Export all files of an export multiple set, several at once
+    *
+    * Used instead of DoExport() for each file, when the format supports
+    * ExportTask.  Each task is prepared on the main thread, then runs on a
+    * worker of ThreadPool, with at most one per worker at once.  One progress
+    * dialog shows the progress of all.  Every file that is started is also
+    * finished, even if an exception escapes.
+    * @param names The files to export, in order
+    * @param prepare Called on the main thread for each file in turn
+    */
+   ProgressResult DoExportConcurrently(
+      const std::vector<wxFileName> &names, const TaskFactory &prepare);
+
+   /** \brief Decide the path for one file of the set, first moving any
+    * existing file aside, if overwriting
+    * @param[out] backup Set to where the existing file was moved, if it was */
+   wxString StartFile(const wxFileName &name, wxFileName &backup);
+
+   /** \brief After export of one file of the set ends with the result, remove
+    * the backup or restore it, or remove the partial file, and remember the
+    * file if exported */
+   void FinishFile(const wxString &fullPath, const wxFileName &backup,
+      ProgressResult result);
    /** \brief Takes an arbitrary text string and converts it to a form that can
     * be used as a file name, if necessary prompting the user to edit the file
     * name produced */
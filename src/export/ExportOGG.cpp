@@ -16,6 +16,7 @@
 #ifdef USE_LIBVORBIS
 
 #include "Export.h"
+#include "ExportPipeline.h"
 
 #include <wx/log.h>
 #include <wx/slider.h>
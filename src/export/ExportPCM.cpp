@@ -38,6 +38,7 @@
 #include "wxFileNameWrapper.h"
 
 #include "Export.h"
+#include "ExportPipeline.h"
 
 #ifdef USE_LIBID3TAG
    #include <id3tag.h>
@@ -403,7 +404,20 @@ public:
    FileExtension GetExtension(int index) override;
    unsigned GetMaxChannels(int index) override;
 
+   bool CanExportInTask(int subformat) override;
+   std::unique_ptr<ExportTask> PrepareExportTask(
+      AudacityProject *project, unsigned channels,
+      const wxFileNameWrapper &fName, bool selectedOnly, double t0, double t1,
+      MixerSpec *mixerSpec, const Tags *metadata, int subformat,
+      ProgressResult &failure) override;
+
 private:
+   class Task;
+   std::unique_ptr<Task> Prepare(AudacityProject *project, unsigned channels,
+      const wxFileNameWrapper &fName, bool selectedOnly, double t0, double t1,
+      MixerSpec *mixerSpec, const Tags *metadata, int subformat,
+      ProgressResult &failure);
+
    void ReportTooBigError(wxWindow * pParent);
    ArrayOf<char> AdjustString(const wxString & wxStr, int sf_format);
    bool AddStrings(AudacityProject *project, SNDFILE *sf, const Tags *tags, int sf_format);
@@ -459,6 +473,48 @@ void ExportPCM::ReportTooBigError(wxWindow * pParent)
 #endif
 }
 
+//! Mixes and writes the samples of an export prepared by ExportPCM
+class ExportPCM::Task final : public ExportTask
+{
+public:
+   Task(ExportPCM &plugin, const wxFileNameWrapper &fName,
+      double t0, double t1)
+      : mPlugin{ plugin }, mFName{ fName }, mT0{ t0 }, mT1{ t1 }
+   {}
+
+   ProgressResult Run(const ProgressReport &report) override;
+
+   ExportPCM &mPlugin;
+   const wxFileNameWrapper mFName;
+   const double mT0, mT1;
+   const Tags *mMetadata{};
+
+   wxString mFormatStr;
+   SF_INFO mInfo{};
+   int mSFFormat{};
+   int mFileFormat{};
+   sampleFormat mFormat{ int16Sample };
+   size_t mMaxBlockLen{ 44100 * 5 };
+
+   wxFile mFile;   // will be closed when the task is destroyed
+   SFFile mSF; // wraps mFile
+   std::unique_ptr<ExportPipeline> mMixer;
+};
+
+bool ExportPCM::CanExportInTask(int WXUNUSED(subformat))
+{
+   return true;
+}
+
+std::unique_ptr<ExportTask> ExportPCM::PrepareExportTask(
+   AudacityProject *project, unsigned channels, const wxFileNameWrapper &fName,
+   bool selectedOnly, double t0, double t1, MixerSpec *mixerSpec,
+   const Tags *metadata, int subformat, ProgressResult &failure)
+{
+   return Prepare(project, channels, fName, selectedOnly, t0, t1,
+      mixerSpec, metadata, subformat, failure);
+}
+
 /**
  *
  * @param subformat Control whether we are doing a "preset" export to a popular
@@ -474,6 +530,29 @@ ProgressResult ExportPCM::Export(AudacityProject *project,
                                  MixerSpec *mixerSpec,
                                  const Tags *metadata,
                                  int subformat)
+{
+   auto failure = ProgressResult::Cancelled;
+   auto pTask = Prepare(project, numChannels, fName, selectionOnly, t0, t1,
+      mixerSpec, metadata, subformat, failure);
+   if (!pTask)
+      return failure;
+
+   InitProgress( pDialog, fName,
+      (selectionOnly
+         ? XO("Exporting the selected audio as %s")
+         : XO("Exporting the audio as %s"))
+         .Format( pTask->mFormatStr ) );
+   auto &progress = *pDialog;
+
+   return pTask->Run([&](double current, double total){
+      return progress.Update(current, total);
+   });
+}
+
+auto ExportPCM::Prepare(AudacityProject *project,
+   unsigned numChannels, const wxFileNameWrapper &fName, bool selectionOnly,
+   double t0, double t1, MixerSpec *mixerSpec, const Tags *metadata,
+   int subformat, ProgressResult &failure) -> std::unique_ptr<Task>
 {
    double rate = ProjectRate::Get( *project ).GetRate();
    const auto &tracks = TrackList::Get( *project );
@@ -513,210 +592,216 @@ ProgressResult ExportPCM::Export(AudacityProject *project,
    }
 
    int fileFormat = sf_format & SF_FORMAT_TYPEMASK;
-   
-   auto updateResult = ProgressResult::Success;
-   {
-      wxFile f;   // will be closed when it goes out of scope
-      SFFile       sf; // wraps f
 
-      wxString     formatStr;
-      SF_INFO      info;
-      //int          err;
+   auto pTask = std::make_unique<Task>(*this, fName, t0, t1);
+   auto &f = pTask->mFile;
+   auto &sf = pTask->mSF;
+   auto &info = pTask->mInfo;
+   pTask->mSFFormat = sf_format;
+   pTask->mFileFormat = fileFormat;
 
-      //This whole operation should not occur while a file is being loaded on OD,
-      //(we are worried about reading from a file being written to,) so we block.
-      //Furthermore, we need to do this because libsndfile is not threadsafe.
-      formatStr = SFCall<wxString>(sf_header_name, fileFormat);
+   failure = ProgressResult::Cancelled;
 
-      // Use libsndfile to export file
+   //This whole operation should not occur while a file is being loaded on OD,
+   //(we are worried about reading from a file being written to,) so we block.
+   //Furthermore, we need to do this because libsndfile is not threadsafe.
+   pTask->mFormatStr = SFCall<wxString>(sf_header_name, fileFormat);
 
-      info.samplerate = (unsigned int)(rate + 0.5);
-      info.frames = (unsigned int)((t1 - t0)*rate + 0.5);
-      info.channels = numChannels;
-      info.format = sf_format;
-      info.sections = 1;
-      info.seekable = 0;
+   // Use libsndfile to export file
 
-      // Bug 46.  Trap here, as sndfile.c does not trap it properly.
-      if( (numChannels != 1) && ((sf_format & SF_FORMAT_SUBMASK) == SF_FORMAT_GSM610) )
-      {
-         AudacityMessageBox( XO("GSM 6.10 requires mono") );
-         return ProgressResult::Cancelled;
-      }
+   info.samplerate = (unsigned int)(rate + 0.5);
+   info.frames = (unsigned int)((t1 - t0)*rate + 0.5);
+   info.channels = numChannels;
+   info.format = sf_format;
+   info.sections = 1;
+   info.seekable = 0;
 
-      if (sf_format == SF_FORMAT_WAVEX + SF_FORMAT_GSM610) {
-         AudacityMessageBox(
-            XO("WAVEX and GSM 6.10 formats are not compatible") );
-         return ProgressResult::Cancelled;
-      }
+   // Bug 46.  Trap here, as sndfile.c does not trap it properly.
+   if( (numChannels != 1) && ((sf_format & SF_FORMAT_SUBMASK) == SF_FORMAT_GSM610) )
+   {
+      AudacityMessageBox( XO("GSM 6.10 requires mono") );
+      return nullptr;
+   }
 
-      // If we can't export exactly the format they requested,
-      // try the default format for that header type...
-      // 
-      // LLL: I don't think this is valid since libsndfile checks
-      // for all allowed subtypes explicitly and doesn't provide
-      // for an unspecified subtype.
-      if (!sf_format_check(&info))
-         info.format = (info.format & SF_FORMAT_TYPEMASK);
-      if (!sf_format_check(&info)) {
-         AudacityMessageBox( XO("Cannot export audio in this format.") );
-         return ProgressResult::Cancelled;
-      }
-      const auto path = fName.GetFullPath();
-      if (f.Open(path, wxFile::write)) {
-         // Even though there is an sf_open() that takes a filename, use the one that
-         // takes a file descriptor since wxWidgets can open a file with a Unicode name and
-         // libsndfile can't (under Windows).
-         sf.reset(SFCall<SNDFILE*>(sf_open_fd, f.fd(), SFM_WRITE, &info, FALSE));
-         //add clipping for integer formats.  We allow floats to clip.
-         sf_command(sf.get(), SFC_SET_CLIPPING, NULL, sf_subtype_is_integer(sf_format)?SF_TRUE:SF_FALSE) ;
-      }
+   if (sf_format == SF_FORMAT_WAVEX + SF_FORMAT_GSM610) {
+      AudacityMessageBox(
+         XO("WAVEX and GSM 6.10 formats are not compatible") );
+      return nullptr;
+   }
 
-      if (!sf) {
-         AudacityMessageBox( XO("Cannot export audio to %s").Format( path ) );
-         return ProgressResult::Cancelled;
-      }
-      // Retrieve tags if not given a set
-      if (metadata == NULL)
-         metadata = &Tags::Get( *project );
-
-      // Install the meta data at the beginning of the file (except for
-      // WAV and WAVEX formats)
-      if (fileFormat != SF_FORMAT_WAV &&
-          fileFormat != SF_FORMAT_WAVEX) {
-         if (!AddStrings(project, sf.get(), metadata, sf_format)) {
-            return ProgressResult::Cancelled;
-         }
+   // If we can't export exactly the format they requested,
+   // try the default format for that header type...
+   // 
+   // LLL: I don't think this is valid since libsndfile checks
+   // for all allowed subtypes explicitly and doesn't provide
+   // for an unspecified subtype.
+   if (!sf_format_check(&info))
+      info.format = (info.format & SF_FORMAT_TYPEMASK);
+   if (!sf_format_check(&info)) {
+      AudacityMessageBox( XO("Cannot export audio in this format.") );
+      return nullptr;
+   }
+   const auto path = fName.GetFullPath();
+   if (f.Open(path, wxFile::write)) {
+      // Even though there is an sf_open() that takes a filename, use the one that
+      // takes a file descriptor since wxWidgets can open a file with a Unicode name and
+      // libsndfile can't (under Windows).
+      sf.reset(SFCall<SNDFILE*>(sf_open_fd, f.fd(), SFM_WRITE, &info, FALSE));
+      //add clipping for integer formats.  We allow floats to clip.
+      sf_command(sf.get(), SFC_SET_CLIPPING, NULL, sf_subtype_is_integer(sf_format)?SF_TRUE:SF_FALSE) ;
+   }
+
+   if (!sf) {
+      AudacityMessageBox( XO("Cannot export audio to %s").Format( path ) );
+      return nullptr;
+   }
+   // Retrieve tags if not given a set
+   if (metadata == NULL)
+      metadata = &Tags::Get( *project );
+   pTask->mMetadata = metadata;
+
+   // Install the meta data at the beginning of the file (except for
+   // WAV and WAVEX formats)
+   if (fileFormat != SF_FORMAT_WAV &&
+       fileFormat != SF_FORMAT_WAVEX) {
+      if (!AddStrings(project, sf.get(), metadata, sf_format)) {
+         return nullptr;
       }
+   }
 
-      sampleFormat format;
-      if (sf_subtype_more_than_16_bits(info.format))
-         format = floatSample;
-      else
-         format = int16Sample;
-
-      // Bug 2200
-      // Only trap size limit for file types we know have an upper size limit.
-      // The error message mentions aiff and wav.
-      if( (fileFormat == SF_FORMAT_WAV) ||
-          (fileFormat == SF_FORMAT_WAVEX) ||
-          (fileFormat == SF_FORMAT_AIFF ))
+   sampleFormat format;
+   if (sf_subtype_more_than_16_bits(info.format))
+      format = floatSample;
+   else
+      format = int16Sample;
+   pTask->mFormat = format;
+
+   // Bug 2200
+   // Only trap size limit for file types we know have an upper size limit.
+   // The error message mentions aiff and wav.
+   if( (fileFormat == SF_FORMAT_WAV) ||
+       (fileFormat == SF_FORMAT_WAVEX) ||
+       (fileFormat == SF_FORMAT_AIFF ))
+   {
+      float sampleCount = (float)(t1-t0)*rate*info.channels;
+      float byteCount = sampleCount * sf_subtype_bytes_per_sample( info.format);
+      // Test for 4 Gibibytes, rather than 4 Gigabytes
+      if( byteCount > 4.295e9)
       {
-         float sampleCount = (float)(t1-t0)*rate*info.channels;
-         float byteCount = sampleCount * sf_subtype_bytes_per_sample( info.format);
-         // Test for 4 Gibibytes, rather than 4 Gigabytes
-         if( byteCount > 4.295e9)
-         {
-            ReportTooBigError( wxTheApp->GetTopWindow() );
-            return ProgressResult::Failed;
-         }
+         ReportTooBigError( wxTheApp->GetTopWindow() );
+         failure = ProgressResult::Failed;
+         return nullptr;
       }
-      size_t maxBlockLen = 44100 * 5;
+   }
 
-      {
-         std::vector<char> dither;
-         if ((info.format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_24) {
-            dither.reserve(maxBlockLen * info.channels * SAMPLE_SIZE(int24Sample));
-         }
+   wxASSERT(info.channels >= 0);
+   pTask->mMixer = CreateMixer(tracks, selectionOnly,
+                               t0, t1,
+                               info.channels, pTask->mMaxBlockLen, true,
+                               rate, format, mixerSpec);
+
+   return pTask;
+}
+
+ProgressResult ExportPCM::Task::Run(const ProgressReport &report)
+{
+   auto &info = mInfo;
+   const auto format = mFormat;
+   const auto maxBlockLen = mMaxBlockLen;
+   const auto &fName = mFName;
+
+   auto updateResult = ProgressResult::Success;
+   {
+      std::vector<char> dither;
+      if ((info.format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_24) {
+         dither.reserve(maxBlockLen * info.channels * SAMPLE_SIZE(int24Sample));
+      }
+
+      while (updateResult == ProgressResult::Success) {
+         sf_count_t samplesWritten;
+         size_t numSamples = mMixer->Process(maxBlockLen);
+
+         if (numSamples == 0)
+            break;
 
-         wxASSERT(info.channels >= 0);
-         auto mixer = CreateMixer(tracks, selectionOnly,
-                                  t0, t1,
-                                  info.channels, maxBlockLen, true,
-                                  rate, format, mixerSpec);
-
-         InitProgress( pDialog, fName,
-            (selectionOnly
-               ? XO("Exporting the selected audio as %s")
-               : XO("Exporting the audio as %s"))
-               .Format( formatStr ) );
-         auto &progress = *pDialog;
-
-         while (updateResult == ProgressResult::Success) {
-            sf_count_t samplesWritten;
-            size_t numSamples = mixer->Process(maxBlockLen);
-
-            if (numSamples == 0)
-               break;
-
-            auto mixed = mixer->GetBuffer();
-
-            // Bug 1572: Not ideal, but it does add the desired dither
-            if ((info.format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_24) {
-               for (int c = 0; c < info.channels; ++c) {
-                  CopySamples(
-                     mixed + (c * SAMPLE_SIZE(format)), format,
-                     dither.data() + (c * SAMPLE_SIZE(int24Sample)), int24Sample,
-                     numSamples, gHighQualityDither, info.channels, info.channels
-                  );
-                  // Copy back without dither
-                  CopySamples(
-                     dither.data() + (c * SAMPLE_SIZE(int24Sample)), int24Sample,
-                     const_cast<samplePtr>(mixed) // PRL fix this!
-                        + (c * SAMPLE_SIZE(format)), format,
-                     numSamples, DitherType::none, info.channels, info.channels);
-               }
+         auto mixed = mMixer->GetBuffer();
+
+         // Bug 1572: Not ideal, but it does add the desired dither
+         if ((info.format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_24) {
+            for (int c = 0; c < info.channels; ++c) {
+               CopySamples(
+                  mixed + (c * SAMPLE_SIZE(format)), format,
+                  dither.data() + (c * SAMPLE_SIZE(int24Sample)), int24Sample,
+                  numSamples, gHighQualityDither, info.channels, info.channels
+               );
+               // Copy back without dither
+               CopySamples(
+                  dither.data() + (c * SAMPLE_SIZE(int24Sample)), int24Sample,
+                  const_cast<samplePtr>(mixed) // PRL fix this!
+                     + (c * SAMPLE_SIZE(format)), format,
+                  numSamples, DitherType::none, info.channels, info.channels);
             }
+         }
 
-            if (format == int16Sample)
-               samplesWritten = SFCall<sf_count_t>(sf_writef_short, sf.get(), (const short *)mixed, numSamples);
-            else
-               samplesWritten = SFCall<sf_count_t>(sf_writef_float, sf.get(), (const float *)mixed, numSamples);
+         if (format == int16Sample)
+            samplesWritten = SFCall<sf_count_t>(sf_writef_short, mSF.get(), (const short *)mixed, numSamples);
+         else
+            samplesWritten = SFCall<sf_count_t>(sf_writef_float, mSF.get(), (const float *)mixed, numSamples);
 
-            if (static_cast<size_t>(samplesWritten) != numSamples) {
-               char buffer2[1000];
-               sf_error_str(sf.get(), buffer2, 1000);
-               //Used to give this error message
+         if (static_cast<size_t>(samplesWritten) != numSamples) {
+            char buffer2[1000];
+            sf_error_str(mSF.get(), buffer2, 1000);
+            //Used to give this error message
 #if 0
-               AudacityMessageBox(
-                  XO(
-                  /* i18n-hint: %s will be the error message from libsndfile, which
-                   * is usually something unhelpful (and untranslated) like "system
-                   * error" */
+            AudacityMessageBox(
+               XO(
+               /* i18n-hint: %s will be the error message from libsndfile, which
+                * is usually something unhelpful (and untranslated) like "system
+                * error" */
 "Error while writing %s file (disk full?).\nLibsndfile says \"%s\"")
-                     .Format( formatStr, wxString::FromAscii(buffer2) ));
+                  .Format( mFormatStr, wxString::FromAscii(buffer2) ));
 #else
-               // But better to give the same error message as for
-               // other cases of disk exhaustion.
-               // The thrown exception doesn't escape but GuardedCall
-               // will enqueue a message.
-               GuardedCall([&fName]{
-                  throw FileException{
-                     FileException::Cause::Write, fName }; });
+            // But better to give the same error message as for
+            // other cases of disk exhaustion.
+            // The thrown exception doesn't escape but GuardedCall
+            // will enqueue a message.
+            GuardedCall([&fName]{
+               throw FileException{
+                  FileException::Cause::Write, fName }; });
 #endif
-               updateResult = ProgressResult::Cancelled;
-               break;
-            }
-            
-            updateResult = progress.Update(mixer->MixGetCurrentTime() - t0, t1 - t0);
+            updateResult = ProgressResult::Cancelled;
+            break;
          }
+
+         updateResult = report(mMixer->MixGetCurrentTime() - mT0, mT1 - mT0);
       }
-      
-      // Install the WAV metata in a "LIST" chunk at the end of the file
-      if (updateResult == ProgressResult::Success ||
-          updateResult == ProgressResult::Stopped) {
-         if (fileFormat == SF_FORMAT_WAV ||
-             fileFormat == SF_FORMAT_WAVEX) {
-            if (!AddStrings(project, sf.get(), metadata, sf_format)) {
-               // TODO: more precise message
-               ShowExportErrorDialog("PCM:675");
-               return ProgressResult::Cancelled;
-            }
-         }
-         if (0 != sf.close()) {
+   }
+
+   // Install the WAV metata in a "LIST" chunk at the end of the file
+   if (updateResult == ProgressResult::Success ||
+       updateResult == ProgressResult::Stopped) {
+      if (mFileFormat == SF_FORMAT_WAV ||
+          mFileFormat == SF_FORMAT_WAVEX) {
+         if (!mPlugin.AddStrings(nullptr, mSF.get(), mMetadata, mSFFormat)) {
             // TODO: more precise message
-            ShowExportErrorDialog("PCM:681");
+            ShowExportErrorDialog("PCM:675");
             return ProgressResult::Cancelled;
          }
       }
+      if (0 != mSF.close()) {
+         // TODO: more precise message
+         ShowExportErrorDialog("PCM:681");
+         return ProgressResult::Cancelled;
+      }
    }
+   mFile.Close();
 
    if (updateResult == ProgressResult::Success ||
        updateResult == ProgressResult::Stopped)
-      if ((fileFormat == SF_FORMAT_AIFF) ||
-          (fileFormat == SF_FORMAT_WAV))
+      if ((mFileFormat == SF_FORMAT_AIFF) ||
+          (mFileFormat == SF_FORMAT_WAV))
          // Note: file has closed, and gets reopened and closed again here:
-         if (!AddID3Chunk(fName, metadata, sf_format) ) {
+         if (!mPlugin.AddID3Chunk(fName, mMetadata, mSFFormat) ) {
             // TODO: more precise message
             ShowExportErrorDialog("PCM:694");
             return ProgressResult::Cancelled;
@@ -0,0 +1,198 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file ExportPipeline.cpp
+
+**********************************************************************/
+
+#include "ExportPipeline.h"
+
+#include <algorithm>
+#include <cstring>
+#include <wx/debug.h>
+#include <wx/log.h>
+
+#include "MemoryX.h"
+#include "Mix.h"
+
+BoolSetting ExportPipelined{ L"/Performance/ExportPipelined", true };
+
+namespace {
+//! Bound on the samples per channel in the queue
+constexpr size_t QueueSamples = 65536;
+
+using Clock = std::chrono::steady_clock;
+
+//! Accumulate seconds since start; only one thread writes each total
+void Add(std::atomic<double> &total, Clock::time_point start)
+{
+   const std::chrono::duration<double> elapsed = Clock::now() - start;
+   total.store(total.load(std::memory_order_relaxed) + elapsed.count(),
+      std::memory_order_relaxed);
+}
+}
+
+ExportPipeline::ExportPipeline(std::unique_ptr<Mixer> pMixer,
+   unsigned numChannels, size_t bufferSize, bool interleaved,
+   sampleFormat format)
+   : mMixer{ std::move(pMixer) }
+   , mBufferSize{ bufferSize }
+   , mBufferBytes{
+      bufferSize * (interleaved ? numChannels : 1) * SAMPLE_SIZE(format) }
+   , mPipelined{ ExportPipelined.Read() }
+{
+   if (!mPipelined)
+      return;
+
+   // Small buffers, as for some codecs of FFmpeg, need more slots to keep
+   // the mixer busy
+   const auto nSlots = std::max<size_t>(2, QueueSamples / bufferSize);
+   const auto nBuffers = interleaved ? 1 : numChannels;
+   mSlots.resize(nSlots);
+   for (auto &slot : mSlots)
+      for (unsigned ii = 0; ii < nBuffers; ++ii)
+         slot.buffers.emplace_back(mBufferBytes / SAMPLE_SIZE(format), format);
+}
+
+ExportPipeline::~ExportPipeline()
+{
+   if (mThread.joinable()) {
+      {
+         std::lock_guard<std::mutex> guard(mMutex);
+         mStop = true;
+      }
+      mReleased.notify_one();
+      mThread.join();
+   }
+
+   const auto stats = GetStatistics();
+   wxLogDebug(wxT("Export pipeline: mixing %.3f s, encoding %.3f s, "
+      "mixer waited %.3f s, encoder waited %.3f s"),
+      stats.mixing, stats.encoding, stats.mixerWaiting, stats.encoderWaiting);
+}
+
+size_t ExportPipeline::Process(size_t maxSamples)
+{
+   wxASSERT(maxSamples == mBufferSize);
+
+   if (mCalled)
+      Add(mEncoding, mReturned);
+   mCalled = true;
+   auto returned = finally([this]{ mReturned = Clock::now(); });
+
+   if (!mPipelined) {
+      const auto start = Clock::now();
+      auto count = mMixer->Process(maxSamples);
+      Add(mMixing, start);
+      return count;
+   }
+
+   if (mEnded)
+      return 0;
+
+   if (!mThread.joinable())
+      mThread = std::thread([this]{ Run(); });
+
+   std::unique_lock<std::mutex> lock(mMutex);
+   if (mHolding) {
+      mHolding = false;
+      mFront = (mFront + 1) % mSlots.size();
+      --mCount;
+      mReleased.notify_one();
+   }
+
+   const auto start = Clock::now();
+   mFilled.wait(lock, [this]{ return mCount > 0 || mException; });
+   Add(mEncoderWaiting, start);
+
+   if (mCount == 0) {
+      mEnded = true;
+      std::rethrow_exception(mException);
+   }
+
+   mHolding = true;
+   const auto count = mSlots[mFront].count;
+   if (count == 0)
+      mEnded = true;
+   return count;
+}
+
+double ExportPipeline::MixGetCurrentTime()
+{
+   if (!mPipelined)
+      return mMixer->MixGetCurrentTime();
+   // The mixing thread does not touch the held slot, so no lock is needed
+   return mHolding ? mSlots[mFront].time : 0;
+}
+
+constSamplePtr ExportPipeline::GetBuffer()
+{
+   return GetBuffer(0);
+}
+
+constSamplePtr ExportPipeline::GetBuffer(int channel)
+{
+   if (!mPipelined)
+      return mMixer->GetBuffer(channel);
+   wxASSERT(mHolding);
+   return mSlots[mFront].buffers[channel].ptr();
+}
+
+auto ExportPipeline::GetStatistics() const -> Statistics
+{
+   Statistics result;
+   result.mixing = mMixing.load(std::memory_order_relaxed);
+   result.encoding = mEncoding.load(std::memory_order_relaxed);
+   result.mixerWaiting = mMixerWaiting.load(std::memory_order_relaxed);
+   result.encoderWaiting = mEncoderWaiting.load(std::memory_order_relaxed);
+   return result;
+}
+
+bool ExportPipeline::WaitForSpace()
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   const auto start = Clock::now();
+   mReleased.wait(lock,
+      [this]{ return mStop || mCount < mSlots.size(); });
+   Add(mMixerWaiting, start);
+   return !mStop;
+}
+
+void ExportPipeline::Run()
+{
+   // The exporter does not read the slot at back until mCount is
+   // incremented
+   size_t back = 0;
+   try {
+      while (WaitForSpace()) {
+         auto &slot = mSlots[back];
+         const auto start = Clock::now();
+         const auto count = mMixer->Process(mBufferSize);
+         Add(mMixing, start);
+
+         slot.count = count;
+         slot.time = mMixer->MixGetCurrentTime();
+         const auto bytes = mBufferBytes / mBufferSize * count;
+         for (size_t ii = 0; ii < slot.buffers.size(); ++ii)
+            memcpy(slot.buffers[ii].ptr(), mMixer->GetBuffer(ii), bytes);
+
+         {
+            std::lock_guard<std::mutex> guard(mMutex);
+            ++mCount;
+         }
+         mFilled.notify_one();
+         back = (back + 1) % mSlots.size();
+
+         if (count == 0)
+            break;
+      }
+   }
+   catch (...) {
+      {
+         std::lock_guard<std::mutex> guard(mMutex);
+         mException = std::current_exception();
+      }
+      mFilled.notify_one();
+   }
+}
@@ -0,0 +1,124 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file ExportPipeline.h
+@brief Mixes the audio for an exporter in a worker thread
+
+**********************************************************************/
+
+#ifndef __AUDACITY_EXPORT_PIPELINE__
+#define __AUDACITY_EXPORT_PIPELINE__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Prefs.h"
+#include "SampleFormat.h"
+
+class Mixer;
+
+//! Whether exporters mix in a thread of their own, while they encode
+extern AUDACITY_DLL_API BoolSetting ExportPipelined;
+
+//! Overlaps the mixing of the tracks with the encoding of an export
+/*!
+ A worker thread calls Process() of the Mixer and copies its buffers into a
+ bounded queue.  The exporter's thread takes the buffers from the queue with
+ the same member functions it would call on the Mixer, so that it can encode
+ one buffer while the next is mixed.
+
+ Exceptions from mixing are rethrown by Process() in the exporter's thread.
+
+ When ExportPipelined is off, the Mixer is called directly, but the times of
+ mixing and encoding are still measured.
+ */
+class AUDACITY_DLL_API ExportPipeline final
+{
+public:
+   //! Seconds spent in each stage; complete after Process() returns 0
+   struct Statistics {
+      //! In Mixer::Process()
+      double mixing{ 0 };
+      //! By the exporter between calls to Process()
+      double encoding{ 0 };
+      //! By the mixing thread, with the queue full
+      double mixerWaiting{ 0 };
+      //! By the exporter in Process(), with the queue empty
+      double encoderWaiting{ 0 };
+   };
+
+   //! Takes the arguments of the Mixer's constructor that describe its output
+   ExportPipeline(std::unique_ptr<Mixer> pMixer,
+      unsigned numChannels, size_t bufferSize, bool interleaved,
+      sampleFormat format);
+   ExportPipeline( const ExportPipeline & ) PROHIBITED;
+   ExportPipeline &operator=( const ExportPipeline & ) PROHIBITED;
+   //! Stops the mixing thread, and logs the statistics
+   ~ExportPipeline();
+
+   //! Like Mixer::Process(); maxSamples must be the buffer size
+   /*! Starts the mixing thread at the first call */
+   size_t Process(size_t maxSamples);
+
+   //! Like Mixer::MixGetCurrentTime(), for the buffer last returned
+   double MixGetCurrentTime();
+
+   //! Retrieve the main buffer or the interleaved buffer
+   constSamplePtr GetBuffer();
+
+   //! Retrieve one of the non-interleaved buffers
+   constSamplePtr GetBuffer(int channel);
+
+   Statistics GetStatistics() const;
+
+private:
+   struct Slot {
+      std::vector<SampleBuffer> buffers;
+      size_t count{ 0 };
+      double time{ 0 };
+   };
+
+   void Run();
+   //! Wait for the exporter to release a slot
+   /*! @return false if stopped */
+   bool WaitForSpace();
+
+   const std::unique_ptr<Mixer> mMixer;
+   const size_t mBufferSize;
+   const size_t mBufferBytes;
+   const bool mPipelined;
+
+   std::vector<Slot> mSlots;
+   //! Slot that the exporter reads, when mHolding
+   size_t mFront{ 0 };
+   size_t mCount{ 0 };
+   bool mHolding{ false };
+   bool mEnded{ false };
+   std::exception_ptr mException;
+
+   std::thread mThread;
+   mutable std::mutex mMutex;
+   //! Signals that a slot is filled, or mixing failed
+   std::condition_variable mFilled;
+   //! Signals that a slot is released, or mStop is set
+   std::condition_variable mReleased;
+   bool mStop{ false };
+
+   //! When Process() last returned, if it was called
+   std::chrono::steady_clock::time_point mReturned;
+   bool mCalled{ false };
+
+   std::atomic<double> mMixing{ 0 };
+   std::atomic<double> mEncoding{ 0 };
+   std::atomic<double> mMixerWaiting{ 0 };
+   std::atomic<double> mEncoderWaiting{ 0 };
+};
+
+#endif
@@ -16,6 +16,7 @@
 
 
 #include "Export.h"
+#include "ExportPipeline.h"
 #include "wxFileNameWrapper.h"
 #include "Prefs.h"
 #include "Mix.h"
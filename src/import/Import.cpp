@@ -453,46 +453,13 @@ std::unique_ptr<ExtImportItem> Importer::CreateDefaultImportItem()
    return new_item;
 }
 
-// returns number of tracks imported
-bool Importer::Import( AudacityProject &project,
-                     const FilePath &fName,
-                     WaveTrackFactory *trackFactory,
-                     TrackHolders &tracks,
-                     Tags *tags,
-                     TranslatableString &errorMessage)
+auto Importer::ChoosePlugins(const FilePath &fName) -> ImportPluginPtrs
 {
-   AudacityProject *pProj = &project;
-   auto cleanup = valueRestorer( pProj->mbBusyImporting, true );
-
    const FileExtension extension{ fName.AfterLast(wxT('.')) };
 
-   // Always refuse to import MIDI, even though the FFmpeg plugin pretends to know how (but makes very bad renderings)
-#ifdef USE_MIDI
-   // MIDI files must be imported, not opened
-   if (FileNames::IsMidi(fName)) {
-      errorMessage = XO(
-"\"%s\" \nis a MIDI file, not an audio file. \nAudacity cannot open this type of file for playing, but you can\nedit it by clicking File > Import > MIDI.")
-         .Format( fName );
-      return false;
-   }
-#endif
-
-   // Bug #2647: Peter has a Word 2000 .doc file that is recognized and imported by FFmpeg.
-   if (wxFileName(fName).GetExt() == wxT("doc")) {
-      errorMessage =
-         XO("\"%s\" \nis a not an audio file. \nAudacity cannot open this type of file.")
-         .Format( fName );
-      return false;
-   }
-
-   using ImportPluginPtrs = std::vector< ImportPlugin* >;
-
    // This list is used to call plugins in correct order
    ImportPluginPtrs importPlugins;
 
-   // This list is used to remember plugins that should have been compatible with the file.
-   ImportPluginPtrs compatiblePlugins;
-
    // Not implemented (yet?)
    wxString mime_type = wxT("*");
 
@@ -604,6 +571,47 @@ bool Importer::Import( AudacityProject &project,
       }
    }
 
+   return importPlugins;
+}
+
+// returns number of tracks imported
+bool Importer::Import( AudacityProject &project,
+                     const FilePath &fName,
+                     WaveTrackFactory *trackFactory,
+                     TrackHolders &tracks,
+                     Tags *tags,
+                     TranslatableString &errorMessage)
+{
+   AudacityProject *pProj = &project;
+   auto cleanup = valueRestorer( pProj->mbBusyImporting, true );
+
+   const FileExtension extension{ fName.AfterLast(wxT('.')) };
+
+   // Always refuse to import MIDI, even though the FFmpeg plugin pretends to know how (but makes very bad renderings)
+#ifdef USE_MIDI
+   // MIDI files must be imported, not opened
+   if (FileNames::IsMidi(fName)) {
+      errorMessage = XO(
+"\"%s\" \nis a MIDI file, not an audio file. \nAudacity cannot open this type of file for playing, but you can\nedit it by clicking File > Import > MIDI.")
+         .Format( fName );
+      return false;
+   }
+#endif
+
+   // Bug #2647: Peter has a Word 2000 .doc file that is recognized and imported by FFmpeg.
+   if (wxFileName(fName).GetExt() == wxT("doc")) {
+      errorMessage =
+         XO("\"%s\" \nis a not an audio file. \nAudacity cannot open this type of file.")
+         .Format( fName );
+      return false;
+   }
+
+   // This list is used to remember plugins that should have been compatible with the file.
+   ImportPluginPtrs compatiblePlugins;
+
+   // This list is used to call plugins in correct order
+   ImportPluginPtrs importPlugins = ChoosePlugins(fName);
+
    // Try the import plugins, in the permuted sequences just determined
    for (const auto plugin : importPlugins)
    {
@@ -830,6 +838,41 @@ bool Importer::Import( AudacityProject &project,
    return false;
 }
 
+std::unique_ptr<ImportFileHandle> Importer::OpenForTask(
+   AudacityProject &project, const FilePath &fName)
+{
+   const FileExtension extension{ fName.AfterLast(wxT('.')) };
+
+   // Files of these kinds have their own semantics in Import()
+   if (extension.IsSameAs(wxT("lof"), false) ||
+       extension.IsSameAs(wxT("aup"), false) ||
+       extension.IsSameAs(wxT("aup3"), false))
+      return nullptr;
+
+   // Leave the refusals to Import()
+#ifdef USE_MIDI
+   if (FileNames::IsMidi(fName))
+      return nullptr;
+#endif
+   if (wxFileName(fName).GetExt() == wxT("doc"))
+      return nullptr;
+
+   for (const auto plugin : ChoosePlugins(fName))
+   {
+      auto inFile = plugin->Open(fName, &project);
+      if ( (inFile != NULL) && (inFile->GetStreamCount() > 0) )
+      {
+         // The stream selector is a dialog, and failure might be retried
+         // with other plugins; Import() does those things
+         if (inFile->GetStreamCount() > 1 || !inFile->CanImportInTask())
+            return nullptr;
+         inFile->SetStreamUsage(0, true);
+         return inFile;
+      }
+   }
+   return nullptr;
+}
+
 //-------------------------------------------------------------------------
 // ImportStreamDialog
 //-------------------------------------------------------------------------
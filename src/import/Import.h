@@ -175,7 +175,21 @@ public:
               Tags *tags,
               TranslatableString &errorMessage);
 
+   /**
+    * Opens a file with the first plugin that recognizes it, as Import()
+    * does, and chooses its only stream, for an import on a worker thread.
+    * Returns null, and nothing is shown, if the file needs a dialog or
+    * is not an ordinary audio file, or its plugin can't import in a task;
+    * then Import() must be used.
+    */
+   std::unique_ptr<ImportFileHandle> OpenForTask(
+      AudacityProject &project, const FilePath &fName);
+
 private:
+   using ImportPluginPtrs = std::vector< ImportPlugin* >;
+   //! The plugins to try for the file, in order
+   ImportPluginPtrs ChoosePlugins(const FilePath &fName);
+
    static Importer mInstance;
 
    ExtImportItems mExtImportItems;
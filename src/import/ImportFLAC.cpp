@@ -147,6 +147,7 @@ public:
    ByteCount GetFileUncompressedBytes() override;
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks,
               Tags *tags) override;
+   bool CanImportInTask() override { return true; }
 
    wxInt32 GetStreamCount() override { return 1; }
 
@@ -270,7 +271,7 @@ FLAC__StreamDecoderWriteStatus MyFLACFile::write_callback(const FLAC__Frame *fra
 
       mFile->mSamplesDone += frame->header.blocksize;
 
-      mFile->mUpdateResult = mFile->mProgress->Update((wxULongLong_t) mFile->mSamplesDone, mFile->mNumSamples != 0 ? (wxULongLong_t)mFile->mNumSamples : 1);
+      mFile->mUpdateResult = mFile->UpdateProgress((wxULongLong_t) mFile->mSamplesDone, mFile->mNumSamples != 0 ? (wxULongLong_t)mFile->mNumSamples : 1);
       if (mFile->mUpdateResult != ProgressResult::Success)
       {
          return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
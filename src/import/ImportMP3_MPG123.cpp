@@ -132,6 +132,7 @@ public:
    TranslatableString GetFileDescription() override;
    ByteCount GetFileUncompressedBytes() override;
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks, Tags *tags) override;
+   bool CanImportInTask() override;
 
    bool SetupOutputFormat();
 
@@ -247,6 +248,11 @@ auto MP3ImportFileHandle::GetFileUncompressedBytes() -> ByteCount
    return 0;
 }
 
+bool MP3ImportFileHandle::CanImportInTask()
+{
+   return true;
+}
+
 wxInt32 MP3ImportFileHandle::GetStreamCount()
 {
    return 1;
@@ -275,7 +281,7 @@ ProgressResult MP3ImportFileHandle::Import(WaveTrackFactory *trackFactory,
 
    long long framesCount = mpg123_framelength(mHandle);
 
-   mUpdateResult = mProgress->Update(0ll, framesCount);
+   mUpdateResult = UpdateProgress(0ll, framesCount);
 
    if (mUpdateResult == ProgressResult::Cancelled)
       return ProgressResult::Cancelled;
@@ -294,7 +300,7 @@ ProgressResult MP3ImportFileHandle::Import(WaveTrackFactory *trackFactory,
    while ((ret = mpg123_decode_frame(mHandle, &frameIndex, &data, &dataSize)) ==
                  MPG123_OK)
    {
-      mUpdateResult = mProgress->Update(
+      mUpdateResult = UpdateProgress(
          static_cast<long long>(frameIndex), framesCount);
 
       if (mUpdateResult == ProgressResult::Cancelled)
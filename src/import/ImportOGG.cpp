@@ -125,6 +125,7 @@ public:
    ByteCount GetFileUncompressedBytes() override;
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks,
               Tags *tags) override;
+   bool CanImportInTask() override { return true; }
 
    wxInt32 GetStreamCount() override
    {
@@ -337,7 +338,7 @@ ProgressResult OggImportFileHandle::Import(
 
          samplesSinceLastCallback += samplesRead;
          if (samplesSinceLastCallback > SAMPLES_PER_CALLBACK) {
-            updateResult = mProgress->Update(ov_time_tell(mVorbisFile.get()),
+            updateResult = UpdateProgress(ov_time_tell(mVorbisFile.get()),
                ov_time_total(mVorbisFile.get(), bitstream));
             samplesSinceLastCallback -= SAMPLES_PER_CALLBACK;
          }
@@ -45,12 +45,26 @@
 #endif
 
 #include "../FileFormats.h"
+#include "MemoryX.h"
 #include "Prefs.h"
 #include "../ShuttleGui.h"
 #include "../WaveTrack.h"
 #include "ImportPlugin.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#ifdef __WXMSW__
+   #include <wx/msw/wrapwin.h>
+#else
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <unistd.h>
+#endif
 
 #ifdef USE_LIBID3TAG
    #include <id3tag.h>
@@ -66,6 +80,215 @@
 
 #define DESC XO("WAV, AIFF, and other uncompressed types")
 
+//! Whether uncompressed WAV and AIFF files are read by mapping them to memory
+static BoolSetting ImportPCMMapped{ L"/Performance/ImportMapped", true };
+
+namespace {
+//! Read-only view of the whole of a file, mapped to memory
+/*! If the file is truncated while mapped, reading it faults */
+class MappedFile final
+{
+public:
+   MappedFile() = default;
+   MappedFile( const MappedFile & ) PROHIBITED;
+   MappedFile &operator=( const MappedFile & ) PROHIBITED;
+   ~MappedFile();
+
+   //! @return whether a non-empty file was mapped
+   bool Open(const FilePath &path);
+
+   const unsigned char *Data() const { return mData; }
+   size_t Size() const { return mSize; }
+
+private:
+   const unsigned char *mData{ nullptr };
+   size_t mSize{ 0 };
+};
+
+#ifdef __WXMSW__
+
+bool MappedFile::Open(const FilePath &path)
+{
+   const auto file = CreateFileW(path.wc_str(), GENERIC_READ, FILE_SHARE_READ,
+      nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+   if (file == INVALID_HANDLE_VALUE)
+      return false;
+   auto closeFile = finally([&]{ CloseHandle(file); });
+
+   LARGE_INTEGER size;
+   if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 ||
+       static_cast<unsigned long long>(size.QuadPart) >
+          std::numeric_limits<size_t>::max())
+      return false;
+
+   const auto mapping =
+      CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if (!mapping)
+      return false;
+   // The view keeps the mapping open
+   const auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+   CloseHandle(mapping);
+   if (!data)
+      return false;
+
+   mData = static_cast<const unsigned char *>(data);
+   mSize = static_cast<size_t>(size.QuadPart);
+   return true;
+}
+
+MappedFile::~MappedFile()
+{
+   if (mData)
+      UnmapViewOfFile(mData);
+}
+
+#else
+
+bool MappedFile::Open(const FilePath &path)
+{
+   const auto fd = open(path.fn_str(), O_RDONLY);
+   if (fd < 0)
+      return false;
+   // The mapping remains after the descriptor is closed
+   auto closeFile = finally([&]{ close(fd); });
+
+   struct stat info;
+   if (fstat(fd, &info) != 0 || info.st_size <= 0 ||
+       static_cast<unsigned long long>(info.st_size) >
+          std::numeric_limits<size_t>::max())
+      return false;
+
+   const auto size = static_cast<size_t>(info.st_size);
+   const auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (data == MAP_FAILED)
+      return false;
+   madvise(data, size, MADV_SEQUENTIAL);
+
+   mData = static_cast<const unsigned char *>(data);
+   mSize = size;
+   return true;
+}
+
+MappedFile::~MappedFile()
+{
+   if (mData)
+      munmap(const_cast<unsigned char *>(mData), mSize);
+}
+
+#endif
+
+//! Find the data chunk of a Sony Wave64 file
+/*! Its chunks are named by GUIDs, and have 64 bit little-endian sizes that
+ count their headers
+ @return offset of the first sample, or 0 if there is none */
+size_t FindW64SampleData(const unsigned char *data, size_t size)
+{
+   static const unsigned char riffId[16] = { 'r', 'i', 'f', 'f',
+      0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
+   static const unsigned char waveId[16] = { 'w', 'a', 'v', 'e',
+      0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+   static const unsigned char dataId[16] = { 'd', 'a', 't', 'a',
+      0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+   constexpr size_t ChunkHeaderBytes = 24;
+   const auto read64 = [&](size_t pos){
+      uint64_t result = 0;
+      for (size_t ii = 8; ii-- > 0;)
+         result = (result << 8) | data[pos + ii];
+      return result;
+   };
+
+   if (size < 40 ||
+       memcmp(data, riffId, 16) != 0 || memcmp(data + 24, waveId, 16) != 0)
+      return 0;
+
+   for (uint64_t pos = 40; pos + ChunkHeaderBytes <= size;) {
+      if (memcmp(data + pos, dataId, 16) == 0)
+         return pos + ChunkHeaderBytes;
+      const auto chunkSize = read64(pos + 16);
+      if (chunkSize < ChunkHeaderBytes || chunkSize > size - pos)
+         return 0;
+      // Chunks are aligned to 8 bytes
+      pos += (chunkSize + 7) & ~uint64_t{ 7 };
+   }
+   return 0;
+}
+
+//! Find the sound data chunk of a RIFF WAVE, RF64, Wave64 or AIFF file
+/*! @param type the major format, as given by libsndfile
+ @return offset of the first sample, or 0 if there is none */
+size_t FindSampleData(const unsigned char *data, size_t size, int type)
+{
+   if (type == SF_FORMAT_W64)
+      return FindW64SampleData(data, size);
+
+   const bool aiff = (type == SF_FORMAT_AIFF);
+   const bool rf64 = (type == SF_FORMAT_RF64);
+   const auto isId = [&](size_t pos, const char *id){
+      return memcmp(data + pos, id, 4) == 0;
+   };
+   // RIFF is little-endian, AIFF big-endian
+   const auto read32 = [&](size_t pos) -> uint64_t {
+      const auto p = data + pos;
+      return aiff
+         ? (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+         : (uint32_t(p[3]) << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+   };
+
+   if (size < 12 || !isId(8, aiff ? "AIFF" : "WAVE"))
+      return 0;
+   if (aiff ? !isId(0, "FORM")
+       : !(isId(0, "RIFF") || (rf64 && (isId(0, "RF64") || isId(0, "BW64")))))
+      return 0;
+
+   for (uint64_t pos = 12; pos + 8 <= size;) {
+      const auto chunkSize = read32(pos + 4);
+      // In RF64, the size of the data chunk is in the ds64 chunk instead,
+      // but the frame count from libsndfile is enough
+      if (!aiff && isId(pos, "data"))
+         return pos + 8;
+      if (aiff && isId(pos, "SSND")) {
+         // Sound data follow an offset and a block size
+         if (pos + 16 > size)
+            return 0;
+         const auto offset = pos + 16 + read32(pos + 8);
+         return offset < size ? offset : 0;
+      }
+      // Other chunks too big for 32 bit sizes are not expected
+      if (rf64 && chunkSize == 0xFFFFFFFF)
+         return 0;
+      // Chunks are padded to even lengths
+      pos += 8 + chunkSize + (chunkSize & 1);
+   }
+   return 0;
+}
+
+//! Bytes per sample of the subtypes that are read from mapped files
+size_t MappedSampleBytes(int subtype)
+{
+   switch (subtype) {
+   case SF_FORMAT_PCM_16:
+      return 2;
+   case SF_FORMAT_PCM_24:
+      return 3;
+   case SF_FORMAT_FLOAT:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+//! Convert interleaved samples into one buffer per channel, in one pass
+template< typename Dest, typename Convert >
+void Deinterleave(const unsigned char *src, size_t sampleBytes,
+   const std::vector<Dest*> &dests, size_t frames, const Convert &convert)
+{
+   const auto nChannels = dests.size();
+   for (size_t jj = 0; jj < frames; ++jj)
+      for (size_t cc = 0; cc < nChannels; ++cc, src += sampleBytes)
+         dests[cc][jj] = convert(src);
+}
+}
+
 class PCMImportPlugin final : public ImportPlugin
 {
 public:
@@ -93,6 +316,7 @@ public:
    ByteCount GetFileUncompressedBytes() override;
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks,
               Tags *tags) override;
+   bool CanImportInTask() override { return true; }
 
    wxInt32 GetStreamCount() override { return 1; }
 
@@ -106,9 +330,21 @@ public:
    {}
 
 private:
+   using NewChannelGroup = std::vector< std::shared_ptr<WaveTrack> >;
+
+   //! Map the file, if it is WAV, RF64, Wave64 or AIFF with samples that can
+   //! be converted directly
+   /*! @return the first sample, or null to read the file with libsndfile */
+   const unsigned char *MapSamples(MappedFile &file) const;
+
+   //! Convert the mapped samples into whole blocks of the tracks
+   ProgressResult ImportMapped(
+      const unsigned char *samples, const NewChannelGroup &channels);
+
    SFFile                mFile;
    const SF_INFO         mInfo;
    sampleFormat          mFormat;
+   const bool            mUseMapping;
 };
 
 TranslatableString PCMImportPlugin::GetPluginFormatDescription()
@@ -189,7 +425,8 @@ PCMImportFileHandle::PCMImportFileHandle(const FilePath &name,
                                          SFFile &&file, SF_INFO info)
 :  ImportFileHandle(name),
    mFile(std::move(file)),
-   mInfo(info)
+   mInfo(info),
+   mUseMapping(ImportPCMMapped.Read())
 {
    wxASSERT(info.channels >= 0);
 
@@ -283,7 +520,129 @@ struct id3_tag_deleter {
 using id3_tag_holder = std::unique_ptr<id3_tag, id3_tag_deleter>;
 #endif
 
-using NewChannelGroup = std::vector< std::shared_ptr<WaveTrack> >;
+const unsigned char *PCMImportFileHandle::MapSamples(MappedFile &file) const
+{
+   const auto type = mInfo.format & SF_FORMAT_TYPEMASK;
+   const auto subtype = mInfo.format & SF_FORMAT_SUBMASK;
+   const bool aiff = (type == SF_FORMAT_AIFF);
+   if (!(aiff || type == SF_FORMAT_WAV || type == SF_FORMAT_WAVEX ||
+         type == SF_FORMAT_RF64 || type == SF_FORMAT_W64))
+      return nullptr;
+   // Plain AIFF has no floating point samples
+   const auto sampleBytes = MappedSampleBytes(subtype);
+   if (sampleBytes == 0 || (aiff && subtype == SF_FORMAT_FLOAT))
+      return nullptr;
+   // Only 16 bit samples may stay integers
+   if (mFormat != floatSample &&
+       !(mFormat == int16Sample && subtype == SF_FORMAT_PCM_16))
+      return nullptr;
+   if (mInfo.frames <= 0 || mInfo.channels < 1)
+      return nullptr;
+
+   if (!file.Open(mFilename))
+      return nullptr;
+   const auto offset = FindSampleData(file.Data(), file.Size(), type);
+   if (offset == 0)
+      return nullptr;
+
+   // Don't believe a header that describes more samples than the file has;
+   // libsndfile reads what there is
+   const auto bytes = static_cast<unsigned long long>(mInfo.frames) *
+      mInfo.channels * sampleBytes;
+   if (bytes > file.Size() - offset)
+      return nullptr;
+
+   return file.Data() + offset;
+}
+
+ProgressResult PCMImportFileHandle::ImportMapped(
+   const unsigned char *samples, const NewChannelGroup &channels)
+{
+   const auto subtype = mInfo.format & SF_FORMAT_SUBMASK;
+   const bool bigEndian =
+      ((mInfo.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_AIFF);
+   const auto sampleBytes = MappedSampleBytes(subtype);
+   const auto frameBytes = sampleBytes * mInfo.channels;
+   const auto fileTotalFrames =
+      (sampleCount)mInfo.frames; // convert from sf_count_t
+
+   // Each buffer becomes one sample block, whose summaries are computed
+   // while its samples are still in cache
+   const auto blockSize = channels.front()->GetIdealBlockSize();
+   std::vector<SampleBuffer> buffers;
+   for (size_t ii = 0; ii < channels.size(); ++ii)
+      buffers.emplace_back(blockSize, mFormat);
+
+   const auto read16 = [bigEndian](const unsigned char *p) -> int16_t {
+      return static_cast<int16_t>(
+         bigEndian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0]);
+   };
+   const auto read24 = [bigEndian](const unsigned char *p) -> int32_t {
+      // Assemble in the high bytes, then shift to extend the sign
+      const uint32_t value = bigEndian
+         ? (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8)
+         : (uint32_t(p[2]) << 24) | (p[1] << 16) | (p[0] << 8);
+      return static_cast<int32_t>(value) >> 8;
+   };
+   const auto readFloat = [](const unsigned char *p) -> float {
+      const uint32_t bits = (uint32_t(p[3]) << 24) | (p[2] << 16) |
+         (p[1] << 8) | p[0];
+      float value;
+      memcpy(&value, &bits, sizeof value);
+      return value;
+   };
+
+   // Same scaling as libsndfile, so the result does not depend on the path
+   const auto convert = [&](size_t frames) {
+      if (mFormat == int16Sample) {
+         std::vector<short *> dests;
+         for (const auto &buffer : buffers)
+            dests.push_back(reinterpret_cast<short *>(buffer.ptr()));
+         Deinterleave(samples, sampleBytes, dests, frames, read16);
+         return;
+      }
+
+      std::vector<float *> dests;
+      for (const auto &buffer : buffers)
+         dests.push_back(reinterpret_cast<float *>(buffer.ptr()));
+      switch (subtype) {
+      case SF_FORMAT_PCM_16:
+         Deinterleave(samples, sampleBytes, dests, frames,
+            [&](const unsigned char *p){ return read16(p) / 32768.0f; });
+         break;
+      case SF_FORMAT_PCM_24:
+         Deinterleave(samples, sampleBytes, dests, frames,
+            [&](const unsigned char *p){ return read24(p) / 8388608.0f; });
+         break;
+      default:
+         Deinterleave(samples, sampleBytes, dests, frames, readFloat);
+         break;
+      }
+   };
+
+   auto updateResult = ProgressResult::Success;
+   decltype(fileTotalFrames) framescompleted = 0;
+   while (framescompleted < fileTotalFrames) {
+      const auto frames = limitSampleBufferSize(
+         blockSize, fileTotalFrames - framescompleted);
+      convert(frames);
+
+      for (size_t ii = 0; ii < channels.size(); ++ii)
+         channels[ii]->AppendBlock(buffers[ii].ptr(), mFormat, frames);
+
+      samples += frames * frameBytes;
+      framescompleted += frames;
+
+      updateResult = UpdateProgress(
+         framescompleted.as_long_long(),
+         fileTotalFrames.as_long_long()
+      );
+      if (updateResult != ProgressResult::Success)
+         break;
+   }
+
+   return updateResult;
+}
 
 ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
                                 TrackHolders &outTracks,
@@ -309,7 +668,11 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
    auto maxBlockSize = channels.begin()->get()->GetMaxBlockSize();
    auto updateResult = ProgressResult::Cancelled;
 
-   {
+   // Uncompressed WAV and AIFF are converted straight from memory
+   MappedFile mapped;
+   if (const auto samples = mUseMapping ? MapSamples(mapped) : nullptr)
+      updateResult = ImportMapped(samples, channels);
+   else {
       // Otherwise, we're in the "copy" mode, where we read in the actual
       // samples from the file and store our own local copy of the
       // samples in the tracks.
@@ -371,7 +734,7 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
             framescompleted += block;
          }
 
-         updateResult = mProgress->Update(
+         updateResult = UpdateProgress(
             framescompleted.as_long_long(),
             fileTotalFrames.as_long_long()
          );
@@ -35,6 +35,7 @@ bool ImportPlugin::SupportsExtension(const FileExtension &extension)
 
 ImportFileHandle::ImportFileHandle(const FilePath & filename)
 :  mFilename(filename)
+,  mDefaultFormat{ QualitySettings::SampleFormatChoice() }
 {
 }
 
@@ -44,6 +45,9 @@ ImportFileHandle::~ImportFileHandle()
 
 void ImportFileHandle::CreateProgress()
 {
+   if (mProgressReport)
+      return;
+
    wxFileName ff( mFilename );
 
    auto title = XO("Importing %s").Format( GetFileDescription() );
@@ -51,11 +55,33 @@ void ImportFileHandle::CreateProgress()
       title, Verbatim( ff.GetFullName() ) );
 }
 
+bool ImportFileHandle::CanImportInTask()
+{
+   return false;
+}
+
+void ImportFileHandle::SetProgressReport(ProgressReport report)
+{
+   mProgressReport = std::move(report);
+}
+
+auto ImportFileHandle::UpdateProgress(double current, double total)
+   -> ProgressResult
+{
+   if (mProgressReport)
+      return mProgressReport(current, total);
+   return mProgress->Update(current, total);
+}
+
 sampleFormat ImportFileHandle::ChooseFormat(sampleFormat effectiveFormat)
 {
    // Consult user preference
-   auto defaultFormat = QualitySettings::SampleFormatChoice();
+   return ChooseFormat(effectiveFormat, QualitySettings::SampleFormatChoice());
+}
 
+sampleFormat ImportFileHandle::ChooseFormat(
+   sampleFormat effectiveFormat, sampleFormat defaultFormat)
+{
    // Don't choose format narrower than effective or default
    auto format = std::max(effectiveFormat, defaultFormat);
 
@@ -69,5 +95,5 @@ sampleFormat ImportFileHandle::ChooseFormat(sampleFormat effectiveFormat)
 std::shared_ptr<WaveTrack> ImportFileHandle::NewWaveTrack(
    WaveTrackFactory &trackFactory, sampleFormat effectiveFormat, double rate)
 {
-   return trackFactory.Create(ChooseFormat(effectiveFormat), rate);
+   return trackFactory.Create(ChooseFormat(effectiveFormat, mDefaultFormat), rate);
 }
@@ -47,6 +47,7 @@ but little else.
 
 
 
+#include <functional>
 #include <memory>
 #include "audacity/Types.h"
 #include "Identifier.h"
@@ -107,6 +108,10 @@ class AUDACITY_DLL_API ImportFileHandle /* not final */
 {
 public:
    using ProgressResult = BasicUI::ProgressResult;
+   //! Receives the progress of Import(); the result is returned by
+   //! UpdateProgress()
+   using ProgressReport =
+      std::function<ProgressResult(double current, double total)>;
 
    ImportFileHandle(const FilePath & filename);
 
@@ -114,8 +119,19 @@ public:
 
    // The importer should call this to create the progress dialog and
    // identify the filename being imported.
+   // No dialog is made if SetProgressReport() was called.
    void CreateProgress();
 
+   //! Whether Import() may be called on a worker thread, after
+   //! SetProgressReport()
+   /*! Such an importer shows no dialogs and reads no preferences in
+    Import(), and reports progress only with UpdateProgress().  Default
+    returns false */
+   virtual bool CanImportInTask();
+
+   //! Report the progress of Import() to a function instead of a dialog
+   void SetProgressReport(ProgressReport report);
+
    // This is similar to GetPluginFormatDescription, but if possible the
    // importer will return a more specific description of the
    // specific file that is open.
@@ -152,11 +168,22 @@ public:
 
 protected:
    //! Build a wave track with appropriate format, which will not be narrower than the specified one
+   /*! Uses the default format in preferences when the handle was made */
    std::shared_ptr<WaveTrack> NewWaveTrack( WaveTrackFactory &trackFactory,
       sampleFormat effectiveFormat, double rate);
 
+   //! Update the dialog of CreateProgress(), or call the ProgressReport
+   ProgressResult UpdateProgress(double current, double total);
+
    FilePath mFilename;
    std::unique_ptr<ProgressDialog> mProgress;
+
+private:
+   static sampleFormat ChooseFormat(
+      sampleFormat effectiveFormat, sampleFormat defaultFormat);
+
+   ProgressReport mProgressReport;
+   const sampleFormat mDefaultFormat;
 };
 
 
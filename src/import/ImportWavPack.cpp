@@ -62,6 +62,7 @@ public:
    TranslatableString GetFileDescription() override;
    ByteCount GetFileUncompressedBytes() override;
    ProgressResult Import(WaveTrackFactory *trackFactory, TrackHolders &outTracks, Tags *tags) override;
+   bool CanImportInTask() override;
    wxInt32 GetStreamCount() override;
    const TranslatableStrings &GetStreamInfo() override;
    void SetStreamUsage(wxInt32 StreamID, bool Use) override;
@@ -220,7 +221,7 @@ ProgressResult WavPackImportFileHandle::Import(WaveTrackFactory *trackFactory, T
          }
 
          totalSamplesRead += samplesRead;
-         updateResult = mProgress->Update(WavpackGetProgress(mWavPackContext), 1.0);
+         updateResult = UpdateProgress(WavpackGetProgress(mWavPackContext), 1.0);
       } while (updateResult == ProgressResult::Success && samplesRead != 0);
    }
 
@@ -283,6 +284,11 @@ ProgressResult WavPackImportFileHandle::Import(WaveTrackFactory *trackFactory, T
    return updateResult;
 }
 
+bool WavPackImportFileHandle::CanImportInTask()
+{
+   return true;
+}
+
 wxInt32 WavPackImportFileHandle::GetStreamCount()
 {
    return 1;
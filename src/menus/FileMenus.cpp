@@ -161,10 +161,11 @@ void DoImport(const CommandContext &context, bool isRaw)
                .AddImportedTracks(fileName, std::move(newTracks));
          }
       }
-      else {
-         ProjectFileManager::Get( project ).Import(fileName);
-      }
    }
+
+   if (!isRaw)
+      ProjectFileManager::Get( project ).Import(
+         FilePaths( selectedFiles.begin(), selectedFiles.end() ));
 }
 
 }
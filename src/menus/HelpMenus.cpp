@@ -6,9 +6,11 @@
 
 #include "../AboutDialog.h"
 #include "AllThemeResources.h"
+#include "../AudioIO.h"
 #include "AudioIOBase.h"
 #include "../CommonCommandFlags.h"
 #include "../CrashReport.h" // for HAS_CRASH_REPORT
+#include "../DBConnection.h"
 #include "FileNames.h"
 #include "../HelpText.h"
 #include "../HelpUtilities.h"
@@ -25,6 +27,7 @@
 #include "Theme.h"
 #include "../commands/CommandContext.h"
 #include "../commands/CommandManager.h"
+#include "../effects/AudioGraphBufferPool.h"
 #include "../prefs/PrefsDialog.h"
 #include "../widgets/AudacityMessageBox.h"
 #include "../widgets/HelpSystem.h"
@@ -281,6 +284,11 @@ void OnAudioDeviceInfo(const CommandContext &context)
    auto &project = context.project;
    auto gAudioIO = AudioIOBase::Get();
    wxString info = gAudioIO->GetDeviceInfo();
+   info += AudioIO::Get()->GetPrefetchInfo( project );
+   info += AudioGraph::BufferPool::Get().GetInfo();
+
+   if (auto &pConnection = ConnectionPtr::Get( project ).mpConnection)
+      info += pConnection->GetReadPoolInfo();
    ShowDiagnostics( project, info,
       XO("Audio Device Info"), wxT("deviceinfo.txt") );
 }
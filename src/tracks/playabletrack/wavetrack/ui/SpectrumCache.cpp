@@ -10,11 +10,27 @@
 
 #include "SpectrumCache.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include "BasicUI.h"
+#include "../../../../DBConnection.h"
 #include "RealFFTf.h"
 #include "SampleTrackCache.h"
 #include "../../../../prefs/SpectrogramSettings.h"
+#include "../../../../Sequence.h"
+#include "../../../../SpectrumTileStore.h"
 #include "Spectrum.h"
+#include "ThreadPool.h"
 #include "WaveClipUtilities.h"
 #include "WaveTrack.h"
 
@@ -71,6 +87,24 @@ void ComputeSpectrogramGainFactors
    }
 }
 
+//! Convert one column of accumulated reassignment power to decibels
+void PowerToDB(float *results, size_t nBins,
+   const std::vector<float> &gainFactors)
+{
+   for (size_t ii = 0; ii < nBins; ++ii) {
+      float &power = results[ii];
+      if (power <= 0)
+         power = -160.0;
+      else
+         power = 10.0*log10f(power);
+   }
+   if (!gainFactors.empty()) {
+      // Apply a frequency-dependent gain factor
+      for (size_t ii = 0; ii < nBins; ++ii)
+         results[ii] += gainFactors[ii];
+   }
+}
+
 }
 
 bool SpecCache::Matches
@@ -283,12 +317,8 @@ bool SpecCache::CalculateOneSpectrum
 
                   // This is non-negative, because bin and correctedX are
                   auto ind = (int)nBins * correctedX + bin;
-#ifdef _OPENMP
-                  // This assignment can race if index reaches into another thread's bins.
-                  // The probability of a race very low, so this carries little overhead,
-                  // about 5% slower vs allowing it to race.
-                  #pragma omp atomic update
-#endif
+                  // Reassignment is computed in one thread, so this
+                  // accumulation does not race
                   out[ind] += power;
                }
             }
@@ -368,46 +398,46 @@ void SpecCache::Populate
    if (!autocorrelation)
       ComputeSpectrogramGainFactors(fftLen, rate, frequencyGainSetting, gainFactors);
 
+   // Storage for mutable per-lane data of the thread pool; lane 0 is this
+   // thread, which uses the given cache and scratch
+   auto &pool = ThreadPool::Get();
+   std::vector<std::unique_ptr<SampleTrackCache>> laneCaches(
+      pool.GetConcurrency());
+   std::vector<std::vector<float>> laneScratches(pool.GetConcurrency());
+
    // Loop over the ranges before and after the copied portion and compute anew.
    // One of the ranges may be empty.
    for (int jj = 0; jj < 2; ++jj) {
       const int lowerBoundX = jj == 0 ? 0 : copyEnd;
       const int upperBoundX = jj == 0 ? copyBegin : numPixels;
 
-#ifdef _OPENMP
-      // Storage for mutable per-thread data.
-      // private clause ensures one copy per thread
-      struct ThreadLocalStorage {
-         ThreadLocalStorage()  { }
-         ~ThreadLocalStorage() { }
-
-         void init(SampleTrackCache &waveTrackCache, size_t scratchSize) {
-            if (!cache) {
-               cache = std::make_unique<SampleTrackCache>(waveTrackCache.GetTrack());
-               scratch.resize(scratchSize);
+      if (reassignment) {
+         // Columns accumulate contributions from their neighbors
+         for (auto xx = lowerBoundX; xx < upperBoundX; ++xx)
+            CalculateOneSpectrum(
+               settings, waveTrackCache, xx, numSamples,
+               offset, rate, pixelsPerSecond,
+               lowerBoundX, upperBoundX,
+               gainFactors, &scratch[0], &freq[0]);
+      }
+      else if (lowerBoundX < upperBoundX) {
+         pool.ParallelFor(upperBoundX - lowerBoundX,
+         [&](size_t ii, size_t lane){
+            auto &pCache = laneCaches[lane];
+            auto &laneScratch = laneScratches[lane];
+            if (lane > 0 && !pCache) {
+               pCache = std::make_unique<SampleTrackCache>(
+                  waveTrackCache.GetTrack());
+               laneScratch.resize(scratchSize);
             }
-         }
-         std::unique_ptr<SampleTrackCache> cache;
-         std::vector<float> scratch;
-      } tls;
-
-      #pragma omp parallel for private(tls)
-#endif
-      for (auto xx = lowerBoundX; xx < upperBoundX; ++xx)
-      {
-#ifdef _OPENMP
-         tls.init(waveTrackCache, scratchSize);
-         SampleTrackCache& cache = *tls.cache;
-         float* buffer = &tls.scratch[0];
-#else
-         SampleTrackCache& cache = waveTrackCache;
-         float* buffer = &scratch[0];
-#endif
-         CalculateOneSpectrum(
-            settings, cache, xx, numSamples,
-            offset, rate, pixelsPerSecond,
-            lowerBoundX, upperBoundX,
-            gainFactors, buffer, &freq[0]);
+            CalculateOneSpectrum(
+               settings, lane > 0 ? *pCache : waveTrackCache,
+               lowerBoundX + ii, numSamples,
+               offset, rate, pixelsPerSecond,
+               lowerBoundX, upperBoundX,
+               gainFactors, lane > 0 ? &laneScratch[0] : &scratch[0],
+               &freq[0]);
+         });
       }
 
       if (reassignment) {
@@ -444,26 +474,708 @@ void SpecCache::Populate
 
          // Now Convert to dB terms.  Do this only after accumulating
          // power values, which may cross columns with the time correction.
-#ifdef _OPENMP
-         #pragma omp parallel for
-#endif
-         for (xx = lowerBoundX; xx < upperBoundX; ++xx) {
-            float *const results = &freq[nBins * xx];
-            for (size_t ii = 0; ii < nBins; ++ii) {
-               float &power = results[ii];
-               if (power <= 0)
-                  power = -160.0;
-               else
-                  power = 10.0*log10f(power);
-            }
-            if (!gainFactors.empty()) {
-               // Apply a frequency-dependent gain factor
-               for (size_t ii = 0; ii < nBins; ++ii)
-                  results[ii] += gainFactors[ii];
-            }
+         for (xx = lowerBoundX; xx < upperBoundX; ++xx)
+            PowerToDB(&freq[nBins * xx], nBins, gainFactors);
+      }
+   }
+}
+
+namespace {
+
+//! Count of columns in each tile
+constexpr size_t TileWidth = 128;
+
+//! Bound on the memory of the tiles kept for one clip
+constexpr size_t MaxTileBytes = 64 * 1024 * 1024;
+
+//! Least time between notifications of the main thread while a tile fills
+constexpr auto NoticeInterval = std::chrono::milliseconds{ 50 };
+
+//! The settings and zoom that determine the contents of tiles
+using TileKey = std::tuple<
+   int, // algorithm
+   int, // windowType
+   size_t, // windowSize
+   size_t, // zeroPaddingFactor
+   int, // frequencyGain
+   double, // rate
+   double // pixelsPerSecond
+>;
+
+TileKey MakeTileKey(const SpectrogramSettings &settings,
+   double rate, double pixelsPerSecond)
+{
+   return { settings.algorithm, settings.windowType, settings.WindowSize(),
+      settings.ZeroPaddingFactor(), settings.frequencyGain,
+      rate, pixelsPerSecond };
+}
+
+//! What the columns of a tile depend on, besides its key
+/*! Tiles with equal dependencies for the same key have equal columns, so a
+ tile survives an edit of the clip that leaves its dependency unchanged */
+struct TileDependency {
+   //! Start and id of each block holding samples the columns may read
+   std::vector<std::pair<long long, long long>> blocks;
+   //! Length of the sequence, or -1 if the samples read do not reach it
+   long long end{ -1 };
+   //! Trims in samples, or -1 if the samples read do not reach them
+   long long trimLeft{ -1 };
+   long long trimRight{ -1 };
+   //! Thousandths of a sample in the offset of the clip, which decide the
+   //! rounding of positions in the track
+   long long phase{ 0 };
+
+   bool operator ==(const TileDependency &other) const
+   {
+      return blocks == other.blocks && end == other.end &&
+         trimLeft == other.trimLeft && trimRight == other.trimRight &&
+         phase == other.phase;
+   }
+   bool operator !=(const TileDependency &other) const
+   {
+      return !(*this == other);
+   }
+};
+
+TileDependency MakeTileDependency(const WaveClip &clip,
+   const SpectrogramSettings &settings, double pixelsPerSecond,
+   long long index)
+{
+   TileDependency result;
+   const auto &sequence = *clip.GetSequence();
+   const auto numSamples = clip.GetSequenceSamplesCount().as_long_long();
+   const auto rate = clip.GetRate();
+   const double samplesPerPixel = rate / pixelsPerSecond;
+
+   // Generous bounds of the samples read by the columns, including the
+   // margins for reassignment
+   const long long fftLen =
+      settings.WindowSize() * settings.ZeroPaddingFactor();
+   const long long margin =
+      2 * (fftLen + static_cast<long long>(ceil(samplesPerPixel))) + 1;
+   const auto s0 = std::max(0LL, static_cast<long long>(
+      floor(index * TileWidth * samplesPerPixel)) - margin);
+   const auto s1 = std::min(numSamples, static_cast<long long>(
+      ceil((index + 1) * TileWidth * samplesPerPixel)) + margin);
+   if (s0 >= s1)
+      return result;
+
+   // Padding at the end of the clip depends on its length
+   if (s1 == numSamples)
+      result.end = numSamples;
+
+   // Trimmed samples are read from the track as silence
+   const auto trimLeft =
+      static_cast<long long>(ceil(clip.GetTrimLeft() * rate)) + 1;
+   const auto trimRight =
+      static_cast<long long>(ceil(clip.GetTrimRight() * rate)) + 1;
+   if (s0 < trimLeft)
+      result.trimLeft = trimLeft;
+   if (s1 > numSamples - trimRight)
+      result.trimRight = trimRight;
+
+   const double phase = clip.GetSequenceStartTime() * rate;
+   result.phase = std::llround(1000 * (phase - floor(phase)));
+
+   const auto &blocks = sequence.GetBlockArray();
+   for (size_t ii = sequence.FindBlock(s0);
+      ii < blocks.size() && blocks[ii].start < s1; ++ii) {
+      const auto &block = blocks[ii];
+      result.blocks.emplace_back(
+         block.start.as_long_long(), block.sb->GetBlockID());
+   }
+   return result;
+}
+
+//! Inputs shared by the tiles of one key, while the clip is unchanged
+struct TileSource {
+   //! A copy of the clip, in an otherwise empty copy of the track, which
+   //! worker threads read while the original may be edited
+   std::shared_ptr<const SampleTrack> pTrack;
+   //! Null if tiles are not kept in the project file
+   std::shared_ptr<SpectrumTileStore> pStore;
+   //! A copy, with windows already cached by the main thread
+   SpectrogramSettings settings;
+   sampleCount numSamples;
+   double offset;
+   double rate;
+   double pixelsPerSecond;
+};
+
+//! Round toward negative infinity
+long long TileIndex(long long column)
+{
+   const long long width = TileWidth;
+   return column >= 0 ? column / width : -((width - 1 - column) / width);
+}
+
+}
+
+//! A fixed range of columns of a spectrogram, computed by a worker thread
+struct SpecTile {
+   SpecTile(std::shared_ptr<const TileSource> pSource, long long index,
+      TileDependency dependency, std::function<void()> onReady);
+
+   //! Called in a worker thread
+   void Compute();
+
+   //! Called in a worker thread
+   /*! @return false if the tile depends on more than the clip's blocks */
+   bool MakeStoreKey(SpectrumTileStore::Key &key) const;
+
+   //! Called in a worker thread, for algorithms other than reassignment
+   void ComputeColumns(SampleTrackCache &cache);
+
+   //! Called in a worker thread, for reassignment
+   void ComputeReassignment(SampleTrackCache &cache);
+
+   //! Called in a worker thread when more leading columns are complete
+   void Publish(size_t ready);
+
+   //! Called in the main thread, after the tile is withdrawn from the workers
+   /*! Fill the columns not computed from the stale tile, if any, and release
+    it, so that the tile can serve as the stale tile of its replacement */
+   void AbsorbStale();
+
+   const std::shared_ptr<const TileSource> mpSource;
+   const std::function<void()> mOnReady;
+   const long long mIndex;
+   //! Computed by the main thread from the original clip
+   const TileDependency mDependency;
+
+   //! Allocated by the main thread; then only the worker writes freq
+   SpecCache mColumns;
+   //! Count of leading columns of mColumns that are complete
+   std::atomic<size_t> mReady{ 0 };
+   std::atomic<bool> mCancelled{ false };
+
+   //! Used only by the worker
+   std::chrono::steady_clock::time_point mLastNotice{};
+
+   //! Used only by the main thread:
+
+   //! Stamp of the last call to GetSpectrogram that used the tile
+   unsigned long long mLastUse{ 0 };
+   //! A tile for the same columns, invalidated by an edit of the clip, that
+   //! is drawn where this one is not yet ready
+   std::shared_ptr<SpecTile> mpStale;
+};
+
+SpecTile::SpecTile(std::shared_ptr<const TileSource> pSource,
+   long long index, TileDependency dependency, std::function<void()> onReady)
+   : mpSource{ std::move(pSource) }
+   , mOnReady{ std::move(onReady) }
+   , mIndex{ index }
+   , mDependency{ std::move(dependency) }
+{
+   const auto &source = *mpSource;
+   mColumns.len = TileWidth;
+   mColumns.freq.resize(TileWidth * source.settings.NBins());
+   mColumns.where.resize(TileWidth + 1);
+   // purposely offset the display 1/2 sample to the left, as in drawing the
+   // whole clip
+   fillWhere(mColumns.where, TileWidth, 0.5, 0,
+      index * TileWidth / source.pixelsPerSecond,
+      source.rate, source.rate / source.pixelsPerSecond);
+}
+
+void SpecTile::Compute()
+{
+   const auto &source = *mpSource;
+   const auto &settings = source.settings;
+
+   SpectrumTileStore::Key key;
+   const bool store = source.pStore && MakeStoreKey(key);
+   if (store) {
+      auto lock = DBConnection::LockForBackgroundReads();
+      if (source.pStore->Load(key, &mColumns.freq[0], mColumns.freq.size())) {
+         mReady.store(TileWidth, std::memory_order_release);
+         return;
+      }
+   }
+
+   SampleTrackCache cache{ source.pTrack };
+   if (settings.algorithm == SpectrogramSettings::algReassignment)
+      ComputeReassignment(cache);
+   else
+      ComputeColumns(cache);
+
+   if (store && !mCancelled.load(std::memory_order_relaxed)) {
+      auto lock = DBConnection::LockForBackgroundReads();
+      source.pStore->Save(key, &mColumns.freq[0], mColumns.freq.size());
+   }
+}
+
+void SpecTile::ComputeColumns(SampleTrackCache &cache)
+{
+   const auto &source = *mpSource;
+   const auto &settings = source.settings;
+
+   const size_t fftLen = settings.WindowSize() * settings.ZeroPaddingFactor();
+   std::vector<float> scratch(fftLen);
+   std::vector<float> gainFactors;
+   if (settings.algorithm != SpectrogramSettings::algPitchEAC)
+      ComputeSpectrogramGainFactors(
+         fftLen, source.rate, settings.frequencyGain, gainFactors);
+
+   for (size_t xx = 0; xx < TileWidth; ++xx) {
+      if (mCancelled.load(std::memory_order_relaxed))
+         return;
+      {
+         auto lock = DBConnection::LockForBackgroundReads();
+         mColumns.CalculateOneSpectrum(settings, cache, xx,
+            source.numSamples, source.offset, source.rate,
+            source.pixelsPerSecond, 0, TileWidth,
+            gainFactors, &scratch[0], &mColumns.freq[0]);
+      }
+      Publish(xx + 1);
+   }
+}
+
+void SpecTile::ComputeReassignment(SampleTrackCache &cache)
+{
+   const auto &source = *mpSource;
+   const auto &settings = source.settings;
+   const auto nBins = settings.NBins();
+
+   const size_t fftLen = settings.WindowSize() * settings.ZeroPaddingFactor();
+   std::vector<float> scratch(3 * fftLen);
+   std::vector<float> gainFactors;
+   ComputeSpectrogramGainFactors(
+      fftLen, source.rate, settings.frequencyGain, gainFactors);
+
+   // Time corrections move power by less than the FFT length, so accumulate
+   // over a margin of that many samples on each side, and keep only the
+   // inner columns, which then do not depend on the division into tiles
+   const double samplesPerPixel = source.rate / source.pixelsPerSecond;
+   const auto margin =
+      static_cast<size_t>(ceil(fftLen / samplesPerPixel)) + 1;
+   const auto width = TileWidth + 2 * margin;
+
+   SpecCache columns;
+   columns.len = width;
+   columns.freq.resize(width * nBins);
+   columns.where.resize(width + 1);
+   // The same positions as in mColumns.where for the inner columns, but
+   // possibly negative in the left margin, which then reads silence
+   const double w0 =
+      1.0 + mIndex * TileWidth / source.pixelsPerSecond * source.rate;
+   for (size_t xx = 0; xx <= width; ++xx)
+      columns.where[xx] = sampleCount(floor(w0 +
+         (static_cast<double>(xx) - static_cast<double>(margin)) *
+            samplesPerPixel));
+
+   for (size_t xx = 0; xx < width; ++xx) {
+      if (mCancelled.load(std::memory_order_relaxed))
+         return;
+      {
+         auto lock = DBConnection::LockForBackgroundReads();
+         columns.CalculateOneSpectrum(settings, cache, xx,
+            source.numSamples, source.offset, source.rate,
+            source.pixelsPerSecond, 0, width,
+            gainFactors, &scratch[0], &columns.freq[0]);
+      }
+      // The inner column one margin to the left gets no more power
+      if (xx + 1 <= 2 * margin)
+         continue;
+      const auto ready = xx + 1 - 2 * margin;
+      auto results = &columns.freq[nBins * (ready - 1 + margin)];
+      PowerToDB(results, nBins, gainFactors);
+      std::copy_n(results, nBins, &mColumns.freq[nBins * (ready - 1)]);
+      Publish(ready);
+   }
+}
+
+void SpecTile::Publish(size_t ready)
+{
+   // Publish the columns to the main thread
+   mReady.store(ready, std::memory_order_release);
+
+   // Let the main thread draw them now and then, but not for every column;
+   // the worker notifies it again when the tile is done
+   if (!mOnReady || ready == TileWidth ||
+       mCancelled.load(std::memory_order_relaxed))
+      return;
+   const auto now = std::chrono::steady_clock::now();
+   if (now - mLastNotice >= NoticeInterval) {
+      mLastNotice = now;
+      BasicUI::CallAfter(mOnReady);
+   }
+}
+
+void SpecTile::AbsorbStale()
+{
+   if (!mpStale)
+      return;
+   const auto ready = mReady.load(std::memory_order_acquire);
+   const auto staleReady = mpStale->mReady.load(std::memory_order_acquire);
+   if (staleReady > ready) {
+      const auto nBins = mpSource->settings.NBins();
+      std::copy(&mpStale->mColumns.freq[nBins * ready],
+         &mpStale->mColumns.freq[nBins * staleReady],
+         &mColumns.freq[nBins * ready]);
+      mReady.store(staleReady, std::memory_order_release);
+   }
+   mpStale.reset();
+}
+
+bool SpecTile::MakeStoreKey(SpectrumTileStore::Key &key) const
+{
+   const auto &source = *mpSource;
+   const auto &settings = source.settings;
+   const auto &dependency = mDependency;
+
+   // Trimmed samples are read from the track, not from the blocks
+   if (dependency.blocks.empty() ||
+       dependency.trimLeft >= 0 || dependency.trimRight >= 0)
+      return false;
+
+   char buffer[256];
+   snprintf(buffer, sizeof(buffer),
+      "%d %d %zu %zu %d %.17g %.17g %lld %.3f %lld",
+      settings.algorithm, settings.windowType,
+      settings.WindowSize(), settings.ZeroPaddingFactor(),
+      settings.frequencyGain, source.rate, source.pixelsPerSecond,
+      mIndex, dependency.phase / 1000.0, dependency.end);
+   key.description = buffer;
+
+   for (const auto &block : dependency.blocks) {
+      key.description +=
+         " " + std::to_string(block.first) +
+         ":" + std::to_string(block.second);
+      key.blockIDs.push_back(block.second);
+   }
+   return true;
+}
+
+namespace {
+
+//! Dedicated threads that compute tiles, most recently requested first
+/*!
+ These are not the threads of the ThreadPool, so that drawing never waits for
+ them, and long computations of tiles do not delay effects.
+ */
+class SpecTileWorkers final {
+public:
+   static SpecTileWorkers &Get();
+
+   SpecTileWorkers();
+   ~SpecTileWorkers();
+
+   //! Put the tile at the front of the queue
+   void Schedule(const std::shared_ptr<SpecTile> &pTile);
+
+   //! Stop computation of the tile, waiting if a worker is busy with it
+   /*! After this, no worker refers to the tile, so the caller can release
+    it, and its copy of the track, in the main thread */
+   void Withdraw(SpecTile &tile);
+
+private:
+   void Run(size_t iThread);
+
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+   //! Notified when a worker finishes with a tile
+   std::condition_variable mIdle;
+   std::deque<std::shared_ptr<SpecTile>> mQueue;
+   //! For each thread, the tile it computes now, or null
+   std::vector<const SpecTile*> mBusy;
+   std::vector<std::thread> mThreads;
+   bool mStop{ false };
+};
+
+SpecTileWorkers &SpecTileWorkers::Get()
+{
+   static SpecTileWorkers workers;
+   return workers;
+}
+
+SpecTileWorkers::SpecTileWorkers()
+{
+   // Leave one core for the main thread
+   const auto nThreads =
+      std::max(2u, std::thread::hardware_concurrency()) - 1;
+   mBusy.resize(nThreads);
+   for (size_t ii = 0; ii < nThreads; ++ii)
+      mThreads.emplace_back([this, ii]{ Run(ii); });
+}
+
+SpecTileWorkers::~SpecTileWorkers()
+{
+   {
+      std::lock_guard<std::mutex> guard{ mMutex };
+      mStop = true;
+      for (auto &pTile : mQueue)
+         pTile->mCancelled.store(true, std::memory_order_relaxed);
+   }
+   mCondition.notify_all();
+   for (auto &thread : mThreads)
+      thread.join();
+   mQueue.clear();
+}
+
+void SpecTileWorkers::Schedule(const std::shared_ptr<SpecTile> &pTile)
+{
+   {
+      std::lock_guard<std::mutex> guard{ mMutex };
+      mQueue.push_front(pTile);
+   }
+   mCondition.notify_one();
+}
+
+void SpecTileWorkers::Withdraw(SpecTile &tile)
+{
+   tile.mCancelled.store(true, std::memory_order_relaxed);
+   std::unique_lock<std::mutex> lock{ mMutex };
+   mQueue.erase(std::remove_if(mQueue.begin(), mQueue.end(),
+      [&](const auto &pTile){ return pTile.get() == &tile; }),
+      mQueue.end());
+   mIdle.wait(lock, [&]{
+      return std::find(mBusy.begin(), mBusy.end(), &tile) == mBusy.end();
+   });
+}
+
+void SpecTileWorkers::Run(size_t iThread)
+{
+   std::unique_lock<std::mutex> lock{ mMutex };
+   while (true) {
+      mCondition.wait(lock, [this]{ return mStop || !mQueue.empty(); });
+      if (mStop)
+         return;
+
+      auto pTile = std::move(mQueue.front());
+      mQueue.pop_front();
+      mBusy[iThread] = pTile.get();
+      lock.unlock();
+
+      std::function<void()> onReady;
+      if (!pTile->mCancelled.load(std::memory_order_relaxed)) {
+         try {
+            pTile->Compute();
+         }
+         catch (...) {
+            // Leave the rest of the tile blank
+         }
+         if (!pTile->mCancelled.load(std::memory_order_relaxed))
+            onReady = pTile->mOnReady;
+      }
+      // Not the last reference, which the main thread releases after
+      // Withdraw()
+      pTile.reset();
+
+      lock.lock();
+      mBusy[iThread] = nullptr;
+      mIdle.notify_all();
+      if (onReady)
+         BasicUI::CallAfter(std::move(onReady));
+   }
+}
+
+}
+
+//! Tiles of one clip, for any number of keys
+class SpecTileSet {
+public:
+   ~SpecTileSet();
+
+   //! Withdraw and release all tiles
+   void Clear();
+
+   //! Called after the clip changes
+   /*! Keep the tiles whose dependencies are unchanged, and set the others
+    aside to be drawn until their replacements are ready */
+   void Revalidate(const WaveClip &clip);
+
+   //! Find the tile, or create and schedule it
+   /*! @return null if index is out of the bounds of the clip */
+   SpecTile *GetTile(const WaveClip &clip, const WaveTrack &track,
+      const SpectrogramSettings &settings, double pixelsPerSecond,
+      long long index, const std::function<void()> &onReady,
+      std::vector<std::shared_ptr<SpecTile>> &newTiles);
+
+   //! Release least recently used tiles beyond the bound on memory, but
+   //! not those of the last call, and stale tiles not replaced in it
+   void Evict();
+
+   int mDirty{ -1 };
+   double mLeftTrim{ 0 };
+   double mRightTrim{ 0 };
+   unsigned long long mUseCount{ 0 };
+
+   // What the last call to GetSpectrogram assembled
+   TileKey mLastKey{};
+   long long mLastX0{ 0 };
+   size_t mLastLen{ 0 };
+   size_t mLastReady{ 0 };
+
+private:
+   using Slot = std::pair<TileKey, long long>;
+
+   std::shared_ptr<const TileSource> GetSource(const TileKey &key,
+      const WaveClip &clip, const WaveTrack &track,
+      const SpectrogramSettings &settings, double pixelsPerSecond);
+
+   std::map<Slot, std::shared_ptr<SpecTile>> mTiles;
+   //! Tiles invalidated by the last Revalidate, not yet replaced
+   std::map<Slot, std::shared_ptr<SpecTile>> mStale;
+   std::map<TileKey, std::shared_ptr<const TileSource>> mSources;
+
+   // Copy of the clip and its extent, made once for each value of mDirty,
+   // and shared by all sources
+   std::shared_ptr<const SampleTrack> mpTrack;
+   sampleCount mNumSamples{ 0 };
+   double mOffset{ 0 };
+};
+
+SpecTileSet::~SpecTileSet()
+{
+   Clear();
+}
+
+void SpecTileSet::Clear()
+{
+   auto &workers = SpecTileWorkers::Get();
+   for (auto &pair : mTiles)
+      pair.second->mCancelled.store(true, std::memory_order_relaxed);
+   for (auto &pair : mTiles)
+      workers.Withdraw(*pair.second);
+   mTiles.clear();
+   mStale.clear();
+   mSources.clear();
+   mpTrack.reset();
+}
+
+void SpecTileSet::Revalidate(const WaveClip &clip)
+{
+   // New tiles must read the new contents of the clip
+   mSources.clear();
+   mpTrack.reset();
+
+   std::vector<std::shared_ptr<SpecTile>> invalid;
+   for (auto iter = mTiles.begin(); iter != mTiles.end();) {
+      const auto &pTile = iter->second;
+      const auto &source = *pTile->mpSource;
+      if (source.rate == clip.GetRate() &&
+          pTile->mDependency == MakeTileDependency(clip,
+             source.settings, source.pixelsPerSecond, pTile->mIndex))
+         ++iter;
+      else {
+         pTile->mCancelled.store(true, std::memory_order_relaxed);
+         invalid.push_back(pTile);
+         mStale[iter->first] = pTile;
+         iter = mTiles.erase(iter);
+      }
+   }
+
+   auto &workers = SpecTileWorkers::Get();
+   for (auto &pTile : invalid) {
+      workers.Withdraw(*pTile);
+      // Don't let chains of stale tiles grow while the clip is edited
+      // repeatedly, as when recording
+      pTile->AbsorbStale();
+   }
+}
+
+std::shared_ptr<const TileSource> SpecTileSet::GetSource(const TileKey &key,
+   const WaveClip &clip, const WaveTrack &track,
+   const SpectrogramSettings &settings, double pixelsPerSecond)
+{
+   auto &pSource = mSources[key];
+   if (!pSource) {
+      if (!mpTrack) {
+         // Copy only the clip, which is all that the columns read, so the
+         // cost does not grow with the other clips of the track; sample
+         // blocks are shared, not copied
+         const auto &pFactory = clip.GetSequence()->GetFactory();
+         auto pCopy = track.EmptyCopy(pFactory);
+         pCopy->AddClip(std::make_shared<WaveClip>(clip, pFactory, false));
+         mpTrack = std::move(pCopy);
+         mNumSamples = clip.GetSequenceSamplesCount();
+         mOffset = clip.GetSequenceStartTime();
+      }
+      std::shared_ptr<SpectrumTileStore> pStore;
+      if (const auto pList = track.GetOwner())
+         if (const auto pProject = pList->GetOwner()) {
+            auto &store = SpectrumTileStore::Get(*pProject);
+            if (store.IsEnabled())
+               pStore = store.shared_from_this();
          }
+      auto pNewSource = std::make_shared<TileSource>(TileSource{
+         mpTrack, std::move(pStore), settings, mNumSamples, mOffset,
+         clip.GetRate(), pixelsPerSecond });
+      // Workers only read the windows
+      pNewSource->settings.CacheWindows();
+      pSource = std::move(pNewSource);
+   }
+   return pSource;
+}
+
+SpecTile *SpecTileSet::GetTile(const WaveClip &clip, const WaveTrack &track,
+   const SpectrogramSettings &settings, double pixelsPerSecond,
+   long long index, const std::function<void()> &onReady,
+   std::vector<std::shared_ptr<SpecTile>> &newTiles)
+{
+   const double samplesPerPixel = clip.GetRate() / pixelsPerSecond;
+   const double columns =
+      clip.GetSequenceSamplesCount().as_double() / samplesPerPixel;
+   if (index < 0 || index * TileWidth >= columns)
+      return nullptr;
+
+   const Slot slot{
+      MakeTileKey(settings, clip.GetRate(), pixelsPerSecond), index };
+   auto &pTile = mTiles[slot];
+   if (!pTile) {
+      pTile = std::make_shared<SpecTile>(
+         GetSource(slot.first, clip, track, settings, pixelsPerSecond),
+         index, MakeTileDependency(clip, settings, pixelsPerSecond, index),
+         onReady);
+      const auto iter = mStale.find(slot);
+      if (iter != mStale.end()) {
+         pTile->mpStale = std::move(iter->second);
+         mStale.erase(iter);
       }
+      newTiles.push_back(pTile);
+   }
+   pTile->mLastUse = mUseCount;
+   return pTile.get();
+}
+
+void SpecTileSet::Evict()
+{
+   // Stale tiles are only drawn in place of visible tiles
+   mStale.clear();
+
+   const auto tileBytes = [](const SpecTile &tile){
+      auto bytes = tile.mColumns.freq.size() * sizeof(float);
+      if (tile.mpStale)
+         bytes += tile.mpStale->mColumns.freq.size() * sizeof(float);
+      return bytes;
+   };
+   size_t bytes = 0;
+   for (auto &pair : mTiles)
+      bytes += tileBytes(*pair.second);
+
+   auto &workers = SpecTileWorkers::Get();
+   while (bytes > MaxTileBytes) {
+      const auto iter = std::min_element(mTiles.begin(), mTiles.end(),
+         [](const auto &a, const auto &b){
+            return a.second->mLastUse < b.second->mLastUse; });
+      if (iter == mTiles.end() || iter->second->mLastUse == mUseCount)
+         break;
+      bytes -= tileBytes(*iter->second);
+      workers.Withdraw(*iter->second);
+      mTiles.erase(iter);
    }
+
+   // Release sources no longer used by any tile
+   for (auto iter = mSources.begin(); iter != mSources.end();) {
+      if (iter->second.use_count() == 1)
+         iter = mSources.erase(iter);
+      else
+         ++iter;
+   }
+   if (mSources.empty())
+      mpTrack.reset();
 }
 
 bool WaveClipSpectrumCache::GetSpectrogram(const WaveClip &clip,
@@ -471,7 +1183,8 @@ bool WaveClipSpectrumCache::GetSpectrogram(const WaveClip &clip,
    const float *& spectrogram,
    const sampleCount *& where,
    size_t numPixels,
-   double t0, double pixelsPerSecond)
+   double t0, double pixelsPerSecond,
+   const std::function<void()> &onReady)
 {
    t0 += clip.GetTrimLeft();
 
@@ -479,113 +1192,104 @@ bool WaveClipSpectrumCache::GetSpectrogram(const WaveClip &clip,
       static_cast<const WaveTrack*>(waveTrackCache.GetTrack().get());
    const SpectrogramSettings &settings = track->GetSpectrogramSettings();
    const auto rate = clip.GetRate();
+   const auto nBins = settings.NBins();
 
-   //Trim offset comparison failure forces spectrogram cache rebuild
-   //and skip copying "unchanged" data after clip border was trimmed.
-   bool match =
-      mSpecCache &&
-      mSpecCache->leftTrim == clip.GetTrimLeft() &&
-      mSpecCache->rightTrim == clip.GetTrimRight() &&
-      mSpecCache->len > 0 &&
-      mSpecCache->Matches
-      (mDirty, pixelsPerSecond, settings, rate);
-
-   if (match &&
-       mSpecCache->start == t0 &&
-       mSpecCache->len >= numPixels) {
-      spectrogram = &mSpecCache->freq[0];
-      where = &mSpecCache->where[0];
-
-      return false;  //hit cache completely
-   }
-
-   // Caching is not implemented for reassignment, unless for
-   // a complete hit, because of the complications of time reassignment
-   if (settings.algorithm == SpectrogramSettings::algReassignment)
-      match = false;
-
-   // Free the cache when it won't cause a major stutter.
-   // If the window size changed, we know there is nothing to be copied
-   // If we zoomed out, or resized, we can give up memory. But not too much -
-   // up to 2x extra is needed at the end of the clip to prevent stutter.
-   if (mSpecCache->freq.capacity() > 2.1 * mSpecCache->freq.size() ||
-       mSpecCache->windowSize*mSpecCache->zeroPaddingFactor <
-       settings.WindowSize()*settings.ZeroPaddingFactor())
-   {
-      match = false;
-      mSpecCache = std::make_unique<SpecCache>();
+   if (!mTiles)
+      mTiles = std::make_unique<SpecTileSet>();
+   auto &tiles = *mTiles;
+   if (tiles.mDirty != mDirty ||
+       tiles.mLeftTrim != clip.GetTrimLeft() ||
+       tiles.mRightTrim != clip.GetTrimRight()) {
+      // Recompute only the tiles that read changed samples
+      tiles.Revalidate(clip);
+      tiles.mDirty = mDirty;
+      tiles.mLeftTrim = clip.GetTrimLeft();
+      tiles.mRightTrim = clip.GetTrimRight();
+      tiles.mLastLen = 0;
    }
+   ++tiles.mUseCount;
 
-   const double tstep = 1.0 / pixelsPerSecond;
-   const double samplesPerPixel = rate * tstep;
-
-   int oldX0 = 0;
-   double correction = 0.0;
-
-   int copyBegin = 0, copyEnd = 0;
-   if (match) {
-      findCorrection(mSpecCache->where, mSpecCache->len, numPixels,
-         t0, rate, samplesPerPixel,
-         oldX0, correction);
-      // Remember our first pixel maps to oldX0 in the old cache,
-      // possibly out of bounds.
-      // For what range of pixels can data be copied?
-      copyBegin = std::min((int)numPixels, std::max(0, -oldX0));
-      copyEnd = std::min((int)numPixels, std::max(0,
-         (int)mSpecCache->len - oldX0
-      ));
-   }
+   // Columns are numbered from the start of the sequence, so that tiles
+   // remain good while the view scrolls
+   const auto x0 = std::llround(t0 * pixelsPerSecond);
+   const auto key = MakeTileKey(settings, rate, pixelsPerSecond);
 
-   // Resize the cache, keep the contents unchanged.
    mSpecCache->Grow(numPixels, settings, pixelsPerSecond, t0);
    mSpecCache->leftTrim = clip.GetTrimLeft();
    mSpecCache->rightTrim = clip.GetTrimRight();
-   auto nBins = settings.NBins();
+   mSpecCache->dirty = mDirty;
 
-   // Optimization: if the old cache is good and overlaps
-   // with the current one, re-use as much of the cache as
-   // possible
-   if (copyEnd > copyBegin)
-   {
-      // memmove is required since dst/src overlap
-      memmove(&mSpecCache->freq[nBins * copyBegin],
-               &mSpecCache->freq[nBins * (copyBegin + oldX0)],
-               nBins * (copyEnd - copyBegin) * sizeof(float));
+   // Copy the ready columns of the visible tiles, or else those of the
+   // tiles they replace, and blank the others
+   std::vector<std::shared_ptr<SpecTile>> newTiles;
+   size_t totalReady = 0;
+   for (size_t xx = 0; xx < numPixels;) {
+      const auto column = x0 + static_cast<long long>(xx);
+      const auto index = TileIndex(column);
+      const size_t begin =
+         column - index * static_cast<long long>(TileWidth);
+      const auto count = std::min(TileWidth - begin, numPixels - xx);
+      const auto dest = &mSpecCache->freq[nBins * xx];
+      size_t ready = 0;
+      if (const auto pTile = tiles.GetTile(clip, *track, settings,
+         pixelsPerSecond, index, onReady, newTiles)) {
+         const auto tileReady = pTile->mReady.load(std::memory_order_acquire);
+         ready = std::min(count, std::max(tileReady, begin) - begin);
+         std::copy_n(&pTile->mColumns.freq[nBins * begin], nBins * ready, dest);
+         totalReady += ready;
+         if (tileReady == TileWidth)
+            pTile->mpStale.reset();
+         else if (const auto &pStale = pTile->mpStale) {
+            const auto staleReady =
+               pStale->mReady.load(std::memory_order_acquire);
+            const auto shown =
+               std::min(count, std::max(staleReady, begin) - begin);
+            if (shown > ready) {
+               std::copy_n(&pStale->mColumns.freq[nBins * (begin + ready)],
+                  nBins * (shown - ready), dest + nBins * ready);
+               ready = shown;
+            }
+         }
+      }
+      std::fill(dest + nBins * ready, dest + nBins * count,
+         std::numeric_limits<float>::lowest());
+      xx += count;
    }
 
-   // Reassignment accumulates, so it needs a zeroed buffer
-   if (settings.algorithm == SpectrogramSettings::algReassignment)
-   {
-      // The cache could theoretically copy from the middle, resulting
-      // in two regions to update. This won't happen in zoom, since
-      // old cache doesn't match. It won't happen in resize, since the
-      // spectrum view is pinned to left side of window.
-      wxASSERT(
-         (copyBegin >= 0 && copyEnd == (int)numPixels) || // copied the end
-         (copyBegin == 0 && copyEnd <= (int)numPixels)    // copied the beginning
-      );
+   // Anticipate scrolling by one tile in either direction
+   if (numPixels > 0) {
+      tiles.GetTile(clip, *track, settings, pixelsPerSecond,
+         TileIndex(x0) - 1, onReady, newTiles);
+      tiles.GetTile(clip, *track, settings, pixelsPerSecond,
+         TileIndex(x0 + static_cast<long long>(numPixels) - 1) + 1, onReady, newTiles);
+   }
 
-      int zeroBegin = copyBegin > 0 ? 0 : copyEnd-copyBegin;
-      int zeroEnd = copyBegin > 0 ? copyBegin : numPixels;
+   // Schedule so that the leftmost visible tile is computed first
+   auto &workers = SpecTileWorkers::Get();
+   for (auto iter = newTiles.rbegin(); iter != newTiles.rend(); ++iter)
+      workers.Schedule(*iter);
 
-      memset(&mSpecCache->freq[nBins*zeroBegin], 0, nBins*(zeroEnd-zeroBegin)*sizeof(float));
-   }
+   tiles.Evict();
 
    // purposely offset the display 1/2 sample to the left (as compared
    // to waveform display) to properly center response of the FFT
-   fillWhere(mSpecCache->where, numPixels, 0.5, correction,
-      t0, rate, samplesPerPixel);
-
-   mSpecCache->Populate
-      (settings, waveTrackCache, copyBegin, copyEnd, numPixels,
-       clip.GetSequenceSamplesCount(),
-       clip.GetSequenceStartTime(), rate, pixelsPerSecond);
-
-   mSpecCache->dirty = mDirty;
-   spectrogram = &mSpecCache->freq[0];
-   where = &mSpecCache->where[0];
-
-   return true;
+   fillWhere(mSpecCache->where, numPixels, 0.5, 0,
+      x0 / pixelsPerSecond, rate, rate / pixelsPerSecond);
+
+   spectrogram = mSpecCache->freq.data();
+   where = mSpecCache->where.data();
+
+   const bool updated = !(
+      tiles.mLastLen == numPixels &&
+      tiles.mLastX0 == x0 &&
+      tiles.mLastKey == key &&
+      tiles.mLastReady == totalReady
+   );
+   tiles.mLastKey = key;
+   tiles.mLastX0 = x0;
+   tiles.mLastLen = numPixels;
+   tiles.mLastReady = totalReady;
+   return updated;
 }
 
 WaveClipSpectrumCache::WaveClipSpectrumCache()
@@ -617,4 +1321,5 @@ void WaveClipSpectrumCache::Invalidate()
 {
    // Invalidate the spectrum display cache
    mSpecCache = std::make_unique<SpecCache>();
+   mTiles.reset();
 }
@@ -14,7 +14,9 @@
 class sampleCount;
 class SpectrogramSettings;
 class SampleTrackCache;
+class SpecTileSet;
 
+#include <functional>
 #include <vector>
 #include "MemoryX.h"
 #include "WaveClip.h" // to inherit WaveClipListener
@@ -57,7 +59,8 @@ public:
    void Grow(size_t len_, const SpectrogramSettings& settings,
                double pixelsPerSecond, double start_);
 
-   // Calculate the dirty columns at the begin and end of the cache
+   // Calculate the dirty columns at the begin and end of the cache, in the
+   // threads of the ThreadPool, except for reassignment
    void Populate
       (const SpectrogramSettings &settings, SampleTrackCache &waveTrackCache,
        int copyBegin, int copyEnd, size_t numPixels,
@@ -110,7 +113,10 @@ struct WaveClipSpectrumCache final : WaveClipListener
 
    // Cache of values to colour pixels of Spectrogram - used by TrackArtist
    std::unique_ptr<SpecPxCache> mSpecPxCache;
+   // Columns assembled from mTiles for the last call to GetSpectrogram
    std::unique_ptr<SpecCache> mSpecCache;
+   // Columns computed in the background, for more than the visible range
+   std::unique_ptr<SpecTileSet> mTiles;
    int mDirty { 0 };
 
    static WaveClipSpectrumCache &Get( const WaveClip &clip );
@@ -119,11 +125,20 @@ struct WaveClipSpectrumCache final : WaveClipListener
    void Invalidate() override; // NOFAIL-GUARANTEE
 
    /** Getting high-level data for screen display */
+   /*!
+    Columns are computed by worker threads, in tiles of fixed width.  After
+    an edit, only tiles that read changed samples are recomputed, and their
+    old columns are given until the new ones are ready.  Columns not yet
+    computed are filled with std::numeric_limits<float>::lowest(), and
+    onReady is called later, in the main thread, as more become ready.
+    @return whether the contents of spectrogram changed since the last call
+    */
    bool GetSpectrogram(const WaveClip &clip, SampleTrackCache &cache,
                        const float *& spectrogram,
                        const sampleCount *& where,
                        size_t numPixels,
-                       double t0, double pixelsPerSecond);
+                       double t0, double pixelsPerSecond,
+                       const std::function<void()> &onReady = {});
 };
 
 #endif
@@ -34,6 +34,7 @@ Paul Licameli split from WaveTrackView.cpp
 #include "../../../../WaveTrack.h"
 #include "../../../../prefs/SpectrogramSettings.h"
 #include "../../../../ProjectSettings.h"
+#include "../../../../ProjectWindows.h"
 #include "SampleTrackCache.h"
 
 #include <wx/dcmemory.h>
@@ -318,7 +319,8 @@ void DrawClipSpectrum(TrackPanelDrawingContext &context,
                                    const WaveClip *clip,
                                    const wxRect &rect,
                                    const std::shared_ptr<SpectralData> &mpSpectralData,
-                                   bool selected)
+                                   bool selected,
+                                   const std::function<void()> &onReady)
 {
    auto &dc = context.dc;
    const auto artist = TrackArtist::Get( context );
@@ -418,7 +420,7 @@ void DrawClipSpectrum(TrackPanelDrawingContext &context,
       updated = WaveClipSpectrumCache::Get( *clip ).GetSpectrogram( *clip,
          waveTrackCache, freq, where,
          (size_t)hiddenMid.width,
-         t0, pps);
+         t0, pps, onReady);
    }
    auto nBins = settings.NBins();
 
@@ -860,10 +862,18 @@ void SpectrumView::DoDraw(TrackPanelDrawingContext& context,
    TrackArt::DrawBackgroundWithSelection(
       context, rect, track, blankSelectedBrush, blankBrush );
 
+   // Repaint as background computation of the spectrogram progresses
+   std::function<void()> onReady;
+   if (const auto pProject = artist->parent->GetProject())
+      onReady = [wProject = pProject->weak_from_this()]{
+         if (auto pPanel = FindProjectPanel(wProject.lock().get()))
+            pPanel->Refresh(false);
+      };
+
    SampleTrackCache cache(track->SharedPointer<const WaveTrack>());
    for (const auto &clip: track->GetClips()){
       DrawClipSpectrum( context, cache, clip.get(), rect,
-                        mpSpectralData, clip.get() == selectedClip);
+                        mpSpectralData, clip.get() == selectedClip, onReady);
    }
 
    DrawBoldBoundaries( context, track, rect );
@@ -10,7 +10,10 @@
 
 #include "WaveformCache.h"
 
+#include <algorithm>
 #include <cmath>
+#include <float.h>
+#include "SampleBlock.h"
 #include "Sequence.h"
 #include "GetWaveDisplay.h"
 #include "WaveClipUtilities.h"
@@ -60,6 +63,173 @@ public:
    std::vector<int> bl;
 };
 
+//! Min, max and sums of squares of whole blocks, and of groups of FanOut
+//! consecutive nodes of the level below, up to a single root
+/*!
+ Nodes of the lowest level come from the summaries that blocks keep in
+ memory, so building the pyramid reads no sample data.  Leaves are
+ remembered by block id and start, so that after edits, only the nodes
+ above changed blocks are recomputed.
+
+ Then a column of pixels covering many blocks combines at most
+ 2 * (FanOut - 1) nodes per level, so that the view is drawn in time
+ proportional to its width, not to the length of the clip.
+ */
+class WaveformPyramid {
+public:
+   //! Use the pyramid when columns cover at least this many blocks on
+   //! average, so that attributing each block to only one column is not
+   //! visible
+   static constexpr double MinBlocksPerPixel = 4.0;
+
+   explicit WaveformPyramid(int dirty_) : dirty{ dirty_ } {}
+
+   int dirty;
+
+   //! Recompute nodes for blocks that changed since the last update
+   void Update(const Sequence &sequence);
+
+   //! Fill columns as GetWaveDisplay() does
+   /*! Each block is attributed to the column containing its start
+    @pre `Update()` was called for the sequence in its present state
+    @return false if none of the samples asked for are in range */
+   bool GetWaveDisplay(float *min, float *max, float *rms, int *bl,
+      size_t len, const sampleCount *where) const;
+
+private:
+   static constexpr size_t FanOut = 4;
+
+   struct Node {
+      float min{ FLT_MAX };
+      float max{ -FLT_MAX };
+      double sumsq{ 0 };
+      double count{ 0 };
+
+      void Combine(const Node &other)
+      {
+         min = std::min(min, other.min);
+         max = std::max(max, other.max);
+         sumsq += other.sumsq;
+         count += other.count;
+      }
+   };
+
+   //! Combine leaves in [lo, hi)
+   Node Query(size_t lo, size_t hi) const;
+
+   std::vector<SampleBlockID> mIds;
+   std::vector<sampleCount> mStarts;
+   sampleCount mNumSamples{ 0 };
+   //! mLevels[0] has one node per block; the last level has one node
+   std::vector<std::vector<Node>> mLevels;
+};
+
+void WaveformPyramid::Update(const Sequence &sequence)
+{
+   const auto &blocks = sequence.GetBlockArray();
+   const auto nBlocks = blocks.size();
+   const auto oldBlocks = mIds.size();
+   mIds.resize(nBlocks);
+   mStarts.resize(nBlocks);
+   if (mLevels.empty())
+      mLevels.emplace_back();
+   mLevels[0].resize(nBlocks);
+
+   // Indices of changed nodes of the current level, increasing
+   std::vector<size_t> changed;
+   for (size_t ii = 0; ii < nBlocks; ++ii) {
+      const auto &block = blocks[ii];
+      const auto id = block.sb->GetBlockID();
+      if (ii < oldBlocks && mIds[ii] == id && mStarts[ii] == block.start)
+         continue;
+      mIds[ii] = id;
+      mStarts[ii] = block.start;
+      // no-throw for display operations!
+      const auto summary = block.sb->GetMinMaxRMS(false);
+      const double count = block.sb->GetSampleCount();
+      mLevels[0][ii] =
+         { summary.min, summary.max, summary.RMS * summary.RMS * count, count };
+      changed.push_back(ii);
+   }
+   mNumSamples = sequence.GetNumSamples();
+   // If blocks were removed, the last group of each level is shorter
+   if (nBlocks < oldBlocks && nBlocks > 0 &&
+      (changed.empty() || changed.back() != nBlocks - 1))
+      changed.push_back(nBlocks - 1);
+
+   size_t level = 0;
+   for (; mLevels[level].size() > 1; ++level) {
+      if (mLevels.size() == level + 1)
+         mLevels.emplace_back();
+      const auto &below = mLevels[level];
+      const auto size = (below.size() + FanOut - 1) / FanOut;
+      auto &nodes = mLevels[level + 1];
+      const auto oldSize = nodes.size();
+      nodes.resize(size);
+
+      std::vector<size_t> parents;
+      for (auto index : changed)
+         if (parents.empty() || parents.back() != index / FanOut)
+            parents.push_back(index / FanOut);
+      // A shorter level may make a new last group
+      if (size < oldSize && (parents.empty() || parents.back() != size - 1))
+         parents.push_back(size - 1);
+      for (auto parent : parents) {
+         Node node;
+         const auto end = std::min(below.size(), (parent + 1) * FanOut);
+         for (auto ii = parent * FanOut; ii < end; ++ii)
+            node.Combine(below[ii]);
+         nodes[parent] = node;
+      }
+      changed.swap(parents);
+   }
+   mLevels.resize(level + 1);
+}
+
+auto WaveformPyramid::Query(size_t lo, size_t hi) const -> Node
+{
+   Node result;
+   for (size_t level = 0; lo < hi; ++level) {
+      const auto &nodes = mLevels[level];
+      // Take nodes at the ends until the rest make whole groups
+      while (lo < hi && lo % FanOut != 0)
+         result.Combine(nodes[lo++]);
+      while (lo < hi && hi % FanOut != 0)
+         result.Combine(nodes[--hi]);
+      lo /= FanOut;
+      hi /= FanOut;
+   }
+   return result;
+}
+
+bool WaveformPyramid::GetWaveDisplay(float *min, float *max, float *rms,
+   int *bl, size_t len, const sampleCount *where) const
+{
+   const auto nBlocks = mStarts.size();
+   if (nBlocks == 0 || std::max(sampleCount(0), where[0]) >= mNumSamples)
+      return false;
+   const auto begin = mStarts.begin(), end = mStarts.end();
+   auto lo = static_cast<size_t>(
+      std::lower_bound(begin, end, where[0]) - begin);
+   for (size_t pixel = 0; pixel < len; ++pixel) {
+      const auto hi = static_cast<size_t>(
+         std::lower_bound(begin + lo, end, where[pixel + 1]) - begin);
+      auto first = lo, last = hi;
+      if (first == last) {
+         // No block starts in the column; use the one containing it
+         first = std::min(nBlocks - 1, first > 0 ? first - 1 : 0);
+         last = first + 1;
+      }
+      const auto node = Query(first, last);
+      min[pixel] = node.min;
+      max[pixel] = node.max;
+      rms[pixel] = node.count > 0 ? sqrt(node.sumsq / node.count) : 0;
+      bl[pixel] = first;
+      lo = hi;
+   }
+   return true;
+}
+
 //
 // Getting high-level data from the track for screen display and
 // clipping calculations
@@ -251,8 +421,24 @@ bool WaveClipWaveformCache::GetWaveDisplay(
       }
 
       // Done with append buffer, now fetch the rest of the cache miss
-      // from the sequence
-      if (p1 > p0) {
+      // from the sequence, or from the pyramid if zoomed out far enough
+      const double samplesPerPixel = (p1 > p0)
+         ? (where[p1] - where[p0]).as_double() / (p1 - p0)
+         : 0;
+      if (p1 > p0 && samplesPerPixel >=
+         WaveformPyramid::MinBlocksPerPixel * sequence->GetMaxBlockSize()
+      ) {
+         if (!mPyramid || mPyramid->dirty != mDirty) {
+            if (!mPyramid)
+               mPyramid = std::make_unique<WaveformPyramid>(mDirty);
+            mPyramid->Update(*sequence);
+            mPyramid->dirty = mDirty;
+         }
+         if (!mPyramid->GetWaveDisplay(&min[p0], &max[p0], &rms[p0],
+            &bl[p0], p1 - p0, &where[p0]))
+            return false;
+      }
+      else if (p1 > p0) {
          if (!::GetWaveDisplay(*sequence, &min[p0],
                                         &max[p0],
                                         &rms[p0],
@@ -305,4 +491,5 @@ void WaveClipWaveformCache::Invalidate()
 {
    // Invalidate wave display cache
    mWaveCache = std::make_unique<WaveCache>();
+   mPyramid.reset();
 }
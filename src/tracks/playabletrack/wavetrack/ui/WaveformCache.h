@@ -14,6 +14,7 @@
 #include "WaveClip.h"
 
 class WaveCache;
+class WaveformPyramid;
 
 struct WaveClipWaveformCache final : WaveClipListener
 {
@@ -24,6 +25,10 @@ struct WaveClipWaveformCache final : WaveClipListener
    std::unique_ptr<WaveCache> mWaveCache;
    int mDirty { 0 };
 
+   // Summaries of whole blocks and groups of blocks, for drawing zoomed out
+   // views in time proportional to the width
+   std::unique_ptr<WaveformPyramid> mPyramid;
+
    static WaveClipWaveformCache &Get( const WaveClip &clip );
 
    void MarkChanged() override; // NOFAIL-GUARANTEE